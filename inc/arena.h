@@ -0,0 +1,41 @@
+/*!
+ * @file /arena.h
+ * @brief Arena (bump) allocator
+ * @details
+ * Memory is handed out from large chunks and is only given back all at once, by resetting the arena. Resetting keeps the
+ * chunks for reuse, so something that is rebuilt over and over (e.g., the strings of a parsed program) settles into a fixed
+ * set of chunks instead of a malloc and free per string. A zeroed arena_t is an empty arena.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define ARENA_CHUNK_SIZE 4096
+
+typedef struct arena_chunk_s {
+    struct arena_chunk_s * next;
+    size_t                 size;
+    size_t                 used;
+    char                   data[];
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t * first;
+    arena_chunk_t * current;    /* the chunk being allocated from; the ones after it are free (after a reset) */
+} arena_t;
+
+void * arena_alloc(arena_t * arena, size_t size);                  /* NULL if out of memory */
+char * arena_strndup(arena_t * arena, const char * s, size_t n);  /* copies at most n characters plus a terminator */
+void   arena_reset(arena_t * arena);                              /* everything allocated is released, chunks are kept */
+void   arena_free(arena_t * arena);                               /* chunks are freed too */
+
+/* copy: to is reset and gets everything allocated in from, in one chunk; rebase: where something allocated in from is in to */
+bool   arena_copy(arena_t * to, arena_t * from);
+void * arena_rebase(arena_t * to, arena_t * from, void * ptr);
+
+#endif
@@ -0,0 +1,72 @@
+/*!
+ * @file /buffer.h
+ * @brief Named data buffers for the user processors
+ * @details
+ * A buffer is a list of 32 bit words that the block user instructions move between a state machine's FIFOs and the user
+ * processor, the way a C program on the real hardware would hand an array to the SDK (or DMA) instead of writing one word
+ * at a time:
+ *
+ *     write block <buffer>          ; the whole buffer into the TX FIFO
+ *     read block <buffer> <count>   ; count words from the RX FIFO, replacing what the buffer held
+ *     print block <buffer>
+ *
+ * Each step of such an instruction moves as many words as the FIFO takes (or has), so a long transfer is not one scheduled
+ * user instruction per word. Buffers are declared by the parser when it encounters the .buffer statements:
+ *
+ *     .buffer <name> <words>                      ; that many zero words
+ *     .buffer_file <name> "<file>" [<bytes>]      ; the file, 1 (default), 2 or 4 bytes per word (little endian)
+ *
+ * The declarations are part of the build; the words themselves belong to each simulation context, allocated (and files
+ * read) after each build, and grow as a read block needs them to.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "constants.h"
+
+#define NUM_BUFFERS 16
+#define BUFFER_NONE -1
+#define BUFFER_MAX_WORDS (1 << 24)
+#define BUFFER_FILE_NAME_MAX 256
+
+typedef struct {
+    char            name[SYMBOL_MAX];
+    uint32_t        words;              // initial length, when not read from a file
+    char            file[BUFFER_FILE_NAME_MAX];     // read after each build, if set
+    uint8_t         word_bytes;         // bytes of the file per word
+} buffer_config_t;
+
+typedef struct {
+    buffer_config_t buffers[NUM_BUFFERS];
+    int             num_buffers;
+} buffers_t;
+
+typedef struct {
+    uint32_t *      words;
+    uint32_t        length;
+    uint32_t        allocated;
+} buffer_data_t;
+
+typedef struct {
+    buffer_data_t   data[NUM_BUFFERS];
+} buffers_data_t;
+
+/* configuration (from the parser); false (after printing why) if the declaration is not valid */
+void buffer_reset_all();                // before a parse: no buffers
+bool buffer_declare(char * name, uint32_t words, int line);
+bool buffer_declare_file(char * name, char * file_name, int word_bytes, int line);
+int  buffer_find(char * name);          // BUFFER_NONE if not declared
+
+/* running */
+void buffer_restart();                  // after a build: each buffer zeroed or read from its file
+buffer_data_t * buffer_data(int index);
+bool buffer_reserve(int index, uint32_t length);    // room for at least length words (the length is not changed)
+
+void buffer_data_free(buffers_data_t * data);
+
+#endif
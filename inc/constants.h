@@ -8,5 +8,6 @@
 #define LABEL_TYPE  2
 #define VAR_TYPE    3
 #define DATA_TYPE   4
+#define BUFFER_TYPE 5
 
 #endif
\ No newline at end of file
@@ -0,0 +1,90 @@
+/*!
+ * @file /context.h
+ * @brief Simulation context (all of the state of one simulated system)
+ * @details
+ * Everything that a simulation mutates (hardware registers, the parsed program, scheduling state, change tracking, and the
+ * simulated devices) lives in a simpio_t rather than in file-scope statics, so more than one simulation can exist in a process.
+ *
+ * The modules reach their state through simpio_context, the context selected on the calling thread. It starts out pointing
+ * at a built-in default context, so single-simulation callers (e.g., the UI) never need to know it exists. To run a second,
+ * independent simulation, create a context and select it (on this thread or another thread) before calling into the modules.
+ * 
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include "hardware.h"
+#include "hardware_changed.h"
+#include "instruction.h"
+#include "execution.h"
+#include "device_spi_flash.h"
+#include "device_keypad.h"
+#include "device_uart.h"
+#include "device_i2c_eeprom.h"
+#include "device_ws2812.h"
+#include "device_plugin.h"
+#include "buffer.h"
+#include "decoder.h"
+#include "replay.h"
+#include "state_hash.h"
+#include "period.h"
+#include "symbols.h"
+#include "print.h"
+#include "libsimpio.h"
+
+typedef struct simpio_s {
+    hardware_state_t          hardware;
+    instruction_state_t       instruction;
+    exec_state_t              exec;
+    hardware_changed_state_t  changed;
+    spif_device_t             spi_flash;
+    spif_storage_t            spi_flash_storage;    // flash contents of this context, not copied
+    keypad_device_t           keypad;
+    uart_device_t             uart;
+    uart_streams_t            uart_streams;         // files of this context, not copied
+    i2c_eeprom_device_t       i2c_eeprom;
+    i2c_eeprom_storage_t      i2c_eeprom_storage;   // eeprom contents of this context, not copied
+    ws2812_device_t           ws2812;
+    ws2812_frames_t           ws2812_frames;        // framebuffer and frame file of this context, not copied
+    device_plugins_t          plugins;
+    buffers_t                 buffers;
+    buffers_data_t            buffers_data;         // words of this context, not copied
+    decoder_state_t           decoders;
+    decoder_output_t          decoder_output;       // decoded frames of this context, not copied
+    replay_recorder_t         replay;               // recording of this context's inputs, not copied
+    state_hash_t              state_hash;           // hashing of this context's run, not copied
+    period_state_t            period;               // detection of this context's periods, not copied
+    symbols_t                 symbols;
+    print_state_t             print;                // where (and how much) this context prints, not copied
+    /* when embedded (see libsimpio.h) */
+    char *                    source;               // text of the program last loaded, for reset
+    size_t                    source_length;
+    simpio_event_callback_t   event_callback;
+    void *                    event_data;
+} simpio_t;
+
+extern __thread simpio_t * simpio_context;  // the context selected on this thread
+
+simpio_t * context_create();                // allocated and reset to system defaults; returns NULL if out of memory
+
+void context_destroy(simpio_t * context);   // the default context cannot be destroyed
+
+simpio_t * context_select(simpio_t * context);  // makes context current on this thread, returns the previous one
+
+simpio_t * context_default();
+
+/* copies the state a parse produces (hardware, program, symbols, scheduling, device and decoder state) from one context to another,
+   leaving the rest of to (print sink, change tracking, decoded frames, embedding data) alone; pointers into from are pointed into to instead */
+void context_copy_program(simpio_t * to, simpio_t * from);
+
+/* copies the program state (as above) and change tracking (but not the gpio history), i.e., everything needed to show the
+   state of from */
+void context_copy_state(simpio_t * to, simpio_t * from);
+
+/* the same, into a context context_copy_state already copied from into, without copying what running doesn't change (the
+   symbols and which plugins are loaded); it allocates nothing, so it can be called as often as the state is shown */
+void context_copy_running_state(simpio_t * to, simpio_t * from);
+
+#endif
@@ -0,0 +1,114 @@
+/*!
+ * @file /decoder.h
+ * @brief Protocol decoders (SPI, UART, I2C, parallel) over the GPIO pins
+ * @details
+ * Decoders watch GPIO pins while the simulation runs and turn what they see into frames (a word, an I2C start, address or
+ * stop, ...) stamped with the cycles they started and ended at. They are configured by the parser (see the .decoder
+ * statements in simpio.y) and fed by the execution engine after every state machine step, but only look at anything when a
+ * pin they watch changed, or a UART is due to sample its line, so they cost next to nothing while running.
+ *
+ * Frames are kept in a log (the last DECODER_LOG_SIZE of them) for the UI, passed to a frame hook (used for libsimpio events),
+ * and, if the program asks for it, printed as messages and/or written to a file one line per frame.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAX_DECODERS 4
+#define DECODER_NO_PIN 0xFF             // e.g., an SPI decoder without a chip select
+#define DECODER_LOG_SIZE 1024
+#define DECODER_FILE_NAME_MAX 256
+#define DECODER_TEXT_MAX 80
+
+typedef enum { decoder_spi, decoder_uart, decoder_i2c, decoder_parallel } decoder_type_e;
+
+typedef enum {
+    decoded_word,       // value (spi: value is mosi, value2 miso; i2c: a data byte, with ack)
+    decoded_start,      // i2c start (or repeated start)
+    decoded_stop,       // i2c stop, spi chip select released
+    decoded_address,    // i2c: value is the 7 bit address, value2 is 1 for a read, with ack
+    decoded_error       // uart: no stop bit (value is what was received)
+} decoded_kind_e;
+
+typedef struct {
+    uint8_t         decoder;    // index of the decoder, in the order they were configured
+    decoded_kind_e  kind;
+    uint32_t        start;      // cycles
+    uint32_t        end;
+    uint32_t        value;
+    uint32_t        value2;
+    bool            ack;
+} decoded_frame_t;
+
+typedef void (*decoder_frame_hook_t)(const decoded_frame_t * frame);
+
+/* configuration (from the parser); false (after printing why) if the configuration is not valid */
+void decoder_reset_all();
+bool decoder_add_spi(int clk, int mosi, int miso, int cs, int mode, int bits, int shift_right);
+bool decoder_add_uart(int rx, int cycles_per_bit, int bits);
+bool decoder_add_i2c(int scl, int sda);
+bool decoder_add_parallel(int first_pin, int width, int strobe, int rising);
+void decoder_set_print(bool print);             // also print each frame as a message
+void decoder_set_file(const char * file_name);  // also write each frame to a file (created again on each build)
+
+/* running */
+void decoder_update(uint32_t cycle);            // after every sm step, with the cycle it ran in
+void decoder_restart();                         // forgets the frames decoded so far (after a build)
+void decoder_set_frame_hook(decoder_frame_hook_t hook);
+
+/* decoded frames */
+uint8_t decoder_count();                        // decoders configured
+uint32_t decoder_frames_total();                // decoded since the last build
+uint32_t decoder_frames_kept();
+bool decoder_frame(uint32_t n, decoded_frame_t * frame);    // n-th oldest frame kept
+int decoder_frame_text(const decoded_frame_t * frame, char * text, size_t size);
+
+/***********************************************************************************************************
+ * state data
+ **********************************************************************************************************/
+
+typedef struct {
+    decoder_type_e  type;
+    uint8_t         pins[4];        // spi: clk, mosi, miso, cs; uart: rx; i2c: scl, sda; parallel: strobe, first data pin
+    uint8_t         mode;           // spi: 0-3; parallel: 1 for the rising strobe edge, 0 for falling
+    uint8_t         bits;           // bits per word (parallel: width)
+    bool            shift_right;    // least significant bit first
+    uint32_t        cycles_per_bit; // uart
+    /* decoding */
+    bool            active;         // in a frame (spi: selected, uart: receiving, i2c: after a start)
+    uint8_t         count;          // bits so far
+    uint32_t        value;
+    uint32_t        value2;
+    uint32_t        start;
+    uint32_t        next_sample;    // uart
+    bool            addressed;      // i2c: the address byte has been seen
+} decoder_t;
+
+typedef struct {
+    decoder_t   decoders[MAX_DECODERS];
+    uint8_t     count;
+    bool        print;
+    char        file_name[DECODER_FILE_NAME_MAX];
+    uint32_t    watched;        // gpios (bit n for gpio n) the decoders look at
+    uint32_t    last_values;    // of the watched gpios
+    uint32_t    last_cycle;
+    uint32_t    deadline;       // first cycle a decoder has to look at even if nothing changed
+} decoder_state_t;
+
+typedef struct {
+    decoded_frame_t *    log;       // allocated on the first frame
+    uint32_t             total;
+    FILE *               file;
+    decoder_frame_hook_t hook;
+} decoder_output_t;
+
+void decoder_output_free(decoder_output_t * output);
+
+#endif
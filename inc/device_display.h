@@ -0,0 +1,20 @@
+/*!
+ * @file /device_display.h
+ * @brief UI displays for the simulated devices
+ * @details
+ * Looks up the function that displays the state of a simulated device in the UI temp window, by the name the device registered
+ * with (see hardware_register_device), and calls it with the device's instance. This is part of the UI, not of the simulation core.
+ * 
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef DEVICE_DISPLAY_H
+#define DEVICE_DISPLAY_H
+
+#include "hardware.h"
+
+typedef int (*device_display_handler_t) (int instance);
+
+device_display_handler_t device_display_handler(const hardware_device_t * device);    // NULL if the device has no display
+
+#endif
@@ -0,0 +1,88 @@
+/*!
+ * @file /device_i2c_eeprom.h
+ * @brief Simulated I2C EEPROM device (24C256 style)
+ * @details
+ * This configures and enables a simulated 32KB I2C EEPROM: 16 bit memory addresses, 64 byte pages, byte and page writes that
+ * take effect at the stop condition and then keep it busy for a number of cycles (during which it does not acknowledge its
+ * address, so a program can poll for the end of the write), and current address, random and sequential reads. It can also
+ * stretch the clock after each byte it acknowledges.
+ *
+ * Its scl and sda pins are made open-drain (see hardware.h), so the PIO program drives them low through their pindirs and
+ * releases them to be pulled up, as with the real bus. The enable and timing functions below are intended to be called by
+ * the parser when it encounters the .device i2c_eeprom statements in the PIO program.
+ *
+ * The contents are a memory mapping: of the file named by the program, if any (shared, so what is written ends up in the
+ * file, as an EEPROM keeps its contents), otherwise anonymous and erased (0xFF) after each build.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef DEVICE_I2C_EEPROM_H
+#define DEVICE_I2C_EEPROM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define I2C_EEPROM_SIZE             (32 * 1024)
+#define I2C_EEPROM_PAGE_SIZE        64
+#define I2C_EEPROM_DEFAULT_ADDRESS  0x50
+#define I2C_EEPROM_DEFAULT_WRITE_CYCLES 1000
+#define I2C_EEPROM_NO_PIN           0xFF
+#define I2C_EEPROM_FILE_NAME_MAX    256
+#define I2C_EEPROM_DISPLAY_LINES    4
+#define I2C_EEPROM_DISPLAY_LINE_SIZE 16
+
+typedef enum {
+    i2c_ee_idle,            // waiting for a start condition
+    i2c_ee_receiving,       // shifting in a byte from the controller
+    i2c_ee_acking,          // a byte was received, its ack (or nack) goes out on the next falling scl
+    i2c_ee_holding_ack,     // holding sda low for the ack clock
+    i2c_ee_sending,         // shifting out a byte to the controller
+    i2c_ee_controller_ack   // sda released, the controller acks (more) or nacks (done) the byte sent
+} i2c_ee_phase_e;
+
+typedef struct {
+    i2c_ee_phase_e  phase;
+    bool            ack;            // i2c_ee_acking: whether to ack; i2c_ee_controller_ack: whether the controller did
+    bool            reading;        // the r/w bit of the address byte
+    uint8_t         bits;           // shifted so far of the current byte
+    uint8_t         shift;
+    uint8_t         byte_index;     // of the transaction, 0 being the device address
+    uint16_t        address;        // the memory address pointer
+    uint8_t         page[I2C_EEPROM_PAGE_SIZE];     // written bytes, stored at the stop condition
+    uint64_t        page_written;   // bit n for page[n]
+    bool            last_scl, last_sda;
+    uint32_t        busy_until;     // cycle the write in progress ends at
+    uint32_t        stretch_until;  // cycle the clock is held low until
+} i2c_ee_state_t;
+
+typedef struct {
+    uint8_t         scl, sda;
+    uint8_t         i2c_address;    // 7 bit
+    uint32_t        write_cycles;   // busy after a write
+    uint32_t        stretch_cycles; // scl held low after each ack, 0 for none
+    int             device;         // as registered with the hardware, to be woken when a stretch or write ends
+    char            file[I2C_EEPROM_FILE_NAME_MAX];     // mapped after each build, if set
+    i2c_ee_state_t  state;
+    uint32_t        writes, reads;  // bytes, since the last build
+} i2c_eeprom_device_t;
+
+typedef struct {
+    uint8_t *       data;           // I2C_EEPROM_SIZE bytes, mapped by restart
+    bool            shared;         // mapped from the file
+} i2c_eeprom_storage_t;
+
+/* configuration (from the parser); false (after printing why) if the configuration is not valid */
+void device_i2c_eeprom_reset();                 // before a parse: no eeprom until a .device i2c_eeprom statement enables one
+bool device_enable_i2c_eeprom(uint8_t scl_pin, uint8_t sda_pin, uint8_t i2c_address);
+void device_i2c_eeprom_set_timing(uint32_t write_cycles, uint32_t stretch_cycles);
+void device_i2c_eeprom_set_file(const char * file_name);
+
+/* running */
+void device_i2c_eeprom_restart();               // after a build: maps the contents, the bus idles released
+uint8_t device_i2c_eeprom_peek(uint16_t address);
+bool device_i2c_eeprom_busy();                  // a write is in progress
+
+void device_i2c_eeprom_storage_free(i2c_eeprom_storage_t * storage);
+
+#endif
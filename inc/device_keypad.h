@@ -13,9 +13,18 @@
 
 #include <stdint.h>
 
+typedef struct {
+    uint8_t row_pins[4];
+    uint8_t col_pins[4];
+    int8_t  keypress_row, keypress_col;
+    int     device;         // as registered with the hardware, to be woken when the key pressed changes
+} keypad_device_t;
+
 // from the keypad's perspective, row pins are input and column pins are driven based on keypress,
 // so from the user's perspective, row pins are driven and column pins are checked for keypress connections
 void device_enable_keypad(uint8_t r1_pin, uint8_t r2_pin, uint8_t r3_pin, uint8_t r4_pin, uint8_t c1_pin, uint8_t c2_pin, uint8_t c3_pin, uint8_t c4_pin);
 
 void device_set_keypress(uint8_t key);
+
+void device_set_keypress_char(char ch);  // a character from the keypad legend (1-9, 0, A-D, *, #) or space for no key pressed
 #endif
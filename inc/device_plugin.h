@@ -0,0 +1,54 @@
+/*!
+ * @file /device_plugin.h
+ * @brief Simulated devices loaded from shared libraries
+ * @details
+ * Loads device plugins (see simpio_plugin.h for the ABI) for the parser (.device load), and keeps their instances in a table
+ * that grows as needed. Each instance registers itself with the hardware like the built-in devices do, with its number in
+ * the table as the instance passed to its handler, so the table can be copied between contexts without fixing up pointers.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef DEVICE_PLUGIN_H
+#define DEVICE_PLUGIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "simpio_plugin.h"
+
+#define DEVICE_PLUGIN_FILE_NAME_MAX 256
+
+typedef struct {
+    const simpio_device_plugin_t *  plugin;
+    void *                          library;    // dlopen handle, one reference per instance
+    char                            file_name[DEVICE_PLUGIN_FILE_NAME_MAX];
+    void *                          state;      // plugin->state_size bytes
+    int                             device;     // as registered with the hardware
+    void *                          saved;      // for copying the state of a plugin with save and restore (see device_plugin_copy_running)
+    size_t                          saved_size;
+} device_plugin_instance_t;
+
+typedef struct {
+    device_plugin_instance_t *  instances;
+    int                         count;
+    int                         allocated;
+    int                         current;        // instance being initialized or run, for the host services
+} device_plugins_t;
+
+/* configuration (from the parser); false (after printing why) if the library can't be loaded or the plugin rejects the config */
+bool device_plugin_load(const char * file_name, const char * config);
+void device_plugin_reset_all();                 // drops the instances of the last parse
+
+/* running */
+void device_plugin_run(int instance);           // the execution handler of every plugin instance
+int device_plugin_display(int instance, char * text, size_t size);     // -1 if the plugin has no display
+
+/* contexts: copy makes to's instances the same as from's (same plugins, copied state); copy_running only copies the state,
+   into instances that copy already made the same, and allocates nothing (a state that no longer fits the buffer set aside
+   for it by copy is left as it was, and false returned) */
+bool device_plugin_copy(device_plugins_t * to, const device_plugins_t * from);
+bool device_plugin_copy_running(device_plugins_t * to, const device_plugins_t * from);
+void device_plugins_free(device_plugins_t * plugins);
+
+#endif
@@ -4,6 +4,12 @@
  * @details
  * This configures and enables the simulated SPI flash device. This will add itself to the list of devices enabled in execution and ui (see execution.c and ui.c).
  * The enable function below is intended to be called by the parser when it encounters a command in the PIO program to configure this device
+ *
+ * The flash is 16MB, like a W25Q128. Its contents are kept in 16MB of reserved address space in which only the sectors that hold
+ * something are materialized; a sector that was never programmed (or was erased) reads as 0xFF without using any memory. An image
+ * file is mapped (copy on write) rather than read in, so loading one costs nothing until its pages are read, and saving writes
+ * only up to the last sector that holds something. The contents belong to the context and survive builds and resets, like a
+ * real flash chip's, unless the program names an image file to start from (.device spi_flash_image).
  * 
  *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
  */
@@ -12,22 +18,99 @@
 #define DEVICE_SPI_FLASH_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
 
 #define SPI_FLASH_PAGE_SIZE 256
-#define SPI_FLASH_NUM_PAGES   3   
+#define SPI_FLASH_NUM_PAGES   65536     // 16MB
 
 #define SPI_FLASH_DISPLAY_LINES 3 
 #define SPI_FLASH_DISPLAY_LINE_SIZE 10 
 // will display the first lines * line_size bytes/line of simulated flash storage contents 
 
-#define SPI_FLASH_SIZE SPI_FLASH_PAGE_SIZE * SPI_FLASH_NUM_PAGES
+#define SPI_FLASH_SIZE (SPI_FLASH_PAGE_SIZE * SPI_FLASH_NUM_PAGES)
 
 #define SPI_SECTOR_SIZE 4096
+#define SPI_FLASH_NUM_SECTORS (SPI_FLASH_SIZE / SPI_SECTOR_SIZE)
+#define SPI_FLASH_FILE_NAME_MAX 256
+#define SPI_FLASH_DEFAULT_IMAGE "spi_flash.bin"   // saved to from the UI if the program does not name an image
 
-// the following define how many times the spi_flash execution handler is called before it reports not busy
+#define SPI_BLOCK_SIZE 65536
+
+// the following define how many cycles the spi_flash reports busy for,
+// by default (see .device spi_flash_busy); real parts take far longer, e.g., 0.4ms (50000 cycles at 125MHz) to program a page
 #define FLASH_CMD_PROGRAM_DELAY                10
 #define FLASH_CMD_ERASE_DELAY                  10
+#define FLASH_CMD_BLOCK_ERASE_DELAY            40
+#define FLASH_CMD_CHIP_ERASE_DELAY             100
+
+#define SPI_FLASH_NO_PIN 0xFF       // io2 and io3 are only needed for quad reads
+
+typedef enum { spif_idle, spif_getting_cmd, spif_getting_addr1, spif_getting_addr2, spif_getting_addr3, spif_getting_dummy, spif_programming, spif_reading, spif_writing_response, spif_processing_cmd, spif_done } spif_state_e;
+
+typedef enum { spif_mode_0, spif_mode_3 } spif_mode_e;
+
+typedef enum {spif_shift_waiting_on_clk_low_then_high, spif_shift_waiting_on_clk_high, spif_shift_waiting_on_clk_high_then_low, spif_shift_waiting_on_clk_low } spif_shift_state_e;
+
+typedef struct {
+    spif_state_e        state;
+    spif_mode_e         mode;
+    spif_shift_state_e  shift_state;
+    uint8_t             cmd;
+    uint8_t             prev_cmd;
+    uint8_t             addr1;
+    uint8_t             addr2;
+    uint8_t             addr3;
+    uint8_t             status_register_1;
+    uint8_t             dummy_byte;             // the 8 dummy clocks of fast reads are shifted in like a byte
+    uint8_t             width;                  // data pins used to read: 1, 2 (dual output) or 4 (quad output)
+    uint32_t            addr;
+    uint8_t             response_byte;
+    uint8_t             program_byte;
+    uint8_t             shift_count;
+    uint32_t            num_bytes;
+    uint32_t            bytes_responded;
+    uint32_t            bytes_received;
+    uint32_t            byte_index;
+    uint32_t            busy_until;             // cycle it reports not busy again at
+    uint8_t *           data_ptr;
+    bool                last_clk;
+    bool                busy;                   // bit 0 of status register 1
+    bool                write_enable_latch;     // bit 1 of status register 1
+} spif_state_t;
+
+typedef struct {
+    uint32_t program;
+    uint32_t sector_erase;
+    uint32_t block_erase;
+    uint32_t chip_erase;
+} spif_busy_cycles_t;
+
+typedef struct {
+    uint clk, tx, rx, cs;
+    uint io2, io3;                              // tx and rx are io0 and io1
+    int device;                                 // as registered with the hardware, to be woken when no longer busy
+    spif_busy_cycles_t busy_cycles;
+    spif_state_t state;
+    char image_file[SPI_FLASH_FILE_NAME_MAX];   // loaded after each build, if set
+    uint8_t head[SPI_FLASH_DISPLAY_LINES * SPI_FLASH_DISPLAY_LINE_SIZE];    // copy of the first bytes of storage, for display
+} spif_device_t;
+
+typedef struct {
+    uint8_t * data;                             // SPI_FLASH_SIZE bytes of address space, reserved on first use
+    uint8_t   sectors[SPI_FLASH_NUM_SECTORS / 8];   // bit set for each materialized sector, the others read as 0xFF
+} spif_storage_t;
+
+void device_enable_spi_flash(uint8_t clk_pin, uint8_t tx_pin, uint8_t rx_pin, uint8_t cs_pin, uint8_t io2_pin, uint8_t io3_pin);
+void device_spi_flash_set_busy_cycles(uint32_t program, uint32_t sector_erase, uint32_t block_erase, uint32_t chip_erase);
+void device_spi_flash_set_image(const char * file_name);
 
-void device_enable_spi_flash(uint8_t clk_pin, uint8_t tx_pin, uint8_t rx_pin, uint8_t cs_pin);
+void device_spi_flash_restart();                            // after a build: loads the image file, if the program names one
+bool device_spi_flash_load(const char * file_name);         // replaces the contents with the image, the rest erased; false if
+                                                            // it can't be read (the contents are then left as they were)
+bool device_spi_flash_save(const char * file_name);         // false if it can't be written
+uint8_t device_spi_flash_peek(uint32_t addr);
+void device_spi_flash_storage_free(spif_storage_t * storage);
 
 #endif
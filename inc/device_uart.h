@@ -0,0 +1,91 @@
+/*!
+ * @file /device_uart.h
+ * @brief Simulated UART (serial port) device
+ * @details
+ * This configures and enables a simulated UART, the other end of a PIO UART: it receives on its rx pin (the PIO program's
+ * tx) and sends on its tx pin (the PIO program's rx). The enable and format functions below are intended to be called by the
+ * parser when it encounters the .device uart statements in the PIO program.
+ *
+ * The bit time in cycles comes from the baud rate, the system clock and the clkdiv of the state machine configured last
+ * before the .device uart statement, wherever in the program its clkdiv is set (cycles_per_bit = sys_clk / (clkdiv * baud)).
+ * Received bytes are written to a file (or printed) and bytes to send are read from a file (or stdin, only without the UI,
+ * which has the terminal), so large amounts of data can be pushed through a PIO UART and the error free throughput measured
+ * (see the statistics in uart_device_t).
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef DEVICE_UART_H
+#define DEVICE_UART_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UART_NO_PIN 0xFF
+#define UART_DEFAULT_SYS_CLK 125000000
+#define UART_DEFAULT_OVERSAMPLING 16
+#define UART_FILE_NAME_MAX 256
+#define UART_STDIO "-"                  // as the input or output file: stdin, or printed like other messages
+
+typedef enum { uart_parity_none, uart_parity_odd, uart_parity_even } uart_parity_e;
+
+typedef struct {
+    bool      active;       // in a frame
+    uint32_t  start;        // cycle the frame started at
+    uint8_t   bit;          // rx: being sampled, tx: being sent (0 is the start bit)
+    uint8_t   samples;      // rx: taken of the current bit
+    uint8_t   votes;        // rx: samples of the current bit that were high
+    uint16_t  frame;        // rx: the data and parity bits so far; tx: every bit of the frame, start bit first
+    uint32_t  next;         // cycle of the next sample (rx) or bit (tx)
+    bool      last;         // rx: the line when last looked at
+} uart_channel_t;
+
+typedef struct {
+    uint8_t         tx, rx;
+    uint32_t        baud;
+    uint32_t        sys_clk;
+    uint8_t         sm;             // whose clkdiv is used (index into the hardware's sms)
+    uint32_t        clkdiv;         // as of the last build
+    uint8_t         bits;           // data bits, 5-9
+    uart_parity_e   parity;
+    uint8_t         stop_bits;      // 1 or 2
+    uint8_t         oversampling;   // samples per bit; the middle three decide its value
+    uint32_t        cycles_per_bit;
+    char            input_file[UART_FILE_NAME_MAX];     // bytes to send, if set
+    char            output_file[UART_FILE_NAME_MAX];    // bytes received, if set
+    int             device;         // as registered with the hardware, to be woken at the next sample or bit
+    uart_channel_t  receive;
+    uart_channel_t  transmit;
+    /* statistics since the last build */
+    uint32_t        received;
+    uint32_t        error_free;
+    uint32_t        framing_errors;
+    uint32_t        parity_errors;
+    uint32_t        sent;
+    uint32_t        first_received; // cycle the first frame received started at
+    uint32_t        last_received;  // cycle the last frame received ended at
+    uint16_t        last_byte;
+} uart_device_t;
+
+typedef struct {
+    FILE *  in;
+    FILE *  out;
+    bool    in_done;
+} uart_streams_t;
+
+/* configuration (from the parser); false (after printing why) if the configuration is not valid */
+void device_uart_reset();               // before a parse: no uart until a .device uart statement enables one
+bool device_enable_uart(uint8_t tx_pin, uint8_t rx_pin, uint32_t baud);
+bool device_uart_set_format(uint8_t bits, uint8_t parity, uint8_t stop_bits, uint8_t oversampling);
+bool device_uart_set_clock(uint32_t sys_clk);
+void device_uart_set_input(const char * file_name);
+void device_uart_set_output(const char * file_name);
+
+/* running */
+void device_uart_restart();             // after a build: closes the files, clears the statistics, the line idles high
+uint32_t device_uart_throughput();      // error free bytes per second received (at the simulated system clock), 0 if none yet
+
+void device_uart_streams_free(uart_streams_t * streams);
+
+#endif
@@ -0,0 +1,91 @@
+/*!
+ * @file /device_ws2812.h
+ * @brief Simulated WS2812 (NeoPixel) LED strip device
+ * @details
+ * This configures and enables a simulated strip of WS2812 LEDs on one gpio: the one-wire bit timings the PIO program drives
+ * are decoded into a framebuffer of pixels, a low of at least the reset time latching the frame. The enable and timing
+ * functions below are intended to be called by the parser when it encounters the .device ws2812 statements in the PIO program.
+ *
+ * Pulse widths are measured in simulated cycles and converted to time with the system clock and the clkdiv of the state
+ * machine configured last before the .device ws2812 statement (wherever in the program its clkdiv is set), as the datasheet
+ * timings are in ns. A high pulse near T0H is a 0 and one near T1H a 1; a high pulse that is near neither, a low shorter
+ * than allowed or a frame that ends in the middle of a pixel is a timing violation (counted, the bit still decoded as the
+ * nearer of the two). The device keeps the frame rate and can write each frame to a file (raw pixel bytes, in the order
+ * received) or print it ("-", as a line of hex that goes wherever the simulation's messages go).
+ *
+ * Only edges of the data pin and the end of the reset time run the device, so it costs a few operations per bit, whatever
+ * the length of the strip.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef DEVICE_WS2812_H
+#define DEVICE_WS2812_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WS2812_NO_PIN 0xFF
+#define WS2812_DEFAULT_SYS_CLK 125000000
+#define WS2812_MAX_PIXELS (1 << 20)
+#define WS2812_FILE_NAME_MAX 256
+#define WS2812_STDOUT "-"                   // as the frame file: print the frames
+/* WS2812B datasheet timings, in ns */
+#define WS2812_DEFAULT_T0H 400
+#define WS2812_DEFAULT_T1H 800
+#define WS2812_DEFAULT_TOLERANCE 150
+#define WS2812_DEFAULT_RESET 50000
+#define WS2812_MIN_LOW 300                  // shortest low between bits (T1L less the tolerance)
+
+typedef struct {
+    uint8_t         pin;
+    uint32_t        num_pixels;
+    uint8_t         bits_per_pixel;     // 24 (GRB) or 32 (GRBW)
+    uint32_t        sys_clk;
+    uint8_t         sm;                 // whose clkdiv is used (index into the hardware's sms)
+    uint32_t        clkdiv;             // as of the last build
+    uint32_t        t0h_ns, t1h_ns, tolerance_ns, reset_ns;
+    uint32_t        reset_cycles;
+    char            file[WS2812_FILE_NAME_MAX];     // frames are written to, if set
+    int             device;             // as registered with the hardware, to be woken at the end of the reset time
+    /* decoding */
+    bool            last;               // the pin when last looked at
+    uint32_t        rose, fell;         // cycles of the last edges
+    uint32_t        pixel;              // being shifted in
+    uint8_t         bits;               // of it so far
+    uint32_t        index;              // of the pixel being received
+    bool            latched;            // since the last bit
+    /* statistics since the last build */
+    uint32_t        frames;
+    uint32_t        frame_pixels;       // of the last frame
+    uint32_t        overflow_pixels;    // beyond the strip, in the last frame
+    uint32_t        high_violations;    // high pulses near neither T0H nor T1H
+    uint32_t        low_violations;     // lows between bits that were too short
+    uint32_t        partial_pixels;     // frames that ended in the middle of a pixel
+    uint32_t        last_violation;     // cycle
+    uint32_t        first_latch, last_latch, previous_latch;    // cycles
+} ws2812_device_t;
+
+typedef struct {
+    uint32_t *      pixels;             // the framebuffer, num_pixels of them
+    uint32_t        allocated;
+    FILE *          file;
+} ws2812_frames_t;
+
+/* configuration (from the parser); false (after printing why) if the configuration is not valid */
+void device_ws2812_reset();             // before a parse: no strip until a .device ws2812 statement enables one
+bool device_enable_ws2812(uint8_t pin, uint32_t num_pixels, uint8_t bits_per_pixel);
+bool device_ws2812_set_clock(uint32_t sys_clk);
+bool device_ws2812_set_timing(uint32_t t0h_ns, uint32_t t1h_ns, uint32_t tolerance_ns, uint32_t reset_ns);
+void device_ws2812_set_file(const char * file_name);
+
+/* running */
+void device_ws2812_restart();           // after a build: a blank framebuffer, statistics cleared, the frame file closed
+uint32_t device_ws2812_pixel(uint32_t index);
+uint32_t device_ws2812_frame_rate();    // frames per second (at the simulated clock) between the last two frames, 0 if none
+uint32_t device_ws2812_average_frame_rate();
+
+void device_ws2812_frames_free(ws2812_frames_t * frames);
+
+#endif
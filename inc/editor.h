@@ -2,12 +2,15 @@
  * @file /editor.h
  * @brief A very simple text editor, part of the Simpio project.
  * @details
- * super simple text management: suitable only for very small files!
- * a) model: a linear array (buffer) of chars read from a file, with an array of indecies 
- *           into the first char on a line, and a cursor position at a certain line and 
- *            character position on that line
+ * simple text management:
+ * a) model: the text is kept in a gap buffer (an array of chars with a gap at the place of the last edit, so typing only
+ *           moves chars when the edit position moves), along with a line index that is also kept as a gap buffer, split
+ *           at the line being edited: lines before the split hold where they start, lines after it hold how far their
+ *           start is from the end of the text, so adding or deleting a char doesn't change either part. Both grow as
+ *           needed, there is no limit on the size of a file. The cursor is at a certain line and character position.
  * b) view: displayed in a window from first to last line (based on size of the window)
- *          with cursor displayed on x and y position on the screen
+ *          with cursor displayed on x and y position on the screen; only lines that changed since the window was last
+ *          refreshed are redrawn (all of them after scrolling)
  * c) controller: scrolling operations affect view only (but somewhat based on the model)
  *                while operations that add and remove chars affect both the view and
  *                the underlying model
@@ -24,17 +27,20 @@
 /**********************************************************************************
  **********************************************************************************/
 
-#define MAX_NUMBER_OF_LINES 1000
-#define ESTIMATED_LINE_SIZE 80
-#define TEXT_BUFFER_SIZE MAX_NUMBER_OF_LINES * ESTIMATED_LINE_SIZE
+#define ED_INITIAL_TEXT_SIZE  4096
+#define ED_INITIAL_LINES_SIZE  256
 
 typedef struct {
   /* model part */
-  FILE *f;
-  char buffer[TEXT_BUFFER_SIZE];
+  char * text;            /* gap buffer: text[0..gap_start) and text[gap_end..text_size) */
+  int  text_size;
+  int  gap_start;
+  int  gap_end;
   int  num_chars;
-  int  line_starts[MAX_NUMBER_OF_LINES];
-  int  line_ends[MAX_NUMBER_OF_LINES];
+  int  * lines;           /* line index gap buffer, see above: lines[0..lines_gap_start) and lines[lines_gap_end..lines_size) */
+  int  lines_size;
+  int  lines_gap_start;
+  int  lines_gap_end;
   int  num_lines; 
   /* view part */
   WINDOW * window;
@@ -44,6 +50,9 @@ typedef struct {
   int  last_displayed_line;
   int  cursor_x;
   int  cursor_y;
+  int  dirty_first_line;  /* lines to redraw on the next refresh (none when first > last) */
+  int  dirty_last_line;
+  int  painted_first_line;/* first_displayed_line when the window was last refreshed */
   /* view <-> model mapping */
   int  current_line;  /* line in the buffer corresponding to the line on the screen */
 } editor_t;
@@ -52,6 +61,7 @@ int ed_init(editor_t *ed, FILE *tf, WINDOW * win, int linenum_color);
 void ed_display_line(editor_t * tb, int line_num);
 void ed_display(editor_t * tb);
 void ed_display_refresh(editor_t * tb);
+void ed_display_noutrefresh(editor_t * tb);   /* like refresh, but waits for doupdate to paint */
 void ed_home(editor_t * tb);
 void ed_up(editor_t * tb);
 void ed_down(editor_t * tb);
@@ -64,5 +74,6 @@ void ed_insert_char(editor_t *ed, char ch);
 void ed_clear_display(editor_t *ed);
 void ed_clear_display_line(editor_t * tb, int line_num);
 void ed_goto_line(editor_t * tb, int line_num);
+char * ed_text(editor_t * tb);   /* the whole text, NUL terminated; valid until the next edit */
 
 #endif
@@ -37,7 +37,7 @@
 
 #define IMPLEMENT_ENUMERATOR(T, NAME, A, MAX)   T * NAME ## _first(NAME ## _enumerator_t * e) {    \
                                                    (*e) = 1;                                       \
-                                                   return &(A[0]);                                 \
+                                                   return ((MAX) > 0) ? &(A[0]) : NULL;            \
                                                 }                                                  \
                                                 T * NAME ## _next(NAME ## _enumerator_t * e) {     \
                                                     T* temp;                                       \
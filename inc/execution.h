@@ -10,17 +10,51 @@
 #ifndef EXECUTION_H
 #define EXECUTION_H
 
+#include <stdatomic.h>
 #include "hardware.h"
 
 typedef enum {exec_normal, exec_interrupt, exec_idle } exec_context_e;
 
+#define EXEC_RUN_HOOK_STEPS 512             /* steps between calls to the run hook */
+
+typedef void (*exec_run_hook_t) ();      /* called now and then while running all programs (e.g., to publish state to another thread) */
+
+/* scheduling state (which processor runs next and what it runs), held by the simulation context (see context.h) */
+typedef struct {
+    bool                                simulation_exited;
+    exec_context_e                      context;
+    sm_t *                              next_sm;              /* round robin position across sms */
+    hardware_sm_enumerator_t            next_sm_e;
+    user_processor_t *                  next_up;              /* round robin position across user processors */
+    hardware_user_processor_enumerator_t next_up_e;
+    user_instruction_t *                user_instruction;     /* the next user instruction to run */
+    instruction_t *                     instruction;          /* the next sm instruction to run */
+    int                                 last_line;
+    bool                                try_user_first;
+    uint32_t                            cycle;                /* highest clock tick reached by any sm */
+    uint64_t                            steps;                /* calls to step the programs since the build */
+    exec_run_hook_t                     run_hook;
+    atomic_bool                         break_requested;      /* set (from any thread) to stop running all programs */
+} exec_state_t;
+
 void exec_reset();
 
+void exec_set_run_hook(exec_run_hook_t hook);
+
+void exec_break();                    /* stops exec_run_all_programs at the next step; safe to call from another thread */
+
+bool exec_exited();                   /* true once a user program has exited the simulation */
+
+uint32_t exec_cycle();                /* number of clock cycles simulated since the last reset */
+uint64_t exec_steps();                /* number of times the programs were stepped since the last reset (the position of recorded inputs) */
+
+int exec_last_line();                 /* source line of the next instruction to execute */
+
 int8_t exec_first_instruction_that_will_be_executed();
 
 int  exec_step_programs_next_instruction();  
 
-int  exec_run_all_programs();         /* runs each defined program/SM in round robin fashion, one clock cycle each, until breakpoint */
+int  exec_run_all_programs();         /* runs each defined program/SM in round robin fashion, one clock cycle each, until breakpoint or break */
 
 bool exec_pio_read(uint8_t pio, uint8_t, uint8_t * value_read);
 
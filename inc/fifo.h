@@ -30,6 +30,8 @@ typedef struct {
     uint32_t      status;
     bool          EXECCTRL_STATUS_SEL;
     int           N;
+    uint32_t      pushed;         /* words pushed by the SM since init (statistics) */
+    uint32_t      pulled;         /* words pulled by the SM since init (statistics) */
     /* private */
     int           rx_bottom;
     int           rx_top;
@@ -51,6 +53,7 @@ bool fifo_pull(fifo_t * fifo, uint32_t * value_ptr);
 
 void fifo_copy(fifo_t * from, fifo_t * to);
 fifo_compare_t fifo_compare(fifo_t * from, fifo_t * to);
+int fifo_level(fifo_t * fifo, bool rx);     /* words in the rx (or tx) fifo */
 
 /* Notes:
  * 1) In bidi mode, first half is the rx fifo and the second half is the tx fifo
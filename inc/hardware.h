@@ -40,6 +40,7 @@ user_instruction_context_e hardware_get_user_instruction_context();
 typedef struct {
     bool value;
     bool pindir; /* true/1 is output */
+    bool latch;  /* open-drain pins: the value written, the pin (value) only being driven low by it when it is an output */
 } gpio_t;
 
 typedef struct {
@@ -79,6 +80,7 @@ typedef struct {
     bool     shiftctl_in_shiftdir;      /* true shifts starting with LSB, false starts with MSB */
     int8_t   wrap;
     int8_t   wrap_target;
+    uint32_t clkdiv;                    /* system clock cycles per sm clock cycle (1..65536); recorded for reporting, all sms are simulated at the same rate */
     /* SM state data */
     uint32_t clock_tick;                /* each sm has their own clock; parallelelism is handled at a higher level by keeping keeping each SMs clock in sync */
     uint32_t pc_temp;                   /* for PC destination so that the instruction counter isn't updated until shifting is complete */
@@ -86,6 +88,7 @@ typedef struct {
     uint8_t  shift_in_resume_count;     /* when an instruction is in a wait state, the number of input shifts is remembered for when it can resume */
     uint16_t exec_machine_instruction;  /* when the destination is the PC, this holds the instruction that is being built up until it is complete */
     instruction_t exec_instruction;     /* when the destination is EXEC, this holds the decoded instruction that is to be executed */
+    instruction_exec_state_t instr_state; /* of the instruction being executed (at pc, or decoded from EXEC) */
     char     program_name[SYMBOL_MAX];  /* the name or the program currently loaded/running in this sm */
     void  *  pio;                       /* pointer up to the pio that this sm is part of */
     uint8_t  pio_num;
@@ -102,12 +105,33 @@ typedef struct {
     uint8_t this_num;
 } pio_t;
 
+/*
+ * A program (.program) is assembled into the instruction memory of the pio current when its first instruction (or label)
+ * comes, at its .origin if it has one, else at the next free address, and the sm current then runs it. As pio_sm_init does
+ * in the SDK, ".config program <name>" then starts it on the current sm, with that sm's own configuration, loading it into
+ * the current pio first if it is not there yet (at its origin, or the next free address, its jumps relocated).
+ */
+#define NUM_PROGRAMS 16
+#define NO_ORIGIN    -1
+#define NOT_LOADED   -1
+
+typedef struct {
+    char     name[SYMBOL_MAX];
+    int16_t  origin;                    /* .origin, or NO_ORIGIN */
+    int8_t   pio;                       /* assembled into, NOT_LOADED until placed */
+    uint8_t  length;                    /* number of instructions */
+    int16_t  offset[NUM_PIOS];          /* address it is loaded at in each pio, or NOT_LOADED */
+    int8_t   wrap_target;               /* relative to the start of the program, -1 if not set */
+    int8_t   wrap;
+} program_t;
+
 typedef struct {
     user_instruction_t instructions[NUM_USER_INSTRUCTIONS];
     int8_t  next_instruction_location; 
     int8_t  pc; /* user program counter */
     uint8_t this_num;
     char    data[STRING_MAX];
+    int     data_length; /* of the string in data, so writing it doesn't rescan it */
 } user_processor_t;
 
 typedef struct {
@@ -116,12 +140,13 @@ typedef struct {
     int8_t  pc; /* user program counter */
     uint8_t this_num;
     char    data[STRING_MAX];
+    int     data_length;
     bool    enabled;
+    uint8_t irq_flags;  /* the irq flags mapped to this handler (bit n for flag n) */
 } ih_processor_t;
 
+/* the interrupt handler an irq flag is mapped to, if it is (see irq_handler_flags in hardware_state_t) */
 typedef struct {
-    bool    set; 
-    bool    mapped_to_irq;
     uint8_t pio;
     ih_processor_t * ih;
 } hardware_irq_flag_t;
@@ -138,9 +163,9 @@ typedef struct {
  *       how the real pico system works so a TODO is to look at a more accurate way to do PIO configuration.
  *
  * Note: Since each PIO program is generally targeted at a single SM/PIO, there is also a pseudo instruction to set
- *       the SM and PIO for each program. Multiple programs can be define, each with their own SM and PIO. This means
- *       that if a given PIO program is to be run by multiple SM/PIOs then it would been to be duplicated (this is a 
- *       side effect of not having dynamic configuration through a C runtime system). 
+ *       the SM and PIO for each program. Multiple programs can be define, each with their own SM and PIO. A program
+ *       can also be started on other SMs (of either PIO) with ".config program <name>", each with its own configuration,
+ *       as the C runtime would do with pio_add_program and pio_sm_init (see program_t).
  *
  * Note: Some configuration items are configured through the .define pseudo instruction, if they are global rather than
  *       configured per SM. (TODO: this all needs to be revisited to better match real pico configuration at some point.)
@@ -176,12 +201,18 @@ void hardware_set_out_pins(int base, int num_pins, int line);
 void hardware_set_in_pins(int base, int line);
 void hardware_set_side_set_pins(int base, int line);
 void hardware_set_side_set_count(int num_pins, int optional, int pindirs, int line);
-void hardware_set_program_name(char* name);
+bool hardware_add_program(char* name, int line);           /* .program: the program assembled from here on */
+bool hardware_set_origin(int origin, int line);
+void hardware_place_program();                              /* before the current program's first instruction or label */
+void hardware_program_instruction_added();
+bool hardware_start_program(char* name, int line);         /* .config program: on the current sm */
 void hardware_set_shiftctl_out(int dir, bool ap, int threshold, int line);
 void hardware_set_shiftctl_in(int dir, bool ap, int threshold, int line);
+void hardware_set_clkdiv(int divider, int line);
 void hardware_set_status_sel(int sel, uint8_t level);
 void hardware_set_gpio(uint8_t num, bool val);
 void hardware_set_gpio_dir(uint8_t num, bool val);
+void hardware_set_open_drain(int base, int num_pins, int line);
 void hardware_set_irq(uint8_t irq_num, bool value);
 void hardware_fifo_merge(fifo_mode_t mode);
 
@@ -192,13 +223,32 @@ void hardware_reset();
 
 bool hardware_get_gpio(uint8_t num);
 bool hardware_get_gpio_dir(uint8_t num);
+bool hardware_gpio_is_open_drain(uint8_t num);
+
+/*
+ * Open-drain pins (e.g., I2C's scl and sda) are wired-AND nets with a pull-up: a pin reads low if the pio drives it low (its
+ * pindir is output and its latch 0) or a device pulls it low, and high otherwise. Writes to such a pin only set its latch;
+ * the nets are resolved once per step, after the instruction has run and before the devices do.
+ */
+void hardware_resolve_open_drain();
+void hardware_pull_gpio_low(uint8_t num, bool low);     // for devices on open-drain pins (resolves the pin right away)
+void hardware_drive_gpio(uint8_t num, bool val);        // from outside the simulation, like a device (pulls an open-drain pin low or releases it)
 bool hardware_get_irq(uint8_t irq_num);
 
 void hardware_init_current_sm_pc_if_needed(int8_t first_instruction_location);
 void hardware_init_current_up_pc_if_needed(int8_t first_instruction_location);
 
+/*
+ * The irq flags are a mask (bit n for flag n), shared by both pios as Simpio models them. Setting a flag that is clear and
+ * mapped to an interrupt handler makes it pending, so the execution engine only looks for a handler to start when a
+ * flag was actually raised, and it only looks at the pending ones.
+ */
 bool hardware_irq_flag_set(uint8_t irq, bool set_or_clear);
 bool hardware_irq_flag_is_set(uint8_t irq);
+uint8_t hardware_irq_flags();
+uint8_t hardware_irq_handler_flags();                   /* the flags mapped to an interrupt handler */
+ih_processor_t * hardware_irq_next_handler();          /* of the lowest pending flag still set whose handler isn't running, NULL if none */
+void hardware_irq_handler_done(ih_processor_t * ih);   /* the handler ended: its flags still set are pending again */
 
 void hardware_enable_irq_handler(uint8_t pio, uint8_t irq, uint8_t flag, uint8_t line);
 
@@ -208,32 +258,85 @@ void hardware_enable_irq_handler(uint8_t pio, uint8_t irq, uint8_t flag, uint8_t
  *
  * A "device" is a simulated peripheral (attached to GPIO pins)
  *
- * A simulated device has:
- * - an execution handler that is called to simulate an attached peripheral
- * - an display handler that is called to display the state of the simulated peripheral
+ * A simulated device has an execution handler that is called to simulate an attached peripheral.
+ * (The UI finds a display handler for a device by its name, see device_display.h, so the simulation core has no UI dependency.)
  *
  * This hardware module is just a container for which devices are enabled and pointers to their handlers.
- * The execution module will make use of the execution handler and the UI module will use the display handler
+ * The execution module will make use of the execution handler.
  *
  * Simulated peripherals (devices) will call the register function to add itself to the list of devices.
  * The execution and UI modules will use the enumerator functions below to find out what devices are enabled and their handlers.
  *
+ * A device registers the gpios it looks at (its sensitivity, bit n for gpio n), and the execution engine only calls its
+ * handler after a step that changed one of them, or once a cycle it asked to be woken at is reached (e.g., when it is busy
+ * for a while, or something outside the simulation changed, like a key press). A sensitivity of DEVICE_SENSITIVE_ALWAYS
+ * has it called after every step. Each device is called once when the simulation starts.
+ *
+ * Devices loaded from plugins (see device_plugin.h) can have many instances, so the handler is passed the instance number
+ * the device registered with. The table holds MAX_DEVICES, and only the devices up to the last one registered are looked at.
+ *
  ************************************************************************************************************************/
 
-#define MAX_DEVICES 5
+#define MAX_DEVICES 64
+#define DEVICE_SENSITIVE_ALWAYS 0
+#define DEVICE_NO_WAKE UINT32_MAX
 
-typedef void (*device_execution_handler_t) ();
-typedef int (*device_display_handler_t) ();
+typedef void (*device_execution_handler_t) (int instance);
 
 typedef struct {
     device_execution_handler_t   execution_handler;
-    device_display_handler_t     display_handler;
     bool                         enabled;
     char                         name[SYMBOL_MAX];
+    int                          instance;          // passed to the handler
+    uint32_t                     sensitivity;       // gpios that wake the handler when they change
+    uint32_t                     last_values;       // of those gpios, when the handler last ran
+    uint32_t                     wake_at;           // cycle the handler runs at even if nothing changed
 } hardware_device_t;
 
-void hardware_register_device(char * name, bool enabled, device_execution_handler_t exec, device_display_handler_t disp);
+int hardware_register_device(char * name, bool enabled, device_execution_handler_t exec, int instance, uint32_t sensitivity);  // device number, or -1
+void hardware_device_set_sensitivity(int device, uint32_t sensitivity);
+void hardware_device_wake_at(int device, uint32_t cycle);   // runs the handler once this cycle is reached (if earlier than already due)
+void hardware_reset_devices();
+uint32_t hardware_get_gpios(uint32_t mask);                 // values of the gpios in mask (bit n for gpio n)
 
 DEFINE_ENUMERATOR(hardware_device_t, hardware_device_enumerator);
 
+/************************************************************************************************************************
+ *
+ * HARDWARE STATE
+ *
+ * Everything above lives in one of these, held by the simulation context (see context.h) rather than in file statics, 
+ * so that each simulation has its own hardware. The "current context" (pio, sm, up, ih) used while adding programs is 
+ * part of it too.
+ *
+ ************************************************************************************************************************/
+
+typedef struct {
+    pio_t                       pios[NUM_PIOS];
+    sm_t                        sms[NUM_PIOS * NUM_SMS];  /* sm index for the s'th sm in p'th pio is p*NUM_SMS + s */ 
+    gpio_t                      gpios[NUM_GPIOS];
+    user_processor_t            user_processors[NUM_USER_PROCESSORS];
+    ih_processor_t              ih_processors[NUM_IH_PROCESSORS];
+    hardware_irq_flag_t         irq_flags[NUM_IRQ_FLAGS];
+    uint8_t                     irq_flags_set;      /* bit n for irq flag n */
+    uint8_t                     irq_handler_flags;  /* mapped to an interrupt handler */
+    uint8_t                     irq_pending;        /* mapped flags raised since their handler was last started */
+    int                         current_pio;
+    int                         current_sm;
+    int                         current_up;
+    int                         current_ih;
+    char                        current_program_name[SYMBOL_MAX];
+    program_t                   programs[NUM_PROGRAMS];
+    int                         num_programs;
+    int                         current_program;    /* being assembled, -1 if none */
+    user_instruction_context_e  user_instruction_context;
+    hardware_device_t           devices[MAX_DEVICES];
+    int                         last_device;
+    uint32_t                    next_wake;      /* the earliest wake_at of the devices, 0 if one runs every step */
+    uint32_t                    device_gpios;   /* the gpio values after the devices last ran */
+    uint32_t                    gpio_values;    /* bit n is the value of gpio n, kept with the gpios */
+    uint32_t                    open_drain;     /* gpios that are open-drain nets (bit n for gpio n) */
+    uint32_t                    pulled_low;     /* of those, the ones devices pull low */
+} hardware_state_t;
+
 #endif
\ No newline at end of file
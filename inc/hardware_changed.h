@@ -6,7 +6,15 @@
  * Call hardware_snapshot to record a baseline, and then call hardware_get_changed to capture what changed since
  * the last captured baseline, and finally parse through the return value to see what specifically changed.
  *
- * This also tracks a predefined number of history values of GPIO pins to facilitate creating timelines.
+ * This also records the history of the GPIO pins to facilitate creating timelines. Only changes are recorded, along with a
+ * level-of-detail pyramid: each level summarizes blocks of GPIO_HISTORY_FANOUT entries of the level below it with which
+ * pins were high and which were low at some point in the block. That way a summary of any span of cycles (e.g., what one
+ * column of a timeline covers), or the next edge of a pin, is found in time proportional to the log of the history length.
+ *
+ * Like a logic analyzer, the history can also be captured around a trigger (a pin edge, a pattern on some pins, an irq flag
+ * being set, a fifo level or a state machine reaching an instruction): until the trigger fires changes only go into a small
+ * pre-trigger ring, and once it has fired the history is the pre-trigger window plus the post-trigger cycles, after which
+ * recording stops. A history can be written out as a VCD file for other waveform viewers.
  * 
  *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
  */
@@ -47,19 +55,123 @@ void hardware_snapshot();
 
 hardware_changed_t * hardware_get_changed();
 
-// the following is for showing timelines - init, let collection happen, call iteration, then immediately call get right number of times or until NULL returned
+// the following is for showing timelines - init, let collection happen, then look at spans of cycles and edges
 
 typedef struct {
-    bool  values[NUM_GPIOS];
-    uint32_t clock_tick; 
-} gpio_history_t;
+    uint32_t start;     // gpio values (bit n for gpio n) at the start of the span
+    uint32_t high;      // gpios that were high at some point in the span
+    uint32_t low;       // gpios that were low at some point in the span
+} gpio_span_t;
 
 void hardware_changed_gpio_history_update(); 
 
-uint32_t hardware_changed_gpio_history_init(); // returns the max number of values that can be stored in the history
+uint32_t hardware_changed_gpio_history_init(); // starts recording (again); returns the max number of changes kept (older ones are dropped)
+
+bool hardware_changed_gpio_history_range(uint32_t * first_cycle, uint32_t * last_cycle);  // false if nothing has been recorded
+
+bool hardware_changed_gpio_history_span(uint32_t start, uint32_t end, gpio_span_t * span);  // cycles [start, end); false if not recorded
+
+bool hardware_changed_gpio_history_edge(uint32_t cycle, uint32_t gpios, bool forward, uint32_t * edge_cycle);  // the first change of any
+                                                                     // of the gpios (bit n for gpio n) after (or before) cycle; false if none
+
+bool hardware_changed_gpio_history_vcd(const char * file_name, uint32_t gpios);  // writes the history of the gpios (0 for all that
+                                                                                 // changed) as a VCD file; false if it could not
+
+// triggered capture - configured by the parser (see the .trigger statements in simpio.y), the trigger functions return false (after
+// printing why) if the configuration is not valid
+
+typedef enum { trigger_none, trigger_edge, trigger_pattern, trigger_irq, trigger_fifo, trigger_pc } trigger_type_e;
+
+typedef enum { capture_off, capture_armed, capture_triggered, capture_done } capture_state_e;
+
+void hardware_changed_trigger_reset();
+bool hardware_changed_trigger_edge(int pin, int rising);
+bool hardware_changed_trigger_pattern(int mask, int value);                     // (gpios & mask) == value
+bool hardware_changed_trigger_irq(int irq_flag);
+bool hardware_changed_trigger_fifo(int pio, int sm, int rx, int level);         // the fifo holds at least level words
+bool hardware_changed_trigger_pc(int pio, int sm, int address);                 // the sm is executing the instruction at address
+bool hardware_changed_trigger_window(int pre, int post);                        // cycles kept before and recorded after the trigger
+void hardware_changed_trigger_set_file(const char * file_name);                 // write the capture as a VCD file when it is done
+
+bool hardware_changed_trigger_arm();    // after a build: (re)starts the capture if there is a trigger; false if out of memory
+
+capture_state_e hardware_changed_gpio_history_capture(uint32_t * trigger_cycle);  // trigger_cycle is set once triggered
+
+/***********************************************************************************************************
+ * state data
+ **********************************************************************************************************/
+
+#define GPIO_HISTORY_MAX_CHANGES (1 << 22)
+#define GPIO_HISTORY_INITIAL_SIZE 4096
+#define GPIO_HISTORY_FANOUT 16
+#define GPIO_HISTORY_LEVELS 6     // GPIO_HISTORY_FANOUT ^ GPIO_HISTORY_LEVELS >= GPIO_HISTORY_MAX_CHANGES
+#define GPIO_TRIGGER_RING 4096    // changes kept before the trigger (the pre-trigger window is cut short if there were more)
+#define GPIO_TRIGGER_DEFAULT_PRE 1000
+#define GPIO_TRIGGER_DEFAULT_POST 10000
+#define GPIO_TRIGGER_FILE_NAME_MAX 256
 
-uint32_t hardware_changed_gpio_history_iteration();  // returns the actual number of values that have been stored in the history
+typedef struct {
+    fifo_t   fifo;
+    uint32_t scratch_x;
+    uint32_t scratch_y;
+    uint32_t osr;      
+    uint32_t isr;      
+    uint8_t  shift_out_count;
+    uint8_t  shift_in_count;
+    uint32_t exec_machine_instruction;
+} sm_snapshot_t;
+
+typedef struct {
+    hardware_irq_t irqs[NUM_IRQS];
+    bool  irqs_changed[NUM_IRQS];
+} pio_snapshot_t;
+
+typedef struct {
+    uint32_t cycle;
+    uint32_t values;    // gpio values (bit n for gpio n) from cycle on
+} gpio_change_t;
+
+typedef struct {
+    uint32_t any_high;  // or of the values in the block
+    uint32_t all_high;  // and of the values in the block
+} gpio_lod_t;
+
+typedef struct {
+    bool            recording;
+    gpio_change_t * changes;
+    uint32_t        count;
+    uint32_t        size;
+    gpio_lod_t *    levels[GPIO_HISTORY_LEVELS];  // levels[k][i] summarizes changes[i * FANOUT^(k+1)] up to the next block
+    uint32_t        last_cycle;                   // last cycle recorded (with or without a change)
+    /* triggered capture */
+    capture_state_e capture;
+    uint32_t        trigger_cycle;
+    uint32_t        stop_cycle;                   // last cycle recorded after the trigger
+    gpio_change_t * ring;                         // changes while armed, the last GPIO_TRIGGER_RING of them
+    uint32_t        ring_count;                   // put in the ring since armed
+} gpio_history_t;
+
+typedef struct {
+    trigger_type_e type;
+    uint32_t       mask;        // edge: the pin (bit n for gpio n); pattern: the pins compared
+    uint32_t       value;       // edge: mask if rising, 0 if falling; pattern: the pin values; irq: the flag; fifo: the level;
+                                // pc: the instruction address
+    uint8_t        sm;          // fifo, pc: pio * NUM_SMS + sm
+    bool           rx;          // fifo: the rx (instead of tx) fifo
+    uint32_t       pre;
+    uint32_t       post;
+    char           file_name[GPIO_TRIGGER_FILE_NAME_MAX];
+} gpio_trigger_t;
+
+typedef struct {
+    pio_snapshot_t pio_snapshots[NUM_PIOS];
+    sm_snapshot_t  sm_snapshots[NUM_PIOS * NUM_SMS];
+    gpio_t         gpio_snapshots[NUM_GPIOS];
+    hardware_changed_t changed;
+    gpio_history_t gpio_history;
+    gpio_trigger_t trigger;
+} hardware_changed_state_t;
 
-gpio_history_t * hardware_changed_gpio_history_get(); // returns next in history starting with oldest first; if called too many times then returns NULL until iteration called again
+void hardware_changed_gpio_history_free(gpio_history_t * history);
 
 #endif
@@ -8,11 +8,10 @@
  * Note: instruction memory is not modeled; instead of 32 uinit32's that are 
  * encoded/decoded, instructions are a structure that is already 'decoded'
  *
- * Also: it is probably helpful to think of an "instruction" defined by this file as an instance of an instruction type that exists in a PIO and is in some
- *       state of execution by a state machine. So, for example "IRQ 0 rel (3)" is a type of instruction to set the first IRQ relative to a state machine and
- *       then causes the state machine to pause for 3 cycles, but this instruction is loaded into a PIO, it becomes an instance with state information, so it
- *       could represent actual IRQ 3 if its context is SM 3. Note that this approach of having state information as part of the "instruction" is very different
- *       that actual hardware where an "instruction" is just some 32 bit value. 
+ * Also: it is probably helpful to think of an "instruction" defined by this file as an instance of an instruction type that exists in a PIO's instruction
+ *       memory. So, for example "IRQ 0 rel (3)" is a type of instruction to set the first IRQ relative to a state machine and then causes the state machine
+ *       to pause for 3 cycles; loaded into a PIO, it could represent actual IRQ 3 when SM 3 runs it. As several state machines can run the same program (see
+ *       program_t in hardware.h), the state of its execution (e.g., the delay left) is kept by each state machine (see instruction_exec_state_t), not here.
  *
  * 
  *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
@@ -35,7 +34,8 @@
 #define NO_LOCATION 255
 
 typedef enum { jmp_instruction, wait_instruction, nop_instruction, in_instruction, out_instruction, push_instruction, pull_instruction, mov_instruction, set_instruction, irq_instruction, empty_instruction }instruction_e;
-typedef enum { read_instruction, write_instruction, user_print_instruction, pin_instruction, data_instruction, repeat_instruction, exit_instruction, empty_user_instruction } user_instruction_e;
+typedef enum { read_instruction, write_instruction, user_print_instruction, pin_instruction, data_instruction, repeat_instruction, exit_instruction,
+               write_block_instruction, read_block_instruction, print_block_instruction, wait_level_instruction, empty_user_instruction } user_instruction_e;
 typedef enum { always, x_zero, y_zero, x_decrement, y_decrement, x_not_equal_y, pin_condition, not_osre, unset_condition } condition_e;
 typedef enum { gpio_source, pin_source, irq_source , reserved_wait_source, unset_wait_source } wait_source_e;
 typedef enum { pins_source, x_source, y_source, null_source, isr_source, osr_source, status_source, reserved_source, unset_source } source_e;
@@ -79,20 +79,26 @@ typedef struct {
     bool              clear;
     bool              wait;
     bool              is_relative;
-    bool              already_set_waiting;/* when setting IRQ and waiting for it to be cleared */
     int8_t            address;            /* the address of this instruction */
     /* housekeeping data */
-    bool              in_delay_state;     /* when the instruction has a delay value, this indicates whther it is waiting for the delay count to be reached */
-    uint8_t           delay_left;         /* when in a delay state, this holds how much time is left to delay */
-    uint8_t           jmp_pc;             /* holds the jump location, in case need to delay before actually jumping */
+    uint8_t           jmp_pc;             /* for an instruction decoded from EXEC (jmp_pc_set), the jump location */
     uint8_t           location;           /* index into label_locations where the location of the jump label can be fount */
+    int16_t           relocation;         /* added to the jump label's location when the program was loaded at another address than assembled at */
     uint8_t           line;               /* line number of this instruction in the source file */
     bool              is_breakpoint;      /* true if a breakpoint has been set on this instruction */
     char              label[LABEL_MAX];   /* needed if can't resolve label on the first pass */
-    bool              not_completed;
     bool              jmp_pc_set;
 } instruction_t;
 
+/* the state of an instruction being executed, held by the sm executing it (several sms can be running the same instruction) */
+typedef struct {
+    bool              in_delay_state;     /* when the instruction has a delay value, this indicates whther it is waiting for the delay count to be reached */
+    uint8_t           delay_left;         /* when in a delay state, this holds how much time is left to delay */
+    uint8_t           jmp_pc;             /* holds the jump location, in case need to delay before actually jumping */
+    bool              not_completed;
+    bool              already_set_waiting;/* when setting IRQ and waiting for it to be cleared */
+} instruction_exec_state_t;
+
 typedef struct {
     user_instruction_e instruction_type;
     data_operation_e   data_operation_type;
@@ -114,6 +120,9 @@ typedef struct {
     bool               is_breakpoint;      /* true if a breakpoint has been set on this instruction */
     int                address;            /* the address of this instruction */
     char               var_name[SYMBOL_MAX];
+    int8_t             var_index;          /* slot of var_name in the user vars, resolved when parsing; -1 if not defined */
+    int8_t             buffer_index;       /* for the block instructions, the buffer (see buffer.h), resolved when parsing */
+    bool               rx_fifo;            /* for wait_level, the fifo waited on */
     bool               continue_user;
 } user_instruction_t;
 
@@ -130,34 +139,17 @@ bool instruction_var_set(char * name, uint32_t val);
 bool instruction_var_get(char * name, uint32_t * value);
 bool instruction_var_define(char * name);
 bool instruction_var_undefine(char * name);
+int  instruction_var_index(char * name);                      /* -1 if not defined */
+bool instruction_var_set_index(int index, uint32_t val);      /* the following two are for execution, with the index resolved when parsing */
+bool instruction_var_get_index(int index, uint32_t * value);
 
 DEFINE_ENUMERATOR(user_variable_t, user_variable)
 
-/************************************************************************************************************************
- *
- * TODO: revisit multiple SM/program execution support
- *
- ************************************************************************************************************************/
-
-/* TODO: check usage and delete */
-typedef struct {
-    char     program_name[SYMBOL_MAX];
-    uint8_t  side_set_bit_count;
-    bool     side_set_value_optional;
-    bool     side_sets_pindirs;
-} program_t;
-
-
-/************************************************************************************************************************
- *
- *
- ************************************************************************************************************************/
-
 void instruction_set_defaults(instruction_t *instr);
 void instruction_set_user_defaults(user_instruction_t* instr);
 
 // reset just the state data (so it can be executed again)
-void instruction_reset(instruction_t *instr);
+void instruction_reset(instruction_exec_state_t *state);
 void instruction_user_reset(user_instruction_t* instr);
 
 void instruction_set_global_default();
@@ -165,6 +157,9 @@ void instruction_set_global_default();
 /* the following adds an instruction for the current program's target sm and pio */    
 bool instruction_add(instruction_t* instr);
 
+/* copies length instructions from address from of pio from_pio to address to of the current pio, relocating their jumps */
+bool instruction_copy(uint8_t from_pio, uint8_t from, uint8_t length, uint8_t to, int line);
+
 bool instruction_user_add(user_instruction_t* instr);
 void instruction_add_data(user_instruction_t* instr, char * data);
 
@@ -187,6 +182,9 @@ char *  instruction_label_symbol(uint8_t line);
 int instruction_fix_forward_labels();
 /* zero means all labels are resolved, positive number is the line of the first instruction whose label could not be resolved */
 
+/* the same for user vars used by user instructions before the var was defined */
+void instruction_fix_forward_vars();
+
 typedef union {
     instruction_t * instruction_ptr;
     user_instruction_t * user_instruction_ptr;
@@ -208,5 +206,25 @@ int instruction_current_delay_remaining();
 
 DEFINE_ENUMERATOR(define_t, instruction_defines)
 
+#define MAX_FORWARD_JMPS (2 * NUM_INSTRUCTIONS)   /* every instruction of both pios */
+
+typedef struct {
+    uint8_t pio;
+    uint8_t address;
+} forward_jmp_t;
+
+/* per simulation program information (defines, labels and user vars), held by the simulation context (see context.h);
+   the names are also in the context's symbol table (see symbols.h) with their index here, so lookups don't scan these */
+typedef struct {
+    define_t          definitions[NUM_DEFINES];
+    label_location_t  label_locations[NUM_INSTRUCTIONS]; /* There can't be more labels than instructions, or at least it isn't reasonable to have more labels than instructions. */
+    user_variable_t   vars[NUM_VARS];
+    int               current_definition;
+    int               current_label;
+    forward_jmp_t     forward_jmps[MAX_FORWARD_JMPS];      /* jmps to labels not yet defined when the jmp was added */
+    int               num_forward_jmps;
+    bool              prev_instruction_was_label;
+} instruction_state_t;
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+/*!
+ * @file /libsimpio.h
+ * @brief Simpio embedding API (libsimpio.a / libsimpio.so)
+ * @details
+ * This is the public interface for driving simulations from another program (e.g., a test harness) without the Simpio UI
+ * and without spawning a process per simulation. The library is just the simulation core (parser, hardware, execution,
+ * devices), which has no ncurses dependency.
+ *
+ * Each simpio_t is an independent simulation. Different simulations can be driven from different threads at the same time,
+ * but any one simulation must only be used by one thread at a time. Loading (parsing) is serialized internally.
+ *
+ * A "cycle" is one simulated clock cycle, i.e., one instruction step of every running state machine.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef LIBSIMPIO_H
+#define LIBSIMPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct simpio_s simpio_t;
+
+/* why running stopped */
+typedef enum {
+    SIMPIO_STOP_CYCLES,         /* ran the number of cycles asked for */
+    SIMPIO_STOP_CONDITION,      /* the until callback returned true */
+    SIMPIO_STOP_BREAKPOINT,     /* the next instruction to execute is on a breakpoint line */
+    SIMPIO_STOP_EXITED,         /* a user program executed exit */
+    SIMPIO_STOP_IDLE,           /* nothing to execute (no program loaded or no instructions) */
+    SIMPIO_STOP_ERROR           /* bad arguments */
+} simpio_stop_e;
+
+/* looking for the system repeating itself while running (see period.h) */
+typedef enum {
+    SIMPIO_PERIOD_OFF,
+    SIMPIO_PERIOD_DETECT,       /* find the period */
+    SIMPIO_PERIOD_SKIP          /* and skip whole periods, when there is no until callback or event callback to call */
+} simpio_period_e;
+
+typedef enum {
+    SIMPIO_REG_PC,
+    SIMPIO_REG_X,
+    SIMPIO_REG_Y,
+    SIMPIO_REG_OSR,
+    SIMPIO_REG_ISR,
+    SIMPIO_REG_SHIFT_IN_COUNT,
+    SIMPIO_REG_SHIFT_OUT_COUNT,
+    SIMPIO_REG_CLOCK_TICK,
+    SIMPIO_REG_CLKDIV,
+    SIMPIO_REG_WORDS_PULLED,    /* words the sm pulled from its TX fifo since load/reset */
+    SIMPIO_REG_WORDS_PUSHED     /* words the sm pushed to its RX fifo since load/reset */
+} simpio_register_e;
+
+typedef enum {
+    SIMPIO_EVENT_PRINT,         /* text: a message the simulator would have shown in the status window */
+    SIMPIO_EVENT_GPIO,          /* gpio, value: a gpio changed value */
+    SIMPIO_EVENT_EXIT,          /* a user program executed exit */
+    SIMPIO_EVENT_DECODE         /* text, decoder, data: a protocol decoder (see .decoder) decoded a frame */
+} simpio_event_e;
+
+typedef struct {
+    simpio_event_e  type;
+    uint32_t        cycle;
+    const char *    text;
+    uint8_t         gpio;
+    bool            value;
+    uint8_t         decoder;    /* in the order the decoders are configured */
+    uint32_t        data;       /* the decoded word, or address */
+} simpio_event_t;
+
+typedef void (*simpio_event_callback_t) (simpio_t * sim, const simpio_event_t * event, void * data);
+typedef bool (*simpio_until_t) (simpio_t * sim, void * data);   /* checked after every instruction, true stops running */
+
+/* create and destroy; NULL if out of memory */
+simpio_t * simpio_create();
+void simpio_destroy(simpio_t * sim);
+
+/* load a program, returns 0 if ok, else the line with the (first) error, or -1 if the program could not be read;
+   a load that fails leaves the simulation as it was */
+int simpio_load_file(simpio_t * sim, const char * file_name);
+int simpio_load_buffer(simpio_t * sim, const char * text, size_t length);
+
+/* back to the state right after the last load (note: this clears breakpoints); same return values as load */
+int simpio_reset(simpio_t * sim);
+
+/* run */
+simpio_stop_e simpio_step(simpio_t * sim, uint32_t cycles);
+simpio_stop_e simpio_run_until(simpio_t * sim, simpio_until_t until, void * data, uint32_t max_cycles);
+bool simpio_toggle_breakpoint(simpio_t * sim, int line);
+uint32_t simpio_cycle(simpio_t * sim);     /* cycles run since load/reset */
+int simpio_line(simpio_t * sim);           /* source line of the next instruction to execute */
+
+/* period detection (off after create); detection starts over with each run, and the period is that of the last one (0 if not found) */
+void simpio_set_period_detection(simpio_t * sim, simpio_period_e mode);
+uint32_t simpio_period(simpio_t * sim);
+uint64_t simpio_period_skipped(simpio_t * sim);   /* cycles of the last run that were skipped */
+
+/* fifos: put writes the TX fifo of a pio/sm and get reads its RX fifo (as a user program would); false if full/empty */
+bool simpio_fifo_put(simpio_t * sim, uint8_t pio, uint8_t sm, uint32_t value);
+bool simpio_fifo_get(simpio_t * sim, uint8_t pio, uint8_t sm, uint32_t * value);
+
+/* gpios: set drives a pin from outside the simulation, as a device would (an open-drain pin is pulled low or released) */
+bool simpio_gpio_get(simpio_t * sim, uint8_t gpio);
+void simpio_gpio_set(simpio_t * sim, uint8_t gpio, bool value);
+
+/* registers of a pio/sm, false if there is no such pio, sm, or register */
+bool simpio_peek(simpio_t * sim, uint8_t pio, uint8_t sm, simpio_register_e reg, uint32_t * value);
+
+/* spi flash contents (see device_spi_flash.h): load maps an image file as the flash (the rest of it erased), save writes the
+   flash out; false if the file could not be read or written. The contents survive reset, unless the program names an image */
+bool simpio_flash_load(simpio_t * sim, const char * file_name);
+bool simpio_flash_save(simpio_t * sim, const char * file_name);
+
+/* recording the inputs given through this API (put, get, gpio set and loads) to a file that the simpio command replays
+   (see replay.h); recording starts with a reset, so the breakpoints are cleared. false if the file could not be written */
+bool simpio_record(simpio_t * sim, const char * file_name);
+void simpio_record_stop(simpio_t * sim);
+
+/* events (one callback per simulation, NULL to remove) */
+void simpio_set_event_callback(simpio_t * sim, simpio_event_callback_t callback, void * data);
+
+#endif
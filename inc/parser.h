@@ -11,7 +11,11 @@
 #ifndef SIMPIO_H
 #define SIMPIO_H
 
-int simpio_parse(char * pio_file_name);
+#include <stdio.h>
+
+int simpio_parse(char * pio_file_name);   /* returns 0 if ok, else the line with the error */
+
+int simpio_parse_stream(FILE * pio_file); /* same as above, but from an already open stream (e.g., fmemopen'ed text) */
 
 void simpio_parse_debug(char * pio_file_name);
 
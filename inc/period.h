@@ -0,0 +1,66 @@
+/*!
+ * @file /period.h
+ * @brief Finding the period of a simulation that has settled into repeating itself, and skipping whole periods of it
+ * @details
+ * Many programs (blinking, clock generation, PWM) settle into a loop where the whole system repeats exactly, so a long run
+ * simulates the same cycles over and over. While running, the detector hashes the state of the system at loop heads (a
+ * state machine wrapping or jumping back, or stalled) and looks for the same hash coming around again (Brent's method, so
+ * it holds a single saved sample however long the period is). The hash only picks out the candidates: the saved sample
+ * keeps a copy of the whole state, and a repeat is only taken when all of it is the same. The state is everything that
+ * decides what happens next: the gpios, irq flags, every state machine's registers, FIFOs and instruction state, and the
+ * scheduler's position.
+ * Once it repeats, what follows is the same as what followed the first time, so whole periods can be skipped by adding
+ * the cycles (and steps, clock ticks and FIFO word counts) they would have taken.
+ *
+ * The detector only looks at systems that don't do anything else that isn't in that state, or that would be missed by
+ * skipping: no user program running, no interrupt handler, no devices or decoders, no gpio history or state hashes being recorded.
+ * Input from outside (e.g., putting a word into a FIFO) is only given between runs, and each run starts detecting anew.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef PERIOD_H
+#define PERIOD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware.h"
+#include "state_hash.h"
+
+typedef enum { period_off, period_detect, period_skip } period_mode_e;
+
+/* the words of state_hash_words, plus the latches, irq flag mapping, the rest of each state machine and the scheduler */
+#define PERIOD_STATE_WORDS_MAX (STATE_HASH_WORDS_MAX + 1 + NUM_PIOS + 3 * NUM_PIOS * NUM_SMS + 6)
+
+typedef struct {
+    uint64_t        hash;
+    uint32_t        cycle;
+    uint64_t        steps;
+    uint32_t        clock_ticks[NUM_PIOS * NUM_SMS];
+    uint32_t        pushed[NUM_PIOS * NUM_SMS];
+    uint32_t        pulled[NUM_PIOS * NUM_SMS];
+} period_sample_t;
+
+typedef struct {
+    period_mode_e   mode;
+    bool            watching;           // this run can be watched (see above)
+    period_sample_t saved;              // the sample later ones are compared with
+    uint32_t        saved_state[PERIOD_STATE_WORDS_MAX];    // and its whole state, for when the hash matches
+    uint32_t        saved_words;
+    uint32_t        samples;            // since the saved one
+    uint32_t        next_save;          // samples until the next one is saved (doubling)
+    int32_t         last_pc[NUM_PIOS * NUM_SMS];
+    uint32_t        period;             // cycles, 0 if not found
+    uint64_t        skipped;            // cycles skipped
+} period_state_t;
+
+void period_set_mode(period_mode_e mode);   // of the current context (off by default)
+
+/* running */
+void period_start();                    // at the start of a run: forget what was seen before
+uint32_t period_cycle(uint32_t max_skip);   // after a step that advanced the cycle; returns the cycles skipped (at most max_skip)
+
+uint32_t period_found();                // cycles the system repeats in, 0 if it was not found since the start
+uint64_t period_skipped();              // cycles skipped since the start
+
+#endif
@@ -12,8 +12,8 @@
 #ifndef INSTRUCTION_PRINT_H
 #define INSTRUCTION_PRINT_H
 
+#include <stdio.h>
 #include "instruction.h"
-#include "ui.h"
 
 void printf_zero_pattern(uint32_t n, bool direction);
 
@@ -28,21 +28,44 @@ void printf_hardware_configuration();
 
 void print_instruction(instruction_t * instr);
 
-extern bool print_ui;
-extern int  print_level;
+/* PRINT output goes to the print sink of the current simulation context (the status window when running the UI, or a
+   callback of an application embedding the simulator), unless it is set to print to stdout; without a sink the output
+   is dropped */
+typedef void (*print_sink_t)(const char * text, void * data);
 
+typedef struct print_lines_s print_lines_t;
+
+/* how a simulation context prints (each one has its own, see context.h) */
+typedef struct {
+    bool            to_stdout;      /* set_print_ui(false) */
+    int             level;
+    print_sink_t    sink;
+    void *          sink_data;
+    print_lines_t * lines;          /* the program's source, for print_line (see set_print_lines) */
+} print_state_t;
+
+extern __thread print_state_t * print_state;    /* of the context selected on this thread */
+
+/* of the current context */
 void set_print_ui(bool ui);
 void set_print_level(int level);
 
+#define PRINT_MSG_MAX 256   /* longest message passed to a sink, including the terminating NUL */
+
+void print_set_sink(print_sink_t sink, void * data);
+void print_msg(const char * fmt, ...);
+
 void set_print_lines(char * filename);
 void print_line(int line);
 
+void print_state_free(print_state_t * print);
+
 #define DEBUG_PRINT_LEVEL 2
 #define INFO_PRINT_LEVEL 1
 #define MIN_PRINT_LEVEL 0
 
-#define PRINT(...) if (print_ui) { status_msg(__VA_ARGS__); } else { printf(__VA_ARGS__); }
-#define PRINTI(...) if (print_level>MIN_PRINT_LEVEL) { PRINT(__VA_ARGS__) }
-#define PRINTD(...) if (print_level>INFO_PRINT_LEVEL) { PRINT(__VA_ARGS__) }
+#define PRINT(...) if (!print_state->to_stdout) { print_msg(__VA_ARGS__); } else { printf(__VA_ARGS__); }
+#define PRINTI(...) if (print_state->level>MIN_PRINT_LEVEL) { PRINT(__VA_ARGS__) }
+#define PRINTD(...) if (print_state->level>INFO_PRINT_LEVEL) { PRINT(__VA_ARGS__) }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+/*!
+ * @file /program_cache.h
+ * @brief Building programs from text, with a cache of parsed program images
+ * @details
+ * Building a program means lexing and parsing its text into a simulation context (configuration, instructions, labels,
+ * defines, ...). The result of each successful build is kept as a program image, keyed by a hash of the text, so building
+ * the same text again (e.g., rebuilding without edits, resetting, or rerunning a test) just copies the image instead of
+ * parsing it again.
+ *
+ * Every build starts from system defaults, whether or not it comes from the cache, so a build is the same as a fresh start
+ * of the simulation. A build that fails leaves the context as it was.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROGRAM_CACHE_SIZE 8    /* number of program images kept (least recently used one is replaced) */
+
+int program_cache_build(const char * text, size_t length);  /* into the current context; returns 0 if ok, else the line with the error, or -1 if out of memory */
+
+void program_cache_clear();
+
+void program_cache_stats(uint32_t * hits, uint32_t * misses);    /* builds since the start that used a cached image, and that parsed */
+
+uint64_t program_cache_hash(const char * text, size_t length);  /* the key a text is cached under (64 bit FNV-1a) */
+
+#endif
@@ -0,0 +1,62 @@
+/*!
+ * @file /replay.h
+ * @brief Recording and replaying the inputs of a simulation
+ * @details
+ * The simulation itself is deterministic; what is not is when a person (or an embedding program) gives it input: a key
+ * pressed on the simulated keypad, the break key, a rebuild, a word put into a FIFO or a gpio driven from outside. The
+ * recorder writes each of those inputs to a text file along with the scheduling step it arrived at (how many times the
+ * programs were stepped since the build) and the cycle, one line each:
+ *
+ *     simpio replay 2
+ *     <step> <cycle> build <length> <hash>         ; the program text that was built, which follows:
+ *     <length bytes of text>
+ *
+ *     <step> <cycle> key <character>               ; keypad (32 is no key pressed)
+ *     <step> <cycle> gpio <gpio> <value>
+ *     <step> <cycle> put <pio> <sm> <value>        ; into the TX FIFO (value in hex)
+ *     <step> <cycle> get <pio> <sm> <value>|-      ; out of the RX FIFO, - if it was empty
+ *     <step> <cycle> break <line>                  ; the run was broken, stopping at line
+ *     <step> <cycle> end <line>                    ; the session ended
+ *
+ * Replaying steps the programs, without any UI, to each recorded step and gives the input there, so the session is
+ * repeated exactly and as fast as the simulation runs. Each build builds the text recorded with it, which has to have the
+ * recorded hash (else the replay stops: the recording was changed). Everything recorded that can be checked is: the cycle
+ * at each input, the words got and the lines a break and the end stopped at. The first difference is reported (a replay
+ * that differs still runs to the end).
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define REPLAY_VERSION 2
+#define REPLAY_LINE_MAX 128
+
+typedef struct {
+    FILE *          file;               // NULL if not recording
+    uint32_t        inputs;
+} replay_recorder_t;
+
+/* recording the inputs of the current context (nothing is written when it is not being recorded) */
+bool replay_record_start(const char * file_name);       // false (after printing why) if the file can't be written
+void replay_record_build(const char * text, size_t length);
+void replay_record_key(char ch);
+void replay_record_gpio(uint8_t gpio, bool value);
+void replay_record_put(uint8_t pio, uint8_t sm, uint32_t value);
+void replay_record_get(uint8_t pio, uint8_t sm, bool got, uint32_t value);
+void replay_record_break(int line);
+void replay_record_stop();                              // records the end and closes the file
+
+void replay_recorder_free(replay_recorder_t * recorder);
+
+/* replays a recording in the current context, printing a summary (and a note if program_file_name, which may be NULL, is
+   not what was built); returns 0 if the replay matched the recording, 1 if it differed, -1 if it could not be replayed */
+int replay_run(const char * program_file_name, const char * replay_file_name);
+
+#endif
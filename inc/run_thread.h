@@ -0,0 +1,37 @@
+/*!
+ * @file /run_thread.h
+ * @brief Running all programs on a worker thread
+ * @details
+ * Runs exec_run_all_programs() for the selected context on its own thread, so the thread that started it (e.g., the UI)
+ * never waits on the simulation and the simulation never waits on the terminal. Nothing is shared through locks:
+ *
+ * - break: run_thread_break() sets the context's break flag (see exec_break), the run stops at the next step
+ * - state: the worker copies the context into one of two snapshot contexts when asked, at most every EXEC_RUN_HOOK_STEPS
+ *          steps; run_thread_snapshot() takes the newest one and asks for the next one into the other, so the worker never
+ *          writes the snapshot being looked at. Both get a full copy before the run starts, so the worker only copies the
+ *          state that running changes, and never allocates
+ * - messages: while running, the context's print sink queues messages in a single producer, single consumer ring that
+ *             run_thread_messages() empties; if the ring is full messages are dropped (and counted) rather than waiting
+ *
+ * While running, only the worker may use the context (except for reading breakpoints, which running does not change).
+ * There is one worker at a time.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef RUN_THREAD_H
+#define RUN_THREAD_H
+
+#include <stdbool.h>
+#include "context.h"
+
+#define RUN_THREAD_MESSAGES 256   /* messages queued before they are dropped */
+
+bool run_thread_start();                  /* runs the selected context; false if the thread could not be started */
+bool run_thread_finished(int * line);     /* once true, the thread is done, line is where it stopped, and the context is the caller's again */
+void run_thread_break();
+
+simpio_t * run_thread_snapshot();         /* newest state, NULL if none yet; valid until the next call */
+void run_thread_messages(print_sink_t sink, void * data);   /* passes queued messages on to sink */
+
+#endif
@@ -0,0 +1,62 @@
+/*!
+ * @file /simpio_plugin.h
+ * @brief Simpio device plugin ABI
+ * @details
+ * This is the interface for simulated devices built as shared libraries and loaded by a program with
+ *   .device load "libfoo.so" "configuration"
+ * Each load makes a new instance of the device, so a plugin can be attached many times (e.g., with different pins in the
+ * configuration), up to the simulator's MAX_DEVICES (64) devices in all, counting the built-in ones; a load past that
+ * fails with an error. See device_plugin.h for the simulator side, and plugins/edge_counter.c for an example.
+ *
+ * The library exports SIMPIO_DEVICE_PLUGIN_ENTRY, a function returning its description (a simpio_device_plugin_t), which
+ * must be for the ABI version the simulator was built with. The simulator allocates state_size bytes (zeroed) for each
+ * instance and passes them to every call. The state is copied between simulations (e.g., from the build to the one that
+ * runs, and from the running simulation to the UI) by copying those bytes, unless the plugin gives save and restore, so
+ * a plugin that keeps pointers or other resources in its state has to give them (and destroy to release them).
+ *
+ * The handler (execute) is only called when one of the gpios the instance is sensitive to changed (see init), once to
+ * begin with, and when a wake up it asked for is due; it must not block. Everything the plugin does to the simulation
+ * goes through the host services it was given at init, which always act on the simulation the instance belongs to.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef SIMPIO_PLUGIN_H
+#define SIMPIO_PLUGIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SIMPIO_DEVICE_ABI_VERSION 1
+#define SIMPIO_DEVICE_PLUGIN_ENTRY "simpio_device_plugin"
+#define SIMPIO_SENSITIVE_ALWAYS 0      /* a sensitivity of 0 has execute called after every step */
+
+/* what the simulator does for a plugin */
+typedef struct {
+    uint32_t  abi_version;
+    bool      (*get_gpio)(uint8_t gpio);
+    void      (*set_gpio)(uint8_t gpio, bool value);
+    uint32_t  (*get_gpios)(uint32_t mask);          /* values of the gpios in mask (bit n for gpio n) */
+    uint32_t  (*cycle)(void);                       /* cycles simulated since the last build */
+    void      (*wake_at)(uint32_t cycle);           /* has execute called once this cycle is reached, even if nothing changed */
+    void      (*print)(const char * format, ...);   /* a message in the status window (or on stdout) */
+} simpio_host_services_t;
+
+/* what a plugin does; the optional functions can be NULL */
+typedef struct {
+    uint32_t      abi_version;                      /* SIMPIO_DEVICE_ABI_VERSION */
+    const char *  name;                             /* instances are named "<name> <n>" */
+    size_t        state_size;
+    /* false (after printing why) if the configuration is not valid; sets the gpios it is sensitive to */
+    bool    (*init)(void * state, const char * config, const simpio_host_services_t * host, uint32_t * sensitivity);
+    void    (*execute)(void * state);
+    int     (*display)(const void * state, char * text, size_t size);  /* optional: text for the UI, like snprintf */
+    size_t  (*save)(const void * state, void * buffer, size_t size);   /* optional: bytes needed (buffer NULL) or written */
+    bool    (*restore)(void * state, const void * buffer, size_t size);    /* optional: into a zeroed state */
+    void    (*destroy)(void * state);                                  /* optional */
+} simpio_device_plugin_t;
+
+typedef const simpio_device_plugin_t * (*simpio_device_plugin_entry_t)(void);
+
+#endif
@@ -0,0 +1,68 @@
+/*!
+ * @file /state_hash.h
+ * @brief Rolling hash of the simulated state, checked against a golden file
+ * @details
+ * A test that only checks that a breakpoint line was reached can't tell when a program (or a change to Simpio) makes it
+ * get there at a different time, or with different values on the way. While enabled, each time the cycle advances the
+ * architectural state (gpio values and directions, irq flags, and for each state machine its pc, scratch, shift and delay
+ * registers and its FIFO contents) is folded into a rolling hash. Every interval cycles the hash is a checkpoint, and when
+ * the run stops there is a last one. Recording writes the checkpoints to a golden file:
+ *
+ *     simpio state hash 1 <interval>
+ *     <cycle> <hash>
+ *     ...
+ *     end <cycle> <hash>
+ *
+ * and checking compares a run with it, reporting the first interval (window of cycles) where they differ: the state (or
+ * its timing) changed somewhere in those cycles. As every checkpoint depends on all of the state before it, the checkpoints
+ * after the first difference are not checked.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef STATE_HASH_H
+#define STATE_HASH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware.h"
+
+#define STATE_HASH_VERSION 1
+#define STATE_HASH_INTERVAL 1024        /* cycles between checkpoints, when recording */
+#define STATE_HASH_LINE_MAX 128
+#define STATE_HASH_WORDS_MAX (3 + NUM_PIOS * NUM_SMS * (7 + TOTAL_FIFO_SIZE_PER_SM))
+
+typedef enum { state_hash_off, state_hash_recording, state_hash_checking } state_hash_mode_e;
+
+typedef struct {
+    uint32_t        cycle;
+    uint64_t        hash;
+} state_hash_checkpoint_t;
+
+typedef struct {
+    state_hash_mode_e           mode;
+    uint32_t                    interval;
+    uint64_t                    hash;
+    FILE *                      file;           // golden file being recorded
+    const char *                file_name;
+    state_hash_checkpoint_t *   golden;         // checkpoints being checked against, the last one is the end
+    uint32_t                    num_golden;
+    uint32_t                    checkpoints;    // taken so far
+    bool                        diverged;
+} state_hash_t;
+
+/* hashing the current context from its current state (e.g., right after a build); false (after printing why) if the golden
+   file can't be written or read */
+bool state_hash_record(const char * file_name);
+bool state_hash_check(const char * file_name);
+
+void state_hash_cycle();            // from the execution engine, each time the cycle advances
+bool state_hash_stop();             // takes the last checkpoint and prints the result of checking; false if the run differed
+
+uint32_t state_hash_words(uint32_t * words);    // the state as the words that are folded in, returns how many (at most STATE_HASH_WORDS_MAX)
+uint64_t state_hash_digest(uint64_t seed);      // the state folded into seed
+
+void state_hash_free(state_hash_t * state_hash);
+
+#endif
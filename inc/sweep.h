@@ -0,0 +1,32 @@
+/*!
+ * @file /sweep.h
+ * @brief Parameter sweep mode
+ * @details
+ * Runs many variants of one PIO program in parallel and tabulates the results. The variants come from a grid file that
+ * lists parameters and the values to try for each; every combination of values is one variant. A parameter is used in
+ * the program by writing ${NAME} wherever its value should go, e.g.:
+ *
+ *     program:    .config shiftctl_out 1 1 ${PULL_THRESH}
+ *     grid file:  PULL_THRESH 8 16 32
+ *                 CLKDIV 1 2 4
+ *
+ * The grid file can also contain these settings:
+ *
+ *     .stop <line>      a variant passes when it gets to this line (default: the last line of the program, like test mode)
+ *                       or when a user program executes exit
+ *     .cycles <n>       a variant fails if it doesn't pass within this many cycles (default 1000000)
+ *     .threads <n>      number of variants to run at once (default: number of processors)
+ *     .periods <mode>   detect: look for each variant settling into repeating itself and list the period it repeats in
+ *                       (see period.h); skip: also skip whole periods, so soaking variants for many cycles is quick
+ *
+ * Blank lines and lines starting with # are ignored.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+int sweep_run(char * pio_file_name, char * grid_file_name);   // returns 0 if every variant passed, else 1
+
+#endif
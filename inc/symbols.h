@@ -1,9 +1,35 @@
 #ifndef SYMBOLS_H
 #define SYMBOLS_H
 
-#define SYMBOL_TABLE_SIZE 100
-
-//TODO: use this for labels, variables, etc.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "arena.h"
+
+#define SYMBOL_TABLE_SIZE 512   /* power of 2; the table starts this big and doubles when it is 3/4 full */
+
+typedef struct {
+    uint32_t hash;          /* of the name, so probing only compares names when the hashes match */
+    int      symbol_type;
+    char *   name;          /* NULL if the slot is empty */
+    char *   value;
+    int      index;         /* for symbols that name a slot in some array (labels, defines, vars) */
+} symbol_t;
+
+/* each simulation context has its own table; the table itself, the names and values, and all other strings of a build
+   (see symbols_text) are in its arena, so starting a new build is one reset */
+typedef struct {
+    arena_t    arena;
+    symbol_t * table;       /* NULL until the first symbol */
+    uint32_t   size;
+    int        count;
+} symbols_t;
+
+typedef enum {
+    symbol_added,
+    symbol_exists,          /* the first one stays */
+    symbol_table_full       /* out of memory to grow the table */
+} symbol_add_e;
 
 void symbols_init();
 
@@ -15,6 +41,16 @@ char * symbols_find(char * name, int s_type);
 
 char * symbols_find_any_type(char * name);
 
+symbol_add_e symbols_new_index(char * name, int s_type, int index);
+
+int symbols_find_index(char * name, int s_type);               /* -1 if not found */
+
+char * symbols_text(const char * text, size_t length);   /* a copy of (at most length characters of) text that lasts until the next symbols_init */
+
 void symbols_done();
 
-#endif
\ No newline at end of file
+/* copy the table of one context to another; rebase finds where a string of from (e.g., a symbol value) is in to */
+void symbols_copy(symbols_t * to, symbols_t * from);
+char * symbols_rebase(symbols_t * to, symbols_t * from, char * ptr);
+
+#endif
@@ -84,14 +84,20 @@ extern WINDOW *src_win, *regs_win, *status_win;
 #define status_window_reset() wmove(status_win, 0, 0)
 #define regs_window_reset() wmove(regs_win, 0, 0)
 
-#define status_msg(...) wprintw(status_win, __VA_ARGS__); wrefresh(status_win)
-#define regs_msg(...) wprintw(regs_win, __VA_ARGS__); wrefresh(regs_win)
+/* the status window is refreshed after every message, except while running (see below); the regs window is only
+   refreshed when the caller is done writing all of it, with ui_refresh(regs_win) */
+#define status_msg(...) wprintw(status_win, __VA_ARGS__); ui_refresh(status_win)
+#define regs_msg(...) wprintw(regs_win, __VA_ARGS__)
+
+void ui_refresh(WINDOW * win);
+
+void ui_status_sink(const char * text, void * data);  /* print sink (see print.h) that writes to the status window */
 
 /**********************************************************************************
  * timeline dialog 
  **********************************************************************************/
 
-#define TIMELINE_DIALOG_NUM_FIELDS 5
+#define TIMELINE_DIALOG_NUM_FIELDS 16
 
 typedef struct {
     bool gpio_set[TIMELINE_DIALOG_NUM_FIELDS];
@@ -102,23 +108,36 @@ typedef struct {
  * timeline display 
  **********************************************************************************/
 
-/* function timeline_window calls to get gpio values:
-   note that these don't care which hardware gpio it is, only the index for display (0..4)
+/* functions timeline_window calls to get gpio values, one span of cycles (one column on the screen) at a time:
+   note that these don't care which hardware gpio it is, only the index for display (0..TIMELINE_DIALOG_NUM_FIELDS-1)
    note that this type of interface is to separate display logic from underlying hardware logic
  */
 
 typedef struct {
-    bool  values[TIMELINE_DIALOG_NUM_FIELDS];
-    uint32_t clock_tick; 
-} ui_gpio_history_t;
+    bool  start[TIMELINE_DIALOG_NUM_FIELDS];   // value at the start of the span
+    bool  high[TIMELINE_DIALOG_NUM_FIELDS];    // high at some point in the span
+    bool  low[TIMELINE_DIALOG_NUM_FIELDS];     // low at some point in the span
+} ui_timeline_span_t;
+
+// callback function to get the values during cycles [start, end); returns false if there is no history for then
+typedef bool (*ui_timeline_span_callback_t)(uint32_t start, uint32_t end, ui_timeline_span_t * span);
+
+// callback function to find the first change of any displayed value after (or before) a cycle; returns false if none
+typedef bool (*ui_timeline_edge_callback_t)(uint32_t cycle, bool forward, uint32_t * edge_cycle);
 
-// callback function to get value to be displayed
-typedef ui_gpio_history_t * (*ui_timeline_iteration_callback_t)();
+// callback function to write the displayed values to a file; describes what it did (or why it could not) in msg
+typedef bool (*ui_timeline_export_callback_t)(char * msg, size_t size);
 
 typedef struct {
-    uint32_t num_places; // may get lowered depending on how many can be done
+    uint32_t first_cycle;    // of the history
+    uint32_t last_cycle;
+    bool     triggered;      // the history was captured around a trigger
+    uint32_t trigger_cycle;
     bool     to_be_displayed[TIMELINE_DIALOG_NUM_FIELDS];
-    ui_timeline_iteration_callback_t callback;
+    uint8_t  gpios[TIMELINE_DIALOG_NUM_FIELDS];   // gpio numbers, for the labels
+    ui_timeline_span_callback_t span_callback;
+    ui_timeline_edge_callback_t edge_callback;
+    ui_timeline_export_callback_t export_callback;
 } ui_timeline_display_data_t;
 
 ui_timeline_dialog_data_t * ui_show_timeline_dialog();
@@ -140,13 +159,23 @@ void ui_temp_window_close();
 
 /**********************************************************************************
  * The following are to allow the user to break out of a program that is running
- * forever. Before running something that may run forever, call the enter function.
- * Then periodically call the check function to give the user an option to break
- * out of it. If check returns true, then cleanly exit running forever and 
- * call the exit function to return control to the UI.
+ * forever (on another thread, see run_thread.h). Before running something that
+ * may run forever, call the enter function. Then keep calling the check function
+ * until the run is over, to give the user an option to break out of it. If check
+ * returns true, then ask the run to stop. Once it has stopped, call the exit
+ * function to return control to the UI.
+ *
+ * While running, writing to the windows does not refresh them (which would make
+ * running as slow as the terminal). Instead the check function waits up to one
+ * frame for a key and repaints all of them together, at most UI_FRAME_HZ times a
+ * second, after calling the frame function to bring them up to date.
  **********************************************************************************/
 
-void ui_enter_run_break_mode();
+#define UI_FRAME_HZ 30
+
+typedef int (*ui_frame_t) ();   /* updates the regs window, returns the line to show in the source window (0 for none) */
+
+void ui_enter_run_break_mode(ui_frame_t frame);
 void ui_exit_run_break_mode();
 bool ui_break_check();
 
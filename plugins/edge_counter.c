@@ -0,0 +1,73 @@
+/*!
+ * @file /edge_counter.c
+ * @brief Example device plugin: counts rising edges on a gpio and divides them down onto another
+ * @details
+ * Build with "make plugins" in the build directory (or gcc -I ../inc -shared -fPIC edge_counter.c -o edge_counter.so) and
+ * attach as many as needed, e.g.:
+ *   .device load "./edge_counter.so" "5"            ; counts rising edges on gpio 5
+ *   .device load "./edge_counter.so" "5 6 4"        ; and toggles gpio 6 every 4 of them
+ *
+ * See simpio_plugin.h for the ABI. The state is plain data, so it needs no save, restore or destroy.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdio.h>
+#include "simpio_plugin.h"
+
+#define NO_PIN 0xFF
+
+typedef struct {
+    const simpio_host_services_t * host;
+    uint8_t     in;
+    uint8_t     out;
+    uint32_t    divide;
+    bool        last;
+    bool        level;          // of out
+    uint32_t    edges;
+    uint32_t    last_edge;      // cycle
+} edge_counter_t;
+
+static bool edge_counter_init(void * state, const char * config, const simpio_host_services_t * host, uint32_t * sensitivity) {
+    edge_counter_t * ec = (edge_counter_t *) state;
+    unsigned in, out = NO_PIN, divide = 1;
+    if (sscanf(config, "%u %u %u", &in, &out, &divide) < 1 || in > 31 || (out != NO_PIN && out > 31) || divide == 0) {
+        host->print("edge counter: expected \"in [out [divide]]\", not \"%s\"\n", config);
+        return false;
+    }
+    ec->host = host;
+    ec->in = in;
+    ec->out = out;
+    ec->divide = divide;
+    ec->last = host->get_gpio(in);
+    *sensitivity = (1u << in);
+    return true;
+}
+
+static void edge_counter_execute(void * state) {
+    edge_counter_t * ec = (edge_counter_t *) state;
+    bool value = ec->host->get_gpio(ec->in);
+    if (value && !ec->last) {
+        ec->edges++;
+        ec->last_edge = ec->host->cycle();
+        if (ec->out != NO_PIN && (ec->edges % ec->divide) == 0) {
+            ec->level = !ec->level;
+            ec->host->set_gpio(ec->out, ec->level);
+        }
+    }
+    ec->last = value;
+}
+
+static int edge_counter_display(const void * state, char * text, size_t size) {
+    const edge_counter_t * ec = (const edge_counter_t *) state;
+    return snprintf(text, size, "gpio %u: %u rising edges, the last at cycle %u\n", ec->in, ec->edges, ec->last_edge);
+}
+
+static const simpio_device_plugin_t edge_counter = {
+    SIMPIO_DEVICE_ABI_VERSION, "edge counter", sizeof(edge_counter_t),
+    edge_counter_init, edge_counter_execute, edge_counter_display, NULL, NULL, NULL
+};
+
+const simpio_device_plugin_t * simpio_device_plugin() {
+    return &edge_counter;
+}
@@ -0,0 +1,109 @@
+/*!
+ * @file /arena.c
+ * @brief Arena (bump) allocator
+ * @details
+ * See arena.h. Allocations are rounded up to 8 bytes so that everything handed out is aligned for any of the simulator's
+ * types. A copy lays out the used part of each chunk of the source one after the other, which is what rebase relies on.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ALIGN(n) (((n) + 7) & ~((size_t) 7))
+
+static arena_chunk_t * new_chunk(size_t size) {
+    arena_chunk_t * chunk;
+    if (size < ARENA_CHUNK_SIZE) size = ARENA_CHUNK_SIZE;
+    chunk = malloc(sizeof(arena_chunk_t) + size);
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+void * arena_alloc(arena_t * arena, size_t size) {
+    arena_chunk_t * chunk;
+    void * ptr;
+    size = ALIGN(size);
+    if (!arena->current) {
+        if (!arena->first && !(arena->first = new_chunk(size))) return NULL;
+        arena->current = arena->first;
+    }
+    while (arena->current->used + size > arena->current->size) {
+        /* chunks after the current one are empty (left from before a reset), use the next one if it is big enough */
+        if (arena->current->next && arena->current->next->size >= size) {
+            arena->current = arena->current->next;
+            continue;
+        }
+        chunk = new_chunk(size);
+        if (!chunk) return NULL;
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+        arena->current = chunk;
+    }
+    ptr = arena->current->data + arena->current->used;
+    arena->current->used += size;
+    return ptr;
+}
+
+char * arena_strndup(arena_t * arena, const char * s, size_t n) {
+    char * copy;
+    size_t length = strnlen(s, n);
+    copy = arena_alloc(arena, length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+void arena_reset(arena_t * arena) {
+    arena_chunk_t * chunk;
+    for (chunk = arena->first; chunk; chunk = chunk->next) chunk->used = 0;
+    arena->current = arena->first;
+}
+
+void arena_free(arena_t * arena) {
+    arena_chunk_t * chunk, * next;
+    for (chunk = arena->first; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+bool arena_copy(arena_t * to, arena_t * from) {
+    arena_chunk_t * chunk, * to_chunk;
+    size_t total = 0;
+    for (chunk = from->first; chunk; chunk = chunk->next) total += chunk->used;
+    arena_reset(to);
+    if (total == 0) return true;
+    if (!to->first || to->first->size < total) {
+        to_chunk = new_chunk(total);
+        if (!to_chunk) return false;
+        to_chunk->next = to->first;
+        to->first = to_chunk;
+        to->current = to_chunk;
+    }
+    for (chunk = from->first; chunk; chunk = chunk->next) {
+        memcpy(to->first->data + to->first->used, chunk->data, chunk->used);
+        to->first->used += chunk->used;
+    }
+    return true;
+}
+
+void * arena_rebase(arena_t * to, arena_t * from, void * ptr) {
+    arena_chunk_t * chunk;
+    size_t offset = 0;
+    for (chunk = from->first; chunk; chunk = chunk->next) {
+        if ((char *) ptr >= chunk->data && (char *) ptr < chunk->data + chunk->used) {
+            return to->first->data + offset + ((char *) ptr - chunk->data);
+        }
+        offset += chunk->used;
+    }
+    return ptr;
+}
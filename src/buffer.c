@@ -0,0 +1,154 @@
+/*!
+ * @file /buffer.c
+ * @brief Named data buffers for the user processors
+ * @details
+ * See buffer.h. The names are in the build's symbol table (with their index), so the parser resolves a block instruction's
+ * buffer once and the instruction only indexes the data at run time. A read block that needs more room than a buffer has
+ * doubles it, so reading a long stream costs a few reallocations rather than one per word.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "buffer.h"
+#include "symbols.h"
+#include "print.h"
+#include "context.h"
+
+#define BUFFERS (simpio_context->buffers)
+#define DATA    (simpio_context->buffers_data)
+
+/*****************************************************************
+ *
+ *  CONFIGURATION
+ *
+ *****************************************************************/
+
+void buffer_reset_all() {
+    memset(&BUFFERS, 0, sizeof(buffers_t));
+}
+
+static buffer_config_t * declare(char * name, int line) {
+    buffer_config_t * buffer;
+    if (BUFFERS.num_buffers == NUM_BUFFERS) {
+        PRINT("Error (line %d): no more than %d buffers can be declared\n", line+1, NUM_BUFFERS);
+        return NULL;
+    }
+    switch (symbols_new_index(name, BUFFER_TYPE, BUFFERS.num_buffers)) {
+        case symbol_added: break;
+        case symbol_exists:
+            PRINT("Error (line %d): buffer %s is already declared\n", line+1, name);
+            return NULL;
+        default:
+            PRINT("Error (line %d): symbol table full (out of memory), buffer %s can't be declared\n", line+1, name);
+            return NULL;
+    }
+    buffer = &(BUFFERS.buffers[BUFFERS.num_buffers++]);
+    snprintf(buffer->name, SYMBOL_MAX, "%s", name);
+    return buffer;
+}
+
+bool buffer_declare(char * name, uint32_t words, int line) {
+    buffer_config_t * buffer;
+    if (words > BUFFER_MAX_WORDS) {
+        PRINT("Error (line %d): a buffer can hold at most %d words\n", line+1, BUFFER_MAX_WORDS);
+        return false;
+    }
+    buffer = declare(name, line);
+    if (!buffer) return false;
+    buffer->words = words;
+    return true;
+}
+
+bool buffer_declare_file(char * name, char * file_name, int word_bytes, int line) {
+    buffer_config_t * buffer;
+    if (word_bytes != 1 && word_bytes != 2 && word_bytes != 4) {
+        PRINT("Error (line %d): a buffer file has 1, 2 or 4 bytes per word\n", line+1);
+        return false;
+    }
+    buffer = declare(name, line);
+    if (!buffer) return false;
+    snprintf(buffer->file, BUFFER_FILE_NAME_MAX, "%s", file_name);
+    buffer->word_bytes = word_bytes;
+    return true;
+}
+
+int buffer_find(char * name) {
+    int i = symbols_find_index(name, BUFFER_TYPE);
+    return (i < 0) ? BUFFER_NONE : i;
+}
+
+/*****************************************************************
+ *
+ *  RUNNING
+ *
+ *****************************************************************/
+
+void buffer_data_free(buffers_data_t * data) {
+    int i;
+    for (i=0; i<NUM_BUFFERS; i++) free(data->data[i].words);
+    memset(data, 0, sizeof(buffers_data_t));
+}
+
+buffer_data_t * buffer_data(int index) {
+    return &(DATA.data[index]);
+}
+
+bool buffer_reserve(int index, uint32_t length) {
+    buffer_data_t * data = &(DATA.data[index]);
+    uint32_t allocated = data->allocated ? data->allocated : 1;
+    uint32_t * words;
+    if (length <= data->allocated) return true;
+    if (length > BUFFER_MAX_WORDS) return false;
+    while (allocated < length) allocated *= 2;
+    if (allocated > BUFFER_MAX_WORDS) allocated = BUFFER_MAX_WORDS;
+    words = realloc(data->words, (size_t) allocated * sizeof(uint32_t));
+    if (!words) return false;
+    memset(words + data->allocated, 0, (size_t) (allocated - data->allocated) * sizeof(uint32_t));
+    data->words = words;
+    data->allocated = allocated;
+    return true;
+}
+
+static void read_file(int index) {
+    buffer_config_t * buffer = &(BUFFERS.buffers[index]);
+    buffer_data_t * data = &(DATA.data[index]);
+    FILE * file = fopen(buffer->file, "rb");
+    long size;
+    uint32_t i, words;
+    int byte, b;
+    if (!file) {
+        PRINT("buffer %s: unable to open %s, the buffer is empty\n", buffer->name, buffer->file);
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+    words = (size > 0) ? (uint32_t) ((size + buffer->word_bytes - 1) / buffer->word_bytes) : 0;
+    if (words > BUFFER_MAX_WORDS) {
+        PRINT("buffer %s: only the first %d words of %s are read\n", buffer->name, BUFFER_MAX_WORDS, buffer->file);
+        words = BUFFER_MAX_WORDS;
+    }
+    if (!buffer_reserve(index, words)) {
+        PRINT("not enough memory for buffer %s\n", buffer->name);
+        fclose(file);
+        return;
+    }
+    for (i = 0; i < words; i++) {
+        for (b = 0; b < buffer->word_bytes && (byte = fgetc(file)) != EOF; b++) data->words[i] |= (uint32_t) byte << (8 * b);
+    }
+    data->length = words;
+    fclose(file);
+}
+
+void buffer_restart() {
+    int i;
+    buffer_data_free(&DATA);
+    for (i=0; i<BUFFERS.num_buffers; i++) {
+        if (BUFFERS.buffers[i].file[0]) read_file(i);
+        else if (buffer_reserve(i, BUFFERS.buffers[i].words)) DATA.data[i].length = BUFFERS.buffers[i].words;
+        else PRINT("not enough memory for buffer %s\n", BUFFERS.buffers[i].name);
+    }
+}
@@ -0,0 +1,135 @@
+/*!
+ * @file /context.c
+ * @brief Simulation context (all of the state of one simulated system)
+ * @details
+ * See context.h. The default context is statically allocated (zeroed like the file-scope statics it replaced), others
+ * are heap allocated and reset to the same system defaults that main applies to the default context.
+ * 
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdlib.h>
+#include "context.h"
+
+static simpio_t default_context;
+
+__thread simpio_t * simpio_context = &default_context;
+__thread print_state_t * print_state = &(default_context.print);
+
+simpio_t * context_create() {
+    simpio_t * context, * prev;
+    context = calloc(1, sizeof(simpio_t));
+    if (!context) return NULL;
+    prev = context_select(context);
+    hardware_set_system_defaults();
+    exec_reset();
+    decoder_reset_all();
+    context_select(prev);
+    return context;
+}
+
+void context_destroy(simpio_t * context) {
+    if (!context || (context == &default_context)) return;
+    if (simpio_context == context) context_select(NULL);
+    free(context->source);
+    arena_free(&(context->symbols.arena));
+    hardware_changed_gpio_history_free(&(context->changed.gpio_history));
+    decoder_output_free(&(context->decoder_output));
+    device_spi_flash_storage_free(&(context->spi_flash_storage));
+    device_uart_streams_free(&(context->uart_streams));
+    device_i2c_eeprom_storage_free(&(context->i2c_eeprom_storage));
+    device_ws2812_frames_free(&(context->ws2812_frames));
+    device_plugins_free(&(context->plugins));
+    buffer_data_free(&(context->buffers_data));
+    replay_recorder_free(&(context->replay));
+    state_hash_free(&(context->state_hash));
+    print_state_free(&(context->print));
+    free(context);
+}
+
+simpio_t * context_select(simpio_t * context) {
+    simpio_t * prev = simpio_context;
+    simpio_context = context ? context : &default_context;
+    print_state = &(simpio_context->print);
+    return prev;
+}
+
+simpio_t * context_default() {
+    return &default_context;
+}
+
+/* the copied state points into itself (e.g., an sm up to its pio), those pointers have to follow the copy */
+#define REBASE(ptr)  if ((char *) (ptr) >= (char *) from && (char *) (ptr) < (char *) (from + 1)) \
+                         (ptr) = (void *) ((char *) to + ((char *) (ptr) - (char *) from))
+
+static void rebase_instruction(simpio_t * to, simpio_t * from, instruction_t * instr) {
+    REBASE(instr->executing_sm);
+    REBASE(instr->pio);
+}
+
+static void rebase_user_instruction(simpio_t * to, simpio_t * from, user_instruction_t * instr) {
+    REBASE(instr->executing_up);
+    REBASE(instr->executing_sm);
+    instr->data_ptr = symbols_rebase(&(to->symbols), &(from->symbols), instr->data_ptr);
+}
+
+/* everything but the plugins and the symbols, which need allocating; to's symbols have to be a copy of from's already */
+static void copy_plain(simpio_t * to, simpio_t * from) {
+    exec_run_hook_t run_hook = to->exec.run_hook;
+    int i, j;
+    to->hardware = from->hardware;
+    to->instruction = from->instruction;
+    to->exec = from->exec;
+    to->exec.run_hook = run_hook;
+    to->spi_flash = from->spi_flash;
+    to->keypad = from->keypad;
+    to->uart = from->uart;
+    to->i2c_eeprom = from->i2c_eeprom;
+    to->ws2812 = from->ws2812;
+    to->buffers = from->buffers;
+    to->decoders = from->decoders;
+    to->changed.trigger = from->changed.trigger;
+    for (i=0; i<NUM_PIOS; i++) {
+        for (j=0; j<NUM_INSTRUCTIONS; j++) rebase_instruction(to, from, &(to->hardware.pios[i].instructions[j]));
+    }
+    for (i=0; i<NUM_PIOS * NUM_SMS; i++) {
+        REBASE(to->hardware.sms[i].pio);
+        rebase_instruction(to, from, &(to->hardware.sms[i].exec_instruction));
+    }
+    for (i=0; i<NUM_USER_PROCESSORS; i++) {
+        for (j=0; j<NUM_USER_INSTRUCTIONS; j++) rebase_user_instruction(to, from, &(to->hardware.user_processors[i].instructions[j]));
+    }
+    for (i=0; i<NUM_IH_PROCESSORS; i++) {
+        for (j=0; j<NUM_USER_INSTRUCTIONS; j++) rebase_user_instruction(to, from, &(to->hardware.ih_processors[i].instructions[j]));
+    }
+    for (i=0; i<NUM_IRQ_FLAGS; i++) REBASE(to->hardware.irq_flags[i].ih);
+    REBASE(to->exec.next_sm);
+    REBASE(to->exec.next_up);
+    REBASE(to->exec.user_instruction);
+    REBASE(to->exec.instruction);
+    REBASE(to->spi_flash.state.data_ptr);
+}
+
+void context_copy_program(simpio_t * to, simpio_t * from) {
+    if (to == from) return;
+    if (!device_plugin_copy(&(to->plugins), &(from->plugins))) { PRINT("could not copy the device plugins\n"); }
+    symbols_copy(&(to->symbols), &(from->symbols));
+    copy_plain(to, from);
+}
+
+void context_copy_state(simpio_t * to, simpio_t * from) {
+    gpio_history_t history = to->changed.gpio_history;
+    if (to == from) return;
+    context_copy_program(to, from);
+    to->changed = from->changed;
+    to->changed.gpio_history = history;  /* not needed to show the state, and to would be sharing from's memory */
+}
+
+void context_copy_running_state(simpio_t * to, simpio_t * from) {
+    gpio_history_t history = to->changed.gpio_history;
+    if (to == from) return;
+    device_plugin_copy_running(&(to->plugins), &(from->plugins));
+    copy_plain(to, from);
+    to->changed = from->changed;
+    to->changed.gpio_history = history;
+}
@@ -0,0 +1,366 @@
+/*!
+ * @file /decoder.c
+ * @brief Protocol decoders (SPI, UART, I2C, parallel) over the GPIO pins
+ * @details
+ * See decoder.h. Each update only reads the watched gpios; if none changed and no UART has a sample due, that is all it does.
+ * Otherwise each decoder looks at the edges of its own pins:
+ *
+ * - spi: shifts in mosi and miso on the sampling clock edge of its mode while selected (chip select low, or always without one)
+ * - uart: a falling edge starts a frame, the line is sampled in the middle of the start, data and stop bits (8N1 by default,
+ *         least significant bit first), which is all timing, hence the deadline for the next sample
+ * - i2c: sda falling or rising while scl is high is a start or stop, otherwise sda is shifted in on scl rising, 8 bits
+ *        (most significant bit first) and the ack, the first byte after a start being the address
+ * - parallel: the data pins are read on the strobe edge
+ *
+ * The line of a UART between updates is the value from the last update, so a sample due before the current cycle uses that.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "decoder.h"
+#include "hardware.h"
+#include "print.h"
+#include "context.h"
+
+/***********************************************************************************************************
+ * state data
+ **********************************************************************************************************/
+
+#define DECODERS (simpio_context->decoders)
+#define OUTPUT (simpio_context->decoder_output)
+
+#define BIT(v, pin) ((bool) (((v) >> (pin)) & 1))
+#define HAS_PIN(pin) ((pin) != DECODER_NO_PIN)
+
+static const char * decoder_names[] = { "spi", "uart", "i2c", "parallel" };
+
+/***********************************************************************************************************
+ * configuration
+ **********************************************************************************************************/
+
+void decoder_reset_all() {
+    memset(&DECODERS, 0, sizeof(decoder_state_t));
+    DECODERS.deadline = UINT32_MAX;
+}
+
+static bool check_pin(int pin, bool optional) {
+    if (optional && pin == DECODER_NO_PIN) return true;
+    if (pin < 0 || pin >= NUM_GPIOS) {
+        PRINT("Error: invalid decoder pin %d\n", pin);
+        return false;
+    }
+    return true;
+}
+
+static bool check_bits(int bits) {
+    if (bits < 1 || bits > 32) {
+        PRINT("Error: decoder words must be 1 to 32 bits, not %d\n", bits);
+        return false;
+    }
+    return true;
+}
+
+static decoder_t * new_decoder(decoder_type_e type) {
+    decoder_t * d;
+    if (DECODERS.count >= MAX_DECODERS) {
+        PRINT("Error: no more than %d decoders\n", MAX_DECODERS);
+        return NULL;
+    }
+    d = &(DECODERS.decoders[DECODERS.count]);
+    memset(d, 0, sizeof(decoder_t));
+    d->type = type;
+    memset(d->pins, DECODER_NO_PIN, sizeof(d->pins));
+    return d;
+}
+
+static void watch(uint8_t pin, uint8_t count) {
+    while (count--) {
+        if (HAS_PIN(pin)) DECODERS.watched |= (1u << pin);
+        pin++;
+    }
+}
+
+static bool add_decoder(decoder_t * d) {
+    int i;
+    for (i=0; i<4; i++) watch(d->pins[i], 1);
+    if (d->type == decoder_parallel) watch(d->pins[1], d->bits);
+    DECODERS.count++;
+    return true;
+}
+
+bool decoder_add_spi(int clk, int mosi, int miso, int cs, int mode, int bits, int shift_right) {
+    decoder_t * d;
+    if (!check_pin(clk, false) || !check_pin(mosi, true) || !check_pin(miso, true) || !check_pin(cs, true) || !check_bits(bits)) return false;
+    if (mode < 0 || mode > 3) {
+        PRINT("Error: spi mode must be 0 to 3\n");
+        return false;
+    }
+    if (!(d = new_decoder(decoder_spi))) return false;
+    d->pins[0] = clk;
+    d->pins[1] = mosi;
+    d->pins[2] = miso;
+    d->pins[3] = cs;
+    d->mode = mode;
+    d->bits = bits;
+    d->shift_right = shift_right;
+    d->active = true;       /* the gpios start out low, i.e., selected */
+    return add_decoder(d);
+}
+
+bool decoder_add_uart(int rx, int cycles_per_bit, int bits) {
+    decoder_t * d;
+    if (!check_pin(rx, false) || !check_bits(bits)) return false;
+    if (cycles_per_bit < 2) {
+        PRINT("Error: uart bits must be at least 2 cycles long\n");
+        return false;
+    }
+    if (!(d = new_decoder(decoder_uart))) return false;
+    d->pins[0] = rx;
+    d->cycles_per_bit = cycles_per_bit;
+    d->bits = bits;
+    d->shift_right = true;
+    return add_decoder(d);
+}
+
+bool decoder_add_i2c(int scl, int sda) {
+    decoder_t * d;
+    if (!check_pin(scl, false) || !check_pin(sda, false)) return false;
+    if (!(d = new_decoder(decoder_i2c))) return false;
+    d->pins[0] = scl;
+    d->pins[1] = sda;
+    d->bits = 8;
+    return add_decoder(d);
+}
+
+bool decoder_add_parallel(int first_pin, int width, int strobe, int rising) {
+    decoder_t * d;
+    if (!check_pin(first_pin, false) || !check_pin(strobe, false) || !check_bits(width)) return false;
+    if (first_pin + width > NUM_GPIOS) {
+        PRINT("Error: parallel decoder pins %d to %d are not all gpios\n", first_pin, first_pin + width - 1);
+        return false;
+    }
+    if (!(d = new_decoder(decoder_parallel))) return false;
+    d->pins[0] = strobe;
+    d->pins[1] = first_pin;
+    d->bits = width;
+    d->mode = rising ? 1 : 0;
+    return add_decoder(d);
+}
+
+void decoder_set_print(bool print) { DECODERS.print = print; }
+
+void decoder_set_file(const char * file_name) { snprintf(DECODERS.file_name, DECODER_FILE_NAME_MAX, "%s", file_name); }
+
+/***********************************************************************************************************
+ * output
+ **********************************************************************************************************/
+
+void decoder_set_frame_hook(decoder_frame_hook_t hook) { OUTPUT.hook = hook; }
+
+void decoder_restart() {
+    OUTPUT.total = 0;
+    if (OUTPUT.file) fclose(OUTPUT.file);
+    OUTPUT.file = NULL;
+}
+
+void decoder_output_free(decoder_output_t * output) {
+    free(output->log);
+    output->log = NULL;
+    if (output->file) fclose(output->file);
+    output->file = NULL;
+}
+
+static void write_file(const char * text) {
+    if (!OUTPUT.file) {
+        OUTPUT.file = fopen(DECODERS.file_name, "w");
+        if (!OUTPUT.file) {
+            PRINT("unable to open %s, decoded frames will not be written to it\n", DECODERS.file_name);
+            DECODERS.file_name[0] = '\0';
+            return;
+        }
+    }
+    fprintf(OUTPUT.file, "%s\n", text);
+}
+
+static void emit(decoder_t * d, decoded_kind_e kind, uint32_t start, uint32_t end, uint32_t value, uint32_t value2, bool ack) {
+    decoded_frame_t frame = { .decoder = d - DECODERS.decoders, .kind = kind, .start = start, .end = end, .value = value, .value2 = value2, .ack = ack };
+    char text[DECODER_TEXT_MAX];
+    if (!OUTPUT.log) OUTPUT.log = malloc(DECODER_LOG_SIZE * sizeof(decoded_frame_t));
+    if (OUTPUT.log) {
+        OUTPUT.log[OUTPUT.total % DECODER_LOG_SIZE] = frame;
+        OUTPUT.total++;
+    }
+    if (OUTPUT.hook) (*OUTPUT.hook)(&frame);
+    if (!DECODERS.print && !DECODERS.file_name[0]) return;
+    decoder_frame_text(&frame, text, DECODER_TEXT_MAX);
+    if (DECODERS.print) { PRINT("%s\n", text); }
+    if (DECODERS.file_name[0]) write_file(text);
+}
+
+/***********************************************************************************************************
+ * decoding
+ **********************************************************************************************************/
+
+static void shift_in(decoder_t * d, uint32_t * word, bool bit) {
+    if (d->shift_right) *word |= ((uint32_t) bit << d->count);
+    else *word = (*word << 1) | bit;
+}
+
+static void run_spi(decoder_t * d, uint32_t values, uint32_t changed, uint32_t cycle) {
+    uint8_t clk = d->pins[0], mosi = d->pins[1], miso = d->pins[2], cs = d->pins[3];
+    bool sample_level = !((d->mode >> 1) ^ (d->mode & 1));    /* modes 0 and 3 sample on the rising edge */
+    if (HAS_PIN(cs) && BIT(changed, cs)) {
+        if (BIT(values, cs) && d->active) emit(d, decoded_stop, cycle, cycle, 0, 0, false);
+        d->active = !BIT(values, cs);
+        d->count = 0;
+    }
+    if (!d->active || !BIT(changed, clk) || BIT(values, clk) != sample_level) return;
+    if (d->count == 0) {
+        d->start = cycle;
+        d->value = d->value2 = 0;
+    }
+    shift_in(d, &(d->value), HAS_PIN(mosi) && BIT(values, mosi));
+    shift_in(d, &(d->value2), HAS_PIN(miso) && BIT(values, miso));
+    if (++d->count == d->bits) {
+        emit(d, decoded_word, d->start, cycle, d->value, d->value2, false);
+        d->count = 0;
+    }
+}
+
+static void run_uart(decoder_t * d, uint32_t values, uint32_t changed, uint32_t cycle) {
+    uint8_t rx = d->pins[0];
+    bool level;
+    while (d->active && d->next_sample <= cycle) {
+        level = BIT((d->next_sample < cycle) ? DECODERS.last_values : values, rx);
+        if (d->count == 0) {
+            if (level) d->active = false;       /* not a start bit after all */
+        }
+        else if (d->count <= d->bits) {
+            if (level) d->value |= (1u << (d->count - 1));
+        }
+        else {
+            emit(d, level ? decoded_word : decoded_error, d->start, d->next_sample, d->value, 0, false);
+            d->active = false;
+        }
+        d->count++;
+        d->next_sample += d->cycles_per_bit;
+    }
+    if (!d->active && BIT(changed, rx) && !BIT(values, rx)) {
+        d->active = true;
+        d->count = 0;
+        d->value = 0;
+        d->start = cycle;
+        d->next_sample = cycle + d->cycles_per_bit / 2;
+    }
+    if (d->active && d->next_sample < DECODERS.deadline) DECODERS.deadline = d->next_sample;
+}
+
+static void run_i2c(decoder_t * d, uint32_t values, uint32_t changed, uint32_t cycle) {
+    uint8_t scl = d->pins[0], sda = d->pins[1];
+    bool ack;
+    if (BIT(changed, sda) && BIT(values, scl) && !BIT(changed, scl)) {
+        if (!BIT(values, sda)) {
+            emit(d, decoded_start, cycle, cycle, 0, 0, false);
+            d->active = true;
+            d->addressed = false;
+        }
+        else if (d->active) {
+            emit(d, decoded_stop, cycle, cycle, 0, 0, false);
+            d->active = false;
+        }
+        d->count = 0;
+        return;
+    }
+    if (!d->active || !BIT(changed, scl) || !BIT(values, scl)) return;
+    if (d->count == 0) {
+        d->start = cycle;
+        d->value = 0;
+    }
+    if (d->count < 8) shift_in(d, &(d->value), BIT(values, sda));
+    else {
+        ack = !BIT(values, sda);
+        if (d->addressed) emit(d, decoded_word, d->start, cycle, d->value, 0, ack);
+        else emit(d, decoded_address, d->start, cycle, d->value >> 1, d->value & 1, ack);
+        d->addressed = true;
+        d->count = 0;
+        return;
+    }
+    d->count++;
+}
+
+static void run_parallel(decoder_t * d, uint32_t values, uint32_t changed, uint32_t cycle) {
+    uint8_t strobe = d->pins[0];
+    uint32_t mask = (d->bits == 32) ? 0xFFFFFFFF : ((1u << d->bits) - 1);
+    if (!BIT(changed, strobe) || BIT(values, strobe) != d->mode) return;
+    emit(d, decoded_word, cycle, cycle, (values >> d->pins[1]) & mask, 0, false);
+}
+
+void decoder_update(uint32_t cycle) {
+    uint32_t values, changed;
+    decoder_t * d;
+    if (!DECODERS.count) return;
+    if (cycle < DECODERS.last_cycle) cycle = DECODERS.last_cycle;
+    DECODERS.last_cycle = cycle;
+    values = hardware_get_gpios(DECODERS.watched);
+    changed = values ^ DECODERS.last_values;
+    if (!changed && cycle < DECODERS.deadline) return;
+    DECODERS.deadline = UINT32_MAX;
+    for (d = DECODERS.decoders; d < DECODERS.decoders + DECODERS.count; d++) {
+        switch (d->type) {
+            case decoder_spi:       run_spi(d, values, changed, cycle);       break;
+            case decoder_uart:      run_uart(d, values, changed, cycle);      break;
+            case decoder_i2c:       run_i2c(d, values, changed, cycle);       break;
+            case decoder_parallel:  run_parallel(d, values, changed, cycle);  break;
+        };
+    }
+    DECODERS.last_values = values;
+}
+
+/***********************************************************************************************************
+ * decoded frames
+ **********************************************************************************************************/
+
+uint8_t decoder_count() { return DECODERS.count; }
+
+uint32_t decoder_frames_total() { return OUTPUT.total; }
+
+uint32_t decoder_frames_kept() { return (OUTPUT.total < DECODER_LOG_SIZE) ? OUTPUT.total : DECODER_LOG_SIZE; }
+
+bool decoder_frame(uint32_t n, decoded_frame_t * frame) {
+    uint32_t kept = decoder_frames_kept();
+    if (n >= kept) return false;
+    *frame = OUTPUT.log[(OUTPUT.total - kept + n) % DECODER_LOG_SIZE];
+    return true;
+}
+
+int decoder_frame_text(const decoded_frame_t * frame, char * text, size_t size) {
+    decoder_t * d = &(DECODERS.decoders[frame->decoder]);
+    char what[DECODER_TEXT_MAX];
+    int digits = (d->bits + 3) / 4;
+    int n = 0;
+    switch (frame->kind) {
+        case decoded_start:     snprintf(what, DECODER_TEXT_MAX, "start");  break;
+        case decoded_stop:      snprintf(what, DECODER_TEXT_MAX, "stop");   break;
+        case decoded_address:
+            snprintf(what, DECODER_TEXT_MAX, "address %02X %s %s", frame->value, frame->value2 ? "read" : "write", frame->ack ? "ack" : "nack");
+            break;
+        case decoded_error:
+            snprintf(what, DECODER_TEXT_MAX, "framing error %0*X", digits, frame->value);
+            break;
+        case decoded_word:
+            if (d->type == decoder_spi) {
+                what[0] = '\0';
+                if (HAS_PIN(d->pins[1])) n = snprintf(what, DECODER_TEXT_MAX, "mosi %0*X", digits, frame->value);
+                if (HAS_PIN(d->pins[2])) snprintf(what + n, DECODER_TEXT_MAX - n, "%smiso %0*X", n ? " " : "", digits, frame->value2);
+            }
+            else if (d->type == decoder_i2c) snprintf(what, DECODER_TEXT_MAX, "data %02X %s", frame->value, frame->ack ? "ack" : "nack");
+            else if (d->bits <= 8 && isprint(frame->value)) snprintf(what, DECODER_TEXT_MAX, "%0*X '%c'", digits, frame->value, frame->value);
+            else snprintf(what, DECODER_TEXT_MAX, "%0*X", digits, frame->value);
+            break;
+    };
+    if (frame->end == frame->start) return snprintf(text, size, "%s%d %u: %s", decoder_names[d->type], frame->decoder, frame->start, what);
+    return snprintf(text, size, "%s%d %u-%u: %s", decoder_names[d->type], frame->decoder, frame->start, frame->end, what);
+}
@@ -0,0 +1,295 @@
+/*!
+ * @file /device_display.c
+ * @brief UI displays for the simulated devices
+ * @details
+ * The simulated devices (see device_*.c) are part of the simulation core which has no UI dependency, so the displays of
+ * their state in the temp window live here, with the rest of the UI, and are found by the name the device registered with
+ * (or, for devices loaded from plugins, show the text the plugin gives, if it gives any).
+ *
+ * Each display handler returns 0 to go back to the UI or a number of instructions to step before displaying the device again.
+ * 
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <string.h>
+#include "device_display.h"
+#include "context.h"
+#include "ui.h"
+
+#define SPIF        (simpio_context->spi_flash)
+#define SPIF_STATE  (SPIF.state)
+#define KEYPAD      (simpio_context->keypad)
+#define UART        (simpio_context->uart)
+#define EEPROM      (simpio_context->i2c_eeprom)
+#define EE_STATE    (EEPROM.state)
+#define WS2812      (simpio_context->ws2812)
+
+/*****************************************************************
+ *
+ *  SPI FLASH
+ *
+ *****************************************************************/
+
+int display_spi_flash_state(int instance) {
+    int ch, i,j;
+    werase(temp_window);
+    ui_temp_window_write("clk pin(%d) = %d\n", SPIF.clk, hardware_get_gpio(SPIF.clk));
+    ui_temp_window_write("tx  pin(%d) = %d\n", SPIF.tx, hardware_get_gpio(SPIF.tx));
+    ui_temp_window_write("rx  pin(%d) = %d\n", SPIF.rx, hardware_get_gpio(SPIF.rx));
+    ui_temp_window_write("cs  pin(%d) = %d\n", SPIF.cs, hardware_get_gpio(SPIF.cs));
+    if (SPIF.io2 != SPI_FLASH_NO_PIN && SPIF.io3 != SPI_FLASH_NO_PIN) {
+        ui_temp_window_write("io2 pin(%d) = %d, io3 pin(%d) = %d\n", SPIF.io2, hardware_get_gpio(SPIF.io2), SPIF.io3, hardware_get_gpio(SPIF.io3));
+    }
+    ui_temp_window_write("state  = ");
+    switch(SPIF_STATE.state) {
+        case spif_idle:             ui_temp_window_write("idle\n");                     break;
+        case spif_getting_cmd:      ui_temp_window_write("getting command\n");          break;
+        case spif_getting_addr1:    ui_temp_window_write("getting address byte 1\n");   break;
+        case spif_getting_addr2:    ui_temp_window_write("getting address byte 2\n");   break;
+        case spif_getting_addr3:    ui_temp_window_write("getting address byte 3\n");   break;
+        case spif_getting_dummy:    ui_temp_window_write("getting dummy clocks\n");     break;
+        case spif_programming:      ui_temp_window_write("writing data\n");             break;
+        case spif_reading:          ui_temp_window_write("reading data (%d bit%s per clock)\n", SPIF_STATE.width, SPIF_STATE.width > 1 ? "s" : "");  break;
+        case spif_writing_response: ui_temp_window_write("writing response\n");         break;
+        case spif_processing_cmd:   ui_temp_window_write("processing command\n");       break;
+        case spif_done:             ui_temp_window_write("done\n");       break;
+    };
+    switch (SPIF_STATE.shift_state) {
+        case spif_shift_waiting_on_clk_low_then_high: ui_temp_window_write("waiting on clk low then high");  break;
+        case spif_shift_waiting_on_clk_high:          ui_temp_window_write("waiting on clk high");           break;
+        case spif_shift_waiting_on_clk_high_then_low: ui_temp_window_write("waiting on clk high then low");  break;
+        case spif_shift_waiting_on_clk_low:          ui_temp_window_write("waiting on clk low");             break;
+
+    };
+    ui_temp_window_write("\n");
+    ui_temp_window_write("current cmd  = %02X\n", SPIF_STATE.cmd);
+    ui_temp_window_write("prev cmd  = %02X\n", SPIF_STATE.prev_cmd);
+    ui_temp_window_write("shift count  = %d\n", SPIF_STATE.shift_count);
+    ui_temp_window_write("last clk pin: %d\n", SPIF_STATE.last_clk);
+    ui_temp_window_write("status register 1: %d\n", SPIF_STATE.status_register_1);
+    ui_temp_window_write("address: %d\n", SPIF_STATE.addr);
+    ui_temp_window_write("current response: %02X\n", SPIF_STATE.response_byte);
+    ui_temp_window_write("bytes responded so far: %d\n", SPIF_STATE.bytes_responded);
+    ui_temp_window_write("byte to program: %02X\n", SPIF_STATE.program_byte);
+    ui_temp_window_write("byte received so far: %d\n", SPIF_STATE.bytes_received);
+    ui_temp_window_write("num bytes expected: %d\n", SPIF_STATE.num_bytes);
+    ui_temp_window_write("byte index: %d\n", SPIF_STATE.byte_index);
+    if (SPIF_STATE.busy) {ui_temp_window_write("device is busy until cycle %d\n", SPIF_STATE.busy_until);}
+    else ui_temp_window_write("device is idle\n");
+    if (SPIF_STATE.write_enable_latch) {ui_temp_window_write("device is enabled for write\n");}
+    else ui_temp_window_write("device is not enabled for write\n");
+    ui_temp_window_write("simulated flash storage (first %d bytes):\n", SPI_FLASH_DISPLAY_LINES * SPI_FLASH_DISPLAY_LINE_SIZE);
+    for (i=0; i < SPI_FLASH_DISPLAY_LINES; i++) {
+        for (j=0; j < SPI_FLASH_DISPLAY_LINE_SIZE; j++) {
+            ui_temp_window_write("%02X ", SPIF.head[ (i*SPI_FLASH_DISPLAY_LINE_SIZE) +j]);
+        }
+        ui_temp_window_write("\n");
+    }
+    ui_temp_window_write("\npress PF6 to step next instruction: %d, 2-9 to run iterations, s to save the flash to %s, else qq to exit\n",
+                         SPIF_STATE.last_clk, SPIF.image_file[0] ? SPIF.image_file : SPI_FLASH_DEFAULT_IMAGE);
+    ch = getch();
+    if ('q' == ch) return 0;
+    if ('s' == ch) {
+        if (device_spi_flash_save(SPIF.image_file[0] ? SPIF.image_file : SPI_FLASH_DEFAULT_IMAGE)) {
+            status_msg("saved the spi flash\n");
+        }
+        return 0;
+    }
+    if ('2' <= ch && ch <= '9') return (ch - '0');
+    if (ch == KEY_F(6)) return 1;
+    return 0;
+}
+
+/*****************************************************************
+ *
+ *  KEYPAD
+ *
+ *****************************************************************/
+
+int display_keypad_state(int instance) {
+    int ch;
+    do {
+        werase(temp_window);
+        if (KEYPAD.keypress_row < 0) { ui_temp_window_write("no key currently pressed\n"); }
+        else ui_temp_window_write("current keypress is row: %d col: %d\n", KEYPAD.keypress_row+1, KEYPAD.keypress_col+1);
+        ui_temp_window_write("\n\npress key on keyboard from following table to simulate a keypress\n");
+        ui_temp_window_write("or press space bar for no key pressed\n");
+        ui_temp_window_write("hit q to quit\n\n");
+        ui_temp_window_write("              COL 1    COL 2    COL 3    COL 4\n");
+        ui_temp_window_write("     ROW 1     1        2        3        A   \n");
+        ui_temp_window_write("     ROW 2     4        5        6        B   \n");
+        ui_temp_window_write("     ROW 3     7        8        9        C   \n");
+        ui_temp_window_write("     ROW 4     *        0        #        D   \n");
+        ch = getch();
+		if (ch == 'q' || ch == 'Q') return 0;
+		device_set_keypress_char(ch);
+		replay_record_key(ch);
+    } while (ch != 'q' && ch != 'Q');
+    return 0;
+}
+
+/*****************************************************************
+ *
+ *  UART
+ *
+ *****************************************************************/
+
+static const char * uart_parity_names[] = { "none", "odd", "even" };
+
+static void display_uart_pin(const char * name, uint8_t pin) {
+    if (pin == UART_NO_PIN) { ui_temp_window_write("%s pin    = none\n", name); }
+    else { ui_temp_window_write("%s pin(%d) = %d\n", name, pin, hardware_get_gpio(pin)); }
+}
+
+int display_uart_state(int instance) {
+    int ch;
+    werase(temp_window);
+    display_uart_pin("tx", UART.tx);
+    display_uart_pin("rx", UART.rx);
+    ui_temp_window_write("%u baud, %u cycles per bit (sys clk %u, clkdiv %u)\n", UART.baud, UART.cycles_per_bit, UART.sys_clk, UART.clkdiv);
+    ui_temp_window_write("%u data bits, parity %s, %u stop bit%s, %u samples per bit\n", UART.bits, uart_parity_names[UART.parity],
+                         UART.stop_bits, UART.stop_bits > 1 ? "s" : "", UART.oversampling);
+    ui_temp_window_write("input  = %s\n", UART.input_file[0] ? UART.input_file : "none");
+    ui_temp_window_write("output = %s\n\n", UART.output_file[0] ? UART.output_file : "none");
+    ui_temp_window_write("receiving: %s", UART.receive.active ? "" : "idle\n");
+    if (UART.receive.active) { ui_temp_window_write("bit %u since cycle %u\n", UART.receive.bit, UART.receive.start); }
+    ui_temp_window_write("sending:   %s", UART.transmit.active ? "" : "idle\n");
+    if (UART.transmit.active) { ui_temp_window_write("bit %u since cycle %u\n", UART.transmit.bit, UART.transmit.start); }
+    ui_temp_window_write("\nreceived %u (last %03X), %u framing errors, %u parity errors, sent %u\n", UART.received, UART.last_byte,
+                         UART.framing_errors, UART.parity_errors, UART.sent);
+    ui_temp_window_write("error free throughput: %u bytes/s\n", device_uart_throughput());
+    ui_temp_window_write("\npress PF6 to step next instruction, 2-9 to run iterations, else q to exit\n");
+    ch = getch();
+    if ('2' <= ch && ch <= '9') return (ch - '0');
+    if (ch == KEY_F(6)) return 1;
+    return 0;
+}
+
+/*****************************************************************
+ *
+ *  I2C EEPROM
+ *
+ *****************************************************************/
+
+static const char * i2c_ee_phase_names[] = {
+    "idle", "receiving", "about to ack", "acking", "sending", "waiting on the controller's ack"
+};
+
+int display_i2c_eeprom_state(int instance) {
+    int ch, i, j;
+    werase(temp_window);
+    ui_temp_window_write("scl pin(%d) = %d%s\n", EEPROM.scl, hardware_get_gpio(EEPROM.scl), EE_STATE.stretch_until ? " (stretched)" : "");
+    ui_temp_window_write("sda pin(%d) = %d\n", EEPROM.sda, hardware_get_gpio(EEPROM.sda));
+    ui_temp_window_write("i2c address %02X, writes take %u cycles, stretches %u cycles\n", EEPROM.i2c_address, EEPROM.write_cycles,
+                         EEPROM.stretch_cycles);
+    ui_temp_window_write("state = %s, byte %d of the transaction (%s), bit %d\n", i2c_ee_phase_names[EE_STATE.phase], EE_STATE.byte_index,
+                         EE_STATE.reading ? "read" : "write", EE_STATE.bits);
+    ui_temp_window_write("address pointer = %04X\n", EE_STATE.address);
+    if (device_i2c_eeprom_busy()) { ui_temp_window_write("device is busy writing until cycle %u\n", EE_STATE.busy_until); }
+    else { ui_temp_window_write("device is idle\n"); }
+    ui_temp_window_write("bytes written %u, read %u\n", EEPROM.writes, EEPROM.reads);
+    ui_temp_window_write("eeprom contents (first %d bytes)%s:\n", I2C_EEPROM_DISPLAY_LINES * I2C_EEPROM_DISPLAY_LINE_SIZE,
+                         EEPROM.file[0] ? "" : ", erased after each build");
+    for (i=0; i < I2C_EEPROM_DISPLAY_LINES; i++) {
+        for (j=0; j < I2C_EEPROM_DISPLAY_LINE_SIZE; j++) {
+            ui_temp_window_write("%02X ", device_i2c_eeprom_peek(i*I2C_EEPROM_DISPLAY_LINE_SIZE + j));
+        }
+        ui_temp_window_write("\n");
+    }
+    ui_temp_window_write("\npress PF6 to step next instruction, 2-9 to run iterations, else q to exit\n");
+    ch = getch();
+    if ('2' <= ch && ch <= '9') return (ch - '0');
+    if (ch == KEY_F(6)) return 1;
+    return 0;
+}
+
+/*****************************************************************
+ *
+ *  WS2812
+ *
+ *****************************************************************/
+
+#define WS2812_DISPLAY_PIXELS 16
+
+int display_ws2812_state(int instance) {
+    int ch;
+    uint32_t i;
+    werase(temp_window);
+    ui_temp_window_write("data pin(%d) = %d\n", WS2812.pin, hardware_get_gpio(WS2812.pin));
+    ui_temp_window_write("%u pixels of %u bits, T0H %u ns, T1H %u ns (+/- %u), reset %u ns = %u cycles (sys clk %u, clkdiv %u)\n",
+                         WS2812.num_pixels, WS2812.bits_per_pixel, WS2812.t0h_ns, WS2812.t1h_ns, WS2812.tolerance_ns, WS2812.reset_ns,
+                         WS2812.reset_cycles, WS2812.sys_clk, WS2812.clkdiv);
+    ui_temp_window_write("frame file = %s\n\n", WS2812.file[0] ? WS2812.file : "none");
+    if (WS2812.latched) { ui_temp_window_write("receiving: idle (latched)\n"); }
+    else { ui_temp_window_write("receiving: pixel %u, bit %u\n", WS2812.index, WS2812.bits); }
+    ui_temp_window_write("frames %u (last of %u pixels, %u beyond the strip), %u frames/s, %u on average\n", WS2812.frames,
+                         WS2812.frame_pixels, WS2812.overflow_pixels, device_ws2812_frame_rate(), device_ws2812_average_frame_rate());
+    ui_temp_window_write("violations: %u high pulses, %u lows, %u partial pixels", WS2812.high_violations, WS2812.low_violations,
+                         WS2812.partial_pixels);
+    if (WS2812.high_violations || WS2812.low_violations || WS2812.partial_pixels) {
+        ui_temp_window_write(" (last at cycle %u)", WS2812.last_violation);
+    }
+    ui_temp_window_write("\nframebuffer (first %d pixels):\n", WS2812_DISPLAY_PIXELS);
+    for (i=0; i < WS2812_DISPLAY_PIXELS && i < WS2812.num_pixels; i++) {
+        ui_temp_window_write(WS2812.bits_per_pixel == 24 ? "%06X " : "%08X ", device_ws2812_pixel(i));
+        if (i % 8 == 7) { ui_temp_window_write("\n"); }
+    }
+    ui_temp_window_write("\npress PF6 to step next instruction, 2-9 to run iterations, else q to exit\n");
+    ch = getch();
+    if ('2' <= ch && ch <= '9') return (ch - '0');
+    if (ch == KEY_F(6)) return 1;
+    return 0;
+}
+
+/*****************************************************************
+ *
+ *  PLUGINS
+ *
+ *****************************************************************/
+
+#define PLUGIN_DISPLAY_MAX 4096
+
+int display_plugin_state(int instance) {
+    char text[PLUGIN_DISPLAY_MAX];
+    int ch;
+    werase(temp_window);
+    if (device_plugin_display(instance, text, sizeof(text)) < 0) return 0;
+    ui_temp_window_write("%s", text);
+    ui_temp_window_write("\npress PF6 to step next instruction, 2-9 to run iterations, else q to exit\n");
+    ch = getch();
+    if ('2' <= ch && ch <= '9') return (ch - '0');
+    if (ch == KEY_F(6)) return 1;
+    return 0;
+}
+
+/*****************************************************************
+ *
+ *  LOOKUP
+ *
+ *****************************************************************/
+
+typedef struct {
+    char *                    name;
+    device_display_handler_t  handler;
+} device_display_t;
+
+static device_display_t device_displays[] = {
+    { "spi flash", display_spi_flash_state },
+    { "keypad",    display_keypad_state },
+    { "uart",      display_uart_state },
+    { "i2c eeprom", display_i2c_eeprom_state },
+    { "ws2812",    display_ws2812_state },
+};
+
+#define NUM_DEVICE_DISPLAYS (sizeof(device_displays) / sizeof(device_displays[0]))
+
+device_display_handler_t device_display_handler(const hardware_device_t * device) {
+    int i;
+    if (device->execution_handler == device_plugin_run) {
+        return (device_plugin_display(device->instance, NULL, 0) >= 0) ? display_plugin_state : NULL;
+    }
+    for (i=0; i<NUM_DEVICE_DISPLAYS; i++) {
+        if (!strcmp(device_displays[i].name, device->name)) return device_displays[i].handler;
+    }
+    return NULL;
+}
@@ -0,0 +1,296 @@
+/*!
+ * @file /device_i2c_eeprom.c
+ * @brief Simulated I2C EEPROM device (24C256 style)
+ * @details
+ * See device_i2c_eeprom.h. As all simulated devices in Simpio, once enabled, this exposes an execution function that is called
+ * by the Simpio execution engine (see execution.c), here whenever scl or sda change, or a clock stretch it started ends.
+ *
+ * sda changing while scl is high is a start (falling) or stop (rising) condition. Otherwise bits are sampled on the rising
+ * edge of scl and the device changes sda (its ack, or the bits of a byte it sends) just after the falling edge, as the
+ * controller only looks at sda while scl is high. The device never drives its pins high, it only stops pulling them low.
+ *
+ * A write transaction is the device address, the two memory address bytes (the top bit ignored) and the data bytes, which
+ * go to a page buffer, wrapping around within the page, and are stored at the stop condition. A read transaction sends
+ * from the memory address pointer on, wrapping around at the end of the memory, until the controller does not ack a byte.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "device_i2c_eeprom.h"
+#include "hardware.h"
+#include "execution.h"
+#include "print.h"
+#include "context.h"
+
+#define EEPROM      (simpio_context->i2c_eeprom)
+#define EE_STATE    (EEPROM.state)
+#define STORAGE     (simpio_context->i2c_eeprom_storage)
+
+#define ADDRESS_MASK (I2C_EEPROM_SIZE - 1)
+
+/*****************************************************************
+ *
+ *  CONFIGURATION
+ *
+ *****************************************************************/
+
+void run_i2c_eeprom(int instance);
+
+void device_i2c_eeprom_reset() {
+    memset(&EEPROM, 0, sizeof(i2c_eeprom_device_t));
+    EEPROM.scl = EEPROM.sda = I2C_EEPROM_NO_PIN;
+    EEPROM.device = -1;
+}
+
+bool device_enable_i2c_eeprom(uint8_t scl_pin, uint8_t sda_pin, uint8_t i2c_address) {
+    if (scl_pin >= NUM_GPIOS || sda_pin >= NUM_GPIOS || scl_pin == sda_pin || i2c_address > 0x7F) {
+        PRINT("i2c eeprom: expected two different scl and sda pins (0-31) and a 7 bit address\n");
+        return false;
+    }
+    PRINTI("enabling i2c eeprom\n");
+    device_i2c_eeprom_reset();
+    EEPROM.scl = scl_pin;
+    EEPROM.sda = sda_pin;
+    EEPROM.i2c_address = i2c_address;
+    EEPROM.write_cycles = I2C_EEPROM_DEFAULT_WRITE_CYCLES;
+    hardware_set_open_drain(scl_pin, 1, 0);
+    hardware_set_open_drain(sda_pin, 1, 0);
+    EEPROM.device = hardware_register_device("i2c eeprom", true, run_i2c_eeprom, 0, (1u << scl_pin) | (1u << sda_pin));
+    return true;
+}
+
+void device_i2c_eeprom_set_timing(uint32_t write_cycles, uint32_t stretch_cycles) {
+    EEPROM.write_cycles = write_cycles;
+    EEPROM.stretch_cycles = stretch_cycles;
+}
+
+void device_i2c_eeprom_set_file(const char * file_name) {
+    snprintf(EEPROM.file, I2C_EEPROM_FILE_NAME_MAX, "%s", file_name);
+}
+
+/*****************************************************************
+ *
+ *  STORAGE
+ *
+ *****************************************************************/
+
+void device_i2c_eeprom_storage_free(i2c_eeprom_storage_t * storage) {
+    if (storage->data) munmap(storage->data, I2C_EEPROM_SIZE);
+    memset(storage, 0, sizeof(i2c_eeprom_storage_t));
+}
+
+/* the file is extended to the size of the eeprom with erased (0xFF) bytes, if shorter */
+static uint8_t * map_file(const char * file_name) {
+    static uint8_t erased[I2C_EEPROM_PAGE_SIZE];
+    struct stat file_stat;
+    uint8_t * data = NULL;
+    off_t size;
+    int fd;
+    memset(erased, 0xFF, sizeof(erased));
+    fd = open(file_name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        PRINT("unable to open i2c eeprom file %s\n", file_name);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    for (size = file_stat.st_size; size < I2C_EEPROM_SIZE; size += I2C_EEPROM_PAGE_SIZE - size % I2C_EEPROM_PAGE_SIZE) {
+        if (pwrite(fd, erased, I2C_EEPROM_PAGE_SIZE - size % I2C_EEPROM_PAGE_SIZE, size) < 0) break;
+    }
+    if (size >= I2C_EEPROM_SIZE) data = mmap(NULL, I2C_EEPROM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED || data == NULL) {
+        PRINT("unable to map i2c eeprom file %s\n", file_name);
+        return NULL;
+    }
+    return data;
+}
+
+static bool map_storage() {
+    uint8_t * data;
+    device_i2c_eeprom_storage_free(&STORAGE);
+    if (EEPROM.file[0]) {
+        STORAGE.data = map_file(EEPROM.file);
+        STORAGE.shared = (STORAGE.data != NULL);
+        if (STORAGE.data) return true;
+        PRINT("the i2c eeprom starts erased instead\n");
+    }
+    data = mmap(NULL, I2C_EEPROM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        PRINT("not enough memory for the i2c eeprom\n");
+        return false;
+    }
+    memset(data, 0xFF, I2C_EEPROM_SIZE);
+    STORAGE.data = data;
+    return true;
+}
+
+uint8_t device_i2c_eeprom_peek(uint16_t address) {
+    if (!STORAGE.data) return 0xFF;
+    return STORAGE.data[address & ADDRESS_MASK];
+}
+
+// the page buffer goes to memory, after which the device is busy for a while
+static void store_page() {
+    uint16_t page_start = EE_STATE.address & ~(I2C_EEPROM_PAGE_SIZE - 1);
+    int i;
+    if (!EE_STATE.page_written) return;
+    for (i = 0; i < I2C_EEPROM_PAGE_SIZE; i++) {
+        if ((EE_STATE.page_written & (1ull << i)) && STORAGE.data) STORAGE.data[page_start + i] = EE_STATE.page[i];
+    }
+    EE_STATE.page_written = 0;
+    EE_STATE.busy_until = exec_cycle() + EEPROM.write_cycles;
+    PRINTI("i2c eeprom: writing page %04X until cycle %u\n", page_start, EE_STATE.busy_until);
+}
+
+/*****************************************************************
+ *
+ *  RUNNING
+ *
+ *****************************************************************/
+
+void device_i2c_eeprom_restart() {
+    if (EEPROM.scl == I2C_EEPROM_NO_PIN) return;
+    map_storage();
+    memset(&EE_STATE, 0, sizeof(i2c_ee_state_t));
+    EEPROM.writes = EEPROM.reads = 0;
+    hardware_pull_gpio_low(EEPROM.scl, false);
+    hardware_pull_gpio_low(EEPROM.sda, false);
+    EE_STATE.last_scl = hardware_get_gpio(EEPROM.scl);
+    EE_STATE.last_sda = hardware_get_gpio(EEPROM.sda);
+}
+
+bool device_i2c_eeprom_busy() {
+    return exec_cycle() < EE_STATE.busy_until;
+}
+
+// a whole byte came in (on the rising edge of its 8th clock): decide on the ack, and what it means
+static void received_byte() {
+    uint8_t byte = EE_STATE.shift;
+    EE_STATE.ack = true;
+    switch (EE_STATE.byte_index) {
+        case 0:
+            EE_STATE.ack = ((byte >> 1) == EEPROM.i2c_address) && !device_i2c_eeprom_busy();
+            EE_STATE.reading = byte & 1;
+            break;
+        case 1:
+            EE_STATE.address = (EE_STATE.address & 0x00FF) | ((uint16_t) byte << 8);
+            break;
+        case 2:
+            EE_STATE.address = ((EE_STATE.address & 0xFF00) | byte) & ADDRESS_MASK;
+            EE_STATE.page_written = 0;
+            break;
+        default:
+            EE_STATE.page[EE_STATE.address % I2C_EEPROM_PAGE_SIZE] = byte;
+            EE_STATE.page_written |= (1ull << (EE_STATE.address % I2C_EEPROM_PAGE_SIZE));
+            // wraps around within the page
+            EE_STATE.address = (EE_STATE.address & ~(I2C_EEPROM_PAGE_SIZE - 1)) | ((EE_STATE.address + 1) % I2C_EEPROM_PAGE_SIZE);
+            EEPROM.writes++;
+            break;
+    }
+    if (EE_STATE.byte_index < 0xFF) EE_STATE.byte_index++;
+    EE_STATE.phase = i2c_ee_acking;
+}
+
+static void send_next_byte() {
+    EE_STATE.shift = device_i2c_eeprom_peek(EE_STATE.address);
+    EE_STATE.address = (EE_STATE.address + 1) & ADDRESS_MASK;
+    EE_STATE.bits = 0;
+    EE_STATE.phase = i2c_ee_sending;
+    EEPROM.reads++;
+    hardware_pull_gpio_low(EEPROM.sda, !(EE_STATE.shift & 0x80));
+}
+
+static void scl_rising(bool sda) {
+    switch (EE_STATE.phase) {
+        case i2c_ee_receiving:
+            EE_STATE.shift = (EE_STATE.shift << 1) | sda;
+            if (++EE_STATE.bits == 8) received_byte();
+            break;
+        case i2c_ee_controller_ack:
+            EE_STATE.ack = !sda;
+            break;
+        default:
+            break;
+    }
+}
+
+static void scl_falling() {
+    switch (EE_STATE.phase) {
+        case i2c_ee_acking:
+            if (!EE_STATE.ack) {
+                EE_STATE.phase = i2c_ee_idle;   // not for this device (or busy), until the next start
+                break;
+            }
+            hardware_pull_gpio_low(EEPROM.sda, true);
+            EE_STATE.phase = i2c_ee_holding_ack;
+            break;
+        case i2c_ee_holding_ack:
+            hardware_pull_gpio_low(EEPROM.sda, false);
+            if (EEPROM.stretch_cycles) {
+                hardware_pull_gpio_low(EEPROM.scl, true);
+                EE_STATE.stretch_until = exec_cycle() + EEPROM.stretch_cycles;
+            }
+            if (EE_STATE.reading) send_next_byte();
+            else {
+                EE_STATE.phase = i2c_ee_receiving;
+                EE_STATE.bits = 0;
+                EE_STATE.shift = 0;
+            }
+            break;
+        case i2c_ee_sending:
+            if (++EE_STATE.bits < 8) hardware_pull_gpio_low(EEPROM.sda, !((EE_STATE.shift << EE_STATE.bits) & 0x80));
+            else {
+                hardware_pull_gpio_low(EEPROM.sda, false);
+                EE_STATE.phase = i2c_ee_controller_ack;
+            }
+            break;
+        case i2c_ee_controller_ack:
+            if (EE_STATE.ack) send_next_byte();
+            else EE_STATE.phase = i2c_ee_idle;
+            break;
+        default:
+            break;
+    }
+}
+
+static void start_condition() {
+    PRINTI("i2c eeprom: start\n");
+    hardware_pull_gpio_low(EEPROM.sda, false);
+    EE_STATE.phase = i2c_ee_receiving;
+    EE_STATE.byte_index = 0;
+    EE_STATE.bits = 0;
+    EE_STATE.shift = 0;
+}
+
+static void stop_condition() {
+    PRINTI("i2c eeprom: stop\n");
+    hardware_pull_gpio_low(EEPROM.sda, false);
+    if (!EE_STATE.reading && EE_STATE.byte_index > 3) store_page();
+    EE_STATE.page_written = 0;
+    EE_STATE.phase = i2c_ee_idle;
+}
+
+void run_i2c_eeprom(int instance) {
+    bool scl, sda;
+    if (EE_STATE.stretch_until && exec_cycle() >= EE_STATE.stretch_until) {
+        EE_STATE.stretch_until = 0;
+        hardware_pull_gpio_low(EEPROM.scl, false);      // which may be the rising edge of scl the controller was waiting for
+    }
+    scl = hardware_get_gpio(EEPROM.scl);
+    sda = hardware_get_gpio(EEPROM.sda);
+    if (scl && EE_STATE.last_scl && sda != EE_STATE.last_sda) {
+        if (sda) stop_condition();
+        else start_condition();
+    }
+    else if (scl && !EE_STATE.last_scl) scl_rising(sda);
+    else if (!scl && EE_STATE.last_scl) scl_falling();
+    if (EE_STATE.stretch_until) hardware_device_wake_at(EEPROM.device, EE_STATE.stretch_until);
+    EE_STATE.last_scl = hardware_get_gpio(EEPROM.scl);
+    EE_STATE.last_sda = hardware_get_gpio(EEPROM.sda);
+}
@@ -0,0 +1,259 @@
+/*!
+ * @file /device_plugin.c
+ * @brief Simulated devices loaded from shared libraries
+ * @details
+ * See device_plugin.h and simpio_plugin.h. Every instance holds its own reference to its library (dlopen counts them), so a
+ * library stays loaded as long as any context has an instance of it. The host services act on the current context, with
+ * PLUGINS.current telling wake_at which instance is asking.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <dlfcn.h>
+#include "device_plugin.h"
+#include "hardware.h"
+#include "execution.h"
+#include "print.h"
+#include "context.h"
+
+#define PLUGINS (simpio_context->plugins)
+#define PLUGIN_PRINT_MAX 256
+
+/*****************************************************************
+ *
+ *  HOST SERVICES
+ *
+ *****************************************************************/
+
+static bool host_get_gpio(uint8_t gpio) { return hardware_get_gpio(gpio); }
+static void host_set_gpio(uint8_t gpio, bool value) { hardware_set_gpio(gpio, value); }
+static uint32_t host_get_gpios(uint32_t mask) { return hardware_get_gpios(mask); }
+static uint32_t host_cycle() { return exec_cycle(); }
+
+static void host_wake_at(uint32_t cycle) {
+    if (PLUGINS.current < 0 || PLUGINS.current >= PLUGINS.count) return;
+    hardware_device_wake_at(PLUGINS.instances[PLUGINS.current].device, cycle);
+}
+
+static void host_print(const char * format, ...) {
+    char text[PLUGIN_PRINT_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    PRINT("%s", text);
+}
+
+static const simpio_host_services_t host_services = {
+    SIMPIO_DEVICE_ABI_VERSION, host_get_gpio, host_set_gpio, host_get_gpios, host_cycle, host_wake_at, host_print
+};
+
+/*****************************************************************
+ *
+ *  INSTANCES
+ *
+ *****************************************************************/
+
+static void instance_free(device_plugin_instance_t * instance) {
+    if (instance->state && instance->plugin && instance->plugin->destroy) instance->plugin->destroy(instance->state);
+    free(instance->state);
+    free(instance->saved);
+    if (instance->library) dlclose(instance->library);
+    memset(instance, 0, sizeof(device_plugin_instance_t));
+}
+
+static device_plugin_instance_t * instance_add(device_plugins_t * plugins) {
+    device_plugin_instance_t * grown;
+    int allocated;
+    if (plugins->count == plugins->allocated) {
+        allocated = plugins->allocated ? 2 * plugins->allocated : 4;
+        grown = realloc(plugins->instances, allocated * sizeof(device_plugin_instance_t));
+        if (!grown) return NULL;
+        plugins->instances = grown;
+        plugins->allocated = allocated;
+    }
+    memset(&(plugins->instances[plugins->count]), 0, sizeof(device_plugin_instance_t));
+    return &(plugins->instances[plugins->count++]);
+}
+
+// a reference to the library and its description, checked against the ABI version; NULL (after printing why) if not usable
+static const simpio_device_plugin_t * open_plugin(const char * file_name, void ** library) {
+    simpio_device_plugin_entry_t entry;
+    const simpio_device_plugin_t * plugin;
+    *library = dlopen(file_name, RTLD_NOW | RTLD_LOCAL);
+    if (!*library) {
+        PRINT("could not load device plugin %s: %s\n", file_name, dlerror());
+        return NULL;
+    }
+    entry = (simpio_device_plugin_entry_t) dlsym(*library, SIMPIO_DEVICE_PLUGIN_ENTRY);
+    plugin = entry ? entry() : NULL;
+    if (!plugin) {
+        PRINT("%s is not a device plugin (no %s)\n", file_name, SIMPIO_DEVICE_PLUGIN_ENTRY);
+    }
+    else if (plugin->abi_version != SIMPIO_DEVICE_ABI_VERSION) {
+        PRINT("device plugin %s is for ABI version %u, not %u\n", file_name, plugin->abi_version, SIMPIO_DEVICE_ABI_VERSION);
+        plugin = NULL;
+    }
+    else if (!plugin->init || !plugin->execute) {
+        PRINT("device plugin %s has no %s function\n", file_name, plugin->init ? "execute" : "init");
+        plugin = NULL;
+    }
+    if (!plugin) {
+        dlclose(*library);
+        *library = NULL;
+    }
+    return plugin;
+}
+
+/*****************************************************************
+ *
+ *  CONFIGURATION
+ *
+ *****************************************************************/
+
+bool device_plugin_load(const char * file_name, const char * config) {
+    device_plugin_instance_t * instance;
+    char name[SYMBOL_MAX];
+    uint32_t sensitivity = SIMPIO_SENSITIVE_ALWAYS;
+    bool ok;
+    instance = instance_add(&PLUGINS);
+    if (!instance) {
+        PRINT("out of memory loading device plugin %s\n", file_name);
+        return false;
+    }
+    snprintf(instance->file_name, DEVICE_PLUGIN_FILE_NAME_MAX, "%s", file_name);
+    instance->plugin = open_plugin(file_name, &(instance->library));
+    if (instance->plugin) instance->state = calloc(1, instance->plugin->state_size ? instance->plugin->state_size : 1);
+    if (!instance->state) {
+        if (instance->plugin) { PRINT("out of memory loading device plugin %s\n", file_name); }
+        instance->plugin = NULL;
+        if (instance->library) dlclose(instance->library);
+        PLUGINS.count--;
+        return false;
+    }
+    snprintf(name, SYMBOL_MAX, "%s %d", instance->plugin->name, PLUGINS.count - 1);
+    instance->device = hardware_register_device(name, true, device_plugin_run, PLUGINS.count - 1, SIMPIO_SENSITIVE_ALWAYS);
+    if (instance->device < 0) {
+        PRINT("device plugin %s not loaded: a simulation has at most %d devices, plugin instances included\n", file_name, MAX_DEVICES);
+        return false;   // the instance is dropped with the rest of the parse
+    }
+    PLUGINS.current = PLUGINS.count - 1;
+    ok = instance->plugin->init(instance->state, config ? config : "", &host_services, &sensitivity);
+    PLUGINS.current = -1;
+    if (!ok) {
+        PRINT("device plugin %s not configured\n", file_name);
+        return false;   // the instance is dropped with the rest of the parse
+    }
+    hardware_device_set_sensitivity(instance->device, sensitivity);
+    PRINTI("device plugin %s loaded as %s\n", file_name, name);
+    return true;
+}
+
+void device_plugin_reset_all() {
+    device_plugins_free(&PLUGINS);
+}
+
+/*****************************************************************
+ *
+ *  RUNNING
+ *
+ *****************************************************************/
+
+void device_plugin_run(int instance) {
+    if (instance < 0 || instance >= PLUGINS.count || !PLUGINS.instances[instance].plugin) return;
+    PLUGINS.current = instance;
+    PLUGINS.instances[instance].plugin->execute(PLUGINS.instances[instance].state);
+    PLUGINS.current = -1;
+}
+
+int device_plugin_display(int instance, char * text, size_t size) {
+    device_plugin_instance_t * i;
+    if (instance < 0 || instance >= PLUGINS.count) return -1;
+    i = &(PLUGINS.instances[instance]);
+    if (!i->plugin || !i->plugin->display) return -1;
+    return i->plugin->display(i->state, text, size);
+}
+
+/*****************************************************************
+ *
+ *  CONTEXTS
+ *
+ *****************************************************************/
+
+/* through to's buffer, which is grown (to twice what is needed, so copy_running has room as the state grows) if allowed */
+static bool copy_state(device_plugin_instance_t * to, const device_plugin_instance_t * from, bool grow) {
+    const simpio_device_plugin_t * plugin = from->plugin;
+    void * buffer;
+    size_t size;
+    if (!plugin->save || !plugin->restore) {
+        memcpy(to->state, from->state, plugin->state_size);
+        return true;
+    }
+    size = plugin->save(from->state, NULL, 0);
+    if (size > to->saved_size || !to->saved) {
+        if (!grow) return false;
+        buffer = malloc(size ? 2 * size : 1);
+        if (!buffer) return false;
+        free(to->saved);
+        to->saved = buffer;
+        to->saved_size = size ? 2 * size : 1;
+    }
+    if (plugin->destroy) plugin->destroy(to->state);
+    memset(to->state, 0, plugin->state_size);
+    return plugin->restore(to->state, to->saved, plugin->save(from->state, to->saved, size));
+}
+
+bool device_plugin_copy(device_plugins_t * to, const device_plugins_t * from) {
+    device_plugin_instance_t * t;
+    const device_plugin_instance_t * f;
+    int i;
+    bool ok = true;
+    if (to == from) return true;
+    // the instances already there are kept if they are of the same plugin, as when the running state is copied again and again
+    for (i = from->count; i < to->count; i++) instance_free(&(to->instances[i]));
+    if (to->count > from->count) to->count = from->count;
+    for (i = 0; i < from->count; i++) {
+        f = &(from->instances[i]);
+        if (i == to->count && !instance_add(to)) return false;
+        t = &(to->instances[i]);
+        if (t->plugin != f->plugin) {
+            instance_free(t);
+            if (!f->plugin) continue;
+            t->library = dlopen(f->file_name, RTLD_NOW | RTLD_LOCAL);
+            t->state = calloc(1, f->plugin->state_size ? f->plugin->state_size : 1);
+            if (!t->library || !t->state) {
+                instance_free(t);
+                ok = false;
+                continue;
+            }
+            t->plugin = f->plugin;
+            memcpy(t->file_name, f->file_name, DEVICE_PLUGIN_FILE_NAME_MAX);
+        }
+        t->device = f->device;
+        if (t->plugin && !copy_state(t, f, true)) ok = false;
+    }
+    to->current = -1;
+    return ok;
+}
+
+bool device_plugin_copy_running(device_plugins_t * to, const device_plugins_t * from) {
+    int i;
+    bool ok = true;
+    if (to == from) return true;
+    for (i = 0; i < from->count && i < to->count; i++) {
+        if (to->instances[i].plugin != from->instances[i].plugin || !from->instances[i].plugin) continue;
+        if (!copy_state(&(to->instances[i]), &(from->instances[i]), false)) ok = false;
+    }
+    return ok;
+}
+
+void device_plugins_free(device_plugins_t * plugins) {
+    int i;
+    for (i = 0; i < plugins->count; i++) instance_free(&(plugins->instances[i]));
+    free(plugins->instances);
+    memset(plugins, 0, sizeof(device_plugins_t));
+    plugins->current = -1;
+}
@@ -4,16 +4,21 @@
  * @details
  * This implements a very small subset of the API of the Winbond family of SPI flash devices (e.g., W25Q128JVSIQ).
  * As all simulated devices in Simpio, once enabled, this exposes a state machine execution function that is called
- * periodically by the Simpio execution engine (see execution.c). Each time this function is called, it looks at the status
+ * by the Simpio execution engine (see execution.c) whenever its clk or cs pin changes, or it stops being busy. Each time this function is called, it looks at the status
  * of the simulated input GPIO lines that it is configured to use, and updates its internal state and possible fiddles the state of
  * output GPIO lines that it is configured to use. 
  *
- * The only Winbond commands supported are those defined below in the #defines.
+ * The only Winbond commands supported are those defined below in the #defines. Reads can be single, dual or quad output (the
+ * latter two after 8 dummy clocks, like fast read), page programs wrap within their 256 byte page and can only clear bits, and
+ * programs and erases need write enable and keep the device busy for a number of cycles afterwards (see spif_busy_cycles_t).
  *
  * Most of the state machine processing is shifting bits in and out. Once a command is completely shifted in, then that command
  * is executed immediately, but a programmed delay can be simulated before the device declares itself ready for the next command.
  *
- * There is a rudimentary UI programmed using the temp_window from ui.c. This allows a user to step through instructions while leaving
+ * The storage (see device_spi_flash.h) is a reserved, private 16MB mapping: sectors are materialized (filled with 0xFF) when first
+ * programmed, erasing one gives its pages back, and an image file is mapped over the start of it copy on write.
+ *
+ * There is a rudimentary UI programmed using the temp_window from ui.c (see device_display.c). This allows a user to step through instructions while leaving
  * the temp window up. This makes it easier to see the progress of bits being shifted into and outof the simulated device. That is, one
  * can watch the device execute, as its internal state is updated in response to what the PIO program is doing.
  * 
@@ -21,59 +26,40 @@
  */
 
 
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "device_spi_flash.h"
 #include "hardware.h"
 #include "print.h"
-#include "ui.h"
+#include "execution.h"
+#include "context.h"
 
-#define BYTE_RECEIVED (spif_state.shift_count == 8)
-#define BYTE_SENT     (spif_state.shift_count == 8)
+#define BYTE_RECEIVED (SPIF_STATE.shift_count == 8)
+#define BYTE_SENT     (SPIF_STATE.shift_count == 8)
 
 #define FLASH_CMD_PAGE_PROGRAM               0x02
 #define FLASH_CMD_READ                       0x03
 #define FLASH_CMD_STATUS                     0x05
 #define FLASH_CMD_WRITE_EN                   0x06
+#define FLASH_CMD_FAST_READ                  0x0B
 #define FLASH_CMD_SECTOR_ERASE               0x20
+#define FLASH_CMD_DUAL_OUTPUT_READ           0x3B
+#define FLASH_CMD_QUAD_OUTPUT_READ           0x6B
 #define FLASH_CMD_READ_MANUFACTURER_ID       0X90
-
-static uint spif_clk, spif_tx, spif_rx, spif_cs;
-
-typedef enum { spif_idle, spif_getting_cmd, spif_getting_addr1, spif_getting_addr2, spif_getting_addr3, spif_programming, spif_reading, spif_writing_response, spif_processing_cmd, spif_done } spif_state_e;
-
-typedef enum { spif_mode_0, spif_mode_3 } spif_mode_e;
-
-typedef enum {spif_shift_waiting_on_clk_low_then_high, spif_shift_waiting_on_clk_high, spif_shift_waiting_on_clk_high_then_low, spif_shift_waiting_on_clk_low } spif_shift_state_e;
+#define FLASH_CMD_CHIP_ERASE                 0xC7
+#define FLASH_CMD_BLOCK_ERASE                0xD8
 
 static uint8_t spif_id[] = { 0xAB, 0XCD };
 
-static uint8_t spif_storage[SPI_FLASH_SIZE];
-
-typedef struct {
-    spif_state_e        state;
-    spif_mode_e         mode;
-    spif_shift_state_e  shift_state;
-    uint8_t             cmd;
-    uint8_t             prev_cmd;
-    uint8_t             addr1;
-    uint8_t             addr2;
-    uint8_t             addr3;
-    uint8_t             status_register_1;
-    uint32_t            addr;
-    uint8_t             response_byte;
-    uint8_t             program_byte;
-    uint8_t             shift_count;
-    uint32_t            num_bytes;
-    uint32_t            bytes_responded;
-    uint32_t            bytes_received;
-    uint32_t            byte_index;
-    uint32_t            delay;                  // will report busy until this many times called
-    uint8_t *           data_ptr;
-    bool                last_clk;
-    bool                busy;                   // bit 0 of status register 1
-    bool                write_enable_latch;     // bit 1 of status register 1
-} spif_state_t;
-
-static spif_state_t spif_state;
+#define SPIF        (simpio_context->spi_flash)
+#define SPIF_STATE  (SPIF.state)
+#define STORAGE     (simpio_context->spi_flash_storage)
+
+#define SECTOR_IS_MATERIALIZED(sector) (STORAGE.sectors[(sector) / 8] & (1 << ((sector) % 8)))
 
 /*****************************************************************
  *
@@ -82,151 +68,252 @@ static spif_state_t spif_state;
  *****************************************************************/
                 
 void spif_shift_in_next_bit(uint8_t * byte) {
-    bool clk = hardware_get_gpio(spif_clk);
-    switch (spif_state.shift_state) {
+    bool clk = hardware_get_gpio(SPIF.clk);
+    switch (SPIF_STATE.shift_state) {
          case spif_shift_waiting_on_clk_low_then_high:
-            if (!clk) spif_state.shift_state = spif_shift_waiting_on_clk_high;
+            if (!clk) SPIF_STATE.shift_state = spif_shift_waiting_on_clk_high;
             break;
         case spif_shift_waiting_on_clk_high:
             if (clk) {
                 *byte = *byte << 1;
-                *byte = *byte + hardware_get_gpio(spif_tx);
-                spif_state.shift_count++;
-                spif_state.shift_state = spif_shift_waiting_on_clk_low_then_high;
+                *byte = *byte + hardware_get_gpio(SPIF.tx);
+                SPIF_STATE.shift_count++;
+                SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low_then_high;
             }
             break;            
     };
 }
 
-void spif_shift_out_next_bit(uint8_t * byte) {
-    bool clk = hardware_get_gpio(spif_clk);
-    switch (spif_state.shift_state) {
+// io0 is tx and io1 is rx; dual and quad output put the most significant bit of each clock on io1 or io3
+static uint spif_io_pin(uint8_t io) {
+    switch (io) {
+        case 0:  return SPIF.tx;
+        case 1:  return SPIF.rx;
+        case 2:  return SPIF.io2;
+        default: return SPIF.io3;
+    };
+}
+
+void spif_shift_out_next_bits(uint8_t * byte, uint8_t width) {
+    bool clk = hardware_get_gpio(SPIF.clk);
+    uint8_t io;
+    switch (SPIF_STATE.shift_state) {
         case spif_shift_waiting_on_clk_high_then_low:
-            if (clk) spif_state.shift_state = spif_shift_waiting_on_clk_low;
+            if (clk) SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low;
             break;
         case spif_shift_waiting_on_clk_low:
             if (!clk) {
-                if (*byte & 0x80) hardware_set_gpio(spif_rx, 1);
-                else hardware_set_gpio(spif_rx, 0);
-                *byte = *byte << 1;
-                spif_state.shift_count++;
-                spif_state.shift_state = spif_shift_waiting_on_clk_high_then_low;
+                if (width == 1) hardware_set_gpio(SPIF.rx, (*byte & 0x80) != 0);
+                else for (io = 0; io < width; io++) hardware_set_gpio(spif_io_pin(io), (*byte >> (8 - width + io)) & 1);
+                *byte = *byte << width;
+                SPIF_STATE.shift_count += width;
+                SPIF_STATE.shift_state = spif_shift_waiting_on_clk_high_then_low;
             }
             break;            
     };
 }
+
+void spif_shift_out_next_bit(uint8_t * byte) {
+    spif_shift_out_next_bits(byte, 1);
+}
     
 uint32_t spif_get_addr() {
     uint32_t addr;
-    addr = spif_state.addr1;
-    addr = (addr << 8) + spif_state.addr2;
-    addr = (addr << 8) + spif_state.addr3;
+    addr = SPIF_STATE.addr1;
+    addr = (addr << 8) + SPIF_STATE.addr2;
+    addr = (addr << 8) + SPIF_STATE.addr3;
+    return addr;
 }
 
 void spif_reset_for_next_cmd() {
-   spif_state.prev_cmd   = spif_state.cmd;
-   spif_state.cmd   = 0;
-   spif_state.addr1 = 0;
-   spif_state.addr2 = 0;
-   spif_state.addr3 = 0;
-   spif_state.addr  = 0;
-   spif_state.response_byte = 0;
-   spif_state.program_byte = 0;
-   spif_state.shift_count = 0;
-   spif_state.bytes_responded = 0;
-   spif_state.bytes_received = 0;
-   spif_state.byte_index = 0;
-   spif_state.data_ptr = NULL;
+   SPIF_STATE.prev_cmd   = SPIF_STATE.cmd;
+   SPIF_STATE.cmd   = 0;
+   SPIF_STATE.addr1 = 0;
+   SPIF_STATE.addr2 = 0;
+   SPIF_STATE.addr3 = 0;
+   SPIF_STATE.addr  = 0;
+   SPIF_STATE.response_byte = 0;
+   SPIF_STATE.program_byte = 0;
+   SPIF_STATE.shift_count = 0;
+   SPIF_STATE.bytes_responded = 0;
+   SPIF_STATE.bytes_received = 0;
+   SPIF_STATE.byte_index = 0;
+   SPIF_STATE.data_ptr = NULL;
 }
 
-    
+
 /*****************************************************************
  *
- *  SPI FLASH DEVICE MANAGEMENT (HANDLERS, ETC.)
+ *  SPI FLASH STORAGE
  *
  *****************************************************************/
-                
-void spif_sm();
 
-int display_spi_flash_state() {
-    int ch, i,j;
-    werase(temp_window);
-    ui_temp_window_write("clk pin(%d) = %d\n", spif_clk, hardware_get_gpio(spif_clk));
-    ui_temp_window_write("tx  pin(%d) = %d\n", spif_tx, hardware_get_gpio(spif_tx));
-    ui_temp_window_write("rx  pin(%d) = %d\n", spif_rx, hardware_get_gpio(spif_rx));
-    ui_temp_window_write("cs  pin(%d) = %d\n", spif_cs, hardware_get_gpio(spif_cs));
-    ui_temp_window_write("state  = ");
-    switch(spif_state.state) {
-        case spif_idle:             ui_temp_window_write("idle\n");                     break;
-        case spif_getting_cmd:      ui_temp_window_write("getting command\n");          break;
-        case spif_getting_addr1:    ui_temp_window_write("getting address byte 1\n");   break;
-        case spif_getting_addr2:    ui_temp_window_write("getting address byte 2\n");   break;
-        case spif_getting_addr3:    ui_temp_window_write("getting address byte 3\n");   break;
-        case spif_programming:      ui_temp_window_write("writing data\n");             break;
-        case spif_reading:          ui_temp_window_write("reading data\n");             break;
-        case spif_writing_response: ui_temp_window_write("writing response\n");         break;
-        case spif_processing_cmd:   ui_temp_window_write("processing command\n");       break;
-        case spif_done:             ui_temp_window_write("done\n");       break;
-    };
-    switch (spif_state.shift_state) {
-        case spif_shift_waiting_on_clk_low_then_high: ui_temp_window_write("waiting on clk low then high");  break;
-        case spif_shift_waiting_on_clk_high:          ui_temp_window_write("waiting on clk high");           break;
-        case spif_shift_waiting_on_clk_high_then_low: ui_temp_window_write("waiting on clk high then low");  break;
-        case spif_shift_waiting_on_clk_low:          ui_temp_window_write("waiting on clk low");             break;
+static bool spif_reserve() {
+    void * data;
+    if (STORAGE.data) return true;
+    data = mmap(NULL, SPI_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (data == MAP_FAILED) {
+        PRINT("not enough memory for the spi flash\n");
+        return false;
+    }
+    STORAGE.data = data;
+    return true;
+}
 
-    };
-    ui_temp_window_write("\n");
-    ui_temp_window_write("current cmd  = %02X\n", spif_state.cmd);
-    ui_temp_window_write("prev cmd  = %02X\n", spif_state.prev_cmd);
-    ui_temp_window_write("shift count  = %d\n", spif_state.shift_count);
-    ui_temp_window_write("last clk pin: %d\n", spif_state.last_clk);
-    ui_temp_window_write("status register 1: %d\n", spif_state.status_register_1);
-    spif_get_addr();
-    ui_temp_window_write("address: %d\n", spif_state.addr);
-    ui_temp_window_write("current response: %02X\n", spif_state.response_byte);
-    ui_temp_window_write("bytes responded so far: %d\n", spif_state.bytes_responded);
-    ui_temp_window_write("byte to program: %02X\n", spif_state.program_byte);
-    ui_temp_window_write("byte received so far: %d\n", spif_state.bytes_received);
-    ui_temp_window_write("num bytes expected: %d\n", spif_state.num_bytes);
-    ui_temp_window_write("byte index: %d\n", spif_state.byte_index);
-    if (spif_state.busy) {ui_temp_window_write("device is busy for %d more cycles\n", spif_state.delay);}
-    else ui_temp_window_write("device is idle\n");
-    if (spif_state.write_enable_latch) {ui_temp_window_write("device is enabled for write\n");}
-    else ui_temp_window_write("device is not enabled for write\n");
-    ui_temp_window_write("simulated flash storage (first %d bytes):\n", SPI_FLASH_DISPLAY_LINES * SPI_FLASH_DISPLAY_LINE_SIZE);
-    for (i=0; i < SPI_FLASH_DISPLAY_LINES; i++) {
-        for (j=0; j < SPI_FLASH_DISPLAY_LINE_SIZE; j++) {
-            ui_temp_window_write("%02X ", spif_storage[ (i*SPI_FLASH_DISPLAY_LINE_SIZE) +j]);
-        }
-        ui_temp_window_write("\n");
+static void spif_update_head(uint32_t addr) {
+    if (addr < sizeof(SPIF.head)) SPIF.head[addr] = device_spi_flash_peek(addr);
+}
+
+static bool spif_materialize(uint32_t sector) {
+    if (SECTOR_IS_MATERIALIZED(sector)) return true;
+    if (!spif_reserve()) return false;
+    memset(STORAGE.data + sector * SPI_SECTOR_SIZE, 0xFF, SPI_SECTOR_SIZE);
+    STORAGE.sectors[sector / 8] |= (1 << (sector % 8));
+    return true;
+}
+
+static void spif_erase_sector(uint32_t sector) {
+    uint32_t i;
+    if (!SECTOR_IS_MATERIALIZED(sector)) return;
+    STORAGE.sectors[sector / 8] &= ~(1 << (sector % 8));
+    madvise(STORAGE.data + sector * SPI_SECTOR_SIZE, SPI_SECTOR_SIZE, MADV_DONTNEED);   /* fails harmlessly if pages are bigger */
+    for (i = sector * SPI_SECTOR_SIZE; i < sizeof(SPIF.head); i++) spif_update_head(i);
+}
+
+static void spif_erase_all() {
+    uint32_t i;
+    if (STORAGE.data) munmap(STORAGE.data, SPI_FLASH_SIZE);
+    STORAGE.data = NULL;
+    memset(STORAGE.sectors, 0, sizeof(STORAGE.sectors));
+    for (i = 0; i < sizeof(SPIF.head); i++) spif_update_head(i);
+}
+
+static void spif_write(uint32_t addr, uint8_t value) {
+    if (addr >= SPI_FLASH_SIZE || !spif_materialize(addr / SPI_SECTOR_SIZE)) return;
+    STORAGE.data[addr] = value;
+    spif_update_head(addr);
+}
+
+uint8_t device_spi_flash_peek(uint32_t addr) {
+    if (addr >= SPI_FLASH_SIZE || !SECTOR_IS_MATERIALIZED(addr / SPI_SECTOR_SIZE)) return 0xFF;
+    return STORAGE.data[addr];
+}
+
+void device_spi_flash_storage_free(spif_storage_t * storage) {
+    if (storage->data) munmap(storage->data, SPI_FLASH_SIZE);
+    memset(storage, 0, sizeof(spif_storage_t));
+}
+
+bool device_spi_flash_load(const char * file_name) {
+    int fd;
+    struct stat file_stat;
+    size_t length, mapped, page_size = sysconf(_SC_PAGESIZE);
+    uint32_t sector, i;
+    bool ok = true;
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        PRINT("unable to open spi flash image %s\n", file_name);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    length = (file_stat.st_size > SPI_FLASH_SIZE) ? SPI_FLASH_SIZE : file_stat.st_size;
+    if (file_stat.st_size > SPI_FLASH_SIZE) PRINT("spi flash image %s is bigger than the flash, only loading %d bytes\n", file_name, SPI_FLASH_SIZE);
+    spif_erase_all();
+    if (!spif_reserve()) {
+        close(fd);
+        return false;
+    }
+    /* whole pages are mapped from the file, the rest (if any) is read into materialized sectors */
+    mapped = length - length % page_size;
+    if (mapped && mmap(STORAGE.data, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) mapped = 0;
+    for (sector = 0; sector * SPI_SECTOR_SIZE < mapped; sector++) STORAGE.sectors[sector / 8] |= (1 << (sector % 8));
+    for (i = mapped; i < length; i += SPI_SECTOR_SIZE - i % SPI_SECTOR_SIZE) {
+        if (!SECTOR_IS_MATERIALIZED(i / SPI_SECTOR_SIZE)) spif_materialize(i / SPI_SECTOR_SIZE);
+    }
+    if (mapped < length && pread(fd, STORAGE.data + mapped, length - mapped, mapped) != (ssize_t) (length - mapped)) {
+        PRINT("unable to read spi flash image %s\n", file_name);
+        spif_erase_all();
+        ok = false;
+    }
+    close(fd);
+    for (i = 0; i < sizeof(SPIF.head); i++) spif_update_head(i);
+    return ok;
+}
+
+/* writes up to the end of the last materialized sector to a new file that then replaces the old one, which may still be mapped */
+bool device_spi_flash_save(const char * file_name) {
+    static uint8_t erased[SPI_SECTOR_SIZE];
+    char temp_name[SPI_FLASH_FILE_NAME_MAX + 8];
+    FILE * file;
+    int32_t last;
+    uint32_t sector;
+    bool ok = true;
+    memset(erased, 0xFF, SPI_SECTOR_SIZE);
+    for (last = SPI_FLASH_NUM_SECTORS - 1; last >= 0 && !SECTOR_IS_MATERIALIZED(last); last--);
+    snprintf(temp_name, sizeof(temp_name), "%s.temp", file_name);
+    file = fopen(temp_name, "wb");
+    if (!file) {
+        PRINT("unable to write spi flash image %s\n", file_name);
+        return false;
+    }
+    for (sector = 0; (int32_t) sector <= last && ok; sector++) {
+        ok = (fwrite(SECTOR_IS_MATERIALIZED(sector) ? STORAGE.data + sector * SPI_SECTOR_SIZE : erased, SPI_SECTOR_SIZE, 1, file) == 1);
+    }
+    if (fclose(file) != 0) ok = false;
+    if (ok && rename(temp_name, file_name) != 0) ok = false;
+    if (!ok) {
+        PRINT("unable to write spi flash image %s\n", file_name);
+        remove(temp_name);
     }
-    ui_temp_window_write("\npress PF6 to step next instruction: %d, 2-9 to run iterations, else qq to exit\n", spif_state.last_clk);
-    ch = getch();
-    if ('q' == ch) return 0;
-    if ('2' <= ch && ch <= '9') return (ch - '0');
-    if (ch == KEY_F(6)) return 1;
-    return 0;
+    return ok;
 }
-        
-void run_spi_flash() {
-    int rc;
+
+void device_spi_flash_set_image(const char * file_name) {
+    snprintf(SPIF.image_file, SPI_FLASH_FILE_NAME_MAX, "%s", file_name);
+}
+
+void device_spi_flash_restart() {
+    uint32_t i;
+    if (SPIF.image_file[0]) {
+        device_spi_flash_load(SPIF.image_file);
+        return;
+    }
+    for (i = 0; i < sizeof(SPIF.head); i++) spif_update_head(i);    /* the build copied in the (empty) head of the parse */
+}
+
+/*****************************************************************
+ *
+ *  SPI FLASH DEVICE MANAGEMENT (HANDLERS, ETC.)
+ *
+ *****************************************************************/
+                
+void spif_sm();
+
+void run_spi_flash(int instance) {
     spif_sm();
 }
 
-void device_enable_spi_flash(uint8_t clk_pin, uint8_t tx_pin, uint8_t rx_pin, uint8_t cs_pin) {
+void device_enable_spi_flash(uint8_t clk_pin, uint8_t tx_pin, uint8_t rx_pin, uint8_t cs_pin, uint8_t io2_pin, uint8_t io3_pin) {
     PRINTI("enabling spi flash\n");
-    spif_clk = clk_pin;
-    spif_tx = tx_pin;
-    spif_rx = rx_pin;
-    spif_cs = cs_pin;
-    hardware_register_device("spi flash", true, run_spi_flash, display_spi_flash_state);
-    spif_state.busy = false;
-    spif_state.write_enable_latch = false;
-    spif_state.delay = 0;
-    spif_state.cmd = 0;
+    SPIF.clk = clk_pin;
+    SPIF.tx = tx_pin;
+    SPIF.rx = rx_pin;
+    SPIF.cs = cs_pin;
+    SPIF.io2 = io2_pin;
+    SPIF.io3 = io3_pin;
+    device_spi_flash_set_busy_cycles(FLASH_CMD_PROGRAM_DELAY, FLASH_CMD_ERASE_DELAY, FLASH_CMD_BLOCK_ERASE_DELAY, FLASH_CMD_CHIP_ERASE_DELAY);
+    SPIF.device = hardware_register_device("spi flash", true, run_spi_flash, 0, (1u << clk_pin) | (1u << cs_pin));
+    SPIF_STATE.busy = false;
+    SPIF_STATE.write_enable_latch = false;
+    SPIF_STATE.busy_until = 0;
+    SPIF_STATE.cmd = 0;
     spif_reset_for_next_cmd();
 }
 
+void device_spi_flash_set_busy_cycles(uint32_t program, uint32_t sector_erase, uint32_t block_erase, uint32_t chip_erase) {
+    SPIF.busy_cycles = (spif_busy_cycles_t) { program, sector_erase, block_erase, chip_erase };
+}
+
 /*****************************************************************
  *
  *  SPI FLASH DEVICE PROCESSING
@@ -234,13 +321,33 @@ void device_enable_spi_flash(uint8_t clk_pin, uint8_t tx_pin, uint8_t rx_pin, ui
  *****************************************************************/
                 
 void spif_stay_busy_for(uint32_t num_cycles) {
-    spif_state.delay = num_cycles;
-    spif_state.busy = true;
+    SPIF_STATE.busy_until = exec_cycle() + num_cycles;
+    SPIF_STATE.busy = (num_cycles > 0);
+    hardware_device_wake_at(SPIF.device, SPIF_STATE.busy_until);
+}
+
+void spif_ignore_cmd() {
+    SPIF_STATE.shift_count = 0;
+    SPIF_STATE.state = spif_done;
+}
+
+// programs and erases are ignored unless write enabled, and disable writes again once done
+bool spif_check_write_enabled() {
+    if (SPIF_STATE.write_enable_latch) return true;
+    PRINT("spi flash not write enabled, ignoring cmd %02X\n", SPIF_STATE.cmd);
+    spif_ignore_cmd();
+    return false;
+}
+
+void spif_written(uint32_t busy_cycles) {
+    SPIF_STATE.write_enable_latch = false;
+    spif_stay_busy_for(busy_cycles);
 }
     
 bool spif_finish() {
-    if (hardware_get_gpio(spif_cs)) {
-        spif_state.state = spif_idle;
+    if (hardware_get_gpio(SPIF.cs)) {
+        if (SPIF_STATE.state == spif_programming && SPIF_STATE.bytes_received > 0) spif_written(SPIF.busy_cycles.program);
+        SPIF_STATE.state = spif_idle;
         spif_reset_for_next_cmd();
         return true;
     }
@@ -248,83 +355,110 @@ bool spif_finish() {
 }
     
 void spif_setup_response(uint8_t * data2write, uint32_t num_bytes) {
-    spif_state.state = spif_writing_response;
-    spif_state.data_ptr = data2write;
-    spif_state.response_byte = data2write[0];
-    spif_state.byte_index = 0;
-    spif_state.num_bytes = num_bytes;
-    spif_state.shift_count = 0;
-    spif_state.shift_state = spif_shift_waiting_on_clk_low;
+    SPIF_STATE.state = spif_writing_response;
+    SPIF_STATE.data_ptr = data2write;
+    SPIF_STATE.response_byte = data2write[0];
+    SPIF_STATE.byte_index = 0;
+    SPIF_STATE.num_bytes = num_bytes;
+    SPIF_STATE.shift_count = 0;
+    SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low;
 }
 
 void spif_response() {
-    spif_shift_out_next_bit(&(spif_state.response_byte));
+    spif_shift_out_next_bit(&(SPIF_STATE.response_byte));
     if BYTE_SENT {
-        spif_state.bytes_responded++;
-        if (spif_state.bytes_responded == spif_state.num_bytes) {
-            spif_state.state = spif_done;
+        SPIF_STATE.bytes_responded++;
+        if (SPIF_STATE.bytes_responded == SPIF_STATE.num_bytes) {
+            SPIF_STATE.state = spif_done;
         }
         else {
-            spif_state.response_byte = spif_state.data_ptr[spif_state.bytes_responded];
-            spif_state.shift_count = 0;
+            SPIF_STATE.response_byte = SPIF_STATE.data_ptr[SPIF_STATE.bytes_responded];
+            SPIF_STATE.shift_count = 0;
         }
     }
 }
     
-void spif_setup_read() {
-    spif_state.state = spif_reading;
-    spif_state.addr = spif_get_addr();
-    spif_state.data_ptr = &(spif_state.response_byte);
-    spif_state.response_byte = spif_storage[(spif_state.addr)++];
-    spif_state.shift_count = 0;
-    spif_state.shift_state = spif_shift_waiting_on_clk_low;
+// reads go on past the end of the flash from its start
+uint8_t spif_next_read_byte() {
+    uint8_t byte = device_spi_flash_peek(SPIF_STATE.addr);
+    SPIF_STATE.addr = (SPIF_STATE.addr + 1) % SPI_FLASH_SIZE;
+    return byte;
+}
+
+void spif_setup_read(uint8_t width) {
+    if (width == 4 && (SPIF.io2 == SPI_FLASH_NO_PIN || SPIF.io3 == SPI_FLASH_NO_PIN)) {
+        PRINT("spi flash has no io2 and io3 pins for quad output, ignoring cmd %02X\n", SPIF_STATE.cmd);
+        spif_ignore_cmd();
+        return;
+    }
+    SPIF_STATE.state = spif_reading;
+    SPIF_STATE.width = width;
+    SPIF_STATE.addr = spif_get_addr();
+    SPIF_STATE.data_ptr = &(SPIF_STATE.response_byte);
+    SPIF_STATE.response_byte = spif_next_read_byte();
+    SPIF_STATE.shift_count = 0;
+    SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low;
+}
+
+void spif_setup_dummy() {
+    SPIF_STATE.state = spif_getting_dummy;
+    SPIF_STATE.dummy_byte = 0;
+    SPIF_STATE.shift_count = 0;
+    SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low_then_high;
 }
     
 void spif_read() {
-    if (spif_state.addr >= SPI_FLASH_SIZE) {
-        spif_state.response_byte = 0xff;
-    }
-    else {
-        spif_state.response_byte = spif_storage[(spif_state.addr)++];
-    }
-    (spif_state.bytes_responded)++;
-    spif_state.shift_count = 0;
+    SPIF_STATE.response_byte = spif_next_read_byte();
+    (SPIF_STATE.bytes_responded)++;
+    SPIF_STATE.shift_count = 0;
 }
 
 void spif_setup_program() {
-    spif_state.state = spif_programming;
-    spif_state.addr = spif_get_addr();
-    spif_state.data_ptr = &(spif_state.program_byte);
-    spif_state.shift_count = 0;
-    spif_state.shift_state = spif_shift_waiting_on_clk_low_then_high;
+    SPIF_STATE.state = spif_programming;
+    SPIF_STATE.addr = spif_get_addr();
+    SPIF_STATE.data_ptr = &(SPIF_STATE.program_byte);
+    SPIF_STATE.shift_count = 0;
+    SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low_then_high;
 }
     
+// programming can only clear bits, and the address wraps around within the page
 void spif_program() {
-    if (spif_state.addr >= SPI_FLASH_SIZE) return;
-    spif_storage[(spif_state.addr)++] = spif_state.program_byte;
-    spif_state.shift_count = 0;
+    uint32_t addr = SPIF_STATE.addr;
+    spif_write(addr, device_spi_flash_peek(addr) & SPIF_STATE.program_byte);
+    SPIF_STATE.addr = (addr & ~(SPI_FLASH_PAGE_SIZE - 1)) | ((addr + 1) & (SPI_FLASH_PAGE_SIZE - 1));
+    (SPIF_STATE.bytes_received)++;
+    SPIF_STATE.shift_count = 0;
 }
 
 void spif_setup_sector_erase() {
-    // realistically, only one sector (sector zero) will probably ever be supported by this simulator
-    uint32_t addr, first, max, i;
-    addr = spif_get_addr();
-    first = addr * SPI_SECTOR_SIZE;
-    if ( first > SPI_FLASH_SIZE ) return; 
-    max = (addr+1) * SPI_SECTOR_SIZE;
-    if (max > SPI_FLASH_SIZE) max = SPI_FLASH_SIZE;
-    for (i=first; i<max; i++) spif_storage[i] = 0xFF;
+    // erases the sector the address is in
+    spif_erase_sector(spif_get_addr() / SPI_SECTOR_SIZE);
+    spif_written(SPIF.busy_cycles.sector_erase);
+    SPIF_STATE.state = spif_done;
+}
+
+void spif_setup_block_erase() {
+    uint32_t sector, first = (spif_get_addr() / SPI_BLOCK_SIZE) * (SPI_BLOCK_SIZE / SPI_SECTOR_SIZE);
+    for (sector = first; sector < first + SPI_BLOCK_SIZE / SPI_SECTOR_SIZE; sector++) spif_erase_sector(sector);
+    spif_written(SPIF.busy_cycles.block_erase);
+    SPIF_STATE.state = spif_done;
+}
+
+void spif_chip_erase() {
+    spif_erase_all();
+    spif_written(SPIF.busy_cycles.chip_erase);
+    SPIF_STATE.state = spif_done;
 }
     
 void spif_setup_write_enable() {
-    spif_state.write_enable_latch = true;
-    spif_state.state = spif_done;
+    SPIF_STATE.write_enable_latch = true;
+    SPIF_STATE.state = spif_done;
 }
     
 void spif_setup_read_manufacturer_id() {
-    spif_state.state = spif_getting_addr1;
-    spif_state.shift_count = 0;
-    spif_state.shift_state = spif_shift_waiting_on_clk_low_then_high;
+    SPIF_STATE.state = spif_getting_addr1;
+    SPIF_STATE.shift_count = 0;
+    SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low_then_high;
 }
     
 /*****************************************************************
@@ -334,67 +468,88 @@ void spif_setup_read_manufacturer_id() {
  *****************************************************************/
                 
 void spif_process_cmd() {
-    switch(spif_state.cmd) {
+    if (SPIF_STATE.busy && SPIF_STATE.cmd != FLASH_CMD_STATUS) {
+        PRINT("spi flash busy, ignoring cmd %02X\n", SPIF_STATE.cmd);
+        spif_ignore_cmd();
+        return;
+    }
+    switch(SPIF_STATE.cmd) {
         case FLASH_CMD_PAGE_PROGRAM:
-        case FLASH_CMD_READ:
         case FLASH_CMD_SECTOR_ERASE:
+        case FLASH_CMD_BLOCK_ERASE:
+            if (!spif_check_write_enabled()) break;
+            // fall through
+        case FLASH_CMD_READ:
+        case FLASH_CMD_FAST_READ:
+        case FLASH_CMD_DUAL_OUTPUT_READ:
+        case FLASH_CMD_QUAD_OUTPUT_READ:
         case FLASH_CMD_READ_MANUFACTURER_ID:
-            spif_state.state = spif_getting_addr1;
-            spif_state.shift_count = 0;
-            spif_state.shift_state = spif_shift_waiting_on_clk_low_then_high;
+            SPIF_STATE.state = spif_getting_addr1;
+            SPIF_STATE.shift_count = 0;
+            SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low_then_high;
             break;
         case FLASH_CMD_STATUS:
-            spif_state.status_register_1 = spif_state.write_enable_latch;
-            spif_state.status_register_1 = (spif_state.status_register_1 << 1) + spif_state.busy;
-            spif_setup_response(&(spif_state.status_register_1), 1);
+            SPIF_STATE.status_register_1 = SPIF_STATE.write_enable_latch;
+            SPIF_STATE.status_register_1 = (SPIF_STATE.status_register_1 << 1) + SPIF_STATE.busy;
+            spif_setup_response(&(SPIF_STATE.status_register_1), 1);
             break;
         case FLASH_CMD_WRITE_EN:
             spif_setup_write_enable();
             break;
+        case FLASH_CMD_CHIP_ERASE:
+            if (spif_check_write_enabled()) spif_chip_erase();
+            break;
         default:
-            PRINT("unknown cmd %02X\n", spif_state.cmd);
-            spif_state.shift_count = 0;
-            spif_state.state = spif_done;
+            PRINT("unknown cmd %02X\n", SPIF_STATE.cmd);
+            spif_ignore_cmd();
             break;
     };
 }
 
 void spif_process_addr1() {
-    spif_state.state = spif_getting_addr2;
-    spif_state.shift_count = 0;
-    spif_state.shift_state = spif_shift_waiting_on_clk_low_then_high;
+    SPIF_STATE.state = spif_getting_addr2;
+    SPIF_STATE.shift_count = 0;
+    SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low_then_high;
 }
 
 void spif_process_addr2() {
-    spif_state.state = spif_getting_addr3;
-    spif_state.shift_count = 0;
-    spif_state.shift_state = spif_shift_waiting_on_clk_low_then_high;
+    SPIF_STATE.state = spif_getting_addr3;
+    SPIF_STATE.shift_count = 0;
+    SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low_then_high;
 }
 
 void spif_process_addr3() {
-    switch(spif_state.cmd) {
+    switch(SPIF_STATE.cmd) {
         case FLASH_CMD_PAGE_PROGRAM:
             spif_setup_program();
             break;
         case FLASH_CMD_READ:
-            spif_setup_read();
+            spif_setup_read(1);
+            break;
+        case FLASH_CMD_FAST_READ:
+        case FLASH_CMD_DUAL_OUTPUT_READ:
+        case FLASH_CMD_QUAD_OUTPUT_READ:
+            spif_setup_dummy();
             break;
         case FLASH_CMD_SECTOR_ERASE:
             spif_setup_sector_erase();
             break;
+        case FLASH_CMD_BLOCK_ERASE:
+            spif_setup_block_erase();
+            break;
         case FLASH_CMD_READ_MANUFACTURER_ID:
             spif_setup_response(spif_id, 2);
             break;
         case FLASH_CMD_WRITE_EN:
         case FLASH_CMD_STATUS:
-            PRINT("unexpected cmd with address %02X\n", spif_state.cmd);
-            spif_state.shift_count = 0;
-            spif_state.state = spif_done;
+            PRINT("unexpected cmd with address %02X\n", SPIF_STATE.cmd);
+            SPIF_STATE.shift_count = 0;
+            SPIF_STATE.state = spif_done;
             break;
         default:
-            PRINT("unknown cmd %02X\n", spif_state.cmd);
-            spif_state.shift_count = 0;
-            spif_state.state = spif_done;
+            PRINT("unknown cmd %02X\n", SPIF_STATE.cmd);
+            SPIF_STATE.shift_count = 0;
+            SPIF_STATE.state = spif_done;
             break;
     };
 }
@@ -407,65 +562,76 @@ void spif_process_addr3() {
 
 // come out of idle when cs goes low
 void spif_when_idle() {
-    if (!hardware_get_gpio(spif_cs)) {
-        spif_state.state = spif_getting_cmd;
-        spif_state.last_clk = hardware_get_gpio(spif_clk);
-        if (spif_state.last_clk) {
-            spif_state.mode = spif_mode_3;
-            spif_state.shift_state = spif_shift_waiting_on_clk_low_then_high;
+    if (!hardware_get_gpio(SPIF.cs)) {
+        SPIF_STATE.state = spif_getting_cmd;
+        SPIF_STATE.last_clk = hardware_get_gpio(SPIF.clk);
+        if (SPIF_STATE.last_clk) {
+            SPIF_STATE.mode = spif_mode_3;
+            SPIF_STATE.shift_state = spif_shift_waiting_on_clk_low_then_high;
         }
         else {
-            spif_state.mode = spif_mode_0;
-            spif_state.shift_state = spif_shift_waiting_on_clk_high;
+            SPIF_STATE.mode = spif_mode_0;
+            SPIF_STATE.shift_state = spif_shift_waiting_on_clk_high;
         }
-        spif_state.shift_count = 0;
+        SPIF_STATE.shift_count = 0;
     }
 }
 
 void spif_when_getting_cmd() {
-    spif_shift_in_next_bit(&(spif_state.cmd));
+    spif_shift_in_next_bit(&(SPIF_STATE.cmd));
     if BYTE_RECEIVED {
         spif_process_cmd();
     }
 }
 
 void spif_when_getting_addr1() {
-    spif_shift_in_next_bit(&(spif_state.addr1));
+    spif_shift_in_next_bit(&(SPIF_STATE.addr1));
     if BYTE_RECEIVED {
         spif_process_addr1();
     }
 }
 
 void spif_when_getting_addr2() {
-    spif_shift_in_next_bit(&(spif_state.addr2));
+    spif_shift_in_next_bit(&(SPIF_STATE.addr2));
     if BYTE_RECEIVED {
         spif_process_addr2();
     }
 }
 
 void spif_when_getting_addr3() {
-    spif_shift_in_next_bit(&(spif_state.addr3));
+    spif_shift_in_next_bit(&(SPIF_STATE.addr3));
     if BYTE_RECEIVED {
         spif_process_addr3();
     }
 }
 
+void spif_when_getting_dummy() {
+    spif_shift_in_next_bit(&(SPIF_STATE.dummy_byte));
+    if BYTE_RECEIVED {
+        switch (SPIF_STATE.cmd) {
+            case FLASH_CMD_DUAL_OUTPUT_READ: spif_setup_read(2); break;
+            case FLASH_CMD_QUAD_OUTPUT_READ: spif_setup_read(4); break;
+            default:                         spif_setup_read(1); break;
+        };
+    }
+}
+
 void spif_when_programming() {
-    spif_shift_in_next_bit(&(spif_state.program_byte));
+    spif_shift_in_next_bit(&(SPIF_STATE.program_byte));
     if BYTE_RECEIVED {
         spif_program();
     }
 }
 
 void spif_when_reading() {
-    spif_shift_out_next_bit(&(spif_state.response_byte));
+    spif_shift_out_next_bits(&(SPIF_STATE.response_byte), SPIF_STATE.width);
     if BYTE_SENT {
         spif_read();
     }
 }
 
 void spif_when_writing_response() {
-    spif_shift_out_next_bit(&(spif_state.response_byte));
+    spif_shift_out_next_bit(&(SPIF_STATE.response_byte));
     if BYTE_SENT {
         spif_response();
     }
@@ -475,16 +641,15 @@ void spif_when_processing_cmd() {
 }
 
 void spif_sm() {
-    if (spif_state.delay > 0) {
-        if (--spif_state.delay == 0) spif_state.busy = false;
-    }
+    if (SPIF_STATE.busy && exec_cycle() >= SPIF_STATE.busy_until) SPIF_STATE.busy = false;
     if (spif_finish()) return;
-    switch (spif_state.state) {
+    switch (SPIF_STATE.state) {
         case spif_idle:               spif_when_idle();           break;
         case spif_getting_cmd:        spif_when_getting_cmd();    break;
         case spif_getting_addr1:      spif_when_getting_addr1();  break;
         case spif_getting_addr2:      spif_when_getting_addr2();  break;
         case spif_getting_addr3:      spif_when_getting_addr3();  break;
+        case spif_getting_dummy:      spif_when_getting_dummy();  break;
         case spif_programming:        spif_when_programming();    break;
         case spif_reading:            spif_when_reading();        break;
         case spif_writing_response:   spif_when_writing_response();   break;
@@ -0,0 +1,301 @@
+/*!
+ * @file /device_uart.c
+ * @brief Simulated UART (serial port) device
+ * @details
+ * See device_uart.h. As all simulated devices in Simpio, once enabled, this exposes an execution function that is called by
+ * the Simpio execution engine (see execution.c), here whenever the rx pin changes and at the cycles it asks to be woken at:
+ *
+ * - receiving: a falling edge on an idle line starts a frame; each bit (start, data least significant first, parity, stop)
+ *   is then sampled three times around its middle, one oversampling period apart, and the majority decides its value. A start
+ *   bit that is high again by then was a glitch; a stop bit that is low is a framing error.
+ * - sending: the next byte of the input file is framed and each bit driven on the tx pin for one bit time, back to back
+ *   until the file ends.
+ *
+ * Received bytes are written to the output file as they complete, including those with errors (which are counted).
+ * Printed ("-") they are messages like any other, so they go wherever the simulation's messages go.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <string.h>
+#include "device_uart.h"
+#include "hardware.h"
+#include "execution.h"
+#include "print.h"
+#include "context.h"
+
+#define UART    (simpio_context->uart)
+#define STREAMS (simpio_context->uart_streams)
+#define RX      (UART.receive)
+#define TX      (UART.transmit)
+
+#define FRAME_BITS (1 + UART.bits + (UART.parity != uart_parity_none) + UART.stop_bits)
+
+/*****************************************************************
+ *
+ *  CONFIGURATION
+ *
+ *****************************************************************/
+
+// cycles per bit (at least 1), from the baud rate and the system clock divided down for the sm
+static void uart_timing() {
+    uint64_t divisor = (uint64_t) UART.clkdiv * UART.baud;
+    UART.cycles_per_bit = (uint32_t) ((UART.sys_clk + divisor / 2) / divisor);
+    if (UART.cycles_per_bit == 0) {
+        PRINT("uart: %u baud is faster than the sm clock, using 1 cycle per bit\n", UART.baud);
+        UART.cycles_per_bit = 1;
+    }
+}
+
+void run_uart(int instance);
+
+void device_uart_reset() {
+    memset(&UART, 0, sizeof(uart_device_t));
+    UART.tx = UART.rx = UART_NO_PIN;
+    UART.device = -1;
+}
+
+bool device_enable_uart(uint8_t tx_pin, uint8_t rx_pin, uint32_t baud) {
+    uint32_t sensitivity;
+    if ((tx_pin == UART_NO_PIN && rx_pin == UART_NO_PIN) || (tx_pin != UART_NO_PIN && tx_pin > 31) || (rx_pin != UART_NO_PIN && rx_pin > 31) || baud == 0) {
+        PRINT("uart: expected tx and rx pins (0-31 or none, not both none) and a baud rate\n");
+        return false;
+    }
+    PRINTI("enabling uart\n");
+    memset(&UART, 0, sizeof(uart_device_t));
+    UART.tx = tx_pin;
+    UART.rx = rx_pin;
+    UART.baud = baud;
+    UART.sys_clk = UART_DEFAULT_SYS_CLK;
+    UART.sm = hardware_pio_num_set() * NUM_SMS + hardware_sm_num_set();
+    UART.clkdiv = hardware_sm_set()->clkdiv;       /* until the restart takes it as configured by the end of the program */
+    UART.bits = 8;
+    UART.parity = uart_parity_none;
+    UART.stop_bits = 1;
+    UART.oversampling = UART_DEFAULT_OVERSAMPLING;
+    uart_timing();
+    sensitivity = (rx_pin != UART_NO_PIN) ? (1u << rx_pin) : (1u << tx_pin);   // without an rx pin it only runs when woken
+    UART.device = hardware_register_device("uart", true, run_uart, 0, sensitivity);
+    return true;
+}
+
+bool device_uart_set_format(uint8_t bits, uint8_t parity, uint8_t stop_bits, uint8_t oversampling) {
+    if (bits < 5 || bits > 9 || parity > uart_parity_even || stop_bits < 1 || stop_bits > 2 || oversampling == 0) {
+        PRINT("uart: expected 5-9 data bits, parity 0 (none), 1 (odd) or 2 (even), 1 or 2 stop bits and an oversampling rate\n");
+        return false;
+    }
+    UART.bits = bits;
+    UART.parity = (uart_parity_e) parity;
+    UART.stop_bits = stop_bits;
+    UART.oversampling = oversampling;
+    return true;
+}
+
+bool device_uart_set_clock(uint32_t sys_clk) {
+    if (sys_clk == 0) {
+        PRINT("uart: the system clock can't be 0\n");
+        return false;
+    }
+    UART.sys_clk = sys_clk;
+    uart_timing();
+    return true;
+}
+
+void device_uart_set_input(const char * file_name) {
+    snprintf(UART.input_file, UART_FILE_NAME_MAX, "%s", file_name);
+}
+
+void device_uart_set_output(const char * file_name) {
+    snprintf(UART.output_file, UART_FILE_NAME_MAX, "%s", file_name);
+}
+
+/*****************************************************************
+ *
+ *  FILES
+ *
+ *****************************************************************/
+
+static void close_streams(uart_streams_t * streams) {
+    if (streams->in && streams->in != stdin) fclose(streams->in);
+    if (streams->out) fclose(streams->out);
+    streams->in = streams->out = NULL;
+    streams->in_done = false;
+}
+
+void device_uart_streams_free(uart_streams_t * streams) {
+    close_streams(streams);
+}
+
+// the next byte to send, or -1 once the input file is done (or there is none)
+static int next_input_byte() {
+    int ch;
+    if (STREAMS.in_done || !UART.input_file[0]) return -1;
+    if (!STREAMS.in) {
+        STREAMS.in = strcmp(UART.input_file, UART_STDIO) ? fopen(UART.input_file, "rb") : stdin;
+        if (!STREAMS.in) {
+            PRINT("uart: unable to open %s, nothing will be sent\n", UART.input_file);
+            STREAMS.in_done = true;
+            return -1;
+        }
+    }
+    ch = fgetc(STREAMS.in);
+    if (ch == EOF) STREAMS.in_done = true;
+    return ch;
+}
+
+static void write_output_byte(uint16_t byte) {
+    if (!UART.output_file[0]) return;
+    if (!strcmp(UART.output_file, UART_STDIO)) {
+        PRINT("%c", byte & 0xFF);
+        return;
+    }
+    if (!STREAMS.out) {
+        STREAMS.out = fopen(UART.output_file, "wb");
+        if (!STREAMS.out) {
+            PRINT("uart: unable to open %s, received bytes will not be written to it\n", UART.output_file);
+            UART.output_file[0] = '\0';
+            return;
+        }
+    }
+    fputc(byte & 0xFF, STREAMS.out);
+}
+
+/*****************************************************************
+ *
+ *  RUNNING
+ *
+ *****************************************************************/
+
+void device_uart_restart() {
+    close_streams(&STREAMS);
+    if (UART.baud) {       /* enabled */
+        UART.clkdiv = simpio_context->hardware.sms[UART.sm].clkdiv;    /* wherever its .config clkdiv was */
+        uart_timing();
+    }
+    /* the UI has the terminal, and reading it would block the thread running the simulation */
+    if (UART.tx != UART_NO_PIN && !strcmp(UART.input_file, UART_STDIO) && !print_state->to_stdout) {
+        PRINT("uart: stdin can only be sent without the UI, nothing will be sent\n");
+        STREAMS.in_done = true;
+    }
+    memset(&RX, 0, sizeof(uart_channel_t));
+    memset(&TX, 0, sizeof(uart_channel_t));
+    UART.received = UART.error_free = UART.framing_errors = UART.parity_errors = UART.sent = 0;
+    UART.first_received = UART.last_received = 0;
+    UART.last_byte = 0;
+    if (UART.tx != UART_NO_PIN) hardware_set_gpio(UART.tx, 1);
+    RX.last = (UART.rx != UART_NO_PIN) ? hardware_get_gpio(UART.rx) : 1;
+}
+
+static bool odd_parity(uint16_t value) {
+    bool odd = false;
+    for (; value; value >>= 1) odd ^= (value & 1);
+    return odd;
+}
+
+// cycle of sample n (0-2) of bit b of the frame being received
+static uint32_t sample_cycle(uint8_t b, uint8_t n) {
+    uint32_t tick = UART.cycles_per_bit / UART.oversampling;
+    return RX.start + b * UART.cycles_per_bit + UART.cycles_per_bit / 2 + n * tick - tick;
+}
+
+static void received_frame(bool framing_error) {
+    uint16_t data = RX.frame & ((1u << UART.bits) - 1);
+    bool parity_bit = (RX.frame >> UART.bits) & 1;
+    bool parity_error = (UART.parity != uart_parity_none) && ((odd_parity(data) ^ parity_bit) != (UART.parity == uart_parity_odd));
+    if (UART.received == 0) UART.first_received = RX.start;
+    UART.received++;
+    UART.last_received = RX.start + FRAME_BITS * UART.cycles_per_bit;
+    UART.last_byte = data;
+    if (framing_error) {
+        UART.framing_errors++;
+        PRINTI("uart: framing error receiving %02X at cycle %u\n", data, RX.start);
+    }
+    if (parity_error) {
+        UART.parity_errors++;
+        PRINTI("uart: parity error receiving %02X at cycle %u\n", data, RX.start);
+    }
+    if (!framing_error && !parity_error) UART.error_free++;
+    write_output_byte(data);
+}
+
+// the bit being received has been sampled: check or keep it, and move on to the next one
+static void received_bit(bool value) {
+    uint8_t data_bits = UART.bits + (UART.parity != uart_parity_none);
+    if (RX.bit == 0 && value) {
+        RX.active = false;      // a glitch, not a start bit
+        return;
+    }
+    if (RX.bit >= 1 && RX.bit <= data_bits) RX.frame |= ((uint16_t) value << (RX.bit - 1));
+    if (RX.bit > data_bits && !value) {
+        received_frame(true);
+        RX.active = false;
+        return;
+    }
+    if (++RX.bit == FRAME_BITS) {
+        received_frame(false);
+        RX.active = false;
+        return;
+    }
+    RX.samples = RX.votes = 0;
+    RX.next = sample_cycle(RX.bit, (UART.cycles_per_bit >= UART.oversampling) ? 0 : 1);
+}
+
+static void run_receive(uint32_t cycle) {
+    bool level = hardware_get_gpio(UART.rx);
+    if (!RX.active) {
+        if (RX.last && !level) {
+            RX = (uart_channel_t) { .active = true, .start = cycle };
+            RX.next = sample_cycle(0, (UART.cycles_per_bit >= UART.oversampling) ? 0 : 1);
+        }
+    }
+    else if (cycle >= RX.next) {
+        RX.votes += level;
+        // with fewer cycles than samples per bit, one sample in the middle decides
+        if (UART.cycles_per_bit < UART.oversampling) received_bit(level);
+        else if (++RX.samples < 3) RX.next = sample_cycle(RX.bit, RX.samples);
+        else received_bit(RX.votes >= 2);
+    }
+    RX.last = level;
+}
+
+static void run_transmit(uint32_t cycle) {
+    int byte;
+    uint16_t data;
+    if (TX.active && cycle < TX.next) return;
+    if (TX.active && ++TX.bit < FRAME_BITS) {
+        hardware_set_gpio(UART.tx, (TX.frame >> TX.bit) & 1);
+        TX.next += UART.cycles_per_bit;
+        return;
+    }
+    if (TX.active) UART.sent++;
+    TX.active = false;
+    byte = next_input_byte();
+    if (byte < 0) return;
+    // start bit (0), data, parity, then stop bits (1)
+    data = (uint16_t) byte & ((1u << UART.bits) - 1);
+    TX.frame = data << 1;
+    if (UART.parity != uart_parity_none) TX.frame |= (uint16_t) (odd_parity(data) ^ (UART.parity == uart_parity_odd)) << (UART.bits + 1);
+    TX.frame |= ((1u << UART.stop_bits) - 1) << (FRAME_BITS - UART.stop_bits);
+    TX.active = true;
+    TX.start = cycle;
+    TX.bit = 0;
+    TX.next = cycle + UART.cycles_per_bit;
+    hardware_set_gpio(UART.tx, 0);
+}
+
+void run_uart(int instance) {
+    uint32_t cycle = exec_cycle();
+    uint32_t wake = DEVICE_NO_WAKE;
+    // sending first, so looped back (tx and rx on the same pin) the receiving side sees each bit as it is driven
+    if (UART.tx != UART_NO_PIN) run_transmit(cycle);
+    if (UART.rx != UART_NO_PIN) run_receive(cycle);
+    if (RX.active) wake = RX.next;
+    if (TX.active && TX.next < wake) wake = TX.next;
+    hardware_device_wake_at(UART.device, wake);
+}
+
+uint32_t device_uart_throughput() {
+    uint64_t sm_clock = UART.sys_clk / UART.clkdiv;
+    if (UART.received == 0 || UART.last_received <= UART.first_received) return 0;
+    return (uint32_t) ((uint64_t) UART.error_free * sm_clock / (UART.last_received - UART.first_received));
+}
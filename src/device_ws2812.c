@@ -0,0 +1,244 @@
+/*!
+ * @file /device_ws2812.c
+ * @brief Simulated WS2812 (NeoPixel) LED strip device
+ * @details
+ * See device_ws2812.h. As all simulated devices in Simpio, once enabled, this exposes an execution function that is called by
+ * the Simpio execution engine (see execution.c), here whenever the data pin changes and once the reset time has passed after
+ * the last falling edge:
+ *
+ * - a rising edge starts a bit (the low before it is checked, unless it follows a reset)
+ * - a falling edge ends it: the width of the high pulse decides its value, and every bits_per_pixel bits (most significant
+ *   first) make a pixel, stored in the framebuffer unless it is beyond the end of the strip
+ * - a low lasting the reset time latches the frame: it is counted, timed and written to the frame file
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "device_ws2812.h"
+#include "hardware.h"
+#include "execution.h"
+#include "print.h"
+#include "context.h"
+
+#define WS2812  (simpio_context->ws2812)
+#define FRAMES  (simpio_context->ws2812_frames)
+
+/*****************************************************************
+ *
+ *  CONFIGURATION
+ *
+ *****************************************************************/
+
+static uint32_t ns_to_cycles(uint32_t ns) {
+    uint64_t divisor = (uint64_t) WS2812.clkdiv * 1000000000;
+    return (uint32_t) (((uint64_t) ns * WS2812.sys_clk + divisor / 2) / divisor);
+}
+
+static uint32_t cycles_to_ns(uint32_t cycles) {
+    return (uint32_t) ((uint64_t) cycles * WS2812.clkdiv * 1000000000 / WS2812.sys_clk);
+}
+
+static void ws2812_timing() {
+    WS2812.reset_cycles = ns_to_cycles(WS2812.reset_ns);
+    if (WS2812.reset_cycles == 0) WS2812.reset_cycles = 1;
+}
+
+void run_ws2812(int instance);
+
+void device_ws2812_reset() {
+    memset(&WS2812, 0, sizeof(ws2812_device_t));
+    WS2812.pin = WS2812_NO_PIN;
+    WS2812.device = -1;
+}
+
+bool device_enable_ws2812(uint8_t pin, uint32_t num_pixels, uint8_t bits_per_pixel) {
+    if (pin >= NUM_GPIOS || num_pixels == 0 || num_pixels > WS2812_MAX_PIXELS || (bits_per_pixel != 24 && bits_per_pixel != 32)) {
+        PRINT("ws2812: expected a pin (0-31), a number of pixels (1-%d) and 24 or 32 bits per pixel\n", WS2812_MAX_PIXELS);
+        return false;
+    }
+    PRINTI("enabling ws2812 strip of %u pixels\n", num_pixels);
+    device_ws2812_reset();
+    WS2812.pin = pin;
+    WS2812.num_pixels = num_pixels;
+    WS2812.bits_per_pixel = bits_per_pixel;
+    WS2812.sys_clk = WS2812_DEFAULT_SYS_CLK;
+    WS2812.sm = hardware_pio_num_set() * NUM_SMS + hardware_sm_num_set();
+    WS2812.clkdiv = hardware_sm_set()->clkdiv;     /* until the restart takes it as configured by the end of the program */
+    WS2812.t0h_ns = WS2812_DEFAULT_T0H;
+    WS2812.t1h_ns = WS2812_DEFAULT_T1H;
+    WS2812.tolerance_ns = WS2812_DEFAULT_TOLERANCE;
+    WS2812.reset_ns = WS2812_DEFAULT_RESET;
+    ws2812_timing();
+    WS2812.device = hardware_register_device("ws2812", true, run_ws2812, 0, (1u << pin));
+    return true;
+}
+
+bool device_ws2812_set_clock(uint32_t sys_clk) {
+    if (sys_clk == 0) {
+        PRINT("ws2812: the system clock can't be 0\n");
+        return false;
+    }
+    WS2812.sys_clk = sys_clk;
+    ws2812_timing();
+    return true;
+}
+
+bool device_ws2812_set_timing(uint32_t t0h_ns, uint32_t t1h_ns, uint32_t tolerance_ns, uint32_t reset_ns) {
+    if (t0h_ns >= t1h_ns || reset_ns == 0) {
+        PRINT("ws2812: expected T0H shorter than T1H, a tolerance and a reset time (all in ns)\n");
+        return false;
+    }
+    WS2812.t0h_ns = t0h_ns;
+    WS2812.t1h_ns = t1h_ns;
+    WS2812.tolerance_ns = tolerance_ns;
+    WS2812.reset_ns = reset_ns;
+    ws2812_timing();
+    return true;
+}
+
+void device_ws2812_set_file(const char * file_name) {
+    snprintf(WS2812.file, WS2812_FILE_NAME_MAX, "%s", file_name);
+}
+
+/*****************************************************************
+ *
+ *  FRAMES
+ *
+ *****************************************************************/
+
+void device_ws2812_frames_free(ws2812_frames_t * frames) {
+    if (frames->file) fclose(frames->file);
+    free(frames->pixels);
+    memset(frames, 0, sizeof(ws2812_frames_t));
+}
+
+uint32_t device_ws2812_pixel(uint32_t index) {
+    if (index >= FRAMES.allocated) return 0;
+    return FRAMES.pixels[index];
+}
+
+/* one line of hex, like any other message (so it goes to the UI or the embedding program, not straight to stdout), given
+   to PRINT a piece at a time as a long strip doesn't fit in one message */
+static void print_frame(uint32_t count) {
+    char text[PRINT_MSG_MAX];
+    int used = snprintf(text, PRINT_MSG_MAX, "frame %u:", WS2812.frames);
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        if (used > PRINT_MSG_MAX - 11) {    /* room for a pixel, and the newline at the end */
+            PRINT("%s", text);
+            used = 0;
+        }
+        used += snprintf(text + used, PRINT_MSG_MAX - used, WS2812.bits_per_pixel == 24 ? " %06X" : " %08X", FRAMES.pixels[i]);
+    }
+    PRINT("%s\n", text);
+}
+
+static void write_frame() {
+    uint32_t i, count = (WS2812.frame_pixels < WS2812.num_pixels) ? WS2812.frame_pixels : WS2812.num_pixels;
+    int byte;
+    if (!WS2812.file[0] || !FRAMES.pixels) return;
+    if (!strcmp(WS2812.file, WS2812_STDOUT)) {
+        print_frame(count);
+        return;
+    }
+    if (!FRAMES.file) {
+        FRAMES.file = fopen(WS2812.file, "wb");
+        if (!FRAMES.file) {
+            PRINT("ws2812: unable to open %s, frames will not be written to it\n", WS2812.file);
+            WS2812.file[0] = '\0';
+            return;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        for (byte = WS2812.bits_per_pixel - 8; byte >= 0; byte -= 8) fputc((FRAMES.pixels[i] >> byte) & 0xFF, FRAMES.file);
+    }
+}
+
+/*****************************************************************
+ *
+ *  RUNNING
+ *
+ *****************************************************************/
+
+void device_ws2812_restart() {
+    uint32_t num_pixels = WS2812.num_pixels;
+    device_ws2812_frames_free(&FRAMES);
+    if (WS2812.pin == WS2812_NO_PIN) return;
+    WS2812.clkdiv = simpio_context->hardware.sms[WS2812.sm].clkdiv;  /* wherever its .config clkdiv was */
+    ws2812_timing();
+    FRAMES.pixels = calloc(num_pixels, sizeof(uint32_t));
+    if (FRAMES.pixels) FRAMES.allocated = num_pixels;
+    else PRINT("not enough memory for a ws2812 strip of %u pixels\n", num_pixels);
+    WS2812.pixel = WS2812.bits = WS2812.index = 0;
+    WS2812.latched = true;
+    WS2812.last = hardware_get_gpio(WS2812.pin);
+    WS2812.rose = WS2812.fell = 0;
+    WS2812.frames = WS2812.frame_pixels = WS2812.overflow_pixels = 0;
+    WS2812.high_violations = WS2812.low_violations = WS2812.partial_pixels = WS2812.last_violation = 0;
+    WS2812.first_latch = WS2812.last_latch = WS2812.previous_latch = 0;
+}
+
+static void violation(uint32_t * count, const char * what, uint32_t cycle) {
+    (*count)++;
+    WS2812.last_violation = cycle;
+    PRINTI("ws2812: %s at cycle %u (pixel %u, bit %u)\n", what, cycle, WS2812.index, WS2812.bits);
+}
+
+static void bit_ended(uint32_t cycle) {
+    uint32_t high = cycles_to_ns(cycle - WS2812.rose);
+    uint32_t from_0 = (high > WS2812.t0h_ns) ? high - WS2812.t0h_ns : WS2812.t0h_ns - high;
+    uint32_t from_1 = (high > WS2812.t1h_ns) ? high - WS2812.t1h_ns : WS2812.t1h_ns - high;
+    bool value = (from_1 < from_0);
+    if ((value ? from_1 : from_0) > WS2812.tolerance_ns) violation(&WS2812.high_violations, "high pulse out of tolerance", cycle);
+    WS2812.pixel = (WS2812.pixel << 1) | value;
+    if (++WS2812.bits < WS2812.bits_per_pixel) return;
+    if (WS2812.index < FRAMES.allocated) FRAMES.pixels[WS2812.index] = WS2812.pixel;
+    if (WS2812.index < UINT32_MAX) WS2812.index++;
+    WS2812.pixel = 0;
+    WS2812.bits = 0;
+}
+
+static void latch(uint32_t cycle) {
+    if (WS2812.bits) violation(&WS2812.partial_pixels, "frame ended in the middle of a pixel", cycle);
+    WS2812.frame_pixels = WS2812.index;
+    WS2812.overflow_pixels = (WS2812.index > WS2812.num_pixels) ? WS2812.index - WS2812.num_pixels : 0;
+    if (WS2812.frames == 0) WS2812.first_latch = WS2812.fell;
+    WS2812.previous_latch = WS2812.last_latch;
+    WS2812.last_latch = WS2812.fell;
+    WS2812.frames++;
+    PRINTI("ws2812: frame %u of %u pixels latched at cycle %u\n", WS2812.frames, WS2812.frame_pixels, cycle);
+    write_frame();
+    WS2812.pixel = WS2812.bits = WS2812.index = 0;
+    WS2812.latched = true;
+}
+
+void run_ws2812(int instance) {
+    uint32_t cycle = exec_cycle();
+    bool level = hardware_get_gpio(WS2812.pin);
+    if (level && !WS2812.last) {
+        if (!WS2812.latched && cycles_to_ns(cycle - WS2812.fell) < WS2812_MIN_LOW) {
+            violation(&WS2812.low_violations, "low between bits too short", cycle);
+        }
+        WS2812.rose = cycle;
+    }
+    else if (!level && WS2812.last) {
+        bit_ended(cycle);
+        WS2812.fell = cycle;
+        WS2812.latched = false;
+        hardware_device_wake_at(WS2812.device, cycle + WS2812.reset_cycles);
+    }
+    else if (!level && !WS2812.latched && cycle - WS2812.fell >= WS2812.reset_cycles) latch(cycle);
+    WS2812.last = level;
+}
+
+uint32_t device_ws2812_frame_rate() {
+    if (WS2812.frames < 2 || WS2812.last_latch == WS2812.previous_latch) return 0;
+    return (uint32_t) ((uint64_t) WS2812.sys_clk / WS2812.clkdiv / (WS2812.last_latch - WS2812.previous_latch));
+}
+
+uint32_t device_ws2812_average_frame_rate() {
+    if (WS2812.frames < 2 || WS2812.last_latch == WS2812.first_latch) return 0;
+    return (uint32_t) ((uint64_t) (WS2812.frames - 1) * (WS2812.sys_clk / WS2812.clkdiv) / (WS2812.last_latch - WS2812.first_latch));
+}
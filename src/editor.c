@@ -2,12 +2,15 @@
  * @file /editor.c
  * @brief A very simple text editor, part of the Simpio project.
  * @details
- * super simple text management: suitable only for very small files!
- * a) model: a linear array (buffer) of chars read from a file, with an array of indecies 
- *           into the first char on a line, and a cursor position at a certain line and 
- *            character position on that line
+ * simple text management:
+ * a) model: the text is kept in a gap buffer (an array of chars with a gap at the place of the last edit, so typing only
+ *           moves chars when the edit position moves), along with a line index that is also kept as a gap buffer, split
+ *           at the line being edited: lines before the split hold where they start, lines after it hold how far their
+ *           start is from the end of the text, so adding or deleting a char doesn't change either part. Both grow as
+ *           needed, there is no limit on the size of a file. The cursor is at a certain line and character position.
  * b) view: displayed in a window from first to last line (based on size of the window)
- *          with cursor displayed on x and y position on the screen
+ *          with cursor displayed on x and y position on the screen; only lines that changed since the window was last
+ *          refreshed are redrawn (all of them after scrolling)
  * c) controller: scrolling operations affect view only (but somewhat based on the model)
  *                while operations that add and remove chars affect both the view and
  *                the underlying model
@@ -18,44 +21,146 @@
 #include "editor.h"
 #include "instruction.h"
 #include "ui.h"
+#include <string.h>
 
 static int linenum_color;
 
+/**********************************************************************************
+ * model
+ **********************************************************************************/
+
+#define GAP(ed)       ((ed)->gap_end - (ed)->gap_start)
+#define LINES_GAP(ed) ((ed)->lines_gap_end - (ed)->lines_gap_start)
+
+static char ed_char(editor_t *ed, int pos) {
+  return (pos < ed->gap_start) ? ed->text[pos] : ed->text[pos + GAP(ed)];
+}
+
+static int ed_line_start(editor_t *ed, int line) {
+  if (line < ed->lines_gap_start) return ed->lines[line];
+  return ed->num_chars - ed->lines[line + LINES_GAP(ed)];
+}
+
+/* not counting the end of line (LF or CRLF) */
+static int ed_line_length(editor_t *ed, int line) {
+  int start = ed_line_start(ed, line);
+  int end = (line+1 < ed->num_lines) ? ed_line_start(ed, line+1) - 1 : ed->num_chars;
+  if (end > start && ed_char(ed, end-1) == '\r') end--;
+  return end - start;
+}
+
+static bool ed_grow_text(editor_t *ed, int needed) {
+  int new_size, after;
+  char * text;
+  if (GAP(ed) >= needed) return true;
+  new_size = ed->text_size ? ed->text_size : ED_INITIAL_TEXT_SIZE;
+  while (new_size - ed->num_chars < needed) new_size *= 2;
+  text = realloc(ed->text, new_size);
+  if (!text) return false;
+  after = ed->text_size - ed->gap_end;
+  memmove(text + new_size - after, text + ed->gap_end, after);
+  ed->gap_end = new_size - after;
+  ed->text = text;
+  ed->text_size = new_size;
+  return true;
+}
+
+static bool ed_grow_lines(editor_t *ed, int needed) {
+  int new_size, after;
+  int * lines;
+  if (LINES_GAP(ed) >= needed) return true;
+  new_size = ed->lines_size ? ed->lines_size : ED_INITIAL_LINES_SIZE;
+  while (new_size - ed->num_lines < needed) new_size *= 2;
+  lines = realloc(ed->lines, new_size * sizeof(int));
+  if (!lines) return false;
+  after = ed->lines_size - ed->lines_gap_end;
+  memmove(lines + new_size - after, lines + ed->lines_gap_end, after * sizeof(int));
+  ed->lines_gap_end = new_size - after;
+  ed->lines = lines;
+  ed->lines_size = new_size;
+  return true;
+}
+
+static void ed_move_gap(editor_t *ed, int pos) {
+  int n;
+  if (pos < ed->gap_start) {
+    n = ed->gap_start - pos;
+    memmove(ed->text + ed->gap_end - n, ed->text + pos, n);
+    ed->gap_start -= n;
+    ed->gap_end -= n;
+  }
+  else if (pos > ed->gap_start) {
+    n = pos - ed->gap_start;
+    memmove(ed->text + ed->gap_start, ed->text + ed->gap_end, n);
+    ed->gap_start += n;
+    ed->gap_end += n;
+  }
+}
+
+/* lines before split hold their start, the rest their distance from the end of the text */
+static void ed_move_lines_gap(editor_t *ed, int split) {
+  while (ed->lines_gap_start < split) {
+    ed->lines[ed->lines_gap_start++] = ed->num_chars - ed->lines[ed->lines_gap_end++];
+  }
+  while (ed->lines_gap_start > split) {
+    ed->lines[--ed->lines_gap_end] = ed->num_chars - ed->lines[--ed->lines_gap_start];
+  }
+}
+
+/* pos must be in line (or at its end) */
+static bool ed_model_insert(editor_t *ed, int line, int pos, char ch) {
+  if (!ed_grow_text(ed, 1)) return false;
+  if (ch == '\n' && !ed_grow_lines(ed, 1)) return false;
+  ed_move_gap(ed, pos);
+  ed_move_lines_gap(ed, line+1);
+  ed->text[ed->gap_start++] = ch;
+  ed->num_chars++;
+  if (ch == '\n') {
+    ed->lines[ed->lines_gap_start++] = pos+1;
+    ed->num_lines++;
+  }
+  return true;
+}
+
+/* returns the char deleted, or 0 if pos is at the end of the text */
+static char ed_model_delete(editor_t *ed, int line, int pos) {
+  char ch;
+  if (pos >= ed->num_chars) return 0;
+  ed_move_gap(ed, pos);
+  ed_move_lines_gap(ed, line+1);
+  ch = ed->text[ed->gap_end++];
+  ed->num_chars--;
+  if (ch == '\n') {
+    /* the next line is now part of this one */
+    ed->lines_gap_end++;
+    ed->num_lines--;
+  }
+  return ch;
+}
+
+char * ed_text(editor_t *ed) {
+  if (!ed_grow_text(ed, 1)) return NULL;
+  ed_move_gap(ed, ed->num_chars);
+  ed->text[ed->num_chars] = '\0';
+  return ed->text;
+}
+
 int ed_init(editor_t *ed, FILE *tf, WINDOW * win, int color) {
+  int ch;
   linenum_color = color;
-  /* read from file into buffer and identify start of each line */
-  char ch;
-  int saw_cr = 0;
-  int saw_lf = 0;
-  int line_start = 0;
-  bool saw_eof = false;
-  ed->num_chars = 0;
-  ed->num_lines = 0;
   if (!tf) return 0;
-  for (ed->num_chars=0, ch=fgetc(tf); (ed->num_chars < TEXT_BUFFER_SIZE) && !saw_eof; ed->num_chars++, ch=fgetc(tf)) {
-    ed->buffer[ed->num_chars] = ch;
-    // account for Windows and Linux style EOLs - either CRLF or just LF
-    if (saw_lf) {
-      if (saw_cr && saw_lf) ed->line_ends[ed->num_lines] = ed->num_chars - 2;
-      else ed->line_ends[ed->num_lines] = ed->num_chars - 1;
-      ed->line_starts[ed->num_lines] = line_start;
-      if (++ed->num_lines >= MAX_NUMBER_OF_LINES) {
-        status_msg("ERROR: file size exceeds max number of lines!!!\n");
-        break;
-      }
-      line_start = ed->num_chars;  /* next line starts here */
-      saw_lf = 0;
-      saw_cr = 0;
+  /* read from file into the buffer, every LF starts a new line */
+  ed->num_chars = 0;
+  ed->num_lines = 1;
+  if (!ed_grow_lines(ed, 1)) return 0;
+  ed->lines[0] = 0;
+  ed->lines_gap_start = 1;
+  for (ch = fgetc(tf); ch != EOF; ch = fgetc(tf)) {
+    if (!ed_model_insert(ed, ed->num_lines-1, ed->num_chars, ch)) {
+      status_msg("ERROR: not enough memory for the file!!!\n");
+      break;
     }
-    if (ch == '\r') saw_cr = 1;
-    if (ch == '\n') saw_lf = 1;
-    if (ch == EOF) saw_eof = true;
   }
-  if (ed->num_chars == TEXT_BUFFER_SIZE) status_msg("ERROR: file size exceeds buffer size!!!\n");
-  /* handle last line that is unhandled when loop ends */
-  if (saw_lf && saw_cr) ed->line_ends[ed->num_lines] = ed->num_chars - 2;
-  else ed->line_ends[ed->num_lines] = ed->num_chars - 1;
-  ed->line_starts[ed->num_lines++] = line_start;
   /* set up the view */
   ed->current_line = 0;
   ed->window = win;
@@ -64,10 +169,34 @@ int ed_init(editor_t *ed, FILE *tf, WINDOW * win, int color) {
   ed->last_displayed_line = (ed->num_lines < ed->window_num_rows) ? ed->num_lines-1 : ed->window_num_rows-1;
   ed->cursor_x = 0;
   ed->cursor_y = 0;
+  ed->dirty_first_line = 0;
+  ed->dirty_last_line = -1;
+  ed->painted_first_line = -1;
   status_msg("editor: lines=%d chars=%d window rows=%d\n", ed->num_lines, ed->num_chars, ed->window_num_rows);
   return 1;
 }
 
+/**********************************************************************************
+ * view
+ **********************************************************************************/
+
+static void ed_mark_dirty(editor_t *ed, int first_line, int last_line) {
+  if (ed->dirty_first_line > ed->dirty_last_line) {
+    ed->dirty_first_line = first_line;
+    ed->dirty_last_line = last_line;
+    return;
+  }
+  if (first_line < ed->dirty_first_line) ed->dirty_first_line = first_line;
+  if (last_line > ed->dirty_last_line) ed->dirty_last_line = last_line;
+}
+
+/* after adding or removing lines, everything from line down moves */
+static void ed_lines_changed(editor_t *ed, int line) {
+  int last = ed->first_displayed_line + ed->window_num_rows - 1;
+  ed->last_displayed_line = (last < ed->num_lines) ? last : ed->num_lines-1;
+  ed_mark_dirty(ed, line, ed->first_displayed_line + ed->window_num_rows - 1);
+}
+
 void ed_clear_display(editor_t *ed) {
   werase(ed->window);
 }
@@ -78,37 +207,64 @@ void ed_clear_display_line(editor_t *ed, int line_num) {
   wmove(ed->window, ed->cursor_y, ed->cursor_x);
 }
 
+/* lines past the end of the text are cleared */
 void ed_display_line(editor_t *ed, int line_num) {
-  int i;
-  int line_len = ed->line_ends[line_num] - ed->line_starts[line_num];
-  int len = (ed->window_num_cols < line_len) ? ed->window_num_cols : line_len;
+  int i, start, len;
   int row = line_num - ed->first_displayed_line;
-  if (instruction_is_breakpoint(line_num+1)) wattron(ed->window, A_BOLD);
-  else wattroff(ed->window, A_BOLD);
+  if (row < 0 || row >= ed->window_num_rows) return;
   wmove(ed->window, row, 0);
-  wattron(ed->window, linenum_color);
-  wprintw(ed->window, "%03d ", line_num+1);
-  wattroff(ed->window, linenum_color);
-  for (i=ed->line_starts[line_num]; i < (ed->line_starts[line_num] + len); i++) {
-    waddch(ed->window, ed->buffer[i]);
+  if (line_num < ed->num_lines) {
+    start = ed_line_start(ed, line_num);
+    len = ed_line_length(ed, line_num);
+    if (ed->window_num_cols < len) len = ed->window_num_cols;
+    if (instruction_is_breakpoint(line_num+1)) wattron(ed->window, A_BOLD);
+    else wattroff(ed->window, A_BOLD);
+    wattron(ed->window, linenum_color);
+    wprintw(ed->window, "%03d ", line_num+1);
+    wattroff(ed->window, linenum_color);
+    for (i=start; i < start + len; i++) waddch(ed->window, ed_char(ed, i));
   }
+  wclrtoeol(ed->window);
 }
 
+static void ed_display_dirty(editor_t *ed) {
+  int i, first, last;
+  first = (ed->dirty_first_line > ed->first_displayed_line) ? ed->dirty_first_line : ed->first_displayed_line;
+  last = ed->first_displayed_line + ed->window_num_rows - 1;
+  if (ed->dirty_last_line < last) last = ed->dirty_last_line;
+  for (i = first; i <= last; i++) ed_display_line(ed, i);
+  ed->dirty_first_line = 0;
+  ed->dirty_last_line = -1;
+}
+
+/* everything (e.g., after breakpoints changed or another window was on top of this one) */
 void ed_display(editor_t *ed) {
-  int i;
-  for (i = ed->first_displayed_line; i <= ed->last_displayed_line; i++) {
-      ed_display_line(ed, i);  
-  }
+  touchwin(ed->window);
+  ed_mark_dirty(ed, ed->first_displayed_line, ed->first_displayed_line + ed->window_num_rows - 1);
+  ed_display_dirty(ed);
   //status_msg("refresh: first_line=%d last_line=%d \n", ed->first_displayed_line, ed->last_displayed_line);
 }
 
-void ed_display_refresh(editor_t *ed) {
-  werase(ed->window);
-  ed_display(ed);
+/* just what changed, unless scrolled; only updates the virtual screen, for painting with other windows (see doupdate) */
+void ed_display_noutrefresh(editor_t *ed) {
+  if (ed->painted_first_line != ed->first_displayed_line) {
+    ed->painted_first_line = ed->first_displayed_line;
+    ed_mark_dirty(ed, ed->first_displayed_line, ed->first_displayed_line + ed->window_num_rows - 1);
+  }
+  ed_display_dirty(ed);
   wmove(ed->window, ed->cursor_y, ed->cursor_x+4);  //TODO: make line number field adjustment not hardcoded
-  wrefresh(ed->window);
+  wnoutrefresh(ed->window);
 }
 
+void ed_display_refresh(editor_t *ed) {
+  ed_display_noutrefresh(ed);
+  doupdate();
+}
+
+/**********************************************************************************
+ * controller
+ **********************************************************************************/
+
 void ed_home(editor_t *ed) {
   /* update the model */
   ed->current_line = ed->first_displayed_line;
@@ -133,7 +289,7 @@ void ed_up(editor_t *ed) {
   }
   else ed->cursor_y--;  
   // adjust cursor if this line is shorter
-  line_len = ed->line_ends[ed->current_line] - ed->line_starts[ed->current_line] - 1; /* note that x cursor starts at zero */
+  line_len = ed_line_length(ed, ed->current_line); /* note that the cursor can be just past the last char, to add to the line */
   if (ed->cursor_x > line_len) ed->cursor_x = line_len; 
   if (ed->cursor_x < 0) ed->cursor_x = 0;
   wmove(ed->window, ed->cursor_y, ed->cursor_x);
@@ -154,7 +310,7 @@ void ed_down(editor_t *ed) {
   }
   else ed->cursor_y++;  
   // adjust cursor if this line is shorter
-  line_len = ed->line_ends[ed->current_line] - ed->line_starts[ed->current_line] - 1; /* note that x cursor starts at zero */
+  line_len = ed_line_length(ed, ed->current_line); /* note that the cursor can be just past the last char, to add to the line */
   if (ed->cursor_x > line_len) ed->cursor_x = line_len; 
   if (ed->cursor_x < 0) ed->cursor_x = 0;
   wmove(ed->window, ed->cursor_y, ed->cursor_x);
@@ -162,8 +318,7 @@ void ed_down(editor_t *ed) {
 
 void ed_right(editor_t *ed) {
   int line_len;
-  line_len = ed->line_ends[ed->current_line] - ed->line_starts[ed->current_line] - 1; /* note that x cursor starts at zero */
-  //status_msg("current_line:%d start:%d end:%d\n", ed->current_line, ed->line_starts[ed->current_line], ed->line_ends[ed->current_line]);
+  line_len = ed_line_length(ed, ed->current_line); /* note that the cursor can be just past the last char, to add to the line */
   ed->cursor_x++;
   if (ed->cursor_x > line_len) ed->cursor_x = line_len;  
   if (ed->cursor_x < 0) ed->cursor_x = 0;
@@ -183,6 +338,7 @@ void ed_page_down(editor_t *ed) {
   if ((ed->last_displayed_line + scroll_amount) >= ed->num_lines) ed->last_displayed_line = ed->num_lines - 1;
   else ed->last_displayed_line += scroll_amount;
   ed->first_displayed_line = ed->last_displayed_line - ed->window_num_rows + 1;
+  if (ed->first_displayed_line < 0) ed->first_displayed_line = 0;
   movement = ed->last_displayed_line - prev_last_line;
   ed->current_line += movement;
 }
@@ -194,54 +350,52 @@ void ed_page_up(editor_t *ed) {
   if ((ed->first_displayed_line - scroll_amount) <= 0) ed->first_displayed_line = 0;
   else ed->first_displayed_line -= scroll_amount;
   ed->last_displayed_line = ed->first_displayed_line + ed->window_num_rows - 1;
+  if (ed->last_displayed_line >= ed->num_lines) ed->last_displayed_line = ed->num_lines - 1;
   movement = prev_first_line - ed->first_displayed_line;
   ed->current_line -= movement;
 }
 
 void ed_del_char(editor_t *ed) {
-  /* update model */
-  int i;
-  for (i = ed->line_starts[ed->current_line] + ed->cursor_x; i < ed->num_chars; i++) ed->buffer[i] = ed->buffer[i+1];
-  ed->num_chars--;
-  ed->line_ends[ed->current_line]--;
-  for (i=ed->num_lines-1; i>ed->current_line; i--) {
-    ed->line_starts[i]--;
-    ed->line_ends[i]--;
-  }
+  /* update model (at the end of a line, this joins the next line to it) */
+  int pos = ed_line_start(ed, ed->current_line) + ed->cursor_x;
+  char ch;
+  if (ed_char(ed, pos) == '\r' && pos+1 < ed->num_chars && ed_char(ed, pos+1) == '\n') ed_model_delete(ed, ed->current_line, pos);
+  ch = ed_model_delete(ed, ed->current_line, pos);
   /* update view */
-  wdelch(ed->window);
+  if (ch == '\n') ed_lines_changed(ed, ed->current_line);
+  else ed_mark_dirty(ed, ed->current_line, ed->current_line);
 }
 
 void ed_insert_char(editor_t *ed, char ch) {
-  /* update model (if full, do nothing, else make room and add the char */
-  int i, pos;
-  if (ed->num_chars >= TEXT_BUFFER_SIZE) {
+  /* update model (at the end of a line, a LF adds a new line after it) */
+  int pos = ed_line_start(ed, ed->current_line) + ed->cursor_x;
+  if (!ed_model_insert(ed, ed->current_line, pos, ch)) {
     status_msg("buffer full\n");
     return;
   }
-  pos = ed->line_starts[ed->current_line] + ed->cursor_x;
-  for (i = ed->num_chars; i > pos; i--) ed->buffer[i] = ed->buffer[i-1];
-  ed->num_chars++;
-  ed->line_ends[ed->current_line]++;
-  for (i=ed->num_lines-1; i>ed->current_line; i--) {
-    ed->line_starts[i]++;
-    ed->line_ends[i]++;
-  }
-  ed->buffer[pos] = ch;
   /* update view */
-  waddch(ed->window, ch);
+  if (ch == '\n') {
+    ed_lines_changed(ed, ed->current_line);
+    ed->cursor_x = 0;
+    ed_down(ed);
+    return;
+  }
+  ed_mark_dirty(ed, ed->current_line, ed->current_line);
   ed_right(ed);
 }
 
 void ed_goto_line(editor_t *ed, int line_num) {
   line_num--; /* adjust so that it starts at zero, like the window numbering */
+  if (line_num < 0) line_num = 0;
+  if (line_num >= ed->num_lines) line_num = ed->num_lines - 1;
   if (line_num < ed->first_displayed_line || line_num > ed->last_displayed_line) {
     /* scroll to line_num */
     ed->first_displayed_line = line_num;
     ed->last_displayed_line = ed->first_displayed_line + ed->window_num_rows - 1;
     if (ed->last_displayed_line >= ed->num_lines) {
-        ed->last_displayed_line = ed->num_lines;
-        ed->first_displayed_line = ed->num_lines - ed->window_num_rows + 1;
+        ed->last_displayed_line = ed->num_lines - 1;
+        ed->first_displayed_line = ed->num_lines - ed->window_num_rows;
+        if (ed->first_displayed_line < 0) ed->first_displayed_line = 0;
     }
   }
   ed->cursor_y = line_num - ed->first_displayed_line;
@@ -21,27 +21,46 @@
 #include "print.h"
 #include "execution.h"
 #include "hardware_changed.h"
-#include "ui.h"
+#include "decoder.h"
+#include "buffer.h"
+#include "context.h"
 #include <string.h>
 
 /***********************************************************************************************************
  * state data
  **********************************************************************************************************/
 
-int current_definition;
-int current_label;
-
-program_t cp;  /* TODO multiple simultaneous program support */
-
-static bool SIMULATION_EXITED;
-
-static exec_context_e exec_context;
+/* scheduling state lives in the simulation context */
+#define EXEC (simpio_context->exec)
+#define HW (simpio_context->hardware)
+#define SIMULATION_EXITED EXEC.simulation_exited
+#define STATE_HASH (simpio_context->state_hash)
 
 void exec_reset() {
-    exec_context = exec_normal;
+    EXEC.context = exec_normal;
     SIMULATION_EXITED = false;
+    EXEC.next_sm = NULL;
+    EXEC.next_up = NULL;
+    EXEC.user_instruction = NULL;
+    EXEC.instruction = NULL;
+    EXEC.last_line = 0;
+    EXEC.try_user_first = true;
+    EXEC.cycle = 0;
+    EXEC.steps = 0;
 }
 
+void exec_set_run_hook(exec_run_hook_t hook) { EXEC.run_hook = hook; }
+
+void exec_break() { atomic_store(&(EXEC.break_requested), true); }
+
+bool exec_exited() { return SIMULATION_EXITED; }
+
+uint32_t exec_cycle() { return EXEC.cycle; }
+
+uint64_t exec_steps() { return EXEC.steps; }
+
+int exec_last_line() { return EXEC.last_line; }
+
 /***********************************************************************************************************
  * helpers
  **********************************************************************************************************/
@@ -444,22 +463,18 @@ bool exec_instruction_decode(sm_t * sm) {
 
 int exec_enable_ih(ih_processor_t * ih) {
     PRINTI("enabling ihs\n");
-    exec_context = exec_interrupt;
+    EXEC.context = exec_interrupt;
     ih->enabled = true;
     ih->pc = 0;
     return ih->instructions[0].line;
 }
 
+/* only raised flags that are mapped to a handler are pending (see hardware.h), so with none this is one test */
 int fired_ihs() {
-    PRINTD("checking ihs\n");
-    FOR_ENUMERATION(f, hardware_irq_flag_t, hardware_irq_flag) {
-        if (f->mapped_to_irq && f->set) {
-            if (!(f->ih->enabled) ) {
-                return exec_enable_ih(f->ih);
-            }
-        }
-    }
-    return -1;
+    ih_processor_t * ih = hardware_irq_next_handler();
+    if (!ih) return -1;
+    PRINTD("irq handler %d fired\n", ih->this_num);
+    return exec_enable_ih(ih);
 }
 
 /***********************************************************************************************************
@@ -470,8 +485,7 @@ bool exec_run_instruction(instruction_t * instruction);
 bool exec_run_user_instruction(user_instruction_t * instruction);
 
 instruction_t* next_instruction() {
-    static sm_t  *sm = NULL;
-    static hardware_sm_enumerator_t e;
+    sm_t * sm = EXEC.next_sm;
     int sm_count;
     pio_t * pio;
     bool found_sm_with_instructions;
@@ -481,18 +495,18 @@ instruction_t* next_instruction() {
        and guarding against infinitely cycling through everything */
     for (sm_count = 0, found_sm_with_instructions = false; sm_count < (NUM_PIOS * NUM_SMS) && !found_sm_with_instructions; sm_count++) {
       if (!sm) {  /* this should only be true when first initialized */
-        sm = hardware_sm_first(&e);
+        sm = hardware_sm_first(&EXEC.next_sm_e);
         //PRINTD("first e = %d pio= %d sm = %d\n", e, sm->pio_num, sm->this_num);
       }
       else {  /* not the first time through */
-        sm = hardware_sm_next(&e);
+        sm = hardware_sm_next(&EXEC.next_sm_e);
         if (sm) {
             //PRINTD("next e = %d pio= %d sm = %d\n", e, sm->pio_num, sm->this_num);
             //PRINTD("next sm  = %x\n", e);
         }
         if (!sm) {
           //PRINTD("going back to first sm\n");
-          sm = hardware_sm_first(&e);
+          sm = hardware_sm_first(&EXEC.next_sm_e);
           //PRINTD("first e = %d pio= %d sm = %d\n", e, sm->pio_num, sm->this_num);
         }
       }
@@ -505,6 +519,7 @@ instruction_t* next_instruction() {
           PRINTD("instruction line num = %d\n", found_instruction->line);
       }
     }
+    EXEC.next_sm = sm;
     if (found_sm_with_instructions) {
         return found_instruction;
     }
@@ -524,8 +539,7 @@ int8_t first_instruction_line() {
 }
 
 user_instruction_t * next_user_instruction(bool dont_switch) {
-    static user_processor_t *up = NULL;
-    static hardware_user_processor_enumerator_t e;
+    user_processor_t * up = EXEC.next_up;
     bool found_up_with_instructions;
     int up_count;
     user_instruction_t * found_instruction;
@@ -534,10 +548,10 @@ user_instruction_t * next_user_instruction(bool dont_switch) {
        and guarding against infinitely cycling through everything */
     for (up_count = 0, found_up_with_instructions = false; up_count < (NUM_USER_PROCESSORS) && !found_up_with_instructions; up_count++) {
       if (!up) {  /* this should only be true when first initialized */
-        up = hardware_user_processor_first(&e);
+        up = hardware_user_processor_first(&EXEC.next_up_e);
       }
       else {  /* not the first time through */
-        if (!dont_switch) up = hardware_user_processor_next(&e);
+        if (!dont_switch) up = hardware_user_processor_next(&EXEC.next_up_e);
         if (!up) {
           continue;
         }
@@ -548,6 +562,7 @@ user_instruction_t * next_user_instruction(bool dont_switch) {
           found_instruction->executing_up = (void *) up;
       }
     }
+    EXEC.next_up = up;
     if (found_up_with_instructions) {
         return found_instruction;
     }
@@ -604,11 +619,30 @@ bool try_sm(instruction_t ** instr) {
  * execution 
  **********************************************************************************************************/
 
+// only devices that have a gpio they are sensitive to changed, or are due to wake up, are run; if no gpio changed and
+// none is due, none of them are looked at
 static void run_each_enabled_device() {
+    hardware_device_t * device;
+    uint32_t gpios = HW.gpio_values;
+    if (gpios == HW.device_gpios && EXEC.cycle < HW.next_wake) return;
     PRINTD("running device handlers\n");
-    FOR_ENUMERATION(device, hardware_device_t, hardware_device_enumerator) {
-        if (device->enabled) (*device->execution_handler)();
-    }    
+    HW.next_wake = DEVICE_NO_WAKE;      /* lowered again by the devices below, and by any handler waking one up */
+    for (device = HW.devices; device <= HW.devices + HW.last_device; device++) {
+        if (!device->enabled) continue;
+        if (device->sensitivity == DEVICE_SENSITIVE_ALWAYS) {
+            (*device->execution_handler)(device->instance);
+            HW.next_wake = 0;
+            continue;
+        }
+        if ((HW.gpio_values & device->sensitivity) != device->last_values || EXEC.cycle >= device->wake_at) {
+            device->wake_at = DEVICE_NO_WAKE;
+            (*device->execution_handler)(device->instance);
+            device->last_values = HW.gpio_values & device->sensitivity;
+        }
+        if (device->wake_at < HW.next_wake) HW.next_wake = device->wake_at;
+    }
+    HW.device_gpios = HW.gpio_values;
+    if (HW.gpio_values != gpios) HW.next_wake = 0;     /* a handler changed a gpio: the devices before it see it next step */
 }
 
 int exec_find_next_instruction_after_interrupt() {
@@ -632,11 +666,12 @@ int exec_step_programs_next_interrupt_instruction() {
             instr = &(ih->instructions[ih->pc]);
             instr->executing_up = (void *) ih;
             completed = exec_run_user_instruction(instr);
+            hardware_resolve_open_drain();
             PRINTI("pc %d (%d)\n", ih->pc, ih->next_instruction_location);
             if (ih->pc >= ih->next_instruction_location) {
                 PRINTI("ih completed\n");
-                ih->enabled = false;
-                exec_context = exec_normal;
+                hardware_irq_handler_done(ih);
+                EXEC.context = exec_normal;
                 return exec_find_next_instruction_after_interrupt();
             }
             else return ih->instructions[ih->pc].line;
@@ -647,104 +682,105 @@ int exec_step_programs_next_interrupt_instruction() {
 
 
 int exec_step_programs_next_instruction() {
-    static user_instruction_t* user_instruction = NULL;
-    static instruction_t* instruction = NULL;
-    static int last_line = 0;
-    static bool try_user_first = true;
-    static bool found_user_instruction;
-    static bool found_sm_instruction;
+    bool found_user_instruction;
+    bool found_sm_instruction;
     sm_t * sm;
     bool completed;
     
+    EXEC.steps++;
     if (SIMULATION_EXITED) {
         PRINTD("exec idle\n");
-        exec_context = exec_idle;
-        return last_line;
+        EXEC.context = exec_idle;
+        return EXEC.last_line;
     }
     
-    if (exec_context == exec_interrupt) {
+    if (EXEC.context == exec_interrupt) {
         PRINTD("exec interrupt\n");
         return exec_step_programs_next_interrupt_instruction();
     }
     
-    found_user_instruction = try_user(&user_instruction);
-    found_sm_instruction = try_sm(&instruction);
+    found_user_instruction = try_user(&EXEC.user_instruction);
+    found_sm_instruction = try_sm(&EXEC.instruction);
     
     if (!found_user_instruction && !found_sm_instruction) {
         PRINTD("no user or sm instruction found, returning last line\n");
-        return last_line;
+        return EXEC.last_line;
     }
     
-    if ( (try_user_first && found_user_instruction) || (!try_user_first  && !found_sm_instruction) ) {
+    if ( (EXEC.try_user_first && found_user_instruction) || (!EXEC.try_user_first  && !found_sm_instruction) ) {
         // execute user instruction and get next one
-        PRINTD("Trying UP first: delay:%d delay_left:%d continue:%d\n", user_instruction->delay, user_instruction->delay_left, user_instruction->continue_user); 
-        if (user_instruction->continue_user && (user_instruction->delay == 0 || user_instruction->delay_left == 1)) { 
-            status_msg("to continue to next user instruction\n"); 
-            try_user_first = true; 
+        PRINTD("Trying UP first: delay:%d delay_left:%d continue:%d\n", EXEC.user_instruction->delay, EXEC.user_instruction->delay_left, EXEC.user_instruction->continue_user); 
+        if (EXEC.user_instruction->continue_user && (EXEC.user_instruction->delay == 0 || EXEC.user_instruction->delay_left == 1)) { 
+            print_msg("to continue to next user instruction\n"); 
+            EXEC.try_user_first = true; 
         }
-        else try_user_first = false;
-        completed = exec_run_user_instruction(user_instruction);
-        if (SIMULATION_EXITED) return last_line;
-        user_instruction = next_user_instruction(try_user_first);  /*dont_switch user processors if in continue_state */
-        found_user_instruction = try_user(&user_instruction);
+        else EXEC.try_user_first = false;
+        completed = exec_run_user_instruction(EXEC.user_instruction);
+        hardware_resolve_open_drain();
+        if (SIMULATION_EXITED) return EXEC.last_line;
+        EXEC.user_instruction = next_user_instruction(EXEC.try_user_first);  /*dont_switch user processors if in continue_state */
+        found_user_instruction = try_user(&EXEC.user_instruction);
         //now find the line of the next instruction that will execute next time around
-        if (!try_user_first) {
-            if (found_sm_instruction) last_line = instruction->line;
+        if (!EXEC.try_user_first) {
+            if (found_sm_instruction) EXEC.last_line = EXEC.instruction->line;
             else {
-                if (found_user_instruction) last_line = user_instruction->line;
+                if (found_user_instruction) EXEC.last_line = EXEC.user_instruction->line;
             }
         }
         else {
-            if (found_user_instruction) last_line = user_instruction->line;
+            if (found_user_instruction) EXEC.last_line = EXEC.user_instruction->line;
             else {
-                if (found_sm_instruction) last_line = instruction->line;
+                if (found_sm_instruction) EXEC.last_line = EXEC.instruction->line;
             }
         }
-        return last_line;
+        return EXEC.last_line;
     }
 
-    if ( (!try_user_first && found_sm_instruction) || (try_user_first  && !found_user_instruction) ) {
+    if ( (!EXEC.try_user_first && found_sm_instruction) || (EXEC.try_user_first  && !found_user_instruction) ) {
         // execute instruction and get next one
-        PRINTD("Trying SM first: delay:%d delay_left:%d\n", instruction->delay, instruction->delay_left); 
-        try_user_first = true;
-        completed = exec_run_instruction(instruction);
+        PRINTD("Trying SM first: delay:%d delay_left:%d\n", EXEC.instruction->delay, ((sm_t *) EXEC.instruction->executing_sm)->instr_state.delay_left); 
+        EXEC.try_user_first = true;
+        completed = exec_run_instruction(EXEC.instruction);
+        hardware_resolve_open_drain();
         run_each_enabled_device();
-        if (SIMULATION_EXITED) return last_line;
-        sm = (sm_t *) instruction->executing_sm;
+        if (SIMULATION_EXITED) return EXEC.last_line;
+        sm = (sm_t *) EXEC.instruction->executing_sm;
+        decoder_update(sm->clock_tick);
         sm->clock_tick++;
-        instruction = next_instruction();
-        last_line = fired_ihs();
-        if (last_line >= 0) return last_line;  // and are now in interrupt context
-        found_sm_instruction = try_sm(&instruction);
-        if (found_user_instruction) last_line = user_instruction->line;
+        if (sm->clock_tick > EXEC.cycle) {
+            EXEC.cycle = sm->clock_tick;
+            if (STATE_HASH.mode != state_hash_off) state_hash_cycle();
+        }
+        EXEC.instruction = next_instruction();
+        EXEC.last_line = fired_ihs();
+        if (EXEC.last_line >= 0) return EXEC.last_line;  // and are now in interrupt context
+        found_sm_instruction = try_sm(&EXEC.instruction);
+        if (found_user_instruction) EXEC.last_line = EXEC.user_instruction->line;
         else {
-            if (found_sm_instruction) last_line = instruction->line;
+            if (found_sm_instruction) EXEC.last_line = EXEC.instruction->line;
         }
-        return last_line;
+        return EXEC.last_line;
     }
     
     // should never get here, but ...
-    return last_line;
+    return EXEC.last_line;
 }
  
-/* runs each defined program/SM in round robin fashion, one clock cycle each, until breakpoint (note will always run at least one instruction) */
+/* runs each defined program/SM in round robin fashion, one clock cycle each, until breakpoint or break (note will always run at least one instruction) */
 int exec_run_all_programs() {
     bool hit_breakpoint = false;
-    bool hit_break_key = false;
-    int next_line;
-    instruction_t * next_instruction;
-    user_instruction_t * next_user_instruction;
-    ui_enter_run_break_mode();
-    while (!hit_breakpoint && !hit_break_key && !SIMULATION_EXITED) {
+    int next_line = EXEC.last_line;
+    unsigned int steps = 0;
+    while (!hit_breakpoint && !atomic_load_explicit(&(EXEC.break_requested), memory_order_relaxed) && !SIMULATION_EXITED) {
       next_line = exec_step_programs_next_instruction();
       hit_breakpoint = instruction_is_breakpoint(next_line);
       if (!hit_breakpoint) {
           next_line = exec_step_programs_next_instruction();
           hit_breakpoint = instruction_is_breakpoint(next_line);
       }
-      hit_break_key = ui_break_check();
+      if (EXEC.run_hook && ((steps += 2) % EXEC_RUN_HOOK_STEPS) == 0) (*EXEC.run_hook)();
     }
-    ui_exit_run_break_mode();
+    atomic_store(&(EXEC.break_requested), false);
     return next_line;
 }
 
@@ -789,14 +825,16 @@ bool run_jmp_instruction(instruction_t * instruction) {
             if (0 <= sm->shiftctl_pull_thresh && sm->shiftctl_pull_thresh <= 31 && sm->shift_out_count < sm->shiftctl_pull_thresh) branch = true;
             break;
     };
-    if (!instruction->jmp_pc_set) {
+    if (instruction->jmp_pc_set) sm->instr_state.jmp_pc = instruction->jmp_pc;
+    else {
         if (branch) {
-            instruction->jmp_pc = instruction_label_location(instruction->location);  /* uses location into labels array to find instruction location */
-            PRINTD("Jumping to instruction %d (line %d)\n", instruction->jmp_pc, instruction->location);
+            /* uses location into labels array to find instruction location, relocated with the program */
+            sm->instr_state.jmp_pc = instruction_label_location(instruction->location) + instruction->relocation;
+            PRINTD("Jumping to instruction %d (line %d)\n", sm->instr_state.jmp_pc, instruction->location);
         }
         else {
-            instruction->jmp_pc = sm->pc + 1;
-            PRINTD("Continuing to instruction %d\n", instruction->jmp_pc);
+            sm->instr_state.jmp_pc = sm->pc + 1;
+            PRINTD("Continuing to instruction %d\n", sm->instr_state.jmp_pc);
         }
     }
     return true;
@@ -1153,7 +1191,7 @@ bool run_out_instruction(instruction_t * instruction) {
     completed = true; 
     if (instruction->destination == pc_destination) {
         pio_t * pio = (pio_t *) sm->pio;
-        if (0 <= sm->pc_temp && sm->pc_temp < pio->next_instruction_location) {
+        if (0 <= sm->pc_temp && sm->pc_temp < NUM_INSTRUCTIONS && pio->instructions[sm->pc_temp].instruction_type != empty_instruction) {
           PRINTI("setting PC to %d\n", sm->pc_temp);
           sm->pc = sm->pc_temp-1;  /* one will be added to the pc as part of general intruction execution */
         }
@@ -1330,8 +1368,11 @@ bool run_set_instruction(instruction_t * instruction) {
             sm->scratch_y = value;
             break;
         case pindirs_destination: 
-            PRINTI("setting pin %d to direction to %d\n", pin_num, value);
-            hardware_set_gpio_dir(pin_num, value);
+            PRINTI("setting pin directions %d..%d to %d\n", sm->set_pins_base, sm->set_pins_base + (sm->set_pins_num-1), value);
+            for (pin_num = sm->set_pins_base; pin_num < (sm->set_pins_base + sm->set_pins_num); pin_num++) {
+                hardware_set_gpio_dir(pin_num, value %  2);
+                value = value >> 1;
+            }
             break;
         default: 
             PRINT("ERROR: invalid destination for set instruction: ");
@@ -1361,11 +1402,11 @@ bool run_irq_instruction(instruction_t * instruction) {
             hardware_irq_flag_set(flag_num, true);
             break;
         case wait_operation:
-            if (instruction->already_set_waiting) {
+            if (sm->instr_state.already_set_waiting) {
                 flag_state = hardware_irq_flag_is_set(flag_num);
                 if (!flag_state) {
                     PRINTI("Wait done for irq %d to be cleared\n", flag_num);
-                    instruction->already_set_waiting = false;
+                    sm->instr_state.already_set_waiting = false;
                     completed = true;
                 }
                 else {
@@ -1376,7 +1417,7 @@ bool run_irq_instruction(instruction_t * instruction) {
             else {
                 PRINTI("Setting irq %d and waiting for it to be cleared\n", flag_num);
                 hardware_irq_flag_set(flag_num, true);
-                instruction->already_set_waiting = true;
+                sm->instr_state.already_set_waiting = true;
                 completed = false;
             }
             break;
@@ -1422,7 +1463,7 @@ bool run_read_instruction(user_instruction_t * instruction) {
     uint32_t value;
     if (sm->fifo.rx_state != FIFO_EMPTY) {
         fifo_read(&(sm->fifo), &value);
-        rc = instruction_var_set(instruction->var_name, value);
+        rc = instruction_var_set_index(instruction->var_index, value);
         if (!rc) { PRINT("unable to set %s to %d\n", instruction->var_name, value); }
         completed = true;
     }
@@ -1430,6 +1471,66 @@ bool run_read_instruction(user_instruction_t * instruction) {
     return completed;
 }
 
+/********************************
+ **** Block Instructions ********
+ *******************************/
+
+/* the block instructions simulate a client C program handing a whole buffer to the SDK (or DMA); each step moves as many words
+   as the FIFO takes or has, so a transfer is not a scheduled user instruction per word */
+bool run_write_block_instruction(user_instruction_t * instr) {
+    sm_t * sm = (sm_t *) instr->executing_sm;
+    buffer_data_t * buffer = buffer_data(instr->buffer_index);
+    uint32_t written = instr->data_index;
+    while (written < buffer->length && fifo_write(&(sm->fifo), buffer->words[written])) written++;
+    PRINTI("wrote %u of %u words of the block\n", written, buffer->length);
+    instr->data_index = written;
+    return (written >= buffer->length);
+}
+
+bool run_read_block_instruction(user_instruction_t * instr) {
+    sm_t * sm = (sm_t *) instr->executing_sm;
+    buffer_data_t * buffer = buffer_data(instr->buffer_index);
+    uint32_t read = instr->data_index;
+    if (read == 0) {
+        if (!buffer_reserve(instr->buffer_index, instr->value)) {
+            PRINT("not enough memory to read %u words, line %d\n", instr->value, instr->line);
+            return true;
+        }
+        buffer->length = 0;
+    }
+    while (read < instr->value && fifo_read(&(sm->fifo), &(buffer->words[read]))) read++;
+    PRINTI("read %u of %u words of the block\n", read, instr->value);
+    buffer->length = read;
+    instr->data_index = read;
+    return (read >= instr->value);
+}
+
+#define BLOCK_WORDS_PER_LINE 8
+
+bool run_print_block_instruction(user_instruction_t * instr) {
+    buffer_data_t * buffer = buffer_data(instr->buffer_index);
+    char line[BLOCK_WORDS_PER_LINE * 9 + 1];
+    uint32_t i;
+    int used = 0;
+    PRINT("%s (%u words):\n", instr->var_name, buffer->length);
+    for (i = 0; i < buffer->length; i++) {
+        used += snprintf(line + used, sizeof(line) - used, " %08X", buffer->words[i]);
+        if ((i + 1) % BLOCK_WORDS_PER_LINE == 0 || i + 1 == buffer->length) {
+            PRINT("%s\n", line);
+            used = 0;
+        }
+    }
+    return true;
+}
+
+/* waits until the RX FIFO has at least level words, or the TX FIFO at most level words */
+bool run_wait_level_instruction(user_instruction_t * instr) {
+    sm_t * sm = (sm_t *) instr->executing_sm;
+    int level = fifo_level(&(sm->fifo), instr->rx_fifo);
+    if (instr->rx_fifo) return (level >= (int) instr->value);
+    return (level <= (int) instr->value);
+}
+
 /********************************
  **** PRINT Instruction *********
  *******************************/
@@ -1439,7 +1540,7 @@ bool run_print_instruction(user_instruction_t * instruction) {
     bool completed;
     bool rc;
     uint32_t value;
-    rc = instruction_var_get(instruction->var_name, &value);
+    rc = instruction_var_get_index(instruction->var_index, &value);
     if (!rc) { PRINT("unable to print %s, variable not defined\n", instruction->var_name); }
     else PRINT("%s = %08X\n", instruction->var_name, value);
     return true;
@@ -1481,6 +1582,14 @@ void run_side_set(instruction_t * instruction) {
  **** Data Instruction *********
  *******************************/
 
+/* a received character is stored at the read position, the data ending after it */
+static void data_received(user_processor_t * up, user_instruction_t * instr, uint32_t value) {
+    up->data[instr->data_index] = value;
+    instr->data_index = instr->data_index + 1;
+    up->data[instr->data_index] = '\0';
+    up->data_length = instr->data_index;
+}
+
 bool run_data_instruction(user_instruction_t * instr) {
     bool completed = false;
     uint32_t value;
@@ -1488,29 +1597,31 @@ bool run_data_instruction(user_instruction_t * instr) {
     user_processor_t * up = (user_processor_t *) instr->executing_up;
     switch (instr->data_operation_type) {
         case data_write:
+            if (up->data_length == 0) {
+                completed = true;
+                break;
+            }
             value = up->data[instr->data_index];
             PRINTI("To write [%d]: %c\n", instr->data_index, value);
             if (sm->fifo.tx_state != FIFO_FULL) {
                 fifo_write(&(sm->fifo), value);
                 instr->data_index = instr->data_index + 1;
-                if (instr->data_index == strlen(up->data)) completed =true;
+                if (instr->data_index == up->data_length) completed =true;
             }
             break;
         case data_read:        
             if (sm->fifo.rx_state != FIFO_EMPTY) {
                 fifo_read(&(sm->fifo), &value);
-                up->data[instr->data_index] = value;
-                instr->data_index = instr->data_index + 1;
-                if ((instr->data_index == instr->max_read_index) || (instr->data_index == STRING_MAX) ) completed = true;
+                data_received(up, instr, value);
+                if ((instr->data_index == instr->max_read_index) || (instr->data_index == STRING_MAX - 1) ) completed = true;
             }
             else PRINTI("Waiting on something in RX FIFO\n");
             break;
         case data_readln:
             if (sm->fifo.rx_state != FIFO_EMPTY) {
                 fifo_read(&(sm->fifo), &value);
-                up->data[instr->data_index] = value;
-                instr->data_index = instr->data_index + 1;
-                if ((value == '.') || (instr->data_index == STRING_MAX) ) completed = true;
+                data_received(up, instr, value);
+                if ((value == '.') || (instr->data_index == STRING_MAX - 1) ) completed = true;
             }
             else PRINTI("Waiting on something in RX FIFO\n");
             break;
@@ -1521,10 +1632,12 @@ bool run_data_instruction(user_instruction_t * instr) {
         case data_set:
             PRINTI("setting data to %s\n", instr->data_ptr);
             snprintf(up->data, STRING_MAX, "%s", instr->data_ptr);
+            up->data_length = strlen(up->data);
             completed = true;
             break;
         case data_clear:
             up->data[0] = '\0';
+            up->data_length = 0;
             instr->data_index = 0;
             completed = true;
             break;
@@ -1578,7 +1691,8 @@ bool run_empty_user_instruction(user_instruction_t * instruction) {
 bool exec_run_instruction(instruction_t * instruction) {
     bool completed;
     sm_t * sm = (sm_t *) instruction->executing_sm;
-    if (!instruction->in_delay_state) {
+    instruction_exec_state_t * state = &(sm->instr_state);
+    if (!state->in_delay_state) {
         PRINTD("instruction: %d\n", instruction->instruction_type);
         switch (instruction->instruction_type) {
             case jmp_instruction:    completed = run_jmp_instruction(instruction); break;
@@ -1600,29 +1714,28 @@ bool exec_run_instruction(instruction_t * instruction) {
         }
         if (instruction->side_set_value >= 0) run_side_set(instruction);
         if (completed && instruction->delay > 0) {
-            instruction->in_delay_state = true;
-            instruction->delay_left = instruction->delay-1;
+            state->in_delay_state = true;
+            state->delay_left = instruction->delay-1;
             completed = false;
             PRINTD("not done, ... delaying\n");
         }
     }
     else {
-        if (instruction->delay_left > 0) {
+        if (state->delay_left > 0) {
             PRINTD("...still delaying\n");
-            instruction->delay_left--;
+            state->delay_left--;
             completed = false;
         }
         else {
             PRINTD("...delay done\n");
             completed = true;
-            instruction->in_delay_state = false;
+            state->in_delay_state = false;
         }
     }
     hardware_changed_gpio_history_update();
     if (completed) {
-        instruction_reset(instruction);
-        sm = (sm_t *) instruction->executing_sm;
-        if (instruction->instruction_type == jmp_instruction) sm->pc = instruction->jmp_pc;
+        instruction_reset(state);
+        if (instruction->instruction_type == jmp_instruction) sm->pc = state->jmp_pc;
         else {
             if ( (instruction->instruction_type == out_instruction) && (instruction->destination == exec_destination) ) {
                 PRINTI("pc set by instruction written\n");
@@ -1638,7 +1751,7 @@ bool exec_run_instruction(instruction_t * instruction) {
             }
         }
     }
-    else instruction->not_completed = true;
+    else state->not_completed = true;
     return completed;
 }
 
@@ -1673,6 +1786,10 @@ bool exec_run_user_instruction(user_instruction_t * instruction) {
             case pin_instruction:         completed = run_pin_instruction(instruction); break;
             case repeat_instruction:      completed = run_repeat_instruction(instruction); break;
             case exit_instruction:        completed = run_exit_instruction(instruction); break;
+            case write_block_instruction: completed = run_write_block_instruction(instruction); break;
+            case read_block_instruction:  completed = run_read_block_instruction(instruction); break;
+            case print_block_instruction: completed = run_print_block_instruction(instruction); break;
+            case wait_level_instruction:  completed = run_wait_level_instruction(instruction); break;
             case empty_user_instruction:  completed = run_empty_user_instruction(instruction); break;
         };
     }
@@ -20,6 +20,8 @@ void fifo_init(fifo_t * f, fifo_mode_t mode) {
     f->tx_state = FIFO_EMPTY;
     f->status = ALL_ONES;
     f->EXECCTRL_STATUS_SEL = true;
+    f->pushed = 0;
+    f->pulled = 0;
    switch(mode) {
        case BIDI:
            f->mode = BIDI;
@@ -120,6 +122,7 @@ bool fifo_push(fifo_t * f, uint32_t value) {
        if (f->rx_top == f->tx_bottom) f->rx_state = FIFO_FULL;       
        else f->rx_state = FIFO_HAS_DATA;
        f->buffer[f->rx_bottom] = value;
+       f->pushed++;
    }
    set_status(f);
    PRINTI("pushed %08X, now in fifo: %d\n", value, f->rx_top - f->rx_bottom);    
@@ -139,6 +142,7 @@ bool fifo_pull(fifo_t * f, uint32_t * value_ptr) {
    f->tx_top--;
    if (f->tx_top == f->tx_bottom) f->tx_state = FIFO_EMPTY;
    else f->tx_state = FIFO_HAS_DATA;
+   f->pulled++;
    set_status(f);
    PRINTI("pulled %d, now in fifo: %d\n", *value_ptr, f->tx_top - f->tx_bottom);    
    return true;
@@ -176,3 +180,7 @@ fifo_compare_t fifo_compare(fifo_t * from, fifo_t * to) {
     return FIFO_MATCH;
 }
 
+int fifo_level(fifo_t * f, bool rx) {
+    if (rx) return (f->rx_state == FIFO_EMPTY) ? 0 : f->rx_top - f->rx_bottom;
+    return (f->tx_state == FIFO_EMPTY) ? 0 : f->tx_top - f->tx_bottom;
+}
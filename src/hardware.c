@@ -11,50 +11,39 @@
  */
   
 #include "hardware.h"
-#include "ui.h"
+#include "context.h"
 #include "print.h"
 #include <string.h>
 
 
-/* hardware state data */
-static pio_t pios[NUM_PIOS];
-static sm_t  sms[NUM_PIOS * NUM_SMS];  /* sm index for the s'th sm in p'th pio is p*NUM_SMS + s */ 
-static gpio_t gpios[NUM_GPIOS];
-static user_processor_t user_processors[NUM_USER_PROCESSORS];
-static ih_processor_t ih_processors[NUM_IH_PROCESSORS];
-static hardware_irq_flag_t hardware_irq_flags[NUM_IRQ_FLAGS];
+/* hardware state data lives in the simulation context */
+#define HW (simpio_context->hardware)
 
-static int current_pio = -1;
-static int current_sm = -1;
-static int current_up = -1;
-static int current_ih = -1;
-
-static char current_program_name[SYMBOL_MAX];
-
-static user_instruction_context_e user_instruction_context;
-user_instruction_context_e hardware_get_user_instruction_context()  {return user_instruction_context;}
+user_instruction_context_e hardware_get_user_instruction_context()  {return HW.user_instruction_context;}
 
 
 /* enumerators */
 
-IMPLEMENT_ENUMERATOR(pio_t, hardware_pio, pios, NUM_PIOS)
-IMPLEMENT_ENUMERATOR(sm_t, hardware_sm, sms, NUM_PIOS * NUM_SMS)
-IMPLEMENT_ENUMERATOR(user_processor_t, hardware_user_processor, user_processors, NUM_USER_PROCESSORS)
-IMPLEMENT_ENUMERATOR(ih_processor_t, hardware_ih_processor, ih_processors, NUM_IH_PROCESSORS)
-IMPLEMENT_ENUMERATOR(hardware_irq_flag_t, hardware_irq_flag, hardware_irq_flags, NUM_IRQ_FLAGS)
+IMPLEMENT_ENUMERATOR(pio_t, hardware_pio, HW.pios, NUM_PIOS)
+IMPLEMENT_ENUMERATOR(sm_t, hardware_sm, HW.sms, NUM_PIOS * NUM_SMS)
+IMPLEMENT_ENUMERATOR(user_processor_t, hardware_user_processor, HW.user_processors, NUM_USER_PROCESSORS)
+IMPLEMENT_ENUMERATOR(ih_processor_t, hardware_ih_processor, HW.ih_processors, NUM_IH_PROCESSORS)
+IMPLEMENT_ENUMERATOR(hardware_irq_flag_t, hardware_irq_flag, HW.irq_flags, NUM_IRQ_FLAGS)
 
 /* some syntactic sugar macros */
-#define CURRENT_PIO pios[current_pio]
-#define CURRENT_SM sms[current_sm]
-#define THIS_PIO pios[pio]
-#define THIS_SM sms[sm]
+#define CURRENT_PIO HW.pios[HW.current_pio]
+#define CURRENT_SM HW.sms[HW.current_sm]
+#define THIS_PIO HW.pios[pio]
+#define THIS_SM HW.sms[sm]
 
 /************************************************************************************************
   set 
  ************************************************************************************************/
     
 void hardware_set_data(char * value) {
-    snprintf(user_processors[current_up].data, STRING_MAX, "%s", value);
+    user_processor_t * up = &(HW.user_processors[HW.current_up]);
+    snprintf(up->data, STRING_MAX, "%s", value);
+    up->data_length = strlen(up->data);
 }
 
 
@@ -63,7 +52,7 @@ int hardware_set_pio(int pio, int line) {
       PRINT("Error (line %d): pio must be 0 or 1\n", line+1);
       return -1;
     }
-    current_pio = pio;
+    HW.current_pio = pio;
     return 0;
 }
 
@@ -72,28 +61,28 @@ int hardware_set_sm(int sm, int line) {
       PRINT("Error (line %d): sm must be 0..3\n", line+1);
       return -1;
     }
-    if (current_pio < 0) current_sm = sm;
-    else current_sm = current_pio * 4 + sm;
-    if (current_program_name) snprintf(CURRENT_SM.program_name, SYMBOL_MAX, "%s", current_program_name);
+    if (HW.current_pio < 0) HW.current_sm = sm;
+    else HW.current_sm = HW.current_pio * 4 + sm;
+    if (HW.current_program_name) snprintf(CURRENT_SM.program_name, SYMBOL_MAX, "%s", HW.current_program_name);
     return 0;
 }
 
 void hardware_set_up(uint8_t pnum, int line) {
     if (pnum >= NUM_USER_PROCESSORS) {
         PRINT("Error (line %d): max user processors is %d\n", line, NUM_USER_PROCESSORS-1);
-        current_up = NUM_USER_PROCESSORS-1;
+        HW.current_up = NUM_USER_PROCESSORS-1;
     }
-    else current_up = pnum;
-    user_instruction_context = up_context;
+    else HW.current_up = pnum;
+    HW.user_instruction_context = up_context;
 }
 
 void hardware_set_ih(uint8_t pnum, int line) {
     if (pnum >= NUM_IH_PROCESSORS) {
         PRINT("Error (line %d): max ih processors is %d\n", line, NUM_IH_PROCESSORS-1);
-        current_ih = NUM_IH_PROCESSORS-1;
+        HW.current_ih = NUM_IH_PROCESSORS-1;
     }
-    else current_ih = pnum;
-    user_instruction_context = ih_context;
+    else HW.current_ih = pnum;
+    HW.user_instruction_context = ih_context;
 }
 
 
@@ -123,7 +112,7 @@ void hardware_set_side_set_count(int num_pins, int optional, int pindirs, int li
         PRINT("Error: side set optional invalid value %d on line %d; assuming 1 (true, optional)\n", optional, line);
         optional = 1;
     }
-    sms[current_sm].side_set_pins_optional = optional;
+    HW.sms[HW.current_sm].side_set_pins_optional = optional;
     if (pindirs < 0 || pindirs > 1) {
         PRINT("Error: side set pindirs invalid value %d on line %d; assuming 0 (false, not pindirs)\n", pindirs, line);
         pindirs = false;
@@ -143,6 +132,14 @@ void hardware_set_shiftctl_in(int dir, bool ap, int threshold, int line) {
     if (0<= threshold && threshold <= 31) CURRENT_SM.shiftctl_push_thresh = threshold;
 }
 
+void hardware_set_clkdiv(int divider, int line) {
+    if (divider < 0 || divider > 65535) {
+      PRINT("Error (line %d): clkdiv must be 0..65535\n", line+1);
+      return;
+    }
+    CURRENT_SM.clkdiv = divider ? divider : 65536;  /* zero means 65536, as on real hardware */
+}
+
 void hardware_set_status_sel(int sel, uint8_t level) {
     CURRENT_SM.fifo.EXECCTRL_STATUS_SEL = (sel != 0);
     CURRENT_SM.fifo.N = level;
@@ -150,7 +147,7 @@ void hardware_set_status_sel(int sel, uint8_t level) {
 
 void hardware_set_pio_instruction_cache(uint8_t pio) {
     int instruction;
-    for (instruction=0; instruction < NUM_INSTRUCTIONS; instruction++) instruction_set_defaults(&(pios[pio].instructions[instruction]));
+    for (instruction=0; instruction < NUM_INSTRUCTIONS; instruction++) instruction_set_defaults(&(HW.pios[pio].instructions[instruction]));
     THIS_PIO.next_instruction_location = 0;
 }
 
@@ -186,9 +183,10 @@ void hardware_set_sm_defaults(uint8_t sm) {
     THIS_SM.shiftctl_push_thresh = -1; 
     THIS_SM.shiftctl_out_shiftdir = false;
     THIS_SM.shiftctl_in_shiftdir = false;
+    THIS_SM.clkdiv = 1;
     THIS_SM.program_name[0] = '\0';
     THIS_SM.pio_num = sm / 4;
-    THIS_SM.pio = (void*) &(pios[sm / 4]);
+    THIS_SM.pio = (void*) &(HW.pios[sm / 4]);
     THIS_SM.this_num = sm % 4;
 }
 
@@ -207,6 +205,7 @@ void hardware_reset_sm(uint8_t sm) {
     THIS_SM.shift_out_resume_count = 0;
     THIS_SM.osr_empty = true;
     THIS_SM.isr_full = false;
+    instruction_reset(&(THIS_SM.instr_state));
 }
 
 void hardware_reset_sms() {
@@ -227,15 +226,16 @@ void hardware_set_sms_defaults() {
 void hardware_reset_user_processor_instruction_cache(int p) {
     int i;
     for (i=0; i<NUM_USER_INSTRUCTIONS; i++) {
-        instruction_set_user_defaults(&(user_processors[p].instructions[i]));
+        instruction_set_user_defaults(&(HW.user_processors[p].instructions[i]));
     }
 }
 
 void hardware_reset_user_processor(int p) {
-    user_processors[p].next_instruction_location = 0;
-    user_processors[p].pc = -1;
-    user_processors[p].this_num = p;
-    user_processors[p].data[0] = '\0';
+    HW.user_processors[p].next_instruction_location = 0;
+    HW.user_processors[p].pc = -1;
+    HW.user_processors[p].this_num = p;
+    HW.user_processors[p].data[0] = '\0';
+    HW.user_processors[p].data_length = 0;
     hardware_reset_user_processor_instruction_cache(p);
 }
 
@@ -249,15 +249,17 @@ void hardware_reset_user_processors() {
 void hardware_reset_ih_processor_instruction_cache(int p) {
     int i;
     for (i=0; i<NUM_USER_INSTRUCTIONS; i++) {
-        instruction_set_user_defaults(&(ih_processors[p].instructions[i]));
+        instruction_set_user_defaults(&(HW.ih_processors[p].instructions[i]));
     }
 }
 
 void hardware_reset_ih_processor(int p) {
-    ih_processors[p].next_instruction_location = 0;
-    ih_processors[p].pc = -1;
-    ih_processors[p].this_num = p;
-    ih_processors[p].data[0] = '\0';
+    HW.ih_processors[p].next_instruction_location = 0;
+    HW.ih_processors[p].pc = -1;
+    HW.ih_processors[p].this_num = p;
+    HW.ih_processors[p].data[0] = '\0';
+    HW.ih_processors[p].data_length = 0;
+    HW.ih_processors[p].irq_flags = 0;
     hardware_reset_ih_processor_instruction_cache(p);
 }
 
@@ -269,21 +271,29 @@ void hardware_reset_ih_processors() {
 }
 
 void hardware_reset_irq_flags() {
- int i;
-  for (i=0; i < NUM_IRQ_FLAGS; i++) {
-    hardware_irq_flags->set = false; 
-    hardware_irq_flags->mapped_to_irq = false;
-  }
+  int i;
+  for (i=0; i < NUM_IRQ_FLAGS; i++) HW.irq_flags[i].ih = NULL;
+  HW.irq_flags_set = 0;
+  HW.irq_handler_flags = 0;
+  HW.irq_pending = 0;
 }
 
+void hardware_reset_programs();
+
 void hardware_set_system_defaults() {
     int pio;
-    current_pio = 0;
-    current_sm = 0;
+    HW.current_pio = 0;
+    HW.current_sm = 0;
+    HW.current_up = -1;
+    HW.current_ih = -1;
     hardware_set_pios_defaults();
     hardware_set_sms_defaults();
     hardware_reset_user_processors();
     hardware_reset_ih_processors();
+    hardware_reset_irq_flags();
+    hardware_reset_devices();
+    HW.open_drain = HW.pulled_low = 0;
+    hardware_reset_programs();
     instruction_set_global_default();
 }
 
@@ -298,41 +308,193 @@ void hardware_reset() {
 #define CHECK_IRQ(x) if (x < 0 || x >= NUM_IRQS) {PRINT("Error: invalid irq index"); return;}
 #define CHECK_IRQ_B(x) if (x < 0 || x >= NUM_IRQS) {PRINT("Error: invalid irq index"); return false;}
 
-void hardware_set_gpio(uint8_t num, bool val) { CHECK_GPIO(num) gpios[num].value = val; } 
-void hardware_set_gpio_dir(uint8_t num, bool dir) { CHECK_GPIO(num) gpios[num].pindir = dir; } 
-bool hardware_get_gpio(uint8_t num) { CHECK_GPIO_B(num) return gpios[num].value; } 
-bool hardware_get_gpio_dir(uint8_t num) { CHECK_GPIO_B(num) return gpios[num].pindir; } 
+#define OPEN_DRAIN(x) (HW.open_drain & (1u << (x)))
+
+/* every write of a gpio value goes through here, so the values are also a word */
+static inline void set_gpio_value(uint8_t num, bool val) {
+    HW.gpios[num].value = val;
+    if (val) HW.gpio_values |= (1u << num);
+    else HW.gpio_values &= ~(1u << num);
+}
+
+void hardware_set_gpio(uint8_t num, bool val) { 
+    CHECK_GPIO(num) 
+    if (OPEN_DRAIN(num)) HW.gpios[num].latch = val;
+    else set_gpio_value(num, val); 
+} 
+void hardware_set_gpio_dir(uint8_t num, bool dir) { CHECK_GPIO(num) HW.gpios[num].pindir = dir; } 
+bool hardware_get_gpio(uint8_t num) { CHECK_GPIO_B(num) return HW.gpios[num].value; } 
+bool hardware_get_gpio_dir(uint8_t num) { CHECK_GPIO_B(num) return HW.gpios[num].pindir; } 
+bool hardware_gpio_is_open_drain(uint8_t num) { CHECK_GPIO_B(num) return OPEN_DRAIN(num) != 0; }
+
+/************************************************************************************************
+  open-drain nets
+ ************************************************************************************************/
+
+static void resolve_open_drain_gpio(uint8_t num) {
+    gpio_t * gpio = &(HW.gpios[num]);
+    set_gpio_value(num, !((gpio->pindir && !gpio->latch) || (HW.pulled_low & (1u << num))));
+}
+
+void hardware_set_open_drain(int base, int num_pins, int line) {
+    int gpio;
+    if (base < 0 || num_pins < 1 || base + num_pins > NUM_GPIOS) {
+        PRINT("Error (line %d): open drain pins must be within 0..%d\n", line+1, NUM_GPIOS-1);
+        return;
+    }
+    for (gpio = base; gpio < base + num_pins; gpio++) {
+        if (!OPEN_DRAIN(gpio)) HW.gpios[gpio].latch = HW.gpios[gpio].value;
+        HW.open_drain |= (1u << gpio);
+        resolve_open_drain_gpio(gpio);
+    }
+}
+
+void hardware_resolve_open_drain() {
+    uint32_t mask;
+    uint8_t gpio;
+    for (gpio = 0, mask = HW.open_drain; mask; gpio++, mask >>= 1) {
+        if (mask & 1) resolve_open_drain_gpio(gpio);
+    }
+}
+
+void hardware_pull_gpio_low(uint8_t num, bool low) {
+    CHECK_GPIO(num)
+    if (low) HW.pulled_low |= (1u << num);
+    else HW.pulled_low &= ~(1u << num);
+    if (OPEN_DRAIN(num)) resolve_open_drain_gpio(num);
+}
+
+/* the change is in the gpio history right away, and the devices sensitive to the pin see it when they next run */
+void hardware_drive_gpio(uint8_t num, bool val) {
+    CHECK_GPIO(num)
+    if (OPEN_DRAIN(num)) hardware_pull_gpio_low(num, !val);
+    else set_gpio_value(num, val);
+    hardware_changed_gpio_history_update();
+}
+
+void hardware_set_irq(uint8_t irq_num, bool value) {HW.pios[HW.current_pio].irqs[irq_num].set = value;}
+
+/************************************************************************************************
+  programs
+ ************************************************************************************************/
+
+#define CURRENT_PROGRAM HW.programs[HW.current_program]
+
+static program_t * find_program(char * name) {
+    int i;
+    for (i=0; i < HW.num_programs; i++) {
+        if (!strcmp(HW.programs[i].name, name)) return &(HW.programs[i]);
+    }
+    return NULL;
+}
+
+void hardware_reset_programs() {
+    HW.num_programs = 0;
+    HW.current_program = -1;
+    HW.current_program_name[0] = '\0';
+}
+
+bool hardware_add_program(char* name, int line) {
+    program_t * program;
+    int pio;
+    snprintf(HW.current_program_name, SYMBOL_MAX, "%s", name);
+    if (find_program(name)) {
+        PRINT("Error (line %d): program %s is already defined\n", line+1, name);
+        return false;
+    }
+    if (HW.num_programs == NUM_PROGRAMS) {
+        PRINT("Error (line %d): number of programs (%d) exceeded\n", line+1, NUM_PROGRAMS);
+        return false;
+    }
+    program = &(HW.programs[HW.num_programs]);
+    snprintf(program->name, SYMBOL_MAX, "%s", name);
+    program->origin = NO_ORIGIN;
+    program->pio = NOT_LOADED;
+    program->length = 0;
+    for (pio=0; pio < NUM_PIOS; pio++) program->offset[pio] = NOT_LOADED;
+    program->wrap_target = -1;
+    program->wrap = -1;
+    HW.current_program = HW.num_programs++;
+    return true;
+}
+
+bool hardware_set_origin(int origin, int line) {
+    if (HW.current_program < 0 || CURRENT_PROGRAM.pio != NOT_LOADED) {
+        PRINT("Error (line %d): .origin must follow .program, before the program's first instruction or label\n", line+1);
+        return false;
+    }
+    if (origin < 0 || origin >= NUM_INSTRUCTIONS) {
+        PRINT("Error (line %d): origin must be 0..%d\n", line+1, NUM_INSTRUCTIONS-1);
+        return false;
+    }
+    CURRENT_PROGRAM.origin = origin;
+    return true;
+}
 
-void hardware_set_irq(uint8_t irq_num, bool value) {pios[current_pio].irqs[irq_num].set = value;}
+void hardware_place_program() {
+    if (HW.current_program < 0) return;
+    if (CURRENT_PROGRAM.pio == NOT_LOADED) {
+        CURRENT_PROGRAM.pio = HW.current_pio;
+        if (CURRENT_PROGRAM.origin != NO_ORIGIN) CURRENT_PIO.next_instruction_location = CURRENT_PROGRAM.origin;
+        CURRENT_PROGRAM.offset[HW.current_pio] = CURRENT_PIO.next_instruction_location;
+    }
+    else if (CURRENT_PROGRAM.pio != HW.current_pio) HW.current_program = -1;  /* instructions for the other pio are not part of it */
+}
 
-void hardware_set_program_name(char* name) {
-   snprintf(current_program_name, SYMBOL_MAX, "%s", name); 
+void hardware_program_instruction_added() {
+    if (HW.current_program >= 0) CURRENT_PROGRAM.length++;
+}
+
+bool hardware_start_program(char* name, int line) {
+    program_t * program = find_program(name);
+    int offset;
+    if (!program || program->length == 0) {
+        PRINT("Error (line %d): no program %s to start (it must be defined before it is started)\n", line+1, name);
+        return false;
+    }
+    offset = program->offset[HW.current_pio];
+    if (offset == NOT_LOADED) {
+        offset = (program->origin != NO_ORIGIN) ? program->origin : CURRENT_PIO.next_instruction_location;
+        if (!instruction_copy(program->pio, program->offset[program->pio], program->length, offset, line)) return false;
+        program->offset[HW.current_pio] = offset;
+        if (offset + program->length > CURRENT_PIO.next_instruction_location) CURRENT_PIO.next_instruction_location = offset + program->length;
+        PRINTI("loaded program %s into pio %d at %d\n", name, HW.current_pio, offset);
+    }
+    CURRENT_SM.first_pc = CURRENT_SM.pc = offset;
+    CURRENT_SM.wrap_target = (program->wrap_target < 0) ? -1 : offset + program->wrap_target;
+    CURRENT_SM.wrap = (program->wrap < 0) ? -1 : offset + program->wrap;
+    snprintf(CURRENT_SM.program_name, SYMBOL_MAX, "%s", name);
+    return true;
 }
 
 
 void hardware_init_current_sm_pc_if_needed(int8_t first_instruction_location) {
-    sm_t *  current_sm = hardware_sm_set();
-    PRINTD("checking first instruction for %d\n", current_sm->this_num);
-    if (current_sm->first_pc < 0) {
-        current_sm->first_pc = current_sm->pc = first_instruction_location;
-        PRINTD("sm %d first instruction = %d\n", current_sm->this_num, first_instruction_location);
+    sm_t *  sm = hardware_sm_set();
+    PRINTD("checking first instruction for %d\n", sm->this_num);
+    if (sm->first_pc < 0) {
+        sm->first_pc = sm->pc = first_instruction_location;
+        PRINTD("sm %d first instruction = %d\n", sm->this_num, first_instruction_location);
     }
-    else {PRINTD("sm %d PC already set to %d\n", current_sm->this_num, current_sm->pc)};
+    else {PRINTD("sm %d PC already set to %d\n", sm->this_num, sm->pc)};
 }
 
 void hardware_init_current_up_pc_if_needed(int8_t first_instruction_location) {
-    user_processor_t *  current_up = hardware_user_processor_set();
-    if (current_up->pc < 0) current_up->pc = first_instruction_location;
+    user_processor_t *  up = hardware_user_processor_set();
+    if (up->pc < 0) up->pc = first_instruction_location;
 }
 
 void hardware_set_wrap(int line) {
-    PRINT("line: %d - setting wrap for pio %d to %d\n", line, current_pio, pios[current_pio].next_instruction_location - 1);
-    sms[current_sm].wrap = pios[current_pio].next_instruction_location - 1;
+    hardware_place_program();
+    PRINT("line: %d - setting wrap for pio %d to %d\n", line, HW.current_pio, HW.pios[HW.current_pio].next_instruction_location - 1);
+    HW.sms[HW.current_sm].wrap = HW.pios[HW.current_pio].next_instruction_location - 1;
+    if (HW.current_program >= 0) CURRENT_PROGRAM.wrap = CURRENT_SM.wrap - CURRENT_PROGRAM.offset[HW.current_pio];
 }
 
 void hardware_set_wrap_target(int line) {
-    PRINT("line: %d - setting wrap_target for pio %d to %d\n", line, current_pio, pios[current_pio].next_instruction_location);
-    sms[current_sm].wrap_target = pios[current_pio].next_instruction_location;
+    hardware_place_program();
+    PRINT("line: %d - setting wrap_target for pio %d to %d\n", line, HW.current_pio, HW.pios[HW.current_pio].next_instruction_location);
+    HW.sms[HW.current_sm].wrap_target = HW.pios[HW.current_pio].next_instruction_location;
+    if (HW.current_program >= 0) CURRENT_PROGRAM.wrap_target = CURRENT_SM.wrap_target - CURRENT_PROGRAM.offset[HW.current_pio];
 }
 
 void hardware_set_pin_condition(int pin_num) {
@@ -340,14 +502,18 @@ void hardware_set_pin_condition(int pin_num) {
 }
 
 bool hardware_irq_flag_set(uint8_t irq, bool set_or_clear) {
-    if (irq < NUM_IRQ_FLAGS) {
-        hardware_irq_flags[irq].set = set_or_clear;
-        return true;
-    }
-    else {
+    uint8_t bit;
+    if (irq >= NUM_IRQ_FLAGS) {
         PRINT("error: invalid irq flag %d\n", irq);
         return false;
     }
+    bit = 1u << irq;
+    if (set_or_clear) {
+        HW.irq_pending |= bit & HW.irq_handler_flags & ~HW.irq_flags_set;
+        HW.irq_flags_set |= bit;
+    }
+    else HW.irq_flags_set &= ~bit;
+    return true;
 }
 
 void hardware_fifo_merge(fifo_mode_t mode) {
@@ -368,54 +534,111 @@ void hardware_enable_irq_handler(uint8_t pio, uint8_t irq, uint8_t flag, uint8_t
         PRINT("Error line %d: can't flag irq %d as irq handler; only flag for IRQs are 0..3\n", line, flag);
         return;
     }
-    pios[pio].irqs[irq].enabled = true;
-    pios[pio].irqs[irq].flag = flag;
-    hardware_irq_flags[flag].mapped_to_irq = true;
-    hardware_irq_flags[flag].pio = pio;
-    hardware_irq_flags[flag].ih = &(ih_processors[current_ih]);
+    HW.pios[pio].irqs[irq].enabled = true;
+    HW.pios[pio].irqs[irq].flag = flag;
+    if (HW.irq_flags[flag].ih) HW.irq_flags[flag].ih->irq_flags &= ~(1u << flag);
+    HW.irq_flags[flag].pio = pio;
+    HW.irq_flags[flag].ih = &(HW.ih_processors[HW.current_ih]);
+    HW.irq_flags[flag].ih->irq_flags |= 1u << flag;
+    HW.irq_handler_flags |= 1u << flag;
 }
 
 /************************************************************************************************
   get 
  ************************************************************************************************/
 
-uint8_t hardware_pio_num_set() { return current_pio; }
-uint8_t hardware_sm_num_set() { return current_sm; }
-uint8_t hardware_up_num_set() { return current_up; }
-uint8_t hardware_ih_num_set() { return current_ih; }
+uint8_t hardware_pio_num_set() { return HW.current_pio; }
+uint8_t hardware_sm_num_set() { return HW.current_sm; }
+uint8_t hardware_up_num_set() { return HW.current_up; }
+uint8_t hardware_ih_num_set() { return HW.current_ih; }
 
 
-pio_t * hardware_pio_set() {return &(pios[current_pio]);}
-sm_t *  hardware_sm_set()  {return &(sms[current_sm]);}
+pio_t * hardware_pio_set() {return &(HW.pios[HW.current_pio]);}
+sm_t *  hardware_sm_set()  {return &(HW.sms[HW.current_sm]);}
 
-user_processor_t* hardware_user_processor_set() { return &(user_processors[current_up]); }
+user_processor_t* hardware_user_processor_set() { return &(HW.user_processors[HW.current_up]); }
 
-ih_processor_t* hardware_ih_processor_set() { return &(ih_processors[current_ih]); }
+ih_processor_t* hardware_ih_processor_set() { return &(HW.ih_processors[HW.current_ih]); }
 
-bool hardware_get_irq(uint8_t irq_num) {return pios[current_pio].irqs[irq_num].set;}
+bool hardware_get_irq(uint8_t irq_num) {return HW.pios[HW.current_pio].irqs[irq_num].set;}
 
 bool hardware_irq_flag_is_set(uint8_t irq) {
     if (irq < NUM_IRQ_FLAGS) {
-        return hardware_irq_flags[irq].set;
+        return (HW.irq_flags_set >> irq) & 1;
     }
     else return false;
 }
 
+uint8_t hardware_irq_flags() { return HW.irq_flags_set; }
+
+uint8_t hardware_irq_handler_flags() { return HW.irq_handler_flags; }
+
+ih_processor_t * hardware_irq_next_handler() {
+    int flag;
+    uint8_t bit;
+    for (flag = 0; HW.irq_pending >> flag; flag++) {
+        bit = 1u << flag;
+        if (!(HW.irq_pending & bit)) continue;
+        if (!(HW.irq_flags_set & bit)) HW.irq_pending &= ~bit;     /* cleared before its handler could start */
+        else if (!HW.irq_flags[flag].ih->enabled) {
+            HW.irq_pending &= ~bit;
+            return HW.irq_flags[flag].ih;
+        }
+    }
+    return NULL;
+}
+
+void hardware_irq_handler_done(ih_processor_t * ih) {
+    ih->enabled = false;
+    HW.irq_pending |= ih->irq_flags & HW.irq_flags_set;
+}
+
 /************************************************************************************************
   devices simulated 
  ************************************************************************************************/
 
-hardware_device_t hardware_devices[MAX_DEVICES];
-static int last_device = -1;
+void hardware_reset_devices() {
+    int i;
+    for (i=0; i < MAX_DEVICES; i++) HW.devices[i].enabled = false;
+    HW.last_device = -1;
+    HW.next_wake = DEVICE_NO_WAKE;
+}
 
-void hardware_register_device(char * name, bool enabled, device_execution_handler_t exec, device_display_handler_t disp) {
-    if (++last_device == MAX_DEVICES) return;
-    strncpy(hardware_devices[last_device].name, name, SYMBOL_MAX);
-    hardware_devices[last_device].enabled = enabled;
-    hardware_devices[last_device].execution_handler = exec;
-    hardware_devices[last_device].display_handler = disp;
+int hardware_register_device(char * name, bool enabled, device_execution_handler_t exec, int instance, uint32_t sensitivity) {
+    hardware_device_t * device;
+    if (HW.last_device + 1 == MAX_DEVICES) {
+        PRINT("too many devices, %s not registered\n", name);
+        return -1;
+    }
+    device = &(HW.devices[++HW.last_device]);
+    strncpy(device->name, name, SYMBOL_MAX);
+    device->enabled = enabled;
+    device->execution_handler = exec;
+    device->instance = instance;
+    device->sensitivity = sensitivity;
+    device->last_values = 0;
+    device->wake_at = 0;            // run once to begin with, whatever the gpios are
+    HW.next_wake = 0;
     PRINTI("device %s registered\n", name);
+    return HW.last_device;
+}
+
+void hardware_device_set_sensitivity(int device, uint32_t sensitivity) {
+    if (device < 0 || device > HW.last_device) return;
+    HW.devices[device].sensitivity = sensitivity;
+    HW.next_wake = 0;               // looked at again, whatever the gpios are
+}
+
+void hardware_device_wake_at(int device, uint32_t cycle) {
+    if (device < 0 || device > HW.last_device) return;
+    if (cycle < HW.devices[device].wake_at) HW.devices[device].wake_at = cycle;
+    if (cycle < HW.next_wake) HW.next_wake = cycle;
+}
+
+uint32_t hardware_get_gpios(uint32_t mask) {
+    return HW.gpio_values & mask;
 }
 
-IMPLEMENT_ENUMERATOR(hardware_device_t, hardware_device_enumerator, hardware_devices, MAX_DEVICES)
+/* up to the last device registered, not the whole table */
+IMPLEMENT_ENUMERATOR(hardware_device_t, hardware_device_enumerator, HW.devices, HW.last_device + 1)
     
\ No newline at end of file
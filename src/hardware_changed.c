@@ -6,7 +6,9 @@
  * 1) tracking changes (snapshots and comparing what changed)
  * 2) gpio history tracking (for timelines)
  *
- * This also tracks a predefined number of history values of GPIO pins to facilitate creating timelines.
+ * The gpio history (for timelines) records only changes, with a level-of-detail pyramid over them (see hardware_changed.h).
+ * A triggered capture keeps the changes in a ring until the trigger fires, then moves the ones in the pre-trigger window into
+ * the history and records as usual until the end of the post-trigger window.
  * 
  *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
  */
@@ -14,52 +16,35 @@
   
 #include "hardware_changed.h"
 #include <stddef.h>
-#include "ui.h"
+#include <stdlib.h>
+#include <string.h>
 #include "enumerator.h"
+#include "print.h"
+#include "context.h"
 
 /***********************************************************************************************************
  * state data
  **********************************************************************************************************/
 
-typedef struct {
-    fifo_t   fifo;
-    uint32_t scratch_x;
-    uint32_t scratch_y;
-    uint32_t osr;      
-    uint32_t isr;      
-    uint8_t  shift_out_count;
-    uint8_t  shift_in_count;
-    uint32_t exec_machine_instruction;
-} sm_snapshot_t;
-
-typedef struct {
-    hardware_irq_t irqs[NUM_IRQS];
-    bool  irqs_changed[NUM_IRQS];
-} pio_snapshot_t;
-
-static pio_snapshot_t pio_snapshots[NUM_PIOS];
-static sm_snapshot_t  sm_snapshots[NUM_PIOS * NUM_SMS];
-static gpio_t         gpio_snapshots[NUM_GPIOS];
-
-hardware_changed_t hardware_changed;
+#define CHANGES (simpio_context->changed)
 
 /***********************************************************************************************************
  * snapshot
  **********************************************************************************************************/
 
-#define SNAPSHOT(X) sm_snapshots[sm_num].X = sm->X; 
+#define SNAPSHOT(X) CHANGES.sm_snapshots[sm_num].X = sm->X; 
 
 void hardware_snapshot() {
     int pio_num, sm_num, irq_num, gpio_num;
     bool gpio, gpio_dir;
     pio_num = 0;
     FOR_ENUMERATION(pio, pio_t, hardware_pio) {
-      for (irq_num=0; irq_num < NUM_IRQS; irq_num++) pio_snapshots[pio_num].irqs[irq_num].set = pio->irqs[irq_num].set;
+      for (irq_num=0; irq_num < NUM_IRQS; irq_num++) CHANGES.pio_snapshots[pio_num].irqs[irq_num].set = pio->irqs[irq_num].set;
       pio_num++;
     }
     sm_num = 0;
     FOR_ENUMERATION(sm, sm_t, hardware_sm) {
-      fifo_copy((&sm->fifo), &(sm_snapshots[sm_num].fifo));
+      fifo_copy((&sm->fifo), &(CHANGES.sm_snapshots[sm_num].fifo));
       SNAPSHOT(scratch_x)
       SNAPSHOT(scratch_y)
       SNAPSHOT(osr)
@@ -72,8 +57,8 @@ void hardware_snapshot() {
   for (gpio_num=0; gpio_num<NUM_GPIOS; gpio_num++) {
       gpio = hardware_get_gpio(gpio_num);
       gpio_dir = hardware_get_gpio_dir(gpio_num);
-      gpio_snapshots[gpio_num].value = gpio;
-      gpio_snapshots[gpio_num].pindir = gpio_dir;
+      CHANGES.gpio_snapshots[gpio_num].value = gpio;
+      CHANGES.gpio_snapshots[gpio_num].pindir = gpio_dir;
   }
 }
 
@@ -81,7 +66,7 @@ void hardware_snapshot() {
  * compare what changed
  **********************************************************************************************************/
 
-#define compare_set(XYZ) hardware_changed.sms[sm_num].XYZ = (sm_snapshots[sm_num].XYZ != sm->XYZ);
+#define compare_set(XYZ) CHANGES.changed.sms[sm_num].XYZ = (CHANGES.sm_snapshots[sm_num].XYZ != sm->XYZ);
 
 hardware_changed_t * hardware_get_changed() {
   int pio_num, sm_num, irq_num;
@@ -90,11 +75,11 @@ hardware_changed_t * hardware_get_changed() {
   pio_num = 0;
   FOR_ENUMERATION(pio, pio_t, hardware_pio) {
       for (irq_num=0; irq_num < NUM_IRQS; irq_num++) {
-          hardware_changed.pios[pio_num].irqs[irq_num] = (pio->irqs[irq_num].set != pio_snapshots[pio_num].irqs[irq_num].set);
+          CHANGES.changed.pios[pio_num].irqs[irq_num] = (pio->irqs[irq_num].set != CHANGES.pio_snapshots[pio_num].irqs[irq_num].set);
       }
       sm_num = 0;
       FOR_ENUMERATION(sm, sm_t, hardware_sm) {
-        hardware_changed.sms[sm_num].fifo = fifo_compare(&(sm->fifo), &(sm_snapshots[sm_num].fifo));
+        CHANGES.changed.sms[sm_num].fifo = fifo_compare(&(sm->fifo), &(CHANGES.sm_snapshots[sm_num].fifo));
         compare_set(scratch_x)
         compare_set(scratch_y)
         compare_set(osr)
@@ -108,100 +93,441 @@ hardware_changed_t * hardware_get_changed() {
   for (gpio_num=0; gpio_num<NUM_GPIOS; gpio_num++) {
       gpio = hardware_get_gpio(gpio_num);
       gpio_dir = hardware_get_gpio_dir(gpio_num);
-      hardware_changed.gpios[gpio_num].value = (gpio_snapshots[gpio_num].value != gpio);
-      hardware_changed.gpios[gpio_num].pindir = (gpio_snapshots[gpio_num].pindir != gpio_dir);
+      CHANGES.changed.gpios[gpio_num].value = (CHANGES.gpio_snapshots[gpio_num].value != gpio);
+      CHANGES.changed.gpios[gpio_num].pindir = (CHANGES.gpio_snapshots[gpio_num].pindir != gpio_dir);
   }
-  return &hardware_changed;
+  return &CHANGES.changed;
 }
 
 /***********************************************************************************************************
  * timelines
  **********************************************************************************************************/
 
-/* note: the values and ticks are in an array until max # reached and then the array becomes a circular buffer:
-   
- (A) the oldest value is at current_index+1 which is the next value to be overwritten (*); 
-     this should be at zero, current_index+2 should be at 1, current_index+3 should be at 2, etc up to max
-     so requests for [0] should return current_index+1, requests for [1] should return current_index+2, up to requests for X which should return [max-1]
-     or [current_index+1+i] for i=0; i<X; i++
-     if (current_index+1+X = max) then X = max-current_index-1
-     so return [current_index+1+i] for i=0; i<max-current_index-1; i++     
-     
- (B) the most recent value is current_index, this should be at max-1, current_index-1 should be at max-2, etc.
-     so requests for max-1 should return current_index, requests for max-2 should return current_index-1, etc. down to requests for X which should return [0]
-     that is, requests for [max-1-i] should return [current_index-i]  for i=0; i<=current_index; i++; (note that current_index-current_index equals zero so that is the last one returned)
-     or equivalently, requests for [i] should return [current_index+1-max+i] when i=max-current_index-1; i<max; i++; 
-     (note that current_index+1-max+(max-current_index-1) is zero), the first one returned, and current_index+1-max+(max-1) = current_index which should be the last one returned, so this all works )
-               
-   since (A) and (B) together cover all mappings of [i] from i=0 to max-1, (A) and (B) are a complete mapping
-   
-   (*) note that if current_index+1 = max, then the oldest value is already at zero so no reordering is needed
-
-*/
+#define HISTORY (CHANGES.gpio_history)
+#define TRIGGER (CHANGES.trigger)
 
-/***********************************************************************************************************
- * state data
- **********************************************************************************************************/
+/* note: changes[] only grows (doubling) until GPIO_HISTORY_MAX_CHANGES, after that the oldest half is dropped and the
+   pyramid rebuilt. levels[k] has one entry per block of FANOUT^(k+1) changes; the last block of a level may be partial,
+   which is fine since only whole blocks are ever used to skip ahead */
 
-#define MAX_GPIO_HISTORY_INDEX 50
+static uint32_t block_size(int level) {
+    uint32_t size = GPIO_HISTORY_FANOUT;
+    while (level-- > 0) size *= GPIO_HISTORY_FANOUT;
+    return size;
+}
 
-static gpio_history_t gpio_history[MAX_GPIO_HISTORY_INDEX];
-static bool gpio_history_values[MAX_GPIO_HISTORY_INDEX][NUM_GPIOS];
+void hardware_changed_gpio_history_free(gpio_history_t * history) {
+    int level;
+    free(history->changes);
+    free(history->ring);
+    for (level=0; level<GPIO_HISTORY_LEVELS; level++) free(history->levels[level]);
+    memset(history, 0, sizeof(gpio_history_t));
+}
 
-static uint32_t gpio_history_count;              // how many values have been stored
-static uint32_t gpio_history_current_index;      // index into the history for where the next value is to be stored
-static uint32_t gpio_history_current_iterator;   // the index into the of the next value to return when iterating
+static void lod_add(uint32_t index, uint32_t values) {
+    int level;
+    uint32_t size;
+    gpio_lod_t * lod;
+    for (level=0, size=GPIO_HISTORY_FANOUT; level<GPIO_HISTORY_LEVELS; level++, size*=GPIO_HISTORY_FANOUT) {
+        lod = &(HISTORY.levels[level][index / size]);
+        if (index % size == 0) lod->any_high = lod->all_high = values;
+        else {
+            lod->any_high |= values;
+            lod->all_high &= values;
+        }
+    }
+}
 
-/***********************************************************************************************************
- * functions
- **********************************************************************************************************/
+static bool history_grow() {
+    uint32_t new_size, half, i;
+    int level;
+    gpio_change_t * changes;
+    gpio_lod_t * lod;
+    if (HISTORY.size >= GPIO_HISTORY_MAX_CHANGES) {
+        half = HISTORY.count / 2;
+        memmove(HISTORY.changes, HISTORY.changes + half, (HISTORY.count - half) * sizeof(gpio_change_t));
+        HISTORY.count -= half;
+        for (i=0; i<HISTORY.count; i++) lod_add(i, HISTORY.changes[i].values);
+        return true;
+    }
+    new_size = HISTORY.size ? HISTORY.size * 2 : GPIO_HISTORY_INITIAL_SIZE;
+    changes = realloc(HISTORY.changes, new_size * sizeof(gpio_change_t));
+    if (!changes) return false;
+    HISTORY.changes = changes;
+    for (level=0; level<GPIO_HISTORY_LEVELS; level++) {
+        lod = realloc(HISTORY.levels[level], (new_size / block_size(level) + 1) * sizeof(gpio_lod_t));
+        if (!lod) return false;
+        HISTORY.levels[level] = lod;
+    }
+    HISTORY.size = new_size;
+    return true;
+}
 
-uint32_t hardware_changed_gpio_history_init() { // returns the max number of values that can be stored in the history
-    gpio_history_count = 0;
-    gpio_history_current_index = 0;
-    return MAX_GPIO_HISTORY_INDEX;
+static void history_add(uint32_t cycle, uint32_t values) {
+    if (HISTORY.count && HISTORY.changes[HISTORY.count-1].values == values) return;
+    if (HISTORY.count == HISTORY.size && !history_grow()) return;
+    HISTORY.changes[HISTORY.count].cycle = cycle;
+    HISTORY.changes[HISTORY.count].values = values;
+    lod_add(HISTORY.count, values);
+    HISTORY.count++;
 }
-    
-uint32_t hardware_changed_gpio_history_iteration() {  // returns the actual number of values that have been stored in the history
-    gpio_history_current_iterator = 0;
-    return gpio_history_count;
+
+uint32_t hardware_changed_gpio_history_init() { // starts recording (again); returns the max number of changes kept
+    HISTORY.count = 0;
+    HISTORY.last_cycle = 0;
+    HISTORY.recording = true;
+    HISTORY.capture = capture_off;
+    if (TRIGGER.type != trigger_none) hardware_changed_trigger_arm();
+    return GPIO_HISTORY_MAX_CHANGES;
 }
 
-gpio_history_t * hardware_changed_gpio_history_get() { // returns next in history starting with oldest first; if called too many times then returns NULL until iteration called again
-    uint32_t i = gpio_history_current_iterator++;
-    uint32_t max = MAX_GPIO_HISTORY_INDEX;
-    uint32_t current_index = gpio_history_current_index;
-    if ( (gpio_history_count < MAX_GPIO_HISTORY_INDEX) || (current_index+1 == max) ) { // simple case where we haven't wrapped yet or we are just about to wrap
-       return &(gpio_history[i]);
-    }
-    if (i < (max-current_index-1)) {  // case (A)
-        return &(gpio_history[current_index + 1 + i]);
+static bool triggered(uint32_t values) {
+    sm_t * sm;
+    gpio_change_t * last;
+    switch (TRIGGER.type) {
+        case trigger_edge:
+            if (HISTORY.ring_count == 0) return false;
+            last = &(HISTORY.ring[(HISTORY.ring_count - 1) % GPIO_TRIGGER_RING]);
+            return ((last->values ^ values) & TRIGGER.mask) && (values & TRIGGER.mask) == TRIGGER.value;
+        case trigger_pattern: return (values & TRIGGER.mask) == TRIGGER.value;
+        case trigger_irq:     return hardware_irq_flag_is_set(TRIGGER.value);
+        case trigger_fifo:
+            sm = &(simpio_context->hardware.sms[TRIGGER.sm]);
+            return fifo_level(&(sm->fifo), TRIGGER.rx) >= (int) TRIGGER.value;
+        case trigger_pc:
+            sm = &(simpio_context->hardware.sms[TRIGGER.sm]);
+            return sm->pc == (int32_t) TRIGGER.value;
+        default: return false;
     }
-    if (i < max) {   // case (B)
-        return &(gpio_history[current_index+1-max+i]);
+}
+
+/* the trigger fired: the history starts with the values at the start of the pre-trigger window, followed by the ring's changes
+   after that (or with the oldest change kept, if the ring did not go back that far) */
+static void trigger_fire(uint32_t cycle) {
+    uint32_t start = (cycle > TRIGGER.pre) ? cycle - TRIGGER.pre : 0;
+    uint32_t first = (HISTORY.ring_count > GPIO_TRIGGER_RING) ? HISTORY.ring_count - GPIO_TRIGGER_RING : 0;
+    uint32_t i;
+    gpio_change_t * change;
+    for (i = first; i + 1 < HISTORY.ring_count && HISTORY.ring[(i + 1) % GPIO_TRIGGER_RING].cycle <= start; i++);
+    for (; i < HISTORY.ring_count; i++) {
+        change = &(HISTORY.ring[i % GPIO_TRIGGER_RING]);
+        history_add((change->cycle < start) ? start : change->cycle, change->values);
     }
-    return NULL;
+    HISTORY.capture = capture_triggered;
+    HISTORY.trigger_cycle = cycle;
+    HISTORY.stop_cycle = (cycle > UINT32_MAX - TRIGGER.post) ? UINT32_MAX : cycle + TRIGGER.post;
+    PRINT("trigger at cycle %u, capturing cycles %u to %u\n", cycle, HISTORY.count ? HISTORY.changes[0].cycle : cycle,
+          HISTORY.stop_cycle);
 }
 
+static void capture_finished() {
+    HISTORY.capture = capture_done;
+    HISTORY.recording = false;
+    PRINT("capture done\n");
+    if (TRIGGER.file_name[0] && hardware_changed_gpio_history_vcd(TRIGGER.file_name, 0)) PRINT("wrote %s\n", TRIGGER.file_name);
+}
 
 void hardware_changed_gpio_history_update() {
     uint8_t gpio;
-    bool gpio_val;
+    uint32_t values = 0;
+    uint32_t cycle;
     sm_t * sm;
-    if (gpio_history_count < MAX_GPIO_HISTORY_INDEX) {  // have not yet wrapped
-        gpio_history_count++;
-        gpio_history_current_index++;
-    }
-    else { // wrapping
-        if (gpio_history_current_index == MAX_GPIO_HISTORY_INDEX) gpio_history_current_index = 0;  // wrap
-        else gpio_history_current_index++;
-    }
+    if (!HISTORY.recording) return;
     sm = hardware_sm_set();
-    gpio_history[gpio_history_current_index].clock_tick = sm->clock_tick;
+    cycle = (sm->clock_tick > HISTORY.last_cycle) ? sm->clock_tick : HISTORY.last_cycle;
     for (gpio=0; gpio<NUM_GPIOS; gpio++) {
-        gpio_val = hardware_get_gpio(gpio);
-        gpio_history[gpio_history_current_index].values[gpio] = gpio_val;
+        if (hardware_get_gpio(gpio)) values |= (1u << gpio);
     }
+    if (HISTORY.capture == capture_armed) {
+        HISTORY.last_cycle = cycle;
+        if (!triggered(values)) {
+            if (HISTORY.ring_count && HISTORY.ring[(HISTORY.ring_count - 1) % GPIO_TRIGGER_RING].values == values) return;
+            HISTORY.ring[HISTORY.ring_count % GPIO_TRIGGER_RING] = (gpio_change_t) { .cycle = cycle, .values = values };
+            HISTORY.ring_count++;
+            return;
+        }
+        trigger_fire(cycle);
+    }
+    if (HISTORY.capture == capture_triggered && cycle > HISTORY.stop_cycle) {
+        HISTORY.last_cycle = HISTORY.stop_cycle;
+        capture_finished();
+        return;
+    }
+    HISTORY.last_cycle = cycle;
+    history_add(cycle, values);
+    if (HISTORY.capture == capture_triggered && cycle == HISTORY.stop_cycle) capture_finished();
+}
+
+capture_state_e hardware_changed_gpio_history_capture(uint32_t * trigger_cycle) {
+    if (HISTORY.capture == capture_triggered || HISTORY.capture == capture_done) *trigger_cycle = HISTORY.trigger_cycle;
+    return HISTORY.capture;
+}
+
+bool hardware_changed_gpio_history_range(uint32_t * first_cycle, uint32_t * last_cycle) {
+    if (HISTORY.count == 0) return false;
+    *first_cycle = HISTORY.changes[0].cycle;
+    *last_cycle = HISTORY.last_cycle;
+    return true;
+}
+
+/* index of the last change at or before cycle, -1 if none */
+static int32_t change_at(uint32_t cycle) {
+    int32_t low = 0, high = HISTORY.count;   // the answer is in [low-1, high)
+    while (low < high) {
+        int32_t mid = low + (high - low) / 2;
+        if (HISTORY.changes[mid].cycle <= cycle) low = mid + 1;
+        else high = mid;
+    }
+    return low - 1;
+}
+
+/* biggest block that starts at index and ends at or before end, -1 if none (just the change at index) */
+static int block_at(uint32_t index, uint32_t end, uint32_t * size) {
+    int level = -1;
+    uint32_t next = GPIO_HISTORY_FANOUT;
+    *size = 1;
+    while (level+1 < GPIO_HISTORY_LEVELS && index % next == 0 && index + next <= end) {
+        level++;
+        *size = next;
+        next *= GPIO_HISTORY_FANOUT;
+    }
+    return level;
+}
+
+/* biggest block that ends just before end and starts at or after first, -1 if none (just the change at end-1) */
+static int block_before(uint32_t end, uint32_t first, uint32_t * size) {
+    int level = -1;
+    uint32_t next = GPIO_HISTORY_FANOUT;
+    *size = 1;
+    while (level+1 < GPIO_HISTORY_LEVELS && end % next == 0 && end >= first + next) {
+        level++;
+        *size = next;
+        next *= GPIO_HISTORY_FANOUT;
+    }
+    return level;
 }
 
+bool hardware_changed_gpio_history_span(uint32_t start, uint32_t end, gpio_span_t * span) {
+    int32_t first, last;
+    uint32_t index, size, any_high, all_high;
+    int level;
+    if (HISTORY.count == 0 || end <= HISTORY.changes[0].cycle || start > HISTORY.last_cycle) return false;
+    first = change_at(start);
+    if (first < 0) first = 0;
+    last = change_at(end - 1);
+    span->start = any_high = all_high = HISTORY.changes[first].values;
+    for (index = first; index <= (uint32_t) last; index += size) {
+        level = block_at(index, last + 1, &size);
+        if (level < 0) {
+            any_high |= HISTORY.changes[index].values;
+            all_high &= HISTORY.changes[index].values;
+        }
+        else {
+            any_high |= HISTORY.levels[level][index / size].any_high;
+            all_high &= HISTORY.levels[level][index / size].all_high;
+        }
+    }
+    span->high = any_high;
+    span->low = ~all_high;
+    return true;
+}
 
+bool hardware_changed_gpio_history_edge(uint32_t cycle, uint32_t gpios, bool forward, uint32_t * edge_cycle) {
+    int32_t at = change_at(cycle);
+    uint32_t index, size, value;
+    gpio_lod_t * lod;
+    int level;
+    if (HISTORY.count == 0) return false;
+    if (forward) {
+        /* the first change after at that differs from the value at cycle */
+        if (at < 0) at = 0;
+        value = HISTORY.changes[at].values & gpios;
+        for (index = at + 1; index < HISTORY.count; index += size) {
+            level = block_at(index, HISTORY.count, &size);
+            if (level < 0) {
+                if ((HISTORY.changes[index].values & gpios) != value) {
+                    *edge_cycle = HISTORY.changes[index].cycle;
+                    return true;
+                }
+            }
+            else {
+                lod = &(HISTORY.levels[level][index / size]);
+                if ((lod->any_high & gpios) != value || (lod->all_high & gpios) != value) size = 1;  // look inside the block
+                else continue;
+                if ((HISTORY.changes[index].values & gpios) != value) {
+                    *edge_cycle = HISTORY.changes[index].cycle;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    /* the last change before cycle that differs from the change before it */
+    if (cycle == 0) return false;
+    at = change_at(cycle - 1);
+    if (at < 1) return false;
+    value = HISTORY.changes[at].values & gpios;
+    for (index = at; index > 0; index -= size) {   // index is one past the changes still to look at, at - 1 included
+        level = block_before(index, 0, &size);
+        if (level >= 0) {
+            lod = &(HISTORY.levels[level][index / size - 1]);
+            if ((lod->any_high & gpios) == value && (lod->all_high & gpios) == value) continue;
+            size = 1;
+        }
+        if ((HISTORY.changes[index - 1].values & gpios) != value) {
+            *edge_cycle = HISTORY.changes[index].cycle;
+            return true;
+        }
+    }
+    return false;
+}
+
+/***********************************************************************************************************
+ * triggered capture
+ **********************************************************************************************************/
+
+void hardware_changed_trigger_reset() {
+    memset(&TRIGGER, 0, sizeof(gpio_trigger_t));
+    TRIGGER.pre = GPIO_TRIGGER_DEFAULT_PRE;
+    TRIGGER.post = GPIO_TRIGGER_DEFAULT_POST;
+}
+
+static bool check_gpio(int pin) {
+    if (pin < 0 || pin >= NUM_GPIOS) {
+        PRINT("Error: invalid trigger pin %d\n", pin);
+        return false;
+    }
+    return true;
+}
+
+static bool check_sm(int pio, int sm) {
+    if (pio < 0 || pio >= NUM_PIOS || sm < 0 || sm >= NUM_SMS) {
+        PRINT("Error: invalid trigger pio %d sm %d\n", pio, sm);
+        return false;
+    }
+    TRIGGER.sm = pio * NUM_SMS + sm;
+    return true;
+}
+
+bool hardware_changed_trigger_edge(int pin, int rising) {
+    if (!check_gpio(pin)) return false;
+    TRIGGER.type = trigger_edge;
+    TRIGGER.mask = 1u << pin;
+    TRIGGER.value = rising ? TRIGGER.mask : 0;
+    return true;
+}
+
+bool hardware_changed_trigger_pattern(int mask, int value) {
+    TRIGGER.type = trigger_pattern;
+    TRIGGER.mask = (uint32_t) mask;
+    TRIGGER.value = (uint32_t) value & TRIGGER.mask;
+    return true;
+}
+
+bool hardware_changed_trigger_irq(int irq_flag) {
+    if (irq_flag < 0 || irq_flag >= NUM_IRQ_FLAGS) {
+        PRINT("Error: invalid trigger irq flag %d\n", irq_flag);
+        return false;
+    }
+    TRIGGER.type = trigger_irq;
+    TRIGGER.value = irq_flag;
+    return true;
+}
+
+bool hardware_changed_trigger_fifo(int pio, int sm, int rx, int level) {
+    if (!check_sm(pio, sm)) return false;
+    if (level < 1 || level > TOTAL_FIFO_SIZE_PER_SM) {
+        PRINT("Error: trigger fifo level must be 1 to %d\n", TOTAL_FIFO_SIZE_PER_SM);
+        return false;
+    }
+    TRIGGER.type = trigger_fifo;
+    TRIGGER.rx = rx;
+    TRIGGER.value = level;
+    return true;
+}
+
+bool hardware_changed_trigger_pc(int pio, int sm, int address) {
+    if (!check_sm(pio, sm)) return false;
+    if (address < 0 || address >= NUM_INSTRUCTIONS) {
+        PRINT("Error: invalid trigger instruction address %d\n", address);
+        return false;
+    }
+    TRIGGER.type = trigger_pc;
+    TRIGGER.value = address;
+    return true;
+}
+
+bool hardware_changed_trigger_window(int pre, int post) {
+    if (pre < 0 || post < 0) {
+        PRINT("Error: trigger windows can't be negative\n");
+        return false;
+    }
+    TRIGGER.pre = pre;
+    TRIGGER.post = post;
+    return true;
+}
+
+void hardware_changed_trigger_set_file(const char * file_name) {
+    snprintf(TRIGGER.file_name, GPIO_TRIGGER_FILE_NAME_MAX, "%s", file_name);
+}
+
+bool hardware_changed_trigger_arm() {
+    if (TRIGGER.type == trigger_none) {
+        if (HISTORY.capture != capture_off) {   /* a capture left over from a build that had a trigger */
+            HISTORY.capture = capture_off;
+            HISTORY.recording = false;
+        }
+        return true;
+    }
+    if (!HISTORY.ring) HISTORY.ring = malloc(GPIO_TRIGGER_RING * sizeof(gpio_change_t));
+    if (!HISTORY.ring) {
+        PRINT("not enough memory for the trigger\n");
+        return false;
+    }
+    HISTORY.ring_count = 0;
+    HISTORY.count = 0;
+    HISTORY.last_cycle = 0;
+    HISTORY.capture = capture_armed;
+    HISTORY.recording = true;
+    return true;
+}
+
+/***********************************************************************************************************
+ * vcd export
+ **********************************************************************************************************/
+
+#define VCD_ID(gpio) ((char) ('!' + (gpio)))
+
+bool hardware_changed_gpio_history_vcd(const char * file_name, uint32_t gpios) {
+    FILE * file;
+    uint32_t i, changed = 0;
+    uint8_t gpio;
+    if (HISTORY.count == 0) return false;
+    for (i=1; i<HISTORY.count; i++) changed |= HISTORY.changes[i].values ^ HISTORY.changes[i-1].values;
+    if (!gpios) gpios = changed ? changed : UINT32_MAX;
+    file = fopen(file_name, "w");
+    if (!file) {
+        PRINT("unable to open %s\n", file_name);
+        return false;
+    }
+    fprintf(file, "$comment simpio gpio history $end\n$timescale 8 ns $end\n$scope module simpio $end\n");
+    for (gpio=0; gpio<NUM_GPIOS; gpio++) {
+        if (gpios & (1u << gpio)) fprintf(file, "$var wire 1 %c gpio%d $end\n", VCD_ID(gpio), gpio);
+    }
+    fprintf(file, "$upscope $end\n$enddefinitions $end\n#%u\n$dumpvars\n", HISTORY.changes[0].cycle);
+    for (gpio=0; gpio<NUM_GPIOS; gpio++) {
+        if (gpios & (1u << gpio)) fprintf(file, "%d%c\n", (HISTORY.changes[0].values >> gpio) & 1, VCD_ID(gpio));
+    }
+    fprintf(file, "$end\n");
+    for (i=1; i<HISTORY.count; i++) {
+        changed = (HISTORY.changes[i].values ^ HISTORY.changes[i-1].values) & gpios;
+        if (!changed) continue;
+        fprintf(file, "#%u\n", HISTORY.changes[i].cycle);
+        for (gpio=0; gpio<NUM_GPIOS; gpio++) {
+            if (changed & (1u << gpio)) fprintf(file, "%d%c\n", (HISTORY.changes[i].values >> gpio) & 1, VCD_ID(gpio));
+        }
+    }
+    if (HISTORY.last_cycle > HISTORY.changes[HISTORY.count-1].cycle) fprintf(file, "#%u\n", HISTORY.last_cycle);
+    fclose(file);
+    return true;
+}
@@ -17,7 +17,7 @@
 #include "symbols.h"
 #include "print.h"
 #include "hardware.h"
-#include "ui.h"
+#include "context.h"
 #include "parser.h"
 #include <string.h>
 #include <assert.h>
@@ -26,36 +26,29 @@
 #define CURRENT_USER_INSTRUCTION hardware_user_processor_set()->instructions[hardware_user_processor_set()->next_instruction_location]
 #define CURRENT_IH_INSTRUCTION hardware_ih_processor_set()->instructions[hardware_ih_processor_set()->next_instruction_location]
 
-static int current_definition;
-static int current_label;
+/* program information lives in the simulation context */
+#define PROGRAM (simpio_context->instruction)
+#define HW (simpio_context->hardware)
 
-static define_t definitions[NUM_DEFINES];
-static label_location_t label_locations[NUM_INSTRUCTIONS]; /* There can't be more labels than instructions, or at least it isn't reasonable to have more labels than instructions. */
-
-static user_variable_t symbol_table[NUM_VARS];
-
-static bool prev_instruction_was_label;
-
-uint8_t instruction_label_location(uint8_t line) { return label_locations[line].location; }
-char *  instruction_label_symbol(uint8_t line){ return label_locations[line].label; }
+uint8_t instruction_label_location(uint8_t line) { return PROGRAM.label_locations[line].location; }
+char *  instruction_label_symbol(uint8_t line){ return PROGRAM.label_locations[line].label; }
 
 /***********************************************************************************************************
  * helpers
  **********************************************************************************************************/
 
-#define UNDEFINED(x) symbol_table[x].name[0] == 0
-#define DEFINED(x)   symbol_table[x].name[0] != 0
-#define UNDEFINE(x)  symbol_table[x].name[0] = 0;
-#define NAME_MATCH(x,n) (strncmp(symbol_table[x].name, n, SYMBOL_MAX) == 0)
+#define UNDEFINED(x) PROGRAM.vars[x].name[0] == 0
+#define DEFINED(x)   PROGRAM.vars[x].name[0] != 0
+#define UNDEFINE(x)  PROGRAM.vars[x].name[0] = 0;
 #define FORALLVARS(i) for (i=0; i<NUM_VARS; i++)
 
 /***********************************************************************************************************
  * enumerators
  **********************************************************************************************************/
 
-IMPLEMENT_ENUMERATOR(define_t, instruction_defines, definitions, NUM_DEFINES)
+IMPLEMENT_ENUMERATOR(define_t, instruction_defines, PROGRAM.definitions, NUM_DEFINES)
 
-IMPLEMENT_ENUMERATOR(user_variable_t, user_variable, symbol_table, NUM_VARS)
+IMPLEMENT_ENUMERATOR(user_variable_t, user_variable, PROGRAM.vars, NUM_VARS)
 
 /***********************************************************************************************************
  * set
@@ -63,48 +56,52 @@ IMPLEMENT_ENUMERATOR(user_variable_t, user_variable, symbol_table, NUM_VARS)
 
 void instruction_vars_init() {
     int i;
-    for (i=0; i<NUM_VARS; i++) {symbol_table[i].has_value = false; UNDEFINE(i) }
+    for (i=0; i<NUM_VARS; i++) {PROGRAM.vars[i].has_value = false; UNDEFINE(i) }
+}
+
+bool instruction_var_set_index(int index, uint32_t val) {
+    if (index < 0 || index >= NUM_VARS || UNDEFINED(index)) return false;
+    PROGRAM.vars[index].value = val;
+    PROGRAM.vars[index].has_value = true;
+    return true;
 }
 
 bool instruction_var_set(char * name, uint32_t val) {
-    int i;
-    FORALLVARS(i) { 
-        if NAME_MATCH(i,name) {
-            symbol_table[i].value = val;
-            symbol_table[i].has_value = true;
-            return true;
-        }
-    }
-    return false;
+    return instruction_var_set_index(instruction_var_index(name), val);
 }
 
 bool instruction_var_define(char * name) {
     int i;
+    i = symbols_find_index(name, VAR_TYPE);
+    if (i >= 0) {
+        /* already known (maybe undefined since), it keeps its slot */
+        if (UNDEFINED(i)) snprintf(PROGRAM.vars[i].name, SYMBOL_MAX, "%s", name);
+        return true;
+    }
     FORALLVARS(i) { 
         if (UNDEFINED(i)) {
-            snprintf(symbol_table[i].name, SYMBOL_MAX, "%s", name);
-            return true;
+            snprintf(PROGRAM.vars[i].name, SYMBOL_MAX, "%s", name);
+            if (symbols_new_index(PROGRAM.vars[i].name, VAR_TYPE, i) == symbol_added) return true;
+            PROGRAM.vars[i].name[0] = 0;
+            return false;
         }
     }
     return false;
 }
 
 bool instruction_var_undefine(char * name) {
-    int i;
-    FORALLVARS(i) { 
-        if NAME_MATCH(i,name) {
-            UNDEFINE(i)
-            return true;
-        }
-    }
-    return false;
+    int i = instruction_var_index(name);
+    if (i < 0) return false;
+    UNDEFINE(i)
+    PROGRAM.vars[i].has_value = false;
+    return true;
 }
 
 bool instruction_toggle_breakpoint(uint8_t line) {
   /* search through all PIO and UP instructions for an instruction on this line */
    int instruction;
    FOR_ENUMERATION(pio, pio_t, hardware_pio) {
-     for (instruction=0; instruction < pio->next_instruction_location; instruction++) {
+     for (instruction=0; instruction < NUM_INSTRUCTIONS; instruction++) {
        if (pio->instructions[instruction].line == line) {
          if (pio->instructions[instruction].is_breakpoint) pio->instructions[instruction].is_breakpoint = false;
          else pio->instructions[instruction].is_breakpoint = true;
@@ -127,19 +124,21 @@ bool instruction_toggle_breakpoint(uint8_t line) {
 void instruction_label_locations_init() {
     int i;
     for (i=0; i< NUM_INSTRUCTIONS; i++) {
-        label_locations[i].label[0] = 0;
-        label_locations[i].location = NO_LOCATION;
+        PROGRAM.label_locations[i].label[0] = 0;
+        PROGRAM.label_locations[i].location = NO_LOCATION;
     }
 }
 
-void instruction_reset(instruction_t *instr) {
-    instr->in_delay_state = false;
-    instr->delay_left = 0;
-    instr->not_completed = false;    
+void instruction_reset(instruction_exec_state_t *state) {
+    state->in_delay_state = false;
+    state->delay_left = 0;
+    state->not_completed = false;    
+    state->already_set_waiting = false;
 }
               
 void instruction_set_defaults(instruction_t *instr) {
     instr->instruction_type = empty_instruction;
+    instr->line = 0;
     instr->side_set_value = -1;
     instr->delay = 0;
     instr->condition = unset_condition;
@@ -158,7 +157,7 @@ void instruction_set_defaults(instruction_t *instr) {
     instr->is_breakpoint = false;
     instr->write_value = 0;
     instr->jmp_pc_set = false;
-    instruction_reset(instr);
+    instr->relocation = 0;
 }
 
 void instruction_user_reset(user_instruction_t* instr) {
@@ -179,27 +178,37 @@ void instruction_set_user_defaults(user_instruction_t* instr) {
     instr->delay = 0;
     instr->is_breakpoint = false;
     instr->var_name[0] = 0;
+    instr->var_index = -1;
+    instr->buffer_index = -1;
+    instr->rx_fifo = false;
     instr->continue_user = false;
     instruction_user_reset(instr);
 }
 
 void instruction_set_definition_defaults() {
-    current_definition = 0;
-    for (int i=0; i<NUM_DEFINES; i++) definitions[i].defined = false;
+    PROGRAM.current_definition = 0;
+    for (int i=0; i<NUM_DEFINES; i++) PROGRAM.definitions[i].defined = false;
 }
 
 void instruction_set_global_default() {
     instruction_set_definition_defaults();
-    current_label = 0;
+    PROGRAM.current_label = 0;
+    PROGRAM.num_forward_jmps = 0;
     instruction_label_locations_init();
     instruction_vars_init();
 }
 
 bool instruction_add(instruction_t* instr) {
+    hardware_place_program();
     if (hardware_pio_set()->next_instruction_location == NUM_INSTRUCTIONS) {
         PRINT("\nERROR line %d: number of SM instructions (%d) exceeded\n", instr->line, NUM_INSTRUCTIONS);
         return false;
     }
+    if (CURRENT_INSTRUCTION.instruction_type != empty_instruction) {
+        PRINT("\nERROR line %d: address %d of pio %d is already used by line %d (see .origin)\n", instr->line,
+              hardware_pio_set()->next_instruction_location, hardware_pio_num_set(), CURRENT_INSTRUCTION.line);
+        return false;
+    }
     PRINTD("\n---->adding instruction Line: %d\n", instr->line);
     CURRENT_INSTRUCTION.line = instr->line;
     CURRENT_INSTRUCTION.instruction_type = instr->instruction_type;
@@ -213,7 +222,7 @@ bool instruction_add(instruction_t* instr) {
     CURRENT_INSTRUCTION.if_full = instr->if_full;
     CURRENT_INSTRUCTION.if_empty = instr->if_empty;
     CURRENT_INSTRUCTION.block = instr->block;
-    CURRENT_INSTRUCTION.already_set_waiting = false;
+    CURRENT_INSTRUCTION.relocation = 0;
     CURRENT_INSTRUCTION.operation = instr->operation;
     CURRENT_INSTRUCTION.index_or_value = instr->index_or_value;
     CURRENT_INSTRUCTION.bit_count = instr->bit_count;
@@ -227,8 +236,41 @@ bool instruction_add(instruction_t* instr) {
     CURRENT_INSTRUCTION.pio =(void *)  hardware_pio_set();
     hardware_init_current_sm_pc_if_needed(hardware_pio_set()->next_instruction_location);  /* first instruction added for this sm will be the first to execute on this sm */
     CURRENT_INSTRUCTION.address = hardware_pio_set()->next_instruction_location;
+    if (instr->instruction_type == jmp_instruction && instr->location == NO_LOCATION && PROGRAM.num_forward_jmps < MAX_FORWARD_JMPS) {
+        PROGRAM.forward_jmps[PROGRAM.num_forward_jmps++] = (forward_jmp_t) { .pio = hardware_pio_num_set(), .address = CURRENT_INSTRUCTION.address };
+    }
     hardware_pio_set()->next_instruction_location++;
-    prev_instruction_was_label = false;
+    hardware_program_instruction_added();
+    PROGRAM.prev_instruction_was_label = false;
+    return true;
+}
+
+bool instruction_copy(uint8_t from_pio, uint8_t from, uint8_t length, uint8_t to, int line) {
+    pio_t * pio = hardware_pio_set();
+    instruction_t * instr;
+    int i;
+    if (to + length > NUM_INSTRUCTIONS) {
+        PRINT("\nERROR line %d: the program does not fit at address %d of pio %d\n", line+1, to, pio->this_num);
+        return false;
+    }
+    for (i=0; i < length; i++) {
+        if (pio->instructions[to+i].instruction_type != empty_instruction) {
+            PRINT("\nERROR line %d: address %d of pio %d is already used by line %d (see .origin)\n", line+1, to+i, pio->this_num,
+                  pio->instructions[to+i].line);
+            return false;
+        }
+    }
+    for (i=0; i < length; i++) {
+        instr = &(pio->instructions[to+i]);
+        *instr = HW.pios[from_pio].instructions[from+i];
+        instr->pio = (void *) pio;
+        instr->address = to+i;
+        instr->relocation += to - from;
+        /* a jmp to a label not yet defined when the program was assembled is resolved with the others */
+        if (instr->instruction_type == jmp_instruction && instr->location == NO_LOCATION && PROGRAM.num_forward_jmps < MAX_FORWARD_JMPS) {
+            PROGRAM.forward_jmps[PROGRAM.num_forward_jmps++] = (forward_jmp_t) { .pio = pio->this_num, .address = to+i };
+        }
+    }
     return true;
 }
 
@@ -257,6 +299,9 @@ bool instruction_user_add(user_instruction_t* instr){
         CURRENT_USER_INSTRUCTION.in_delay_state = false;
         CURRENT_USER_INSTRUCTION.executing_sm = (void *) hardware_sm_set();
         snprintf(CURRENT_USER_INSTRUCTION.var_name, SYMBOL_MAX, "%s", instr->var_name);
+        CURRENT_USER_INSTRUCTION.var_index = instruction_var_index(instr->var_name);
+        CURRENT_USER_INSTRUCTION.buffer_index = instr->buffer_index;
+        CURRENT_USER_INSTRUCTION.rx_fifo = instr->rx_fifo;
         hardware_init_current_up_pc_if_needed(hardware_user_processor_set()->next_instruction_location);  /* first instruction added for this sm will be the first to execute on this sm */
         CURRENT_USER_INSTRUCTION.address = hardware_user_processor_set()->next_instruction_location;
         hardware_user_processor_set()->next_instruction_location++;
@@ -286,6 +331,9 @@ bool instruction_user_add(user_instruction_t* instr){
         CURRENT_IH_INSTRUCTION.in_delay_state = false;
         CURRENT_IH_INSTRUCTION.executing_sm = (void *) hardware_sm_set();
         snprintf(CURRENT_IH_INSTRUCTION.var_name, SYMBOL_MAX, "%s", instr->var_name);
+        CURRENT_IH_INSTRUCTION.var_index = instruction_var_index(instr->var_name);
+        CURRENT_IH_INSTRUCTION.buffer_index = instr->buffer_index;
+        CURRENT_IH_INSTRUCTION.rx_fifo = instr->rx_fifo;
         CURRENT_IH_INSTRUCTION.address = hardware_ih_processor_set()->next_instruction_location;
         hardware_ih_processor_set()->next_instruction_location++;
         return true;
@@ -296,84 +344,106 @@ void instruction_add_data(user_instruction_t* instr, char * data) {
     char numstr[5];
     snprintf(numstr, 5, "%d", instr->line);
     instr->data_ptr = symbols_new(numstr, data, DATA_TYPE);
+    if (!instr->data_ptr) {PRINT("Error (line %d): no room left for data\n", instr->line);}
 }
 
 void instruction_add_define(char* s, int v, int line) {
-    snprintf(definitions[current_definition].symbol, SYMBOL_MAX, "%s", s);
-    definitions[current_definition].value = v;
-    definitions[current_definition].defined = true;
-    current_definition++;
+    if (PROGRAM.current_definition == NUM_DEFINES) {
+        PRINT("\nERROR line %d: number of defines (%d) exceeded\n", line+1, NUM_DEFINES);
+        return;
+    }
+    snprintf(PROGRAM.definitions[PROGRAM.current_definition].symbol, SYMBOL_MAX, "%s", s);
+    symbols_new_index(PROGRAM.definitions[PROGRAM.current_definition].symbol, DEFINE_TYPE, PROGRAM.current_definition);
+    PROGRAM.definitions[PROGRAM.current_definition].value = v;
+    PROGRAM.definitions[PROGRAM.current_definition].defined = true;
+    PROGRAM.current_definition++;
 }
 
 void instruction_add_label(char* l) {
-      pio_t * current_pio = hardware_pio_set();
-      int len = strnlen(l,LABEL_MAX);
+      pio_t * current_pio;
+      hardware_place_program();
+      current_pio = hardware_pio_set();
+      if (PROGRAM.current_label == NUM_INSTRUCTIONS) {
+          PRINT("\nERROR: number of labels (%d) exceeded\n", NUM_INSTRUCTIONS);
+          return;
+      }
       PRINTD("---->adding label: %s\n", l);
-      snprintf(label_locations[current_label].label, LABEL_MAX, "%s", l);
-      PRINTD("---->added label: %s\n", label_locations[current_label].label);
-      label_locations[current_label++].location = current_pio->next_instruction_location;
-      prev_instruction_was_label = true;
+      snprintf(PROGRAM.label_locations[PROGRAM.current_label].label, LABEL_MAX, "%s", l);
+      symbols_new_index(PROGRAM.label_locations[PROGRAM.current_label].label, LABEL_TYPE, PROGRAM.current_label);
+      PRINTD("---->added label: %s\n", PROGRAM.label_locations[PROGRAM.current_label].label);
+      PROGRAM.label_locations[PROGRAM.current_label++].location = current_pio->next_instruction_location;
+      PROGRAM.prev_instruction_was_label = true;
 }
 
 /* return positive number if error */
 int instruction_fix_forward_labels() {
    instruction_t * instr;
    int i, fixed;
-   /* go through all instructions in all pios, looking at jmp instructions */
+   /* only the jmps that were added before their label was */
    fixed = 0;
-   FOR_ENUMERATION(pio, pio_t, hardware_pio) {
-     for (i=0; i < pio->next_instruction_location; i++) {
-       instr = &(pio->instructions[i]);
-       if (instr->instruction_type == jmp_instruction && instr->location == NO_LOCATION) {
-         instr->location = instruction_find_label(instr->label);
-         if (instr->location == NO_LOCATION) {
-             status_msg("unable to fix reference to %s\n", instr->label);
-             return instr->line;
-         }
-         else fixed++;
-       }
+   for (i=0; i < PROGRAM.num_forward_jmps; i++) {
+     instr = &(HW.pios[PROGRAM.forward_jmps[i].pio].instructions[PROGRAM.forward_jmps[i].address]);
+     instr->location = instruction_find_label(instr->label);
+     if (instr->location == NO_LOCATION) {
+         print_msg("unable to fix reference to %s\n", instr->label);
+         return instr->line;
      }
+     else fixed++;
    }
+   PROGRAM.num_forward_jmps = 0;
    PRINTI("fixed %d forward references\n", fixed);
    return 0;
 }
 
+void instruction_fix_forward_vars() {
+   user_instruction_t * instr;
+   int i;
+   FOR_ENUMERATION(up, user_processor_t, hardware_user_processor) {
+     for (i=0; i < up->next_instruction_location; i++) {
+       instr = &(up->instructions[i]);
+       if (instr->var_name[0] && instr->var_index < 0) instr->var_index = instruction_var_index(instr->var_name);
+     }
+   }
+   FOR_ENUMERATION(ih, ih_processor_t, hardware_ih_processor) {
+     for (i=0; i < ih->next_instruction_location; i++) {
+       instr = &(ih->instructions[i]);
+       if (instr->var_name[0] && instr->var_index < 0) instr->var_index = instruction_var_index(instr->var_name);
+     }
+   }
+}
+
 /***********************************************************************************************************
  * get
  **********************************************************************************************************/
 
-int instruction_num_defines() {return current_definition;}
-int instruction_num_labels() {return current_label;}
+int instruction_num_defines() {return PROGRAM.current_definition;}
+int instruction_num_labels() {return PROGRAM.current_label;}
 
-bool instruction_var_get(char * name, uint32_t * value) {
-    int i;
-    FORALLVARS(i) { 
-        if NAME_MATCH(i,name) {
-            if (symbol_table[i].has_value) {
-               *value = symbol_table[i].value;
-               return true;
-            }
-            else return false;
-        }
-    }
-    return false;
+int instruction_var_index(char * name) {
+    if (!name[0]) return -1;
+    return symbols_find_index(name, VAR_TYPE);
 }
 
+bool instruction_var_get_index(int index, uint32_t * value) {
+    if (index < 0 || index >= NUM_VARS || UNDEFINED(index) || !PROGRAM.vars[index].has_value) return false;
+    *value = PROGRAM.vars[index].value;
+    return true;
+}
+
+bool instruction_var_get(char * name, uint32_t * value) {
+    return instruction_var_get_index(instruction_var_index(name), value);
+}
 
 int instruction_find_definition(char *s, int value_if_not_found) {
-    int i;
-    for (i=0; i<current_definition; i++) {
-        if (strncmp(s,definitions[i].symbol, SYMBOL_MAX) == 0) return definitions[i].value;
-    }
-    return value_if_not_found;
+    int i = symbols_find_index(s, DEFINE_TYPE);
+    if (i < 0) return value_if_not_found;
+    return PROGRAM.definitions[i].value;
 }
 
 uint8_t instruction_find_label(char * l) {
-    uint8_t i;
-    for (i=0; i<current_label; i++) {
-      if (strncmp(l,label_locations[i].label, SYMBOL_MAX) == 0) return i;
-    }
-    return NO_LOCATION;
+    int i = symbols_find_index(l, LABEL_TYPE);
+    if (i < 0) return NO_LOCATION;
+    return i;
 } 
 
 void print_instruction(instruction_t* instr);
@@ -440,8 +510,6 @@ int instruction_next_line() {
 }
 
 int instruction_current_delay_remaining() {
-    pio_t * pio = hardware_pio_set();
-    sm_t * sm = hardware_sm_set();
-    return pio->instructions[sm->pc].delay_left;
+    return hardware_sm_set()->instr_state.delay_left;
 }
 
@@ -0,0 +1,303 @@
+/*!
+ * @file /libsimpio.c
+ * @brief Simpio embedding API (libsimpio.a / libsimpio.so)
+ * @details
+ * Thin layer over the simulation core: every call selects the simulation's context on the calling thread (see context.h),
+ * uses the same functions the UI uses, and then restores whatever context was selected before.
+ *
+ * Loading goes through the program cache (see program_cache.h), which serializes parsing and makes reset and reloading the
+ * same text cheap. Everything else only touches the selected context.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libsimpio.h"
+#include "context.h"
+#include "program_cache.h"
+
+#define ENTER(sim)  simpio_t * prev_context = context_select(sim)
+#define LEAVE()     context_select(prev_context)
+
+#define HW (simpio_context->hardware)
+
+/* with only user processors running the sm clock does not advance, this bounds how many steps are a cycle */
+#define MAX_STEPS_PER_CYCLE (2 * (NUM_PIOS * NUM_SMS + NUM_USER_PROCESSORS + NUM_IH_PROCESSORS))
+
+/***********************************************************************************************************
+ * events
+ **********************************************************************************************************/
+
+static void send_event(simpio_event_t * event) {
+    if (!simpio_context->event_callback) return;
+    event->cycle = exec_cycle();
+    (*simpio_context->event_callback)(simpio_context, event, simpio_context->event_data);
+}
+
+static void print_event(const char * text, void * data) {
+    simpio_event_t event = { .type = SIMPIO_EVENT_PRINT, .text = text };
+    send_event(&event);
+}
+
+static void decode_event(const decoded_frame_t * frame) {
+    char text[DECODER_TEXT_MAX];
+    simpio_event_t event = { .type = SIMPIO_EVENT_DECODE, .text = text, .decoder = frame->decoder, .data = frame->value };
+    if (!simpio_context->event_callback) return;
+    decoder_frame_text(frame, text, DECODER_TEXT_MAX);
+    send_event(&event);
+}
+
+void simpio_set_event_callback(simpio_t * sim, simpio_event_callback_t callback, void * data) {
+    sim->event_callback = callback;
+    sim->event_data = data;
+}
+
+/***********************************************************************************************************
+ * create, load, reset
+ **********************************************************************************************************/
+
+simpio_t * simpio_create() {
+    simpio_t * sim = context_create();
+    if (!sim) return NULL;
+    ENTER(sim);
+    print_set_sink(print_event, NULL);
+    decoder_set_frame_hook(decode_event);
+    LEAVE();
+    return sim;
+}
+
+void simpio_destroy(simpio_t * sim) {
+    context_destroy(sim);
+}
+
+static int load_source(simpio_t * sim) {
+    int rc;
+    ENTER(sim);
+    rc = program_cache_build(sim->source, sim->source_length);
+    LEAVE();
+    return rc;
+}
+
+int simpio_load_buffer(simpio_t * sim, const char * text, size_t length) {
+    char * source;
+    if (!text || length == 0) return -1;
+    source = malloc(length);
+    if (!source) return -1;
+    memcpy(source, text, length);
+    free(sim->source);
+    sim->source = source;
+    sim->source_length = length;
+    return load_source(sim);
+}
+
+int simpio_load_file(simpio_t * sim, const char * file_name) {
+    FILE * file;
+    char * text;
+    long length;
+    int rc;
+    file = fopen(file_name, "r");
+    if (!file) return -1;
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    rewind(file);
+    text = (length > 0) ? malloc(length) : NULL;
+    if (!text || fread(text, 1, length, file) != length) {
+        free(text);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    rc = simpio_load_buffer(sim, text, length);
+    free(text);
+    return rc;
+}
+
+int simpio_reset(simpio_t * sim) {
+    if (!sim->source) return -1;
+    return load_source(sim);
+}
+
+/***********************************************************************************************************
+ * run
+ **********************************************************************************************************/
+
+static simpio_stop_e run(simpio_t * sim, uint32_t cycles, simpio_until_t until, void * data) {
+    simpio_stop_e stop = SIMPIO_STOP_CYCLES;
+    simpio_event_t event;
+    bool gpios[NUM_GPIOS];
+    uint32_t target, cycle;
+    uint64_t steps, max_steps;
+    int line, gpio;
+    if (!sim) return SIMPIO_STOP_ERROR;
+    ENTER(sim);
+    period_start();
+    target = exec_cycle() + cycles;
+    max_steps = (uint64_t) cycles * MAX_STEPS_PER_CYCLE;
+    if (exec_first_instruction_that_will_be_executed() < 0) stop = SIMPIO_STOP_IDLE;
+    for (steps = 0; stop == SIMPIO_STOP_CYCLES && exec_cycle() < target && steps < max_steps; steps++) {
+        if (exec_exited()) { stop = SIMPIO_STOP_EXITED; break; }
+        if (sim->event_callback) for (gpio=0; gpio<NUM_GPIOS; gpio++) gpios[gpio] = HW.gpios[gpio].value;
+        cycle = exec_cycle();
+        line = exec_step_programs_next_instruction();
+        if (sim->event_callback) {
+            for (gpio=0; gpio<NUM_GPIOS; gpio++) {
+                if (gpios[gpio] == HW.gpios[gpio].value) continue;
+                event = (simpio_event_t) { .type = SIMPIO_EVENT_GPIO, .gpio = gpio, .value = HW.gpios[gpio].value };
+                send_event(&event);
+            }
+        }
+        if (exec_exited()) {
+            event = (simpio_event_t) { .type = SIMPIO_EVENT_EXIT };
+            send_event(&event);
+            stop = SIMPIO_STOP_EXITED;
+        }
+        else if (until && (*until)(sim, data)) stop = SIMPIO_STOP_CONDITION;
+        else if (instruction_is_breakpoint(line)) stop = SIMPIO_STOP_BREAKPOINT;
+        /* events and conditions are looked at every step, so periods are only skipped without them */
+        else if (exec_cycle() > cycle && exec_cycle() < target) period_cycle((sim->event_callback || until) ? 0 : target - exec_cycle());
+    }
+    LEAVE();
+    return stop;
+}
+
+simpio_stop_e simpio_step(simpio_t * sim, uint32_t cycles) {
+    return run(sim, cycles, NULL, NULL);
+}
+
+simpio_stop_e simpio_run_until(simpio_t * sim, simpio_until_t until, void * data, uint32_t max_cycles) {
+    return run(sim, max_cycles, until, data);
+}
+
+bool simpio_toggle_breakpoint(simpio_t * sim, int line) {
+    bool toggled;
+    if (line <= 0) return false;
+    ENTER(sim);
+    toggled = instruction_toggle_breakpoint(line);
+    LEAVE();
+    return toggled;
+}
+
+uint32_t simpio_cycle(simpio_t * sim) {
+    return sim->exec.cycle;
+}
+
+int simpio_line(simpio_t * sim) {
+    return sim->exec.last_line;
+}
+
+void simpio_set_period_detection(simpio_t * sim, simpio_period_e mode) {
+    ENTER(sim);
+    period_set_mode((mode == SIMPIO_PERIOD_SKIP) ? period_skip : (mode == SIMPIO_PERIOD_DETECT) ? period_detect : period_off);
+    LEAVE();
+}
+
+uint32_t simpio_period(simpio_t * sim) {
+    return sim->period.period;
+}
+
+uint64_t simpio_period_skipped(simpio_t * sim) {
+    return sim->period.skipped;
+}
+
+/***********************************************************************************************************
+ * fifos, gpios, registers
+ **********************************************************************************************************/
+
+static sm_t * get_sm(simpio_t * sim, uint8_t pio, uint8_t sm) {
+    if (pio >= NUM_PIOS || sm >= NUM_SMS) return NULL;
+    return &(sim->hardware.sms[pio * NUM_SMS + sm]);
+}
+
+bool simpio_fifo_put(simpio_t * sim, uint8_t pio, uint8_t sm, uint32_t value) {
+    sm_t * s = get_sm(sim, pio, sm);
+    if (!s) return false;
+    if (sim->replay.file) {
+        ENTER(sim);
+        replay_record_put(pio, sm, value);
+        LEAVE();
+    }
+    return fifo_write(&(s->fifo), value);
+}
+
+bool simpio_fifo_get(simpio_t * sim, uint8_t pio, uint8_t sm, uint32_t * value) {
+    sm_t * s = get_sm(sim, pio, sm);
+    bool got;
+    if (!s) return false;
+    got = fifo_read(&(s->fifo), value);
+    if (sim->replay.file) {
+        ENTER(sim);
+        replay_record_get(pio, sm, got, got ? *value : 0);
+        LEAVE();
+    }
+    return got;
+}
+
+bool simpio_gpio_get(simpio_t * sim, uint8_t gpio) {
+    if (gpio >= NUM_GPIOS) return false;
+    return sim->hardware.gpios[gpio].value;
+}
+
+void simpio_gpio_set(simpio_t * sim, uint8_t gpio, bool value) {
+    if (gpio >= NUM_GPIOS) return;
+    ENTER(sim);
+    if (sim->replay.file) replay_record_gpio(gpio, value);
+    hardware_drive_gpio(gpio, value);
+    LEAVE();
+}
+
+/***********************************************************************************************************
+ * recording
+ **********************************************************************************************************/
+
+bool simpio_record(simpio_t * sim, const char * file_name) {
+    bool ok;
+    ENTER(sim);
+    ok = replay_record_start(file_name);
+    LEAVE();
+    if (ok && sim->source) simpio_reset(sim);   /* the build starts the recording */
+    return ok;
+}
+
+void simpio_record_stop(simpio_t * sim) {
+    ENTER(sim);
+    replay_record_stop();
+    LEAVE();
+}
+
+bool simpio_flash_load(simpio_t * sim, const char * file_name) {
+    bool ok;
+    ENTER(sim);
+    ok = device_spi_flash_load(file_name);
+    LEAVE();
+    return ok;
+}
+
+bool simpio_flash_save(simpio_t * sim, const char * file_name) {
+    bool ok;
+    ENTER(sim);
+    ok = device_spi_flash_save(file_name);
+    LEAVE();
+    return ok;
+}
+
+bool simpio_peek(simpio_t * sim, uint8_t pio, uint8_t sm, simpio_register_e reg, uint32_t * value) {
+    sm_t * s = get_sm(sim, pio, sm);
+    if (!s) return false;
+    switch (reg) {
+        case SIMPIO_REG_PC:              *value = s->pc;              break;
+        case SIMPIO_REG_X:               *value = s->scratch_x;       break;
+        case SIMPIO_REG_Y:               *value = s->scratch_y;       break;
+        case SIMPIO_REG_OSR:             *value = s->osr;             break;
+        case SIMPIO_REG_ISR:             *value = s->isr;             break;
+        case SIMPIO_REG_SHIFT_IN_COUNT:  *value = s->shift_in_count;  break;
+        case SIMPIO_REG_SHIFT_OUT_COUNT: *value = s->shift_out_count; break;
+        case SIMPIO_REG_CLOCK_TICK:      *value = s->clock_tick;      break;
+        case SIMPIO_REG_CLKDIV:          *value = s->clkdiv;          break;
+        case SIMPIO_REG_WORDS_PULLED:    *value = s->fifo.pulled;     break;
+        case SIMPIO_REG_WORDS_PUSHED:    *value = s->fifo.pushed;     break;
+        default: return false;
+    }
+    return true;
+}
@@ -14,10 +14,20 @@
 #include "execution.h"
 #include "hardware_changed.h"
 #include "parser.h"
+#include "program_cache.h"
 #include "print.h"
+#include "device_display.h"
+#include "sweep.h"
+#include "run_thread.h"
+#include "decoder.h"
+#include "buffer.h"
+#include "replay.h"
+#include "state_hash.h"
 #include <sys/stat.h>
 #include <string.h>
 
+#define GOLDEN_FILE_NAME_MAX 256
+
 char temp_file[] = "temp_pio_file"; /* save to temporary file until debugged */
 char * input_file;
 
@@ -123,8 +133,8 @@ void update_regs() {
             if (sm->pio_num != pio_num) {sm_num++; continue;}
             regs_msg("SM:%02d ", sm_num);
             regs_msg("CLOCK: %04d", sm->clock_tick);
-            if (pio->instructions[sm->pc].delay_left > 0) wattron(regs_win, A_BOLD);
-            regs_msg("  DELAY: %02d", pio->instructions[sm->pc].delay_left); 
+            if (sm->instr_state.delay_left > 0) wattron(regs_win, A_BOLD);
+            regs_msg("  DELAY: %02d", sm->instr_state.delay_left); 
             wattroff(regs_win, A_BOLD);      
             print_with_change(scratch_x," X:%08X ") 
             print_with_change(scratch_y,"Y:%08X ") 
@@ -179,6 +189,7 @@ void update_regs() {
     FOR_ENUMERATION(up, user_processor_t, hardware_user_processor) {
        regs_msg("UP%d PC:%d Delay:%d DATA:%s\n", up->this_num, up->pc, up->instructions[up->pc].delay_left, up->data);
     }
+    ui_refresh(regs_win);
 }
 
 static bool built = false;
@@ -188,7 +199,11 @@ static bool first_stepit = true;
 int buildit(char *pio_pgm) {
     int error_line;
     first_stepit = true;
-    error_line = simpio_parse(temp_file);
+    error_line = pio_pgm ? program_cache_build(pio_pgm, strlen(pio_pgm)) : -1;
+    if (error_line < 0) {
+      status_msg("not enough memory to build\n");
+      return 1;
+    }
     if (error_line != 0) {
       //status_msg("Error on line %d\n", error_line);
       return error_line;
@@ -205,6 +220,7 @@ static int prev_line;
 int stepit() {
     int next_line;
     instruction_or_user_instruction_t instr;
+    instruction_exec_state_t * state;
     if (!built) {
       status_msg("need to build before stepping\n");
       return 1;
@@ -231,8 +247,9 @@ int stepit() {
             if (instr.instruction_type == _no_instruction) { status_msg("error: no previous instruction: %d!\n", prev_line); }
             else {
               if (instr.instruction_type == _instruction) {
-                  if (instr.ioru.instruction_ptr->in_delay_state) { status_msg("Line %d in delay state\n", prev_line); }
-                  else { if (instr.ioru.instruction_ptr->not_completed) { status_msg("Line %d blocked or not done yet\n", prev_line); }
+                  state = instr.ioru.instruction_ptr->executing_sm ? &(((sm_t *) instr.ioru.instruction_ptr->executing_sm)->instr_state) : NULL;
+                  if (state && state->in_delay_state) { status_msg("Line %d in delay state\n", prev_line); }
+                  else { if (state && state->not_completed) { status_msg("Line %d blocked or not done yet\n", prev_line); }
                          //else status_msg("\n"); 
                        }
               }
@@ -268,9 +285,25 @@ int toggleit(int line) {
     return 1;
 }
 
+/* called by the UI to repaint while running: shows the messages and the latest state the run thread published,
+   returns the line about to execute */
+static int run_frame() {
+    simpio_t * snapshot, * prev;
+    int line;
+    run_thread_messages(ui_status_sink, NULL);
+    snapshot = run_thread_snapshot();
+    if (!snapshot) return 0;
+    prev = context_select(snapshot);
+    update_regs();
+    line = exec_last_line();
+    context_select(prev);
+    return line;
+}
+
 /* returns line number the program stopped at */
 int runit() {   
     int hit_line;
+    bool broke = false;
     hardware_snapshot();
     if (!built) {
       status_msg("need to build before running\n");
@@ -278,8 +311,21 @@ int runit() {
     }
     first_stepit = false;
     status_msg("running program \n");
-    hit_line = exec_run_all_programs();
+    if (!run_thread_start()) {
+      status_msg("unable to start running\n");
+      return prev_line;
+    }
+    ui_enter_run_break_mode(run_frame);
+    while (!run_thread_finished(&hit_line)) {
+      if (ui_break_check()) {
+          run_thread_break();
+          broke = true;
+      }
+    }
+    ui_exit_run_break_mode();
+    run_thread_messages(ui_status_sink, NULL);
     status_msg("program stopped at line %d\n", hit_line);
+    if (broke) replay_record_break(hit_line);
     update_regs();
     prev_line = hit_line;
     return hit_line;
@@ -290,6 +336,7 @@ int saveit(char *pio_pgm) {
     FILE *fp;
     int rc;
     status_msg("save program \n");
+    if (!pio_pgm) return 0;
     fp = fopen(temp_file,"w+");
     if ( fp ) {
 	   fputs(pio_pgm,fp);
@@ -305,50 +352,74 @@ int saveit(char *pio_pgm) {
 
 static ui_timeline_dialog_data_t * timeline_dialog_data;
 
-static uint32_t max_timeline_values, num_timeline_values;
-
 void get_timeline_parameters() {
   timeline_dialog_data = ui_show_timeline_dialog(); 
-  max_timeline_values = hardware_changed_gpio_history_init();
+  hardware_changed_gpio_history_init();
 }
 
-// callback function to get value to be displayed
+// callback functions to get values to be displayed
 
 static ui_timeline_display_data_t timeline_display_data;
 
-static ui_gpio_history_t ui_history;
-static gpio_history_t * hw_history;
-static uint32_t gpio_history_num, iteration_count; // since num to display may be less than the history, we may need to "eat" the first few values
+static uint32_t timeline_gpios;   // bit n set for hardware gpio n being displayed
 
-ui_gpio_history_t * timeline_callback_function() {
-  uint8_t gpio_num;
-  int32_t pad = gpio_history_num - timeline_display_data.num_places;
-  while (iteration_count < pad) {
-    hw_history = hardware_changed_gpio_history_get();
-    iteration_count++;
-  }
-  hw_history = hardware_changed_gpio_history_get();
-  if (!hw_history) return NULL;
-  // map display gpio_nums to hardware numbers
+// map display gpio_nums to hardware numbers
+bool timeline_span_function(uint32_t start, uint32_t end, ui_timeline_span_t * ui_span) {
+  uint8_t gpio_num, gpio;
+  gpio_span_t span;
+  if (!hardware_changed_gpio_history_span(start, end, &span)) return false;
   for (gpio_num=0; gpio_num<TIMELINE_DIALOG_NUM_FIELDS; gpio_num++) {
     if (timeline_dialog_data->gpio_set[gpio_num]) {
-      ui_history.values[gpio_num] = hw_history->values[timeline_dialog_data->gpio_values[gpio_num]];
+      gpio = timeline_dialog_data->gpio_values[gpio_num];
+      ui_span->start[gpio_num] = (span.start >> gpio) & 1;
+      ui_span->high[gpio_num] = (span.high >> gpio) & 1;
+      ui_span->low[gpio_num] = (span.low >> gpio) & 1;
     }
   }
-  ui_history.clock_tick = hw_history->clock_tick;
-  return &ui_history;
+  return true;
+}
+
+bool timeline_edge_function(uint32_t cycle, bool forward, uint32_t * edge_cycle) {
+  return hardware_changed_gpio_history_edge(cycle, timeline_gpios, forward, edge_cycle);
+}
+
+extern ui_user_functions_t ui_functions;
+
+/* writes the gpios on the timeline to <program file name>.vcd */
+bool timeline_export_function(char * msg, size_t size) {
+  char file_name[GPIO_TRIGGER_FILE_NAME_MAX];
+  char * dot;
+  snprintf(file_name, sizeof(file_name) - 4, "%s", ui_functions.filename);
+  dot = strrchr(file_name, '.');
+  if (dot && !strchr(dot, '/')) *dot = '\0';
+  strcat(file_name, ".vcd");
+  if (!hardware_changed_gpio_history_vcd(file_name, timeline_gpios)) {
+    snprintf(msg, size, "unable to write %s", file_name);
+    return false;
+  }
+  snprintf(msg, size, "wrote %s", file_name);
+  return true;
 }
 
 void show_timeline() {
     uint8_t i;
-    gpio_history_num = timeline_display_data.num_places = hardware_changed_gpio_history_iteration();
-    if (gpio_history_num == 0) {
-        status_msg("no timeline history, nothing to show\n");
+    if (!hardware_changed_gpio_history_range(&timeline_display_data.first_cycle, &timeline_display_data.last_cycle)) {
+        if (hardware_changed_gpio_history_capture(&timeline_display_data.trigger_cycle) == capture_armed) {
+            status_msg("the trigger has not fired yet, nothing to show\n");
+        }
+        else status_msg("no timeline history, nothing to show\n");
         return;  
     }
-    iteration_count = 0;
-    for (i=0; i < TIMELINE_DIALOG_NUM_FIELDS; i++) timeline_display_data.to_be_displayed[i] = timeline_dialog_data->gpio_set[i];
-    timeline_display_data.callback = &timeline_callback_function;
+    timeline_gpios = 0;
+    for (i=0; i < TIMELINE_DIALOG_NUM_FIELDS; i++) {
+        timeline_display_data.to_be_displayed[i] = timeline_dialog_data->gpio_set[i];
+        timeline_display_data.gpios[i] = timeline_dialog_data->gpio_values[i];
+        if (timeline_dialog_data->gpio_set[i]) timeline_gpios |= (1u << timeline_dialog_data->gpio_values[i]);
+    }
+    timeline_display_data.span_callback = &timeline_span_function;
+    timeline_display_data.edge_callback = &timeline_edge_function;
+    timeline_display_data.export_callback = &timeline_export_function;
+    timeline_display_data.triggered = (hardware_changed_gpio_history_capture(&timeline_display_data.trigger_cycle) >= capture_triggered);
     ui_show_timeline_window(&timeline_display_data);
 }
 
@@ -373,10 +444,25 @@ void show_irq_flags() {
     char ch;
     int i;
     ui_temp_window_write("type q to exit\n\n");
-    i = 0;
-    FOR_ENUMERATION(irq_flag, hardware_irq_flag_t, hardware_irq_flag) {
-       ui_temp_window_write("irq flag: %d = %d \n", i, irq_flag->set);
-       i++;
+    for (i=0; i<NUM_IRQ_FLAGS; i++) {
+       ui_temp_window_write("irq flag: %d = %d \n", i, hardware_irq_flag_is_set(i));
+    }
+}
+
+void show_decoded_frames() {
+    char text[DECODER_TEXT_MAX];
+    decoded_frame_t frame;
+    uint32_t n, kept, shown;
+    kept = decoder_frames_kept();
+    shown = getmaxy(temp_window) - 4;
+    ui_temp_window_write("type q to exit\n\n");
+    ui_temp_window_write("%u frames decoded", decoder_frames_total());
+    if (kept > shown) { ui_temp_window_write(", the last %u are:\n", shown); }
+    else ui_temp_window_write("\n");
+    for (n = (kept > shown) ? kept - shown : 0; n < kept; n++) {
+        if (!decoder_frame(n, &frame)) break;
+        decoder_frame_text(&frame, text, DECODER_TEXT_MAX);
+        ui_temp_window_write("%s\n", text);
     }
 }
 
@@ -384,17 +470,18 @@ int temp_window_handler() {
     int num_devices = 0;
     int ch, rc, rc2;
     device_display_handler_t devices[MAX_DEVICES];
+    int instances[MAX_DEVICES];
     if (!built) {
       ui_temp_window_write("nothing to show until program is built and running\n");
     }
     else {
         ui_temp_window_write("f = show fifos\n");
         ui_temp_window_write("i = show irq flags\n");
+        if (decoder_count()) { ui_temp_window_write("d = show decoded frames\n"); }
         FOR_ENUMERATION(device, hardware_device_t, hardware_device_enumerator) {
-            if (device->enabled) {
+            if (num_devices < 10 && device->enabled && (devices[num_devices] = device_display_handler(device))) {
                 ui_temp_window_write("%d = display state information for %s\n", num_devices, device->name);
-                devices[num_devices] = device->display_handler;
-                num_devices++;
+                instances[num_devices++] = device->instance;
             }    
         }
     }
@@ -408,14 +495,18 @@ int temp_window_handler() {
             werase(temp_window);
             show_irq_flags();
         }
+        if (ch == 'd' || ch == 'D') {
+            werase(temp_window);
+            show_decoded_frames();
+        }
         if ('0' <= ch && ch <= '9') {
             ch = ch - '0';
             if (0 <= ch && ch < num_devices) {
-                rc2 = ((*devices[ch])());
+                rc2 = ((*devices[ch])(instances[ch]));
                 if (rc2) {
                     do {
                         for (int i=0; i<rc2; i++) rc = stepit();
-                        rc2 = ((*devices[ch])());
+                        rc2 = ((*devices[ch])(instances[ch]));
                     } while (rc2);
                 }
             }
@@ -427,6 +518,18 @@ int temp_window_handler() {
 
 ui_user_functions_t ui_functions = {&buildit, &stepit, &toggleit, &runit, &saveit, &get_timeline_parameters, &show_timeline, &temp_window_handler, NULL};  // filename filled in later
 
+/* <program file name>.golden, the state hashes of its test run */
+static char golden_file[GOLDEN_FILE_NAME_MAX];
+
+static char * golden_file_name(char * program_file_name) {
+  char * dot;
+  snprintf(golden_file, sizeof(golden_file) - 7, "%s", program_file_name);
+  dot = strrchr(golden_file, '.');
+  if (dot && !strchr(dot, '/')) *dot = '\0';
+  strcat(golden_file, ".golden");
+  return golden_file;
+}
+
 int main_test(int argc, char** argv) {
   instruction_or_user_instruction_t instr;
   int next_line;  
@@ -458,6 +561,11 @@ typedef struct {
     bool print;
     bool inter;
     bool debug;
+    bool sweep;
+    bool record;
+    bool replay;
+    bool golden;
+    bool hash;
 } options_t;
 
 static options_t options;
@@ -473,6 +581,11 @@ void parse_options(int argc, char** argv) {
         options.print    = strchr(optionstr, 'p');
         options.inter    = strchr(optionstr, 'i');
         options.debug    = strchr(optionstr, 'd');
+        options.sweep    = strchr(optionstr, 'w');
+        options.record   = strchr(optionstr, 'r');
+        options.replay   = strchr(optionstr, 'y');
+        options.golden   = strchr(optionstr, 'g');
+        options.hash     = strchr(optionstr, 'h');
     }
     else {
         options.syntax   = false;
@@ -481,6 +594,37 @@ void parse_options(int argc, char** argv) {
         options.print    = false;
         options.inter    = false;
         options.debug    = false;
+        options.sweep    = false;
+        options.record   = false;
+        options.replay   = false;
+        options.golden   = false;
+        options.hash     = false;
+    }
+    if (options.sweep) {
+        if (argc != 4) {
+            printf("sweep mode requires a grid file as third argument\n");
+            exit(-1);
+        }
+        return;
+    }
+    if (options.replay) {
+        if (argc != 4) {
+            printf("replay mode requires a recording file as third argument\n");
+            exit(-1);
+        }
+        return;
+    }
+    if (options.record) {
+        if (argc != 4) {
+            printf("record mode requires a file to record to as third argument\n");
+            exit(-1);
+        }
+        if (options.syntax || options.test) {
+            printf("incompatible options r & s/t; record (r) only records the ui\n");
+            exit(-1);
+        }
+        options.ui = true;
+        return;
     }
     if (argc > 3) {
         line = atoi(argv[3]);
@@ -510,6 +654,14 @@ void parse_options(int argc, char** argv) {
         printf("test mode requires a line number to run to for test success\n");
         exit(-1);
     }
+    if ((options.golden || options.hash) && !options.test) {
+        printf("options g & h (record or check the state hashes) require test mode (t)\n");
+        exit(-1);
+    }
+    if (options.golden && options.hash) {
+        printf("incompatible options g & h; choose either recording (g) or checking (h) the state hashes, not both\n");
+        exit(-1);
+    }
 }
 
 #define INPUT_BUFF_SIZE 80
@@ -525,18 +677,23 @@ int main(int argc, char** argv) {
   if( argc < 2 || argc >4 ) {
     printf("Usage: %s <filename> [stupid] [line_number] \n", argv[0]);
     printf("[stupid] means optional options s, t, u, p, i, and/or d\n");
-    printf("s=syntax details, t=test  (run to line), u=ui, p=print config, i=interactive mode, d=details\n");
+    printf("s=syntax details, t=test  (run to line), u=ui, p=print config, i=interactive mode, d=details, w=sweep, r=record, y=replay, g=golden, h=hash check\n");
     printf("default (no options) means run with ui and info messages\n");
     printf("good option examples:\n");
     printf("   %s <pio file> s         ===> syntax check and print results to terminal\n", argv[0]);
     printf("   %s <pio file> sd        ===> print detailed parsing messages to terminal and stop\n", argv[0]);
     printf("   %s <pio file> t <line>  ===> run to line with minimal messages (for simpio test suite)\n", argv[0]);
+    printf("   %s <pio file> th <line> ===> ... and check the state along the way against <pio file>.golden\n", argv[0]);
+    printf("   %s <pio file> tg <line> ===> ... and record the state along the way to <pio file>.golden\n", argv[0]);
     printf("   %s <pio file> u         ===> run UI with minimal messages\n", argv[0]);
     printf("   %s <pio file> ui        ===> run UI with more info messages\n", argv[0]);
     printf("   %s <pio file> ud        ===> run UI with more detailed messages\n", argv[0]);
     printf("   %s <pio file> p         ===> parse and print hardware configuration\n", argv[0]);
     printf("   %s <pio file> i         ===> interactive mode (no UI) with info messages\n", argv[0]);
     printf("   %s <pio file> id        ===> interactive mode (no UI) with detailed messages\n", argv[0]);
+    printf("   %s <pio file> w <grid>  ===> run every variant in the grid file and print a table of results\n", argv[0]);
+    printf("   %s <pio file> ur <file> ===> run UI, recording its inputs to the file\n", argv[0]);
+    printf("   %s <pio file> y <file>  ===> replay recorded inputs without the UI and check they give the same results\n", argv[0]);
     exit(-1); 
   }
   
@@ -548,6 +705,19 @@ int main(int argc, char** argv) {
   }
 
   parse_options(argc, argv);
+  print_set_sink(ui_status_sink, NULL);
+
+  if (options.sweep) {
+      set_print_ui(true);   /* keep the variants' messages out of the results table */
+      exit(sweep_run(ui_functions.filename, argv[3]));
+  }
+
+  if (options.replay) {
+      set_print_ui(false);
+      set_print_level(MIN_PRINT_LEVEL);
+      rc = replay_run(ui_functions.filename, argv[3]);
+      exit(rc ? -1 : 0);
+  }
     
   if (options.syntax) {
       set_print_ui(false);
@@ -565,7 +735,15 @@ int main(int argc, char** argv) {
               printf("syntax error on line %d\n\n", rc);
               exit(-1);
           }
-          else printf("\nsyntax ok\n\n");
+          else {
+              printf("\nsyntax ok\n\n");
+              device_spi_flash_restart();
+              device_uart_restart();
+              device_i2c_eeprom_restart();
+              device_ws2812_restart();
+              buffer_restart();
+              hardware_changed_trigger_arm();
+          }
       }
       if (options.print) {
             printf_hardware_configuration();
@@ -636,9 +814,12 @@ int main(int argc, char** argv) {
     
   if (options.test) {
     set_print_ui(false);
+    if (options.golden && !state_hash_record(golden_file_name(argv[2]))) exit(-1);
+    if (options.hash && !state_hash_check(golden_file_name(argv[2]))) exit(-1);
     rc = main_test(argc, argv);
+    if (!state_hash_stop() && rc == 0) rc = -1;
     printf("exiting: rc:%d\n", rc);
-    exit(rc);
+    exit(rc ? -1 : 0);  /* rc can be a line number, which as an exit status could wrap around to 0 */
   }
     
   if (options.ui) {
@@ -649,7 +830,9 @@ int main(int argc, char** argv) {
         if (options.inter) set_print_level(INFO_PRINT_LEVEL);
         else set_print_level(MIN_PRINT_LEVEL);
     }
+    if (options.record && !replay_record_start(argv[3])) exit(-1);
     ui_run(&ui_functions);
+    replay_record_stop();
   }
     
   exit(0);
@@ -0,0 +1,171 @@
+/*!
+ * @file /period.c
+ * @brief Finding the period of a simulation that has settled into repeating itself, and skipping whole periods of it
+ * @details
+ * See period.h. Watching costs gathering and hashing the state at each loop head (nothing when off), and copying it when a
+ * sample is saved; only detecting stops at the first repeat.
+ * Pointers in the scheduler's position are kept as offsets into the context, which are the same in every context.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <string.h>
+#include "period.h"
+#include "state_hash.h"
+#include "context.h"
+
+#define PERIOD (simpio_context->period)
+#define HW (simpio_context->hardware)
+#define EXEC (simpio_context->exec)
+#define NUM_ALL_SMS (NUM_PIOS * NUM_SMS)
+
+void period_set_mode(period_mode_e mode) {
+    PERIOD.mode = mode;
+}
+
+/*****************************************************************
+ *
+ *  WATCHING
+ *
+ *****************************************************************/
+
+/* nothing besides the state machines and gpios acts on its own, and nothing needs to see every cycle */
+static bool can_watch() {
+    int i;
+    if (decoder_count() || simpio_context->changed.gpio_history.recording || hardware_irq_handler_flags()) return false;
+    if (simpio_context->state_hash.mode != state_hash_off) return false;
+    for (i=0; i<=HW.last_device; i++) if (HW.devices[i].enabled) return false;
+    return true;
+}
+
+static bool user_program_running() {
+    user_processor_t * up;
+    for (up = HW.user_processors; up < HW.user_processors + NUM_USER_PROCESSORS; up++) {
+        if (up->pc >= 0 && up->instructions[up->pc].instruction_type != empty_user_instruction) return true;
+    }
+    return false;
+}
+
+void period_start() {
+    period_mode_e mode = PERIOD.mode;
+    memset(&PERIOD, 0, sizeof(period_state_t));
+    PERIOD.mode = mode;
+    PERIOD.watching = (mode != period_off) && can_watch();
+    memset(PERIOD.last_pc, 0xFF, sizeof(PERIOD.last_pc));
+}
+
+/* a state machine wrapped or jumped back (or is stalled), and it's not in the middle of a delay */
+static bool loop_head() {
+    bool head = false;
+    int i;
+    for (i=0; i<NUM_ALL_SMS; i++) {
+        if (HW.sms[i].pc < 0) continue;
+        if (HW.sms[i].pc <= PERIOD.last_pc[i] && !HW.sms[i].instr_state.in_delay_state) head = true;
+        PERIOD.last_pc[i] = HW.sms[i].pc;
+    }
+    return head;
+}
+
+static uint32_t offset(void * ptr) {
+    return ptr ? (uint32_t) ((char *) ptr - (char *) simpio_context) : UINT32_MAX;
+}
+
+static inline uint64_t fold(uint64_t hash, uint32_t word) {
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+/* the state (see state_hash_words), with what that leaves out (it's after what is observable) and the scheduler's position */
+static uint32_t state(uint32_t * words) {
+    uint32_t n = state_hash_words(words), latches = 0;
+    int i;
+    sm_t * sm;
+    for (i=0; i<NUM_GPIOS; i++) if (HW.gpios[i].latch) latches |= (1u << i);
+    words[n++] = latches;
+    for (i=0; i<NUM_PIOS; i++) words[n++] = ((uint32_t) HW.pios[i].irqs[0].flag << 8) | HW.pios[i].irqs[1].flag;
+    for (sm = HW.sms; sm < HW.sms + NUM_ALL_SMS; sm++) {
+        words[n++] = sm->pc_temp;
+        words[n++] = ((uint32_t) sm->exec_machine_instruction << 16) | ((uint32_t) sm->shift_out_resume_count << 8) | sm->shift_in_resume_count;
+        words[n++] = (uint32_t) sm->instr_state.in_delay_state | ((uint32_t) sm->instr_state.not_completed << 1) |
+                     ((uint32_t) sm->instr_state.already_set_waiting << 2) | ((uint32_t) sm->osr_empty << 3) |
+                     ((uint32_t) sm->isr_full << 4) | ((uint32_t) sm->instr_state.jmp_pc << 8);
+    }
+    words[n++] = offset(EXEC.instruction);
+    words[n++] = offset(EXEC.next_sm);
+    words[n++] = offset(EXEC.user_instruction);
+    words[n++] = offset(EXEC.next_up);
+    words[n++] = ((uint32_t) EXEC.next_sm_e << 16) | ((uint32_t) EXEC.next_up_e << 8) | EXEC.try_user_first;
+    words[n++] = (uint32_t) EXEC.last_line;
+    return n;
+}
+
+static uint64_t digest(uint32_t * words, uint32_t n) {
+    uint64_t hash = 0;
+    uint32_t i;
+    for (i=0; i<n; i++) hash = fold(hash, words[i]);
+    return hash;
+}
+
+/* the hash only narrows it down: two states are the same only if all of their words are */
+static bool same_as_saved(uint32_t * words, uint32_t n) {
+    return n == PERIOD.saved_words && memcmp(words, PERIOD.saved_state, n * sizeof(uint32_t)) == 0;
+}
+
+static void sample(period_sample_t * s, uint64_t hash) {
+    int i;
+    s->hash = hash;
+    s->cycle = EXEC.cycle;
+    s->steps = EXEC.steps;
+    for (i=0; i<NUM_ALL_SMS; i++) {
+        s->clock_ticks[i] = HW.sms[i].clock_tick;
+        s->pushed[i] = HW.sms[i].fifo.pushed;
+        s->pulled[i] = HW.sms[i].fifo.pulled;
+    }
+}
+
+/* n more periods, as if they had been run (the state, apart from the counters, is the same after every period) */
+static void skip(period_sample_t * now, uint32_t n) {
+    int i;
+    EXEC.cycle += n * PERIOD.period;
+    EXEC.steps += n * (now->steps - PERIOD.saved.steps);
+    for (i=0; i<NUM_ALL_SMS; i++) {
+        HW.sms[i].clock_tick += n * (now->clock_ticks[i] - PERIOD.saved.clock_ticks[i]);
+        HW.sms[i].fifo.pushed += n * (now->pushed[i] - PERIOD.saved.pushed[i]);
+        HW.sms[i].fifo.pulled += n * (now->pulled[i] - PERIOD.saved.pulled[i]);
+    }
+    PERIOD.skipped += (uint64_t) n * PERIOD.period;
+}
+
+uint32_t period_cycle(uint32_t max_skip) {
+    period_sample_t now;
+    uint32_t words[PERIOD_STATE_WORDS_MAX], num_words, n;
+    if (!PERIOD.watching || EXEC.context != exec_normal || !loop_head()) return 0;
+    if (user_program_running()) {
+        PERIOD.next_save = 0;       /* start over once it's done */
+        return 0;
+    }
+    num_words = state(words);
+    sample(&now, digest(words, num_words));
+    if (PERIOD.next_save && now.hash == PERIOD.saved.hash && now.cycle > PERIOD.saved.cycle && same_as_saved(words, num_words)) {
+        if (!PERIOD.period) { PRINTI("the system repeats every %u cycles, from cycle %u\n", now.cycle - PERIOD.saved.cycle, PERIOD.saved.cycle); }
+        PERIOD.period = now.cycle - PERIOD.saved.cycle;
+        PERIOD.watching = (PERIOD.mode == period_skip);     /* only detecting: that's it for this run */
+        n = (PERIOD.mode == period_skip) ? max_skip / PERIOD.period : 0;
+        if (n) skip(&now, n);
+        PERIOD.saved = now;         /* the counters moved on (the state is the same) */
+        if (n) sample(&PERIOD.saved, now.hash);
+        return n * PERIOD.period;
+    }
+    if (++PERIOD.samples >= PERIOD.next_save) {
+        PERIOD.saved = now;
+        memcpy(PERIOD.saved_state, words, num_words * sizeof(uint32_t));
+        PERIOD.saved_words = num_words;
+        PERIOD.samples = 0;
+        PERIOD.next_save = PERIOD.next_save ? 2 * PERIOD.next_save : 1;
+    }
+    return 0;
+}
+
+uint32_t period_found() { return PERIOD.period; }
+
+uint64_t period_skipped() { return PERIOD.skipped; }
@@ -2,7 +2,7 @@
  * @file /print.c
  * @brief Simpio print utilties
  * @details
- * Includes both printf and status_msg output, but note that the same level of information is not 
+ * Includes both printf and print sink (status window) output, but note that the same level of information is not 
  * necessarily provided each way.
  * 
  *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
@@ -11,23 +11,46 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <stdlib.h>
 #include "print.h"
 #include "hardware.h"
-#include "ui.h"
+#include "context.h"
 
-bool print_ui = true;
-int  print_level = 0;
+void set_print_ui(bool ui) { print_state->to_stdout = !ui; }
+void set_print_level(int level) { print_state->level = level; }
 
-void set_print_ui(bool ui) { print_ui = ui; }
-void set_print_level(int level) { print_level = level; }
+void print_set_sink(print_sink_t sink, void * data) {
+    print_state->sink = sink;
+    print_state->sink_data = data;
+}
+
+void print_msg(const char * fmt, ...) {
+    char text[PRINT_MSG_MAX];
+    va_list args;
+    if (!print_state->sink) return;
+    va_start(args, fmt);
+    vsnprintf(text, PRINT_MSG_MAX, fmt, args);
+    va_end(args);
+    (*print_state->sink)(text, print_state->sink_data);
+}
 
 #define MAX_NUMBER_OF_LINES 1000
 #define ESTIMATED_LINE_SIZE 80
 #define TEXT_BUFFER_SIZE MAX_NUMBER_OF_LINES * ESTIMATED_LINE_SIZE
 
-static char print_line_buffer[TEXT_BUFFER_SIZE];
-static int  print_line_starts[MAX_NUMBER_OF_LINES];
-static int  print_line_ends[MAX_NUMBER_OF_LINES];
+struct print_lines_s {
+    char buffer[TEXT_BUFFER_SIZE];
+    int  starts[MAX_NUMBER_OF_LINES];
+    int  ends[MAX_NUMBER_OF_LINES];
+};
+
+#define LINES (print_state->lines)
+
+void print_state_free(print_state_t * print) {
+    free(print->lines);
+    print->lines = NULL;
+}
 
 /**********************************************************************************
  * printfs 
@@ -264,7 +287,8 @@ void printf_instructions() {
     printf("\nINSTRUCTIONS: \n");
     FOR_ENUMERATION(pio, pio_t, hardware_pio) {
       printf("pio: %d (%d)\n", p, pio->next_instruction_location);
-      for (i = 0; i<pio->next_instruction_location; i++) {
+      for (i = 0; i<NUM_INSTRUCTIONS; i++) {
+        if (pio->instructions[i].instruction_type == empty_instruction) continue;
         printf("  PC: %d  ", i);
         printf_instruction(&(pio->instructions[i]));        
       }
@@ -294,7 +318,7 @@ static void printf_user_instruction(user_instruction_t* instr) {
         case data_instruction: 
             switch (instr->data_operation_type) {
                 case data_write:
-                    printf("data read ");
+                    printf("data write ");
                     break;
                 case data_read:
                     printf("data read ");
@@ -322,7 +346,19 @@ static void printf_user_instruction(user_instruction_t* instr) {
             case exit_instruction:
                 printf("exit ");
                 break;
-        case empty_instruction: 
+            case write_block_instruction:
+                printf("write block %s ", instr->var_name);
+                break;
+            case read_block_instruction:
+                printf("read block %s %u ", instr->var_name, instr->value);
+                break;
+            case print_block_instruction:
+                printf("print block %s ", instr->var_name);
+                break;
+            case wait_level_instruction:
+                printf("wait %s %u ", instr->rx_fifo ? "rx_level" : "tx_level", instr->value);
+                break;
+        case empty_user_instruction: 
                 printf("instruction: no instruction! "); 
                 break;
     };
@@ -396,12 +432,10 @@ void printf_hardware_configuration() {
                 printf("         shift out dir: %d\n", sm->shiftctl_out_shiftdir);
             }
         }
-        i=0;
-        FOR_ENUMERATION(f, hardware_irq_flag_t, hardware_irq_flag) {
-            if (f->mapped_to_irq) {
+        for (i=0; i<NUM_IRQ_FLAGS; i++) {
+            if ((hardware_irq_handler_flags() >> i) & 1) {
                 printf("      irq %d mapped to handler\n", i);
             }
-            i++;
         }
     }
     printf("Devices Enabled: \n");
@@ -415,188 +449,188 @@ void printf_hardware_configuration() {
  **********************************************************************************/
 
 static void print_side_set_value(int8_t side_set_value) {
-    if (side_set_value > 0) status_msg("side set value: %2d  ", side_set_value);   
+    if (side_set_value > 0) print_msg("side set value: %2d  ", side_set_value);   
 }
                                      
 static void print_delay(uint8_t delay_value) {
-    status_msg("delay value: %2d  ", delay_value);   
+    print_msg("delay value: %2d  ", delay_value);   
 }
                                      
 static void print_jmp_condition(condition_e condition) {
     switch (condition) {
-        case always: status_msg("always       "); break;
-        case x_zero: status_msg("if x is zero "); break;
-        case y_zero: status_msg("if y is zero "); break;
-        case x_decrement: status_msg("if x is not zero, decrement and jump "); break;
-        case y_decrement: status_msg("if y is not zero, decrement and jump "); break;
-        case x_not_equal_y: status_msg("if x != y    "); break;
-        case pin_condition: status_msg("if pin indicated by EXECCTRL_JMP_PIN is high "); break;
-        case not_osre: status_msg("if OSRE is not empty "); break;
-        case unset_condition: status_msg("unset! "); 
+        case always: print_msg("always       "); break;
+        case x_zero: print_msg("if x is zero "); break;
+        case y_zero: print_msg("if y is zero "); break;
+        case x_decrement: print_msg("if x is not zero, decrement and jump "); break;
+        case y_decrement: print_msg("if y is not zero, decrement and jump "); break;
+        case x_not_equal_y: print_msg("if x != y    "); break;
+        case pin_condition: print_msg("if pin indicated by EXECCTRL_JMP_PIN is high "); break;
+        case not_osre: print_msg("if OSRE is not empty "); break;
+        case unset_condition: print_msg("unset! "); 
     };
-    status_msg("\n");
+    print_msg("\n");
 }
                                      
 static void print_polarity(bool p) {
-    if (p) {status_msg("polarity: one ");}
-    else {status_msg("polarity: zero ");}
+    if (p) {print_msg("polarity: one ");}
+    else {print_msg("polarity: zero ");}
 }
                                      
 static void print_wait_source(wait_source_e w) {
     switch(w) {
-        case gpio_source: status_msg("wait source: gpio "); break;
-        case pin_source: status_msg("wait_source: pin "); break;
-        case irq_source: status_msg("wait_source: irq "); break;
-        case unset_wait_source: status_msg("wait source not set ! "); break;
+        case gpio_source: print_msg("wait source: gpio "); break;
+        case pin_source: print_msg("wait_source: pin "); break;
+        case irq_source: print_msg("wait_source: irq "); break;
+        case unset_wait_source: print_msg("wait source not set ! "); break;
     };
 }
                                      
 static void print_source(source_e s) {
     switch (s) {
-        case pins_source: status_msg("source: pins selected by PINCTRL_IN_BASE + bit count "); break;
-        case x_source: status_msg("source: x scratch register "); break;
-        case y_source: status_msg("source: y scratch register "); break;
-        case null_source: status_msg("source: null "); break;
-        case isr_source: status_msg("source: isr "); break;
-        case osr_source: status_msg("source: osr "); break;
-        case status_source: status_msg("source: status as specified by EXECCTRL_STATUS_SEL "); break;
-        case unset_source: status_msg("source is not set ! "); break;
+        case pins_source: print_msg("source: pins selected by PINCTRL_IN_BASE + bit count "); break;
+        case x_source: print_msg("source: x scratch register "); break;
+        case y_source: print_msg("source: y scratch register "); break;
+        case null_source: print_msg("source: null "); break;
+        case isr_source: print_msg("source: isr "); break;
+        case osr_source: print_msg("source: osr "); break;
+        case status_source: print_msg("source: status as specified by EXECCTRL_STATUS_SEL "); break;
+        case unset_source: print_msg("source is not set ! "); break;
     };
 }
                                      
 static void print_destination(destination_e d) {
     switch (d) {
-        case pins_destination: status_msg("destination: pins selected by PINCTRL_IN_BASE + bit count "); break;
-        case x_destination: status_msg("destination: x scratch register "); break;
-        case y_destination: status_msg("destination: y scratch register "); break;
-        case null_destination: status_msg("destination: null "); break;
-        case pindirs_destination: status_msg("destination: pindirs "); break;
-        case pc_destination: status_msg("destination: instruction counter "); break;
-        case isr_destination: status_msg("destination: isr "); break;
-        case exec_destination: status_msg("destinatino: EXEC "); break;
-        case unset_destination: status_msg("destination is not set ! "); break;
+        case pins_destination: print_msg("destination: pins selected by PINCTRL_IN_BASE + bit count "); break;
+        case x_destination: print_msg("destination: x scratch register "); break;
+        case y_destination: print_msg("destination: y scratch register "); break;
+        case null_destination: print_msg("destination: null "); break;
+        case pindirs_destination: print_msg("destination: pindirs "); break;
+        case pc_destination: print_msg("destination: instruction counter "); break;
+        case isr_destination: print_msg("destination: isr "); break;
+        case exec_destination: print_msg("destinatino: EXEC "); break;
+        case unset_destination: print_msg("destination is not set ! "); break;
     };
 }
 
 static void print_if_full(bool iff) {
-    if (iff) {status_msg("if_full true "); ;}
-    else {status_msg("if_full false ");}
+    if (iff) {print_msg("if_full true "); ;}
+    else {print_msg("if_full false ");}
 }
                                      
 static void print_if_empty(bool iff) {
-    if (iff) {status_msg("if_empty true "); ;}
-    else {status_msg("if_empty false ");}
+    if (iff) {print_msg("if_empty true "); ;}
+    else {print_msg("if_empty false ");}
 }
 
 static void print_block(bool bl) {
-    if (bl) {status_msg("instruction will block/wait ");}
-    else {status_msg("instruction will not block/wait ");}
+    if (bl) {print_msg("instruction will block/wait ");}
+    else {print_msg("instruction will not block/wait ");}
 }
                                      
 static void print_operation(operation_e op) {
     switch (op) {
-        case no_operation: status_msg("operation: none "); break;
-        case invert: status_msg("operation: invert "); break;
-        case bit_reverse: status_msg("operation: bit reverse "); break;
-        case clear_operation: status_msg("operation: clear "); break;
-        case wait_operation: status_msg("operatino: wait "); break;
-        case unset_operation: status_msg("operation is not set !"); break;
+        case no_operation: print_msg("operation: none "); break;
+        case invert: print_msg("operation: invert "); break;
+        case bit_reverse: print_msg("operation: bit reverse "); break;
+        case clear_operation: print_msg("operation: clear "); break;
+        case wait_operation: print_msg("operatino: wait "); break;
+        case unset_operation: print_msg("operation is not set !"); break;
     };
 }
                                      
 static void print_index(uint8_t iov) {
-    status_msg("index: %2d ", iov);
+    print_msg("index: %2d ", iov);
 }
                                      
 static void print_value(uint32_t iov) {
-    status_msg("value: %08x ", iov);
+    print_msg("value: %08x ", iov);
 }
                                      
 static void print_bit_count(uint8_t sc) {
-    status_msg("shift count: %2d ", sc);
+    print_msg("shift count: %2d ", sc);
 }
                                      
 static void print_set_or_clear(operation_e op) {
-    if(op == clear_operation) {status_msg("clear ");}
-    else {status_msg("set  ");}
+    if(op == clear_operation) {print_msg("clear ");}
+    else {print_msg("set  ");}
 }
                                      
 static void print_wait(bool w) {
-    if(w) {status_msg("wait: true ");}
-    else {status_msg("wait: false ");}
+    if(w) {print_msg("wait: true ");}
+    else {print_msg("wait: false ");}
 }
                                      
 static void print_location(uint8_t sc) {
-    status_msg("location: %s(%2d) -> %2d ", instruction_label_symbol(sc), sc, instruction_label_location(sc));
+    print_msg("location: %s(%2d) -> %2d ", instruction_label_symbol(sc), sc, instruction_label_location(sc));
 }
 
 static void print_address(int addr) {   
-   status_msg("address: %2d ", addr);
+   print_msg("address: %2d ", addr);
 }
 
 static void print_jmp_pc(uint8_t addr) {   
-   status_msg("jmp pc: %2d ", addr);
+   print_msg("jmp pc: %2d ", addr);
 }
 
 void print_instruction(instruction_t* instr) {
-    status_msg("Line: %d ", instr->line);
+    print_msg("Line: %d ", instr->line);
     switch (instr->instruction_type) {
         case jmp_instruction: 
-            status_msg("instruction: JMP "); 
+            print_msg("instruction: JMP "); 
             print_jmp_condition(instr->condition);
             print_jmp_pc(instr->jmp_pc);
             break;
         case wait_instruction: 
-            status_msg("instruction: WAIT "); 
+            print_msg("instruction: WAIT "); 
             print_polarity(instr->polarity);
             print_wait_source(instr->wait_source);
             print_index(instr->index_or_value);
             break;
         case nop_instruction: 
-            status_msg("instruction: NOP "); 
+            print_msg("instruction: NOP "); 
             break; 
         case in_instruction: 
-            status_msg("instruction: IN "); 
+            print_msg("instruction: IN "); 
             print_source(instr->source);
             print_bit_count(instr->bit_count);
             break;
         case out_instruction: 
-            status_msg("instruction: OUT "); 
+            print_msg("instruction: OUT "); 
             print_destination(instr->destination);
             print_bit_count(instr->bit_count);
             break;
         case push_instruction: 
-            status_msg("instruction: PUSH "); 
+            print_msg("instruction: PUSH "); 
             print_if_full(instr->if_full);
             print_block(instr->block);
             break;
         case pull_instruction: 
-            status_msg("instruction: PULL "); 
+            print_msg("instruction: PULL "); 
             print_if_empty(instr->if_empty);
             print_block(instr->block);
             break;
         case mov_instruction: 
-            status_msg("instruction: MOV "); 
+            print_msg("instruction: MOV "); 
             print_destination(instr->destination);
             print_operation(instr->operation);
             print_source(instr->source);
             break;
         case irq_instruction: 
-            status_msg("instruction: IRQ "); 
+            print_msg("instruction: IRQ "); 
             print_set_or_clear(instr->operation);
             print_wait(instr->wait);
             break;
         case set_instruction: 
-            status_msg("instruction: SET "); 
+            print_msg("instruction: SET "); 
             print_destination(instr->destination);
             print_value(instr->index_or_value);
             break;
-        case empty_instruction: status_msg("instruction: no instruction! "); break;
+        case empty_instruction: print_msg("instruction: no instruction! "); break;
     };
     print_side_set_value(instr->side_set_value);
     print_delay(instr->delay);
     print_address(instr->address);
-    status_msg("\n");
+    print_msg("\n");
 }
 
 void set_print_lines(char * filename){
@@ -617,13 +651,18 @@ void set_print_lines(char * filename){
     printf("unable to open file %s", filename);
     exit(-2);
   }
+  if (!LINES) LINES = malloc(sizeof(print_lines_t));
+  if (!LINES) {
+    printf("not enough memory for the lines of %s\n", filename);
+    exit(-2);
+  }
  for (num_chars=0, ch=fgetc(fp); (num_chars < TEXT_BUFFER_SIZE) && !saw_eof; num_chars++, ch=fgetc(fp)) {
-    print_line_buffer[num_chars] = ch;
+    LINES->buffer[num_chars] = ch;
     // account for Windows and Linux style EOLs - either CRLF or just LF
     if (saw_lf) {
-      if (saw_cr && saw_lf) print_line_ends[num_lines] = num_chars - 2;
-      else print_line_ends[num_lines] = num_chars - 1;
-      print_line_starts[num_lines] = line_start;
+      if (saw_cr && saw_lf) LINES->ends[num_lines] = num_chars - 2;
+      else LINES->ends[num_lines] = num_chars - 1;
+      LINES->starts[num_lines] = line_start;
       if (++num_lines >= MAX_NUMBER_OF_LINES) {
         printf("ERROR: file size exceeds max number of lines!!!\n");
         break;
@@ -638,9 +677,9 @@ void set_print_lines(char * filename){
   }
   if (num_chars == TEXT_BUFFER_SIZE) printf("ERROR: file size exceeds buffer size!!!\n");
   /* handle last line that is unhandled when loop ends */
-  if (saw_lf && saw_cr) print_line_ends[num_lines] = num_chars - 2;
-  else print_line_ends[num_lines] = num_chars - 1;
-  print_line_starts[num_lines++] = line_start;
+  if (saw_lf && saw_cr) LINES->ends[num_lines] = num_chars - 2;
+  else LINES->ends[num_lines] = num_chars - 1;
+  LINES->starts[num_lines++] = line_start;
   for (int i=0; i<num_lines; i++) print_line(i);
 }
 
@@ -650,10 +689,14 @@ void print_line(int line_num) {
   int i;
   int len;
   printf("%2d ", line_num); 
+  if (!LINES) {
+    printf("\n");
+    return;
+  }
   line_num--;
-  len = print_line_ends[line_num] - print_line_starts[line_num];
-  for (i=print_line_starts[line_num]; i < (print_line_starts[line_num] + len); i++) {
-    putc(print_line_buffer[i],stdout);
+  len = LINES->ends[line_num] - LINES->starts[line_num];
+  for (i=LINES->starts[line_num]; i < (LINES->starts[line_num] + len); i++) {
+    putc(LINES->buffer[i],stdout);
   }
   printf("\n");
 }
\ No newline at end of file
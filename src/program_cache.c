@@ -0,0 +1,159 @@
+/*!
+ * @file /program_cache.c
+ * @brief Building programs from text, with a cache of parsed program images
+ * @details
+ * See program_cache.h. A miss parses the text into a new context (see context.h), which then becomes the cached image;
+ * a hit, or the miss once parsed, is copied into the current context with context_copy_program.
+ *
+ * The parser (lex/yacc) keeps its state in globals, so building is serialized with a mutex. That also covers the cache.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "program_cache.h"
+#include "context.h"
+#include "parser.h"
+
+typedef struct {
+    uint64_t   hash;
+    size_t     length;
+    char *     text;        /* to tell apart different texts with the same hash */
+    simpio_t * image;
+    uint32_t   last_used;
+} program_image_t;
+
+static program_image_t images[PROGRAM_CACHE_SIZE];
+static uint32_t use_count;
+static uint32_t hits, misses;
+static pthread_mutex_t build_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 64 bit FNV-1a */
+uint64_t program_cache_hash(const char * text, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i=0; i<length; i++) {
+        hash ^= (uint8_t) text[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void free_image(program_image_t * image) {
+    free(image->text);
+    context_destroy(image->image);
+    memset(image, 0, sizeof(program_image_t));
+}
+
+static program_image_t * find_image(uint64_t hash, const char * text, size_t length) {
+    int i;
+    for (i=0; i<PROGRAM_CACHE_SIZE; i++) {
+        if (images[i].image && images[i].hash == hash && images[i].length == length && !memcmp(images[i].text, text, length)) return &(images[i]);
+    }
+    return NULL;
+}
+
+static program_image_t * least_recently_used_image() {
+    program_image_t * lru = &(images[0]);
+    int i;
+    for (i=0; i<PROGRAM_CACHE_SIZE; i++) {
+        if (!images[i].image) return &(images[i]);
+        if (images[i].last_used < lru->last_used) lru = &(images[i]);
+    }
+    return lru;
+}
+
+/* parses into a new context; returns 0 and the context if ok, else the error line (or -1) */
+static int parse_image(const char * text, size_t length, simpio_t ** image) {
+    simpio_t * context, * prev;
+    FILE * stream;
+    int rc;
+    context = context_create();
+    if (!context) return -1;
+    stream = fmemopen((void *) text, length, "r");
+    if (!stream) {
+        context_destroy(context);
+        return -1;
+    }
+    /* parse messages go wherever (and are as detailed as) the caller's messages */
+    context->print = simpio_context->print;
+    context->print.lines = NULL;
+    prev = context_select(context);
+    rc = simpio_parse_stream(stream);
+    context_select(prev);
+    fclose(stream);
+    if (rc != 0) {
+        context_destroy(context);
+        return rc;
+    }
+    *image = context;
+    return 0;
+}
+
+int program_cache_build(const char * text, size_t length) {
+    program_image_t * image;
+    simpio_t * parsed;
+    uint64_t hash;
+    char * text_copy;
+    int rc = 0;
+    if (!text || length == 0) return -1;
+    hash = program_cache_hash(text, length);
+    pthread_mutex_lock(&build_lock);
+    image = find_image(hash, text, length);
+    if (image) {
+        PRINTD("program unchanged since it was last built, using the cached build\n");
+        hits++;
+    }
+    else {
+        misses++;
+        rc = parse_image(text, length, &parsed);
+        if (rc == 0) {
+            text_copy = malloc(length);
+            if (text_copy) {
+                memcpy(text_copy, text, length);
+                image = least_recently_used_image();
+                free_image(image);
+                *image = (program_image_t) { .hash = hash, .length = length, .text = text_copy, .image = parsed };
+            }
+            else {
+                /* can't cache it, but the build is still good */
+                context_copy_program(simpio_context, parsed);
+                context_destroy(parsed);
+            }
+        }
+    }
+    if (image) {
+        image->last_used = ++use_count;
+        context_copy_program(simpio_context, image->image);
+    }
+    if (rc == 0) {
+        decoder_restart();
+        device_spi_flash_restart();
+        device_uart_restart();
+        device_i2c_eeprom_restart();
+        device_ws2812_restart();
+        buffer_restart();
+        if (!hardware_changed_trigger_arm()) rc = -1;
+        else replay_record_build(text, length);
+    }
+    pthread_mutex_unlock(&build_lock);
+    return rc;
+}
+
+void program_cache_stats(uint32_t * cache_hits, uint32_t * cache_misses) {
+    pthread_mutex_lock(&build_lock);
+    *cache_hits = hits;
+    *cache_misses = misses;
+    pthread_mutex_unlock(&build_lock);
+}
+
+void program_cache_clear() {
+    int i;
+    pthread_mutex_lock(&build_lock);
+    for (i=0; i<PROGRAM_CACHE_SIZE; i++) free_image(&(images[i]));
+    pthread_mutex_unlock(&build_lock);
+}
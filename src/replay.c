@@ -0,0 +1,285 @@
+/*!
+ * @file /replay.c
+ * @brief Recording and replaying the inputs of a simulation
+ * @details
+ * See replay.h. The position of an input is the step rather than the cycle: with only user processors running the cycle
+ * does not advance, so several steps (and inputs) can share a cycle, while the number of steps since the build is exactly
+ * what the UI, the interactive mode and the library all advance, one call at a time. The cycle is recorded anyway, as the
+ * cheapest check that the replay is still following the recording.
+ *
+ * A build restarts the simulation (and its step count), so it is recorded at step 0 of the build it starts, and anything
+ * run between the last input and a rebuild needs no replaying. The text built is in the recording (the UI builds from its
+ * editor, which need not have been saved), and is what the replay builds; the program file given is only compared with it.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include "replay.h"
+#include "program_cache.h"
+#include "device_keypad.h"
+#include "fifo.h"
+#include "context.h"
+
+#define RECORDER (simpio_context->replay)
+
+/*****************************************************************
+ *
+ *  RECORDING
+ *
+ *****************************************************************/
+
+void replay_recorder_free(replay_recorder_t * recorder) {
+    if (recorder->file) fclose(recorder->file);
+    memset(recorder, 0, sizeof(replay_recorder_t));
+}
+
+bool replay_record_start(const char * file_name) {
+    replay_recorder_free(&RECORDER);
+    RECORDER.file = fopen(file_name, "w");
+    if (!RECORDER.file) {
+        PRINT("unable to open %s, the inputs will not be recorded\n", file_name);
+        return false;
+    }
+    fprintf(RECORDER.file, "simpio replay %d\n", REPLAY_VERSION);
+    return true;
+}
+
+/* starts the line of an input, returns false if not recording */
+static bool record(const char * type) {
+    if (!RECORDER.file) return false;
+    fprintf(RECORDER.file, "%" PRIu64 " %u %s", exec_steps(), exec_cycle(), type);
+    RECORDER.inputs++;
+    return true;
+}
+
+/* the text follows its line, so a session can be replayed whatever has become of the file it was edited in */
+void replay_record_build(const char * text, size_t length) {
+    if (!record("build")) return;
+    fprintf(RECORDER.file, " %zu %016" PRIX64 "\n", length, program_cache_hash(text, length));
+    fwrite(text, 1, length, RECORDER.file);
+    fputc('\n', RECORDER.file);
+}
+
+void replay_record_key(char ch) {
+    if (record("key")) fprintf(RECORDER.file, " %u\n", (uint8_t) ch);
+}
+
+void replay_record_gpio(uint8_t gpio, bool value) {
+    if (record("gpio")) fprintf(RECORDER.file, " %u %d\n", gpio, value);
+}
+
+void replay_record_put(uint8_t pio, uint8_t sm, uint32_t value) {
+    if (record("put")) fprintf(RECORDER.file, " %u %u %08X\n", pio, sm, value);
+}
+
+void replay_record_get(uint8_t pio, uint8_t sm, bool got, uint32_t value) {
+    if (!record("get")) return;
+    if (got) fprintf(RECORDER.file, " %u %u %08X\n", pio, sm, value);
+    else fprintf(RECORDER.file, " %u %u -\n", pio, sm);
+}
+
+void replay_record_break(int line) {
+    if (record("break")) fprintf(RECORDER.file, " %d\n", line);
+    /* a session that crashes after this should still be reproducible up to here */
+    if (RECORDER.file) fflush(RECORDER.file);
+}
+
+void replay_record_stop() {
+    if (record("end")) fprintf(RECORDER.file, " %d\n", exec_last_line());
+    replay_recorder_free(&RECORDER);
+}
+
+/*****************************************************************
+ *
+ *  REPLAYING
+ *
+ *****************************************************************/
+
+typedef struct {
+    const char *    file_name;
+    FILE *          file;
+    int             line;               // of the recording being replayed
+    uint32_t        differences;
+    char *          text;               // of the program file given, to tell whether it is the one recorded
+    size_t          length;
+    bool            built;              // there is something to step (and the inputs have somewhere to go)
+    bool            failed;             // the recording can't be followed any further
+} replay_t;
+
+static void differs(replay_t * replay, const char * what, ...) {
+    char msg[PRINT_MSG_MAX];
+    va_list args;
+    if (replay->differences++ == 0) {
+        va_start(args, what);
+        vsnprintf(msg, PRINT_MSG_MAX, what, args);
+        va_end(args);
+        PRINT("%s line %d: %s\n", replay->file_name, replay->line, msg);
+    }
+}
+
+static char * read_program(const char * file_name, size_t * length) {
+    FILE * file = file_name ? fopen(file_name, "r") : NULL;
+    char * text;
+    long size;
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+    text = (size > 0) ? malloc(size) : NULL;
+    if (text && fread(text, 1, size, file) != (size_t) size) {
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+    *length = (size > 0) ? (size_t) size : 0;
+    return text;
+}
+
+/* the program text that follows a build line, NULL (after printing why) if it isn't all there or isn't what was built */
+static char * read_build_text(replay_t * replay, size_t length, uint64_t hash) {
+    char * text = malloc(length ? length : 1);
+    if (!text) {
+        PRINT("%s line %d: not enough memory for the program text\n", replay->file_name, replay->line);
+        return NULL;
+    }
+    if (fread(text, 1, length, replay->file) != length || fgetc(replay->file) != '\n') {
+        PRINT("%s line %d: the program text built is cut short\n", replay->file_name, replay->line);
+        free(text);
+        return NULL;
+    }
+    if (program_cache_hash(text, length) != hash) {
+        PRINT("%s line %d: the program text is not the one that was built\n", replay->file_name, replay->line);
+        free(text);
+        return NULL;
+    }
+    for (; length; length--) if (text[length - 1] == '\n') replay->line++;
+    replay->line++;
+    return text;
+}
+
+static sm_t * replay_sm(replay_t * replay, unsigned int pio, unsigned int sm) {
+    if (pio < NUM_PIOS && sm < NUM_SMS) return &(simpio_context->hardware.sms[pio * NUM_SMS + sm]);
+    differs(replay, "there is no pio %u sm %u", pio, sm);
+    return NULL;
+}
+
+/* gives the input on a line of the recording (the programs having been stepped to it); false if the line is not an input */
+static bool replay_input(replay_t * replay, const char * type, const char * values) {
+    unsigned int a, b;
+    uint32_t value, got_value;
+    uint64_t hash;
+    size_t length;
+    char word[16], * text;
+    int build_line;
+    bool got;
+    sm_t * sm;
+    if (!strcmp(type, "build") && sscanf(values, "%zu %" SCNx64, &length, &hash) == 2) {
+        build_line = replay->line;
+        text = read_build_text(replay, length, hash);
+        if (!text) {
+            replay->failed = true;
+            return true;
+        }
+        if (replay->text && (length != replay->length || memcmp(text, replay->text, length))) {
+            PRINT("note: the program text built at %s line %d is not that of the program file, replaying it\n", replay->file_name, build_line);
+            free(replay->text);
+            replay->text = NULL;        /* noted once */
+        }
+        replay->built = (program_cache_build(text, length) == 0);
+        free(text);
+    }
+    else if (!strcmp(type, "key") && sscanf(values, "%u", &a) == 1) device_set_keypress_char((char) a);
+    else if (!strcmp(type, "gpio") && sscanf(values, "%u %u", &a, &b) == 2) {
+        if (a < NUM_GPIOS) hardware_drive_gpio(a, b);      /* as simpio_gpio_set did */
+        else differs(replay, "there is no gpio %u", a);
+    }
+    else if (!strcmp(type, "put") && sscanf(values, "%u %u %" SCNx32, &a, &b, &value) == 3) {
+        if ((sm = replay_sm(replay, a, b))) fifo_write(&(sm->fifo), value);
+    }
+    else if (!strcmp(type, "get") && sscanf(values, "%u %u %15s", &a, &b, word) == 3) {
+        if (!(sm = replay_sm(replay, a, b))) return true;
+        got = fifo_read(&(sm->fifo), &got_value);
+        if (strcmp(word, "-") == 0) {
+            if (got) differs(replay, "got %08X from pio %u sm %u, which was empty when recorded", got_value, a, b);
+        }
+        else if (!got) differs(replay, "pio %u sm %u was empty, %s was got when recorded", a, b, word);
+        else if (got_value != (uint32_t) strtoul(word, NULL, 16)) differs(replay, "got %08X from pio %u sm %u, %s when recorded", got_value, a, b, word);
+    }
+    else if ((!strcmp(type, "break") || !strcmp(type, "end")) && sscanf(values, "%u", &a) == 1) {
+        if ((int) a != exec_last_line()) differs(replay, "stopped at line %d, line %u when recorded", exec_last_line(), a);
+    }
+    else return false;
+    return true;
+}
+
+int replay_run(const char * program_file_name, const char * replay_file_name) {
+    replay_t replay = { .file_name = replay_file_name };
+    char line[REPLAY_LINE_MAX], type[16];
+    uint64_t step;
+    uint32_t cycle, inputs = 0;
+    int version, values;
+    bool ended = false;
+    FILE * file = fopen(replay_file_name, "r");
+    if (!file) {
+        PRINT("unable to open %s\n", replay_file_name);
+        return -1;
+    }
+    replay.file = file;
+    replay.text = read_program(program_file_name, &replay.length);
+    if (!fgets(line, REPLAY_LINE_MAX, file) || sscanf(line, "simpio replay %d", &version) != 1 || version != REPLAY_VERSION) {
+        PRINT("%s is not a simpio replay (version %d)\n", replay_file_name, REPLAY_VERSION);
+        free(replay.text);
+        fclose(file);
+        return -1;
+    }
+    replay.line = 1;
+    while (!ended && fgets(line, REPLAY_LINE_MAX, file)) {
+        replay.line++;
+        if (line[0] == '\n' || line[0] == '#') continue;
+        if (sscanf(line, "%" SCNu64 " %" SCNu32 " %15s %n", &step, &cycle, type, &values) != 3) {
+            PRINT("%s line %d: expected a step, a cycle and an input\n", replay_file_name, replay.line);
+            replay.differences++;
+            break;
+        }
+        if (strcmp(type, "build") == 0) step = exec_steps();     /* a rebuild can come at any point */
+        else if (!replay.built) {
+            PRINT("%s line %d: expected a build first\n", replay_file_name, replay.line);
+            break;
+        }
+        if (step < exec_steps()) differs(&replay, "input at step %" PRIu64 ", already past it", step);
+        while (exec_steps() < step) exec_step_programs_next_instruction();
+        if (cycle != exec_cycle() && strcmp(type, "build")) differs(&replay, "at cycle %u, cycle %u when recorded", exec_cycle(), cycle);
+        if (!replay_input(&replay, type, line + values)) {
+            PRINT("%s line %d: %s is not an input\n", replay_file_name, replay.line, type);
+            replay.differences++;
+            break;
+        }
+        if (replay.failed) {
+            replay.differences++;
+            break;
+        }
+        if (!replay.built) {
+            PRINT("%s line %d: the program does not build\n", replay_file_name, replay.line);
+            break;
+        }
+        inputs++;
+        ended = (strcmp(type, "end") == 0);
+    }
+    if (!replay.built || replay.failed) {
+        if (replay.line == 1) { PRINT("%s has nothing to replay\n", replay_file_name); }
+        free(replay.text);
+        fclose(file);
+        return -1;
+    }
+    if (!ended) { PRINT("%s has no end (the session did not finish), replayed up to its last input\n", replay_file_name); }
+    PRINT("replayed %u inputs: %" PRIu64 " steps, %u cycles, stopped at line %d\n", inputs, exec_steps(), exec_cycle(), exec_last_line());
+    if (replay.differences) { PRINT("the replay differs from the recording (%u differences)\n", replay.differences); }
+    else { PRINT("the replay matches the recording\n"); }
+    free(replay.text);
+    fclose(file);
+    return replay.differences ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/*!
+ * @file /run_thread.c
+ * @brief Running all programs on a worker thread
+ * @details
+ * See run_thread.h. The snapshot handoff is one atomic int, fill: 0 or 1 asks the worker to copy the context into that
+ * snapshot, SNAPSHOT_FILLED + n says snapshot n has been filled. The message ring is the usual head/tail pair, each only
+ * written by one side.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "run_thread.h"
+
+#define SNAPSHOT_FILLED 2
+
+static pthread_t thread;
+static simpio_t * context;
+static print_sink_t saved_sink;
+static void * saved_sink_data;
+static exec_run_hook_t saved_hook;
+static atomic_bool done;
+static int stop_line;
+
+static simpio_t * snapshots[2];
+static int front = -1;                  /* the snapshot the caller has */
+static atomic_int fill;
+
+static char messages[RUN_THREAD_MESSAGES][PRINT_MSG_MAX];
+static atomic_uint head, tail, dropped;
+
+/***********************************************************************************************************
+ * worker side
+ **********************************************************************************************************/
+
+static void queue_message(const char * text, void * data) {
+    unsigned int h = atomic_load_explicit(&head, memory_order_relaxed);
+    if (h - atomic_load_explicit(&tail, memory_order_acquire) >= RUN_THREAD_MESSAGES) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+    snprintf(messages[h % RUN_THREAD_MESSAGES], PRINT_MSG_MAX, "%s", text);
+    atomic_store_explicit(&head, h + 1, memory_order_release);
+}
+
+/* run hook (see execution.h) */
+static void publish() {
+    int f = atomic_load_explicit(&fill, memory_order_acquire);
+    if (f < 0 || f >= SNAPSHOT_FILLED) return;
+    context_copy_running_state(snapshots[f], simpio_context);
+    atomic_store_explicit(&fill, f + SNAPSHOT_FILLED, memory_order_release);
+}
+
+static void * worker(void * arg) {
+    context_select(context);
+    stop_line = exec_run_all_programs();
+    atomic_store_explicit(&done, true, memory_order_release);
+    return NULL;
+}
+
+/***********************************************************************************************************
+ * caller side
+ **********************************************************************************************************/
+
+static void restore() {
+    print_set_sink(saved_sink, saved_sink_data);
+    exec_set_run_hook(saved_hook);
+}
+
+bool run_thread_start() {
+    int i;
+    /* everything that needs allocating is copied here, so publishing on the worker only copies plain state */
+    for (i=0; i<2; i++) {
+        if (!snapshots[i]) snapshots[i] = context_create();
+        if (!snapshots[i]) return false;
+        context_copy_state(snapshots[i], simpio_context);
+    }
+    context = simpio_context;
+    saved_sink = context->print.sink;
+    saved_sink_data = context->print.sink_data;
+    saved_hook = context->exec.run_hook;
+    print_set_sink(queue_message, NULL);
+    exec_set_run_hook(publish);
+    front = -1;
+    atomic_store(&fill, 0);
+    atomic_store(&done, false);
+    if (pthread_create(&thread, NULL, worker, NULL)) {
+        restore();
+        return false;
+    }
+    return true;
+}
+
+bool run_thread_finished(int * line) {
+    if (!atomic_load_explicit(&done, memory_order_acquire)) return false;
+    pthread_join(thread, NULL);
+    restore();
+    *line = stop_line;
+    return true;
+}
+
+void run_thread_break() {
+    atomic_store(&(context->exec.break_requested), true);
+}
+
+simpio_t * run_thread_snapshot() {
+    int f = atomic_load_explicit(&fill, memory_order_acquire);
+    if (f >= SNAPSHOT_FILLED) {
+        front = f - SNAPSHOT_FILLED;
+        atomic_store_explicit(&fill, 1 - front, memory_order_release);
+    }
+    return (front < 0) ? NULL : snapshots[front];
+}
+
+void run_thread_messages(print_sink_t sink, void * data) {
+    char text[PRINT_MSG_MAX];
+    unsigned int t = atomic_load_explicit(&tail, memory_order_relaxed);
+    unsigned int h = atomic_load_explicit(&head, memory_order_acquire);
+    unsigned int lost;
+    for (; t != h; t++) {
+        (*sink)(messages[t % RUN_THREAD_MESSAGES], data);
+        atomic_store_explicit(&tail, t + 1, memory_order_release);
+    }
+    lost = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+    if (lost) {
+        snprintf(text, PRINT_MSG_MAX, "(%u messages dropped)\n", lost);
+        (*sink)(text, data);
+    }
+}
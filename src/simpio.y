@@ -16,11 +16,18 @@
 #include "hardware.h"
 #include "instruction.h"
 #include "execution.h"
-#include "ui.h"
 #include "parser.h"
 #include "print.h"
 #include "device_spi_flash.h"
+#include "device_plugin.h"
+#include "device_uart.h"
+#include "device_i2c_eeprom.h"
+#include "device_ws2812.h"
+#include "symbols.h"
 #include "device_keypad.h"
+#include "decoder.h"
+#include "buffer.h"
+#include "hardware_changed.h"
 
 #define END_PARSE_P {yylineno--; return -1;}
 #define END_PARSE {return -1;}
@@ -28,6 +35,7 @@
 extern FILE *yyin;
 extern int yylineno;
 extern int yylex();
+extern void lexer_restart(FILE *);   /* in simpio.l */
 extern int line_count;
 int yyparse();
 
@@ -36,7 +44,6 @@ int yydebug=1;
 instruction_t ci;         /* information associated with the current instruction */
 user_instruction_t uci;   /* information associated with the current user instruction */
 pio_t cpio;               /* information associated with the current pio */
-program_t cprog;          /* information associated with the current program */
 
 int wrap_target_used;
 int wrap_used;
@@ -65,30 +72,52 @@ int yywrap()
 
 void system_init() {
     line_count = 0;
+    yylineno = 1;
     instruction_set_defaults(&ci);
     hardware_set_system_defaults();  
     exec_reset();
+    decoder_reset_all();
+    hardware_changed_trigger_reset();
+    device_plugin_reset_all();
+    device_uart_reset();
+    device_i2c_eeprom_reset();
+    device_ws2812_reset();
+    buffer_reset_all();
+    symbols_init();
 	wrap_target_used = 0;
 	wrap_used = 0;
 }
 
-int simpio_parse(char * pio_file_name)
+int simpio_parse_stream(FILE * pio_file)
 {
     int rc;
-    char ch;
-    PRINTD("parsing %s\n", pio_file_name);
     system_init();
-    yyin = fopen(pio_file_name, "r");
+    lexer_restart(pio_file);   /* drop anything the lexer still buffered from a previous parse that stopped on an error */
     rc = yyparse();
-    fclose(yyin);
     if (rc != 0) return yylineno;
     rc = instruction_fix_forward_labels();
+    instruction_fix_forward_vars();
     if (rc > 0) {PRINT("Could not resolve label on line %d\n", rc);}
     else {PRINTD("All references found and fixed\n");}
     if (rc == 0) return 0;
     else return yylineno;
 }
 
+int simpio_parse(char * pio_file_name)
+{
+    int rc;
+    FILE * pio_file;
+    PRINTD("parsing %s\n", pio_file_name);
+    pio_file = fopen(pio_file_name, "r");
+    if (!pio_file) {
+        PRINT("unable to open %s\n", pio_file_name);
+        return 1;
+    }
+    rc = simpio_parse_stream(pio_file);
+    fclose(pio_file);
+    return rc;
+}
+
 void simpio_parse_debug(char * pio_file_name)
 {
     int rc;
@@ -131,8 +160,8 @@ int simpio_test_build(int argc, char** argv)
 
 %union {
     int       ival;
-    char      sval[32];  
-    char    strval[STRING_MAX];
+    char *    sval;     /* symbols and strings are in the build's arena (see symbols.h) */
+    char *  strval;
 }
 
 %token _DEFINE _PROGRAM _ORIGEN _WRAP_TARGET _WRAP _LANG_OPT _WORD 
@@ -144,8 +173,10 @@ int simpio_test_build(int argc, char** argv)
 %token _BANG _COLON _COLON_COLON
 
 %token _CONFIG _PIO _SM _PIN_CONDITION _SET_PINS _IN_PINS _OUT_PINS _SIDE_SET_PINS _SIDE_SET_COUNT _USER_PROCESSOR  _INTERRUPT_HANDLER _INTERRUPT_SOURCE
-%token _SHIFTCTL_OUT _SHIFTCTL_IN _FIFO_MERGE _CLKDIV _DATA_CONFIG _SERIAL _USB _RS232
-%token _DEVICE _SPI_FLASH _KEYPAD _KEYPRESS
+%token _SHIFTCTL_OUT _SHIFTCTL_IN _FIFO_MERGE _CLKDIV _OPEN_DRAIN _START_PROGRAM _DATA_CONFIG _BUFFER _BUFFER_FILE _SERIAL _USB _RS232
+%token _DEVICE _SPI_FLASH _SPI_FLASH_IMAGE _SPI_FLASH_BUSY _KEYPAD _KEYPRESS _LOAD _UART_FORMAT _UART_CLOCK _UART_INPUT _UART_OUTPUT _I2C_EEPROM _I2C_EEPROM_TIMING _I2C_EEPROM_FILE _WS2812 _WS2812_CLOCK _WS2812_TIMING _WS2812_FILE
+%token _DECODER _DECODER_PRINT _DECODER_FILE _SPI _UART _I2C _PARALLEL _NONE
+%token _TRIGGER _TRIGGER_WINDOW _TRIGGER_FILE
 
 %token <ival> _BINARY_DIGIT _HEX_NUMBER _BINARY_NUMBER _DECIMAL_NUMBER _DELAY
 %token <sval> _SYMBOL 
@@ -155,7 +186,7 @@ int simpio_test_build(int argc, char** argv)
 
 %token _WRITE _READ _DATA _READLN _PRINT _REPEAT _EXIT _VAR _HIGH _LOW _CONTINUE_USER
 
-%type <ival> expression mulexp primary number 
+%type <ival> expression mulexp primary number decoder_pin trigger_address 
 
 %%
 
@@ -175,7 +206,7 @@ label: _SYMBOL _COLON { PRINTD("label: %s\n", $1); instruction_add_label($1); }
  *  directives: program, origen, side_set, opt_pindirs, wrap, lang_opt, and word
  ****************************************************************************************************************/
  
-directive: define_directive | program_directive | origen_directive | wrap_target_directive | wrap_directive | lang_opt_directive | word_directive | config_directive | data_directive | device_directive;
+directive: define_directive | program_directive | origen_directive | wrap_target_directive | wrap_directive | lang_opt_directive | word_directive | config_directive | data_directive | buffer_directive | device_directive | decoder_directive | trigger_directive;
 
 config_directive: _CONFIG config_statement
 
@@ -196,15 +227,21 @@ config_statement: _PIO number { if (hardware_set_pio($2, line_count) < 0) return
                   _FIFO_MERGE number { hardware_fifo_merge($2); } |
                   _VAR _SYMBOL { instruction_var_define($2); } |
                   _SERIAL _RS232 | _SERIAL _USB |
-                  _CLKDIV number;
+                  _CLKDIV number { hardware_set_clkdiv($2, line_count); } |
+                  _OPEN_DRAIN number number { hardware_set_open_drain($2, $3, line_count); } |
+                  _START_PROGRAM _SYMBOL { if (!hardware_start_program($2, line_count)) END_PARSE };
 
 data_directive: _DATA_CONFIG _STRING { hardware_set_data($2); }
 
+buffer_directive: _BUFFER _SYMBOL number { if (!buffer_declare($2, $3, line_count)) END_PARSE } |
+                  _BUFFER_FILE _SYMBOL _STRING { if (!buffer_declare_file($2, $3, 1, line_count)) END_PARSE } |
+                  _BUFFER_FILE _SYMBOL _STRING number { if (!buffer_declare_file($2, $3, $4, line_count)) END_PARSE }
+
 define_directive: _DEFINE _SYMBOL expression { PRINTD("%s = %d", $2, $3); instruction_add_define($2, $3, line_count); } 
 
-program_directive: _PROGRAM _SYMBOL { hardware_set_program_name($2); } 
+program_directive: _PROGRAM _SYMBOL { if (!hardware_add_program($2, line_count)) END_PARSE wrap_target_used = 0; wrap_used = 0; } 
 
-origen_directive: _ORIGEN expression /* TODO */
+origen_directive: _ORIGEN expression { if (!hardware_set_origin($2, line_count)) END_PARSE }
 
 wrap_target_directive: _WRAP_TARGET { if (test_once(&wrap_target_used)) END_PARSE hardware_set_wrap_target(line_count); }
 
@@ -214,9 +251,54 @@ lang_opt_directive: _LANG_OPT _SYMBOL  { /* todo */ }
 
 word_directive:  _WORD expression { /* todo */ }
 
-device_directive: _DEVICE _SPI_FLASH number number number number { device_enable_spi_flash($3, $4, $5, $6); } |
+device_directive: _DEVICE _SPI_FLASH number number number number { device_enable_spi_flash($3, $4, $5, $6, SPI_FLASH_NO_PIN, SPI_FLASH_NO_PIN); } |
+                  _DEVICE _SPI_FLASH number number number number number number { device_enable_spi_flash($3, $4, $5, $6, $7, $8); } |
+                  _DEVICE _SPI_FLASH_IMAGE _STRING { device_spi_flash_set_image($3); } |
+                  _DEVICE _SPI_FLASH_BUSY number number number number { device_spi_flash_set_busy_cycles($3, $4, $5, $6); } |
                   _DEVICE _KEYPAD number number number number number number number number { device_enable_keypad($3, $4, $5, $6, $7, $8, $9, $10); } |
-				  _DEVICE _KEYPRESS number { device_set_keypress($3); }
+				  _DEVICE _KEYPRESS number { device_set_keypress($3); } |
+                  _DEVICE _UART decoder_pin decoder_pin number { if (!device_enable_uart($3, $4, $5)) END_PARSE } |
+                  _DEVICE _UART_FORMAT number number number { if (!device_uart_set_format($3, $4, $5, UART_DEFAULT_OVERSAMPLING)) END_PARSE } |
+                  _DEVICE _UART_FORMAT number number number number { if (!device_uart_set_format($3, $4, $5, $6)) END_PARSE } |
+                  _DEVICE _UART_CLOCK number { if (!device_uart_set_clock($3)) END_PARSE } |
+                  _DEVICE _UART_INPUT _STRING { device_uart_set_input($3); } |
+                  _DEVICE _UART_OUTPUT _STRING { device_uart_set_output($3); } |
+                  _DEVICE _I2C_EEPROM number number { if (!device_enable_i2c_eeprom($3, $4, I2C_EEPROM_DEFAULT_ADDRESS)) END_PARSE } |
+                  _DEVICE _I2C_EEPROM number number number { if (!device_enable_i2c_eeprom($3, $4, $5)) END_PARSE } |
+                  _DEVICE _I2C_EEPROM_TIMING number number { device_i2c_eeprom_set_timing($3, $4); } |
+                  _DEVICE _I2C_EEPROM_FILE _STRING { device_i2c_eeprom_set_file($3); } |
+                  _DEVICE _WS2812 number number { if (!device_enable_ws2812($3, $4, 24)) END_PARSE } |
+                  _DEVICE _WS2812 number number number { if (!device_enable_ws2812($3, $4, $5)) END_PARSE } |
+                  _DEVICE _WS2812_CLOCK number { if (!device_ws2812_set_clock($3)) END_PARSE } |
+                  _DEVICE _WS2812_TIMING number number number number { if (!device_ws2812_set_timing($3, $4, $5, $6)) END_PARSE } |
+                  _DEVICE _WS2812_FILE _STRING { device_ws2812_set_file($3); } |
+                  _DEVICE _LOAD _STRING { if (!device_plugin_load($3, "")) END_PARSE } |
+                  _DEVICE _LOAD _STRING _STRING { if (!device_plugin_load($3, $4)) END_PARSE }
+
+decoder_directive: _DECODER _SPI decoder_pin decoder_pin decoder_pin decoder_pin { if (!decoder_add_spi($3, $4, $5, $6, 0, 8, 0)) END_PARSE } |
+                   _DECODER _SPI decoder_pin decoder_pin decoder_pin decoder_pin number number number { if (!decoder_add_spi($3, $4, $5, $6, $7, $8, $9)) END_PARSE } |
+                   _DECODER _UART number number { if (!decoder_add_uart($3, $4, 8)) END_PARSE } |
+                   _DECODER _UART number number number { if (!decoder_add_uart($3, $4, $5)) END_PARSE } |
+                   _DECODER _I2C number number { if (!decoder_add_i2c($3, $4)) END_PARSE } |
+                   _DECODER _PARALLEL number number number number { if (!decoder_add_parallel($3, $4, $5, $6)) END_PARSE } |
+                   _DECODER_PRINT { decoder_set_print(true); } |
+                   _DECODER_FILE _STRING { decoder_set_file($2); }
+
+decoder_pin: number | _NONE { $$ = DECODER_NO_PIN; }
+
+trigger_directive: _TRIGGER _PIN number _HIGH { if (!hardware_changed_trigger_edge($3, 1)) END_PARSE } |
+                   _TRIGGER _PIN number _LOW { if (!hardware_changed_trigger_edge($3, 0)) END_PARSE } |
+                   _TRIGGER _PINS number number { if (!hardware_changed_trigger_pattern($3, $4)) END_PARSE } |
+                   _TRIGGER _IRQ number { if (!hardware_changed_trigger_irq($3)) END_PARSE } |
+                   _TRIGGER _TX_LEVEL number number number { if (!hardware_changed_trigger_fifo($3, $4, 0, $5)) END_PARSE } |
+                   _TRIGGER _RX_LEVEL number number number { if (!hardware_changed_trigger_fifo($3, $4, 1, $5)) END_PARSE } |
+                   _TRIGGER _PC number number trigger_address { if (!hardware_changed_trigger_pc($3, $4, $5)) END_PARSE } |
+                   _TRIGGER_WINDOW number number { if (!hardware_changed_trigger_window($2, $3)) END_PARSE } |
+                   _TRIGGER_FILE _STRING { hardware_changed_trigger_set_file($2); }
+
+trigger_address: number | _SYMBOL { $$ = instruction_find_label($1);
+                                     if ($$ == NO_LOCATION) { PRINT("Error: the trigger label %s has to be defined before the .trigger statement\n", $1); END_PARSE }
+                                     $$ = instruction_label_location($$); }
 
 /****************************************************************************************************************
  * instructions: 
@@ -232,7 +314,8 @@ user_instruction_continue: user_instruction_delay _CONTINUE_USER { uci.continue_
 
 user_instruction_delay:  user_instruction _DELAY {uci.delay = $2; } | user_instruction {uci.delay = 0;};
 
-user_instruction: write_instruction | read_instruction | data_instruction | print_instruction | repeat_instruction | pin_instruction | exit_instruction;
+user_instruction: write_instruction | read_instruction | data_instruction | print_instruction | repeat_instruction | pin_instruction | exit_instruction |
+                  block_instruction | wait_level_instruction;
 
 jmp_instruction: _JMP jmp_condition _SYMBOL { ci.instruction_type = jmp_instruction;  snprintf(ci.label, SYMBOL_MAX, "%s", $3); ci.location = instruction_find_label(ci.label);  
                                               if (ci.location==NO_LOCATION) {PRINTI("Note: label %s not found (on first pass)", $3);} } 
@@ -302,6 +385,16 @@ repeat_instruction: _REPEAT { uci.delay = 0; uci.instruction_type = repeat_instr
 
 exit_instruction: _EXIT { uci.delay = 0; uci.instruction_type = exit_instruction; } ;
 
+block_instruction: _WRITE _BLOCK block_buffer { uci.delay = 0; uci.instruction_type = write_block_instruction; } |
+                   _READ _BLOCK block_buffer number { uci.delay = 0; uci.instruction_type = read_block_instruction; uci.value = $4; } |
+                   _PRINT _BLOCK block_buffer { uci.delay = 0; uci.instruction_type = print_block_instruction; } ;
+
+block_buffer: _SYMBOL { snprintf(uci.var_name, SYMBOL_MAX, "%s", $1); uci.buffer_index = buffer_find($1);
+                        if (uci.buffer_index == BUFFER_NONE) { PRINT("Error (line %d): buffer %s has to be declared (.buffer) before it is used\n", line_count+1, $1); END_PARSE } } ;
+
+wait_level_instruction: _WAIT _TX_LEVEL number { uci.delay = 0; uci.instruction_type = wait_level_instruction; uci.rx_fifo = false; uci.value = $3; } |
+                        _WAIT _RX_LEVEL number { uci.delay = 0; uci.instruction_type = wait_level_instruction; uci.rx_fifo = true; uci.value = $3; } ;
+
 pin_instruction: _PIN number _HIGH { uci.delay = 0; uci.instruction_type = pin_instruction; uci.pin = $2; uci.set_high = true; } |
                  _PIN number _LOW  { uci.delay = 0; uci.instruction_type = pin_instruction; uci.pin = $2; uci.set_high = false; } ;
 
@@ -0,0 +1,200 @@
+/*!
+ * @file /state_hash.c
+ * @brief Rolling hash of the simulated state, checked against a golden file
+ * @details
+ * See state_hash.h. Folding in the state is a multiply and xor-shift per word, so hashing every cycle costs about as much
+ * as stepping the state machines once more; it's only done while a golden file is being recorded or checked.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "state_hash.h"
+#include "context.h"
+
+#define STATE_HASH (simpio_context->state_hash)
+#define HW (simpio_context->hardware)
+
+/*****************************************************************
+ *
+ *  HASHING
+ *
+ *****************************************************************/
+
+static inline uint64_t fold(uint64_t hash, uint32_t word) {
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+uint32_t state_hash_words(uint32_t * words) {
+    uint32_t n = 0, values = 0, dirs = 0;
+    int i, gpio;
+    sm_t * sm;
+    for (gpio=0; gpio<NUM_GPIOS; gpio++) {
+        if (HW.gpios[gpio].value) values |= (1u << gpio);
+        if (HW.gpios[gpio].pindir) dirs |= (1u << gpio);
+    }
+    words[n++] = values;
+    words[n++] = dirs;
+    words[n++] = hardware_irq_flags();
+    for (sm = HW.sms; sm < HW.sms + NUM_PIOS * NUM_SMS; sm++) {
+        words[n++] = (uint32_t) sm->pc;
+        words[n++] = sm->scratch_x;
+        words[n++] = sm->scratch_y;
+        words[n++] = sm->osr;
+        words[n++] = sm->isr;
+        words[n++] = ((uint32_t) sm->shift_out_count << 16) | ((uint32_t) sm->shift_in_count << 8) | (uint8_t) sm->instr_state.delay_left;
+        words[n++] = ((uint32_t) fifo_level(&(sm->fifo), true) << 8) | (uint32_t) fifo_level(&(sm->fifo), false);
+        for (i=sm->fifo.rx_bottom; i<sm->fifo.rx_top; i++) words[n++] = sm->fifo.buffer[i];
+        for (i=sm->fifo.tx_bottom; i<sm->fifo.tx_top; i++) words[n++] = sm->fifo.buffer[i];
+    }
+    return n;
+}
+
+uint64_t state_hash_digest(uint64_t seed) {
+    uint32_t words[STATE_HASH_WORDS_MAX], n, i;
+    uint64_t hash = seed;
+    n = state_hash_words(words);
+    for (i=0; i<n; i++) hash = fold(hash, words[i]);
+    return hash;
+}
+
+/*****************************************************************
+ *
+ *  CHECKPOINTS
+ *
+ *****************************************************************/
+
+void state_hash_free(state_hash_t * state_hash) {
+    if (state_hash->file) fclose(state_hash->file);
+    free(state_hash->golden);
+    memset(state_hash, 0, sizeof(state_hash_t));
+}
+
+static void start(state_hash_mode_e mode, const char * file_name, uint32_t interval) {
+    STATE_HASH.mode = mode;
+    STATE_HASH.file_name = file_name;
+    STATE_HASH.interval = interval;
+    STATE_HASH.hash = state_hash_digest(0);
+}
+
+bool state_hash_record(const char * file_name) {
+    state_hash_free(&STATE_HASH);
+    STATE_HASH.file = fopen(file_name, "w");
+    if (!STATE_HASH.file) {
+        PRINT("unable to open %s, the state hashes will not be recorded\n", file_name);
+        return false;
+    }
+    fprintf(STATE_HASH.file, "simpio state hash %d %d\n", STATE_HASH_VERSION, STATE_HASH_INTERVAL);
+    start(state_hash_recording, file_name, STATE_HASH_INTERVAL);
+    return true;
+}
+
+static bool read_golden(FILE * file, const char * file_name, uint32_t * interval) {
+    char line[STATE_HASH_LINE_MAX];
+    state_hash_checkpoint_t checkpoint, * golden;
+    uint32_t allocated = 0;
+    int version, line_num = 1;
+    bool end = false;
+    if (!fgets(line, STATE_HASH_LINE_MAX, file) || sscanf(line, "simpio state hash %d %" SCNu32, &version, interval) != 2
+        || version != STATE_HASH_VERSION || *interval == 0) {
+        PRINT("%s is not a simpio state hash file (version %d)\n", file_name, STATE_HASH_VERSION);
+        return false;
+    }
+    while (!end && fgets(line, STATE_HASH_LINE_MAX, file)) {
+        line_num++;
+        end = (strncmp(line, "end ", 4) == 0);
+        if (sscanf(end ? line + 4 : line, "%" SCNu32 " %" SCNx64, &checkpoint.cycle, &checkpoint.hash) != 2) {
+            PRINT("%s line %d: expected a cycle and a hash\n", file_name, line_num);
+            return false;
+        }
+        if (STATE_HASH.num_golden == allocated) {
+            allocated = allocated ? 2 * allocated : 64;
+            golden = realloc(STATE_HASH.golden, allocated * sizeof(state_hash_checkpoint_t));
+            if (!golden) {
+                PRINT("not enough memory for the state hashes in %s\n", file_name);
+                return false;
+            }
+            STATE_HASH.golden = golden;
+        }
+        STATE_HASH.golden[STATE_HASH.num_golden++] = checkpoint;
+    }
+    if (!end) {
+        PRINT("%s has no end, it was not recorded to the end of a run\n", file_name);
+        return false;
+    }
+    return true;
+}
+
+bool state_hash_check(const char * file_name) {
+    uint32_t interval;
+    FILE * file;
+    bool ok;
+    state_hash_free(&STATE_HASH);
+    file = fopen(file_name, "r");
+    if (!file) {
+        PRINT("unable to open %s, the state hashes will not be checked\n", file_name);
+        return false;
+    }
+    ok = read_golden(file, file_name, &interval);
+    fclose(file);
+    if (!ok) {
+        state_hash_free(&STATE_HASH);
+        return false;
+    }
+    start(state_hash_checking, file_name, interval);
+    return true;
+}
+
+/* the state changed somewhere in the window of cycles since the previous checkpoint */
+static void report_divergence(uint32_t cycle) {
+    uint32_t from = (STATE_HASH.checkpoints > 1) ? STATE_HASH.golden[STATE_HASH.checkpoints - 2].cycle : 0;
+    STATE_HASH.diverged = true;
+    PRINT("state differs from %s between cycles %u and %u (found at line %d)\n", STATE_HASH.file_name, from, cycle, exec_last_line());
+}
+
+static void checkpoint(bool end) {
+    uint32_t cycle = exec_cycle();
+    state_hash_checkpoint_t * golden, * golden_end;
+    STATE_HASH.checkpoints++;
+    if (STATE_HASH.mode == state_hash_recording) {
+        fprintf(STATE_HASH.file, "%s%u %016" PRIX64 "\n", end ? "end " : "", cycle, STATE_HASH.hash);
+        return;
+    }
+    if (STATE_HASH.diverged) return;
+    golden_end = &(STATE_HASH.golden[STATE_HASH.num_golden - 1]);
+    if (STATE_HASH.checkpoints > STATE_HASH.num_golden || (!end && STATE_HASH.checkpoints == STATE_HASH.num_golden)) {
+        report_divergence(cycle);
+        PRINT("(the golden run stopped at cycle %u)\n", golden_end->cycle);
+        return;
+    }
+    golden = &(STATE_HASH.golden[STATE_HASH.checkpoints - 1]);
+    if (end && golden != golden_end) {
+        report_divergence(cycle);
+        PRINT("(stopped at cycle %u, the golden run at cycle %u)\n", cycle, golden_end->cycle);
+    }
+    else if (golden->cycle != cycle) {
+        report_divergence(cycle);
+        PRINT("(stopped at cycle %u, the golden run at cycle %u)\n", cycle, golden->cycle);
+    }
+    else if (golden->hash != STATE_HASH.hash) report_divergence(cycle);
+}
+
+void state_hash_cycle() {
+    if (STATE_HASH.mode == state_hash_off) return;
+    STATE_HASH.hash = state_hash_digest(STATE_HASH.hash);
+    if (exec_cycle() % STATE_HASH.interval == 0) checkpoint(false);
+}
+
+bool state_hash_stop() {
+    bool diverged;
+    if (STATE_HASH.mode == state_hash_off) return true;
+    checkpoint(true);
+    if (STATE_HASH.mode == state_hash_recording) { PRINT("recorded %u state hashes to %s\n", STATE_HASH.checkpoints, STATE_HASH.file_name); }
+    else if (!STATE_HASH.diverged) { PRINT("state matches %s (%u state hashes)\n", STATE_HASH.file_name, STATE_HASH.checkpoints); }
+    diverged = STATE_HASH.diverged;
+    state_hash_free(&STATE_HASH);
+    return !diverged;
+}
@@ -0,0 +1,383 @@
+/*!
+ * @file /sweep.c
+ * @brief Parameter sweep mode
+ * @details
+ * See sweep.h for the grid file format. Each variant is the program text with its parameter values substituted, loaded
+ * into its own simulation (see libsimpio.h), so variants run on worker threads without sharing any state. Workers take the
+ * next variant number from a shared counter until all variants are done, then the results are printed in variant order.
+ *
+ * Results per variant:
+ *   cycles       - sm clock cycles to pass (or until failing)
+ *   sys cycles   - the same in system clock cycles, i.e., scaled by clkdiv (the slowest sm decides)
+ *   words        - words moved through the fifos by the sms (pulled from TX plus pushed to RX)
+ *   words/kcycle - words per 1000 system clock cycles
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "sweep.h"
+#include "libsimpio.h"
+#include "constants.h"
+
+#define SWEEP_MAX_PARAMS        8
+#define SWEEP_MAX_VALUES       32
+#define SWEEP_MAX_VARIANTS   4096
+#define SWEEP_VALUE_MAX        16
+#define SWEEP_LINE_MAX        256
+#define SWEEP_DEFAULT_CYCLES 1000000
+
+/* same layout as the simulator, see hardware.h */
+#define SWEEP_NUM_PIOS 2
+#define SWEEP_NUM_SMS  4
+
+typedef struct {
+    char name[SYMBOL_MAX];
+    char values[SWEEP_MAX_VALUES][SWEEP_VALUE_MAX];
+    int  num_values;
+} sweep_param_t;
+
+typedef enum { sweep_pass, sweep_fail, sweep_build_error } sweep_status_e;
+
+typedef struct {
+    sweep_status_e status;
+    simpio_stop_e  stop;
+    int            error_line;
+    uint32_t       cycles;
+    uint64_t       sys_cycles;
+    uint64_t       words;
+    uint32_t       period;         /* cycles, 0 if not found */
+} sweep_result_t;
+
+typedef struct {
+    char *           program;
+    size_t           program_length;
+    sweep_param_t    params[SWEEP_MAX_PARAMS];
+    int              num_params;
+    int              num_variants;
+    int              stop_line;
+    uint32_t         max_cycles;
+    int              num_threads;
+    simpio_period_e  periods;
+    sweep_result_t * results;
+    int              next_variant;
+    pthread_mutex_t  lock;
+} sweep_t;
+
+/***********************************************************************************************************
+ * reading the program and the grid
+ **********************************************************************************************************/
+
+static char * read_file(char * file_name, size_t * length) {
+    FILE * file;
+    char * text;
+    long size;
+    file = fopen(file_name, "r");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+    text = malloc(size + 1);
+    if (text && fread(text, 1, size, file) == size) {
+        text[size] = '\0';
+        *length = size;
+    }
+    else {
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+    return text;
+}
+
+/* including a last line without a newline */
+static int count_lines(char * text) {
+    int lines = 0;
+    for (; *text; text++) if (*text == '\n' || !text[1]) lines++;
+    return lines;
+}
+
+static bool read_grid(sweep_t * sweep, char * grid_file_name) {
+    FILE * file;
+    char line[SWEEP_LINE_MAX];
+    char * token;
+    int line_num = 0;
+    sweep_param_t * param;
+    file = fopen(grid_file_name, "r");
+    if (!file) {
+        printf("unable to open grid file %s\n", grid_file_name);
+        return false;
+    }
+    while (fgets(line, SWEEP_LINE_MAX, file)) {
+        line_num++;
+        token = strtok(line, " \t\r\n");
+        if (!token || token[0] == '#') continue;
+        if (!strcmp(token, ".stop") || !strcmp(token, ".cycles") || !strcmp(token, ".threads") || !strcmp(token, ".periods")) {
+            char * value = strtok(NULL, " \t\r\n");
+            if (!value) { printf("grid line %d: %s needs a value\n", line_num, token); fclose(file); return false; }
+            if (!strcmp(token, ".stop")) sweep->stop_line = atoi(value);
+            if (!strcmp(token, ".cycles")) sweep->max_cycles = strtoul(value, NULL, 0);
+            if (!strcmp(token, ".threads")) sweep->num_threads = atoi(value);
+            if (!strcmp(token, ".periods")) {
+                if (!strcmp(value, "detect")) sweep->periods = SIMPIO_PERIOD_DETECT;
+                else if (!strcmp(value, "skip")) sweep->periods = SIMPIO_PERIOD_SKIP;
+                else { printf("grid line %d: .periods is detect or skip\n", line_num); fclose(file); return false; }
+            }
+            continue;
+        }
+        if (sweep->num_params == SWEEP_MAX_PARAMS) {
+            printf("grid line %d: too many parameters (max %d)\n", line_num, SWEEP_MAX_PARAMS);
+            fclose(file);
+            return false;
+        }
+        param = &(sweep->params[sweep->num_params++]);
+        snprintf(param->name, SYMBOL_MAX, "%s", token);
+        for (param->num_values = 0; (token = strtok(NULL, " \t\r\n")); param->num_values++) {
+            if (param->num_values == SWEEP_MAX_VALUES) {
+                printf("grid line %d: too many values for %s (max %d)\n", line_num, param->name, SWEEP_MAX_VALUES);
+                fclose(file);
+                return false;
+            }
+            snprintf(param->values[param->num_values], SWEEP_VALUE_MAX, "%s", token);
+        }
+        if (param->num_values == 0) {
+            printf("grid line %d: no values for %s\n", line_num, param->name);
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/***********************************************************************************************************
+ * variants
+ **********************************************************************************************************/
+
+/* the variant number is a mixed radix number, with one digit per parameter (the first parameter changes fastest) */
+static int value_index(sweep_t * sweep, int variant, int param_num) {
+    int i;
+    for (i=0; i<param_num; i++) variant /= sweep->params[i].num_values;
+    return variant % sweep->params[param_num].num_values;
+}
+
+static sweep_param_t * find_param(sweep_t * sweep, char * name, int length, int * param_num) {
+    int i;
+    for (i=0; i<sweep->num_params; i++) {
+        if (strlen(sweep->params[i].name) == length && !strncmp(sweep->params[i].name, name, length)) {
+            *param_num = i;
+            return &(sweep->params[i]);
+        }
+    }
+    return NULL;
+}
+
+/* the value of the variant for the ${NAME} at p (and where it ends), NULL if p isn't one */
+static const char * placeholder(sweep_t * sweep, int variant, char * p, char ** end) {
+    sweep_param_t * param;
+    int param_num;
+    if (p[0] != '$' || p[1] != '{' || !(*end = strchr(p, '}')) || !(param = find_param(sweep, p+2, *end-p-2, &param_num))) return NULL;
+    return param->values[value_index(sweep, variant, param_num)];
+}
+
+/* returns the program text with ${NAME} replaced by the values of the variant (caller frees); the first pass sizes it */
+static char * variant_program(sweep_t * sweep, int variant, size_t * length) {
+    char * text, * out, * p, * end;
+    const char * value;
+    size_t size = sweep->program_length, value_length;
+    for (p = sweep->program; *p; ) {
+        if ((value = placeholder(sweep, variant, p, &end))) {
+            size = size - (end + 1 - p) + strlen(value);
+            p = end + 1;
+        }
+        else p++;
+    }
+    text = malloc(size + 1);
+    if (!text) return NULL;
+    for (p = sweep->program, out = text; *p; ) {
+        if ((value = placeholder(sweep, variant, p, &end))) {
+            value_length = strlen(value);
+            memcpy(out, value, value_length);
+            out += value_length;
+            p = end + 1;
+        }
+        else *out++ = *p++;
+    }
+    *out = '\0';
+    *length = out - text;
+    return text;
+}
+
+static void run_variant(sweep_t * sweep, int variant) {
+    sweep_result_t * result = &(sweep->results[variant]);
+    simpio_t * sim;
+    char * text;
+    size_t length;
+    uint32_t clock_tick, clkdiv, pulled, pushed;
+    uint64_t sys_cycles;
+    int pio, sm;
+    result->status = sweep_build_error;
+    sim = simpio_create();
+    text = variant_program(sweep, variant, &length);
+    if (!sim || !text) {
+        result->error_line = -1;
+        free(text);
+        simpio_destroy(sim);
+        return;
+    }
+    simpio_set_period_detection(sim, sweep->periods);
+    result->error_line = simpio_load_buffer(sim, text, length);
+    free(text);
+    if (result->error_line) {
+        simpio_destroy(sim);
+        return;
+    }
+    if (sweep->stop_line > 0) simpio_toggle_breakpoint(sim, sweep->stop_line);
+    result->stop = simpio_run_until(sim, NULL, NULL, sweep->max_cycles);
+    if ( (result->stop == SIMPIO_STOP_EXITED) ||
+         ((result->stop == SIMPIO_STOP_BREAKPOINT) && (simpio_line(sim) == sweep->stop_line)) ) result->status = sweep_pass;
+    else result->status = sweep_fail;
+    result->cycles = simpio_cycle(sim);
+    result->period = simpio_period(sim);
+    result->sys_cycles = 0;
+    result->words = 0;
+    for (pio=0; pio<SWEEP_NUM_PIOS; pio++) {
+        for (sm=0; sm<SWEEP_NUM_SMS; sm++) {
+            simpio_peek(sim, pio, sm, SIMPIO_REG_CLOCK_TICK, &clock_tick);
+            simpio_peek(sim, pio, sm, SIMPIO_REG_CLKDIV, &clkdiv);
+            simpio_peek(sim, pio, sm, SIMPIO_REG_WORDS_PULLED, &pulled);
+            simpio_peek(sim, pio, sm, SIMPIO_REG_WORDS_PUSHED, &pushed);
+            sys_cycles = (uint64_t) clock_tick * clkdiv;
+            if (sys_cycles > result->sys_cycles) result->sys_cycles = sys_cycles;
+            result->words += pulled + pushed;
+        }
+    }
+    simpio_destroy(sim);
+}
+
+static void * sweep_worker(void * arg) {
+    sweep_t * sweep = (sweep_t *) arg;
+    int variant;
+    for (;;) {
+        pthread_mutex_lock(&sweep->lock);
+        variant = sweep->next_variant++;
+        pthread_mutex_unlock(&sweep->lock);
+        if (variant >= sweep->num_variants) return NULL;
+        run_variant(sweep, variant);
+    }
+}
+
+/***********************************************************************************************************
+ * results
+ **********************************************************************************************************/
+
+static char * stop_reason(simpio_stop_e stop) {
+    switch (stop) {
+        case SIMPIO_STOP_CYCLES:     return "cycle limit";
+        case SIMPIO_STOP_CONDITION:  return "stopped";
+        case SIMPIO_STOP_BREAKPOINT: return "wrong line";
+        case SIMPIO_STOP_EXITED:     return "exited";
+        case SIMPIO_STOP_IDLE:       return "nothing to run";
+        case SIMPIO_STOP_ERROR:      return "error";
+    };
+    return "?";
+}
+
+static int print_results(sweep_t * sweep) {
+    int variant, i, passed = 0;
+    sweep_result_t * result;
+    char status[SWEEP_LINE_MAX];
+    printf("%-8s", "variant");
+    for (i=0; i<sweep->num_params; i++) printf(" %-12s", sweep->params[i].name);
+    printf(" %-24s %10s %12s %10s %12s", "result", "cycles", "sys cycles", "words", "words/kcycle");
+    if (sweep->periods != SIMPIO_PERIOD_OFF) printf(" %10s", "period");
+    printf("\n");
+    for (variant=0; variant<sweep->num_variants; variant++) {
+        result = &(sweep->results[variant]);
+        printf("%-8d", variant);
+        for (i=0; i<sweep->num_params; i++) printf(" %-12s", sweep->params[i].values[value_index(sweep, variant, i)]);
+        switch (result->status) {
+            case sweep_pass:
+                passed++;
+                snprintf(status, SWEEP_LINE_MAX, "pass");
+                break;
+            case sweep_fail:
+                snprintf(status, SWEEP_LINE_MAX, "fail (%s)", stop_reason(result->stop));
+                break;
+            case sweep_build_error:
+                if (result->error_line > 0) snprintf(status, SWEEP_LINE_MAX, "error on line %d", result->error_line);
+                else snprintf(status, SWEEP_LINE_MAX, "error");
+                printf(" %s\n", status);
+                continue;
+        };
+        printf(" %-24s %10u %12llu %10llu %12.1f", status, result->cycles, (unsigned long long) result->sys_cycles, (unsigned long long) result->words,
+               result->sys_cycles ? (1000.0 * result->words) / result->sys_cycles : 0.0);
+        if (sweep->periods == SIMPIO_PERIOD_OFF) printf("\n");
+        else if (result->period) printf(" %10u\n", result->period);
+        else printf(" %10s\n", "-");
+    }
+    printf("%d of %d variants passed\n", passed, sweep->num_variants);
+    return passed;
+}
+
+/***********************************************************************************************************
+ * sweep
+ **********************************************************************************************************/
+
+int sweep_run(char * pio_file_name, char * grid_file_name) {
+    static sweep_t sweep;
+    pthread_t threads[SWEEP_MAX_VARIANTS];
+    int i, passed, num_threads;
+    char marker[SYMBOL_MAX + 3];
+    sweep.program = read_file(pio_file_name, &sweep.program_length);
+    if (!sweep.program) {
+        printf("unable to read %s\n", pio_file_name);
+        return 1;
+    }
+    sweep.stop_line = count_lines(sweep.program);
+    sweep.max_cycles = SWEEP_DEFAULT_CYCLES;
+    sweep.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (!read_grid(&sweep, grid_file_name)) {
+        free(sweep.program);
+        return 1;
+    }
+    sweep.num_variants = 1;
+    for (i=0; i<sweep.num_params; i++) {
+        snprintf(marker, sizeof(marker), "${%s}", sweep.params[i].name);
+        if (!strstr(sweep.program, marker)) printf("warning: %s is not used in %s\n", marker, pio_file_name);
+        sweep.num_variants *= sweep.params[i].num_values;
+        if (sweep.num_variants > SWEEP_MAX_VARIANTS) {
+            printf("too many variants (max %d)\n", SWEEP_MAX_VARIANTS);
+            free(sweep.program);
+            return 1;
+        }
+    }
+    sweep.results = calloc(sweep.num_variants, sizeof(sweep_result_t));
+    if (!sweep.results) {
+        free(sweep.program);
+        return 1;
+    }
+    num_threads = sweep.num_threads;
+    if (num_threads > sweep.num_variants) num_threads = sweep.num_variants;
+    if (num_threads < 1) num_threads = 1;
+    printf("running %d variants of %s on %d threads, passing at line %d or exit, within %u cycles\n\n",
+           sweep.num_variants, pio_file_name, num_threads, sweep.stop_line, sweep.max_cycles);
+    sweep.next_variant = 0;
+    pthread_mutex_init(&sweep.lock, NULL);
+    for (i=0; i<num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, sweep_worker, &sweep)) {
+            num_threads = i;
+            break;
+        }
+    }
+    if (num_threads == 0) sweep_worker(&sweep);
+    for (i=0; i<num_threads; i++) pthread_join(threads[i], NULL);
+    passed = print_results(&sweep);
+    free(sweep.results);
+    free(sweep.program);
+    return (passed == sweep.num_variants) ? 0 : 1;
+}
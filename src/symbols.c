@@ -1,16 +1,11 @@
 #include "symbols.h"
+#include "context.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-struct symbol {
-    char * name;
-    char * value;
-    int symbol_type;
-    struct symbol * next;
-};
-
-struct symbol symbols_table[SYMBOL_TABLE_SIZE];
+#define SYMBOLS (simpio_context->symbols)
+#define FULL(size) ((size) * 3 / 4)   /* more than this and the table grows, to keep probe sequences short */
 
 unsigned long djb2_hash(unsigned char *str) {
     unsigned long hash = 5381;
@@ -20,87 +15,131 @@ unsigned long djb2_hash(unsigned char *str) {
 }
 
 void symbols_init() {
-    int i;
-    for (i=0; i<SYMBOL_TABLE_SIZE; i++) symbols_table[i].name = NULL;
-}
-
-void symbol_create(struct symbol * s, char * name, char * value, int s_type) {
-    int nl = strlen(name);
-    int vl = strlen(value);
-    if (s->name = malloc(nl)) {
-        sprintf(s->name, "%s", name);
-        if (s->value = malloc(vl)) {
-            sprintf(s->value, "%s", value);
-            s->symbol_type = s_type;
-        }
-        s->next = NULL;
+    arena_reset(&SYMBOLS.arena);
+    SYMBOLS.table = NULL;
+    SYMBOLS.size = 0;
+    SYMBOLS.count = 0;
+}
+
+/* returns the slot with name (and type, unless any_type), or the empty slot where it would go (NULL if no table yet) */
+static symbol_t * symbol_slot(char * name, uint32_t hash, int s_type, bool any_type) {
+    uint32_t i, slot;
+    symbol_t * s;
+    for (i=0; i<SYMBOLS.size; i++) {
+        slot = (hash + i) & (SYMBOLS.size - 1);
+        s = &(SYMBOLS.table[slot]);
+        if (!s->name) return s;
+        if (s->hash == hash && (any_type || s->symbol_type == s_type) && !strcmp(name, s->name)) return s;
     }
+    return NULL;
 }
 
-char * symbols_new(char * name, char * value, int s_type) {
-    int h = djb2_hash(name) % SYMBOL_TABLE_SIZE;
-    struct symbol * ptr = NULL;
-    if (!(symbols_table[h].name)) {
-        symbols_table[h].next = NULL;
-        symbol_create(&(symbols_table[h]), name, value, s_type);
-        return (symbols_table[h].value);
+/* a table twice the size (the old one stays in the arena until the next symbols_init), with every symbol moved over */
+static bool grow() {
+    symbol_t * old = SYMBOLS.table, * s;
+    uint32_t old_size = SYMBOLS.size, size = old_size ? 2 * old_size : SYMBOL_TABLE_SIZE, i;
+    symbol_t * table = arena_alloc(&SYMBOLS.arena, size * sizeof(symbol_t));
+    if (!table) return false;
+    memset(table, 0, size * sizeof(symbol_t));
+    SYMBOLS.table = table;
+    SYMBOLS.size = size;
+    for (i=0; i<old_size; i++) {
+        if (!old[i].name) continue;
+        s = symbol_slot(old[i].name, old[i].hash, old[i].symbol_type, false);
+        *s = old[i];
     }
-    else {
-        for (ptr = &(symbols_table[h]); ptr->next; ptr=ptr->next);
-        ptr->next = malloc(sizeof(struct symbol));
-        if (ptr->next) {
-            symbol_create(ptr->next, name, value, s_type);
-            return (ptr->next->value);
-        }
+    return true;
+}
+
+/* the slot for a new symbol, growing the table first if it is full */
+static symbol_t * new_slot(char * name, uint32_t hash, int s_type) {
+    if (SYMBOLS.count >= FULL(SYMBOLS.size) && !grow()) return NULL;
+    return symbol_slot(name, hash, s_type, false);
+}
+
+static bool add(symbol_t * s, char * name, uint32_t hash, int s_type) {
+    s->name = symbols_text(name, strlen(name));
+    if (!s->name) return false;
+    s->hash = hash;
+    s->symbol_type = s_type;
+    SYMBOLS.count++;
+    return true;
+}
+
+char * symbols_new(char * name, char * value, int s_type) {
+    uint32_t hash = djb2_hash(name);
+    symbol_t * s = symbol_slot(name, hash, s_type, false);
+    if (!s || !s->name) {
+        s = new_slot(name, hash, s_type);
+        if (!s || !add(s, name, hash, s_type)) return NULL;
     }
-    return NULL;
+    s->value = symbols_text(value, strlen(value));
+    return s->value;
+}
+
+symbol_add_e symbols_new_index(char * name, int s_type, int index) {
+    uint32_t hash = djb2_hash(name);
+    symbol_t * s = symbol_slot(name, hash, s_type, false);
+    if (s && s->name) return symbol_exists;
+    s = new_slot(name, hash, s_type);
+    if (!s || !add(s, name, hash, s_type)) return symbol_table_full;
+    s->value = NULL;
+    s->index = index;
+    return symbol_added;
+}
+
+int symbols_find_index(char * name, int s_type) {
+    symbol_t * s = symbol_slot(name, djb2_hash(name), s_type, false);
+    if (s && s->name) return s->index;
+    else return -1;
 }
 
 char * symbols_find(char * name, int s_type) {
-    int h = djb2_hash(name) % SYMBOL_TABLE_SIZE;
-    struct symbol * ptr;
-    for (ptr = &(symbols_table[h]); ptr && ptr->name && (strcmp(name, ptr->name) || (ptr->symbol_type != s_type)); ptr = ptr->next);
-    if (ptr) return ptr->value;
+    symbol_t * s = symbol_slot(name, djb2_hash(name), s_type, false);
+    if (s && s->name) return s->value;
     else return NULL;
 }
 
 void symbols_update(char * name, char * value, int s_type) {
-    int vl = strlen(value);
-    int h = djb2_hash(name) % SYMBOL_TABLE_SIZE;
-    struct symbol * ptr;
-    for (ptr = &(symbols_table[h]); ptr && ptr->name && (strcmp(name, ptr->name) || (ptr->symbol_type != s_type)); ptr = ptr->next);
-    if (ptr) {
-        if (ptr->value) free(ptr->value);
-        ptr->value = malloc(vl);
-        sprintf(ptr->value, "%s", value);
-    }
-    else symbols_new(name, value, s_type);
+    symbols_new(name, value, s_type);   /* the old value stays in the arena until the next symbols_init */
 }
 
-
 char * symbols_find_any_type(char * name) {
-    int h = djb2_hash(name) % SYMBOL_TABLE_SIZE;
-    struct symbol * ptr;
-    for (ptr = &(symbols_table[h]); ptr && ptr->name && strcmp(name, ptr->name); ptr = ptr->next);
-    if (ptr) return ptr->value;
+    symbol_t * s = symbol_slot(name, djb2_hash(name), 0, true);
+    if (s && s->name) return s->value;
     else return NULL;
 }
 
+char * symbols_text(const char * text, size_t length) {
+    return arena_strndup(&SYMBOLS.arena, text, length);
+}
+
 void symbols_done() {
-    struct symbol * ptr;
-    struct symbol * next;
-    for (int i=0; i<SYMBOL_TABLE_SIZE; i++) {
-        if (symbols_table[i].name) {
-            free(symbols_table[i].name);
-            if (symbols_table[i].value) free(symbols_table[i].value);
-            for (ptr=symbols_table[i].next; ptr;) {
-                next = ptr->next;
-                free(ptr);
-                ptr = next;
-            }
-        }
+    arena_free(&SYMBOLS.arena);
+    SYMBOLS.table = NULL;
+    SYMBOLS.size = 0;
+    SYMBOLS.count = 0;
+}
+
+/* the table is in the arena too, so it comes along with the copy, and only its pointers need rebasing */
+void symbols_copy(symbols_t * to, symbols_t * from) {
+    uint32_t i;
+    to->table = NULL;
+    to->size = 0;
+    to->count = 0;
+    if (!arena_copy(&(to->arena), &(from->arena)) || !from->table) return;
+    to->table = (symbol_t *) symbols_rebase(to, from, (char *) from->table);
+    to->size = from->size;
+    to->count = from->count;
+    for (i=0; i<to->size; i++) {
+        to->table[i].name = symbols_rebase(to, from, from->table[i].name);
+        to->table[i].value = symbols_rebase(to, from, from->table[i].value);
     }
-    
+}
+
+char * symbols_rebase(symbols_t * to, symbols_t * from, char * ptr) {
+    if (!ptr) return NULL;
+    return arena_rebase(&(to->arena), &(from->arena), ptr);
 }
                    
 //#define SYMBOL_TEST
@@ -10,6 +10,9 @@
   
 #include "ui.h"
 #include "editor.h"
+#include <time.h>
+#include <string.h>
+#include <stdint.h>
 
 static FILE* pio_pgm;
 static editor_t editor;
@@ -30,10 +33,52 @@ typedef enum { debug_mode, timeline_parameter_mode, timeline_window_mode } mode_
 
 static mode_e current_mode = debug_mode;
 
-void ui_enter_run_break_mode() { nodelay(editor.window, TRUE); }
-void ui_exit_run_break_mode()  { nodelay(editor.window, FALSE); }
+void ui_status_sink(const char * text, void * data) { status_msg("%s", text); }
+
+/**********************************************************************************
+ * running: windows are repainted together at a capped frame rate
+ **********************************************************************************/
+
+#define FRAME_NSECS (1000000000L / UI_FRAME_HZ)
+
+static bool running = false;
+static ui_frame_t run_frame;
+static struct timespec last_frame;
+
+void ui_refresh(WINDOW * win) { if (!running) wrefresh(win); }
+
+static void ui_paint_frame() {
+    int line = (*run_frame)();
+    if (line > 0) ed_goto_line(&editor, line);
+    wnoutrefresh(regs_win);
+    wnoutrefresh(status_win);
+    ed_display_noutrefresh(&editor);  /* last, so the cursor ends up in the source window */
+    doupdate();
+}
+
+void ui_enter_run_break_mode(ui_frame_t frame) {
+    wtimeout(editor.window, 1000 / UI_FRAME_HZ);
+    run_frame = frame;
+    running = true;
+    clock_gettime(CLOCK_MONOTONIC, &last_frame);
+}
+
+void ui_exit_run_break_mode() {
+    running = false;
+    wtimeout(editor.window, -1);
+    wrefresh(status_win);
+}
+
 bool ui_break_check() {
-    char ch = wgetch(editor.window);
+    struct timespec now;
+    int ch;
+    if (!running) return false;
+    ch = wgetch(editor.window);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec - last_frame.tv_sec) * 1000000000L + (now.tv_nsec - last_frame.tv_nsec) >= FRAME_NSECS) {
+        last_frame = now;
+        ui_paint_frame();
+    }
     if (ch == 'b' || ch == 'B') return true;
     else return false;
 }
@@ -110,10 +155,10 @@ void ui_run(ui_user_functions_t * user_functions) {
     
   //TODO: revisit this always save when first loaded behavior when no longer just saving to a temp file
   int rc;
-  rc = (*user_functions->save_function)(editor.buffer);
+  rc = (*user_functions->save_function)(ed_text(&editor));
   if (rc < 0) {status_msg("auto-save successful; ready to build\n");}
   else {
-    status_msg("auto-save failed; build won't be on this program! (%d)\n", rc);
+    status_msg("auto-save failed (%d)\n", rc);
   }
    
   wrefresh(src_win);
@@ -177,7 +222,7 @@ void ui_process_char(editor_t *ed, int ch) {
       status_msg("F1\n");
       break;
     case KEY_F(2):
-      rc = (*(ui_user_functions->save_function))(ed->buffer);
+      rc = (*(ui_user_functions->save_function))(ed_text(ed));
       if (rc < 0) {status_msg("save successful\n");}
       else {
         status_msg("save failed (%d)\n", rc);
@@ -187,7 +232,7 @@ void ui_process_char(editor_t *ed, int ch) {
       status_msg("F3\n");
       break;    
     case KEY_F(4):
-      rc = (*(ui_user_functions->build_compile_function))(ed->buffer);
+      rc = (*(ui_user_functions->build_compile_function))(ed_text(ed));
       if (rc < 0) {status_msg("build successful\n");}
       else {
         status_msg("error at line %d\n", rc);
@@ -226,6 +271,7 @@ void ui_process_char(editor_t *ed, int ch) {
           ui_temp_window_open();
           (*ui_user_functions->temp_window_handler)();
           ui_temp_window_close();
+          ed_display(ed);
           break;
     default:
       switch (current_mode) {
@@ -244,13 +290,18 @@ void ui_process_char(editor_t *ed, int ch) {
 
 WINDOW *timeline_dialog, *timeline_window;
 
-static int timeline_dialog_input_positions[5][2] = { { 3, 9 }, { 5, 9 }, { 7, 9 }, { 9, 9 } , { 11, 9 }  };
+#define TIMELINE_DIALOG_FIRST_ROW 3
+#define TIMELINE_DIALOG_INPUT_COL 10
+
+static int timeline_dialog_input_position[2];
 static int timeline_dialog_field_num;
 
 static ui_timeline_dialog_data_t timeline_dialog_data;
 static int* timeline_tab() {                            
  if (++timeline_dialog_field_num >= TIMELINE_DIALOG_NUM_FIELDS) timeline_dialog_field_num = 0;
-    return timeline_dialog_input_positions[timeline_dialog_field_num];
+    timeline_dialog_input_position[0] = TIMELINE_DIALOG_FIRST_ROW + timeline_dialog_field_num;
+    timeline_dialog_input_position[1] = TIMELINE_DIALOG_INPUT_COL;
+    return timeline_dialog_input_position;
 }
 
 ui_timeline_dialog_data_t * ui_show_timeline_dialog() {
@@ -271,13 +322,10 @@ ui_timeline_dialog_data_t * ui_show_timeline_dialog() {
     noecho();
     keypad(stdscr, TRUE);
     
-    mvwprintw(timeline_dialog, 3,1,"GPIO 1: ");
-    mvwprintw(timeline_dialog, 5,1,"GPIO 2: ");
-    mvwprintw(timeline_dialog, 7,1,"GPIO 3: ");
-    mvwprintw(timeline_dialog, 9,1,"GPIO 4: ");
-    mvwprintw(timeline_dialog, 11,1,"GPIO 5: ");
+    for (i=0; i<TIMELINE_DIALOG_NUM_FIELDS; i++) mvwprintw(timeline_dialog, TIMELINE_DIALOG_FIRST_ROW + i, 1, "GPIO %d: ", i+1);
+    i=0;
     
-    wmove(timeline_dialog, 3, 9);
+    wmove(timeline_dialog, TIMELINE_DIALOG_FIRST_ROW, TIMELINE_DIALOG_INPUT_COL);
 
     wrefresh(timeline_dialog);
 
@@ -338,17 +386,14 @@ ui_timeline_dialog_data_t * ui_show_timeline_dialog() {
 
 /*
     A timeline is the series of up and down squiggles that show GPIO high/low values over time.
-    Each value in the series is represented by a glyph on the screen. Each glyph is a 2x2 matrix
-    of characters using ncurses. Generally, two side-by-side values are needed to determine if
-    a transition glyph is needed or a constant hi/low value. To help keep things straight, the
-    following mnemonic is used: 
-    - the first value is A and the second value is B in a series
-    - the first column is 1 and the second column is 2
-    - the upper row is U and the lower row is L
-    so for example, A2U is the first value, second column, upper. Each of these things have
-    and x,y coordinate and a character value.
-    Also, generally, only the middle columns (A2 and B1) are filled in. The first column of A 
-    and the second column of B are filled in by the previous and next iterations of the procedure.
+    Each column (place) of the window covers a span of cycles (zoom cycles) and is 2 characters
+    wide: the first one shows the value during the span, the second one how it goes into the next
+    span (a transition glyph if the value changes right at the boundary). A span in which the
+    value changed is drawn as a "busy" checkerboard, since at that zoom level the individual
+    changes don't fit. Each glyph is 2 rows high (upper row for high, lower row for low).
+
+    Only the spans that are on the screen are asked for (see hardware_changed.h for how that is
+    done without going through the whole history), so drawing takes the same time at any zoom.
 */
 
 #define LO2UP_CHAR ACS_LRCORNER
@@ -356,215 +401,218 @@ ui_timeline_dialog_data_t * ui_show_timeline_dialog() {
 #define HI2DOWN_CHAR ACS_URCORNER
 #define DOWN2LO_CHAR ACS_LLCORNER
 #define HIORLO_CHAR ACS_HLINE
+#define BUSY_CHAR ACS_CKBOARD
 #define BLANK_CHAR ' '
-#define TICK_MARKER_CHAR '^'
-
-typedef struct {
-    int x;
-    int y;
-    uint32_t ch;
-} timeline_glyph_t;
-
-static timeline_glyph_t A2L, A2U, B1L, B1U;
-static timeline_glyph_t A1L, A1U, B2L, B2U;
-
-static int max_timeline_x, max_timeline_y;
+#define TICK_MARKER_CHAR '|'
+#define CURSOR_MARKER_CHAR '^'
 
 #define TIMELINE_LEFT_MARGIN 10
 #define ROWS_PER_TIMELINE 3
 #define TIMELINE_HEADER 4
+#define TIMELINE_TICK_ROWS 2
 #define CHARS_PER_PLACE 2
-#define TICK_ROW 2
-
-void ui_draw_timeline_glyph(timeline_glyph_t * g) {
-    wmove(timeline_window, g->y, g->x);
-    //wprintw(timeline_window, "<%d>", g->ch);
-    waddch(timeline_window, g->ch);
-}
+#define TIMELINE_MAX_PLACES 512
+#define PLACES_PER_TICK 8
+#define TIMELINE_MAX_ZOOM (1u << 30)
 
-void ui_draw_timeline_tick(uint32_t place, uint32_t tick) {
-    int y = TIMELINE_DIALOG_NUM_FIELDS * ROWS_PER_TIMELINE + TIMELINE_HEADER + TICK_ROW;
-    int x = place * CHARS_PER_PLACE + TIMELINE_LEFT_MARGIN;;
-    int i;
-    char tick_str[4];
-    wmove(timeline_window,y-2,x);
-    waddch(timeline_window, TICK_MARKER_CHAR);
-    wmove(timeline_window,y-1,x);
-    waddch(timeline_window, '|');
-    snprintf(tick_str, 4, "%03d",tick);
-    for (i=0; i<3; i++) {
-        wmove(timeline_window,y+i,x);
-        waddch(timeline_window, tick_str[i]);
-    }
-    //wprintw(timeline_window,"%2d",place);
-}
+typedef enum { place_none, place_low, place_high, place_busy } place_e;
 
-void ui_draw_timeline_first(int gpio, bool value) {
-    A1U.y = gpio * ROWS_PER_TIMELINE + TIMELINE_HEADER;
-    A1L.y = gpio * ROWS_PER_TIMELINE + TIMELINE_HEADER + 1;
-    A1U.x = A1L.x = TIMELINE_LEFT_MARGIN;
-    if (value) {
-        A1U.ch = HIORLO_CHAR;
-        A1L.ch = BLANK_CHAR;
-    }
-    else {
-        A1U.ch = BLANK_CHAR;
-        A1L.ch = HIORLO_CHAR;
-    }
-    ui_draw_timeline_glyph(&A1U);
-    ui_draw_timeline_glyph(&A1L);
+typedef struct {
+    ui_timeline_display_data_t * data;
+    int      traces[TIMELINE_DIALOG_NUM_FIELDS];   // display indexes of the gpios to show
+    int      num_traces;
+    int      first_trace;                           // scrolled to
+    int      max_traces;                            // that fit in the window
+    int      num_places;
+    uint32_t zoom;                                  // cycles per place
+    uint32_t cursor;                                // cycle shown in the middle
+    char     msg[80];
+} timeline_view_t;
+
+static ui_timeline_span_t timeline_spans[TIMELINE_MAX_PLACES];
+static bool timeline_spans_valid[TIMELINE_MAX_PLACES];
+
+static place_e timeline_place(int place, int trace) {
+    if (place < 0 || !timeline_spans_valid[place]) return place_none;
+    if (timeline_spans[place].high[trace] && timeline_spans[place].low[trace]) return place_busy;
+    return timeline_spans[place].high[trace] ? place_high : place_low;
 }
 
-void ui_draw_timeline_last(int gpio, int last_place, bool value) {
-    B2U.y = gpio * ROWS_PER_TIMELINE + TIMELINE_HEADER;
-    B2L.y = gpio * ROWS_PER_TIMELINE + TIMELINE_HEADER + 1;
-    B2U.x = B2L.x = last_place * CHARS_PER_PLACE -1 + TIMELINE_LEFT_MARGIN;
-    if (value) {
-        B2U.ch = HIORLO_CHAR;
-        B2L.ch = BLANK_CHAR;
-    }
-    else {
-        B2U.ch = BLANK_CHAR;
-        B2L.ch = HIORLO_CHAR;
-    }
-    ui_draw_timeline_glyph(&B2U);
-    ui_draw_timeline_glyph(&B2L);
+static void ui_draw_timeline_glyph(int y, int x, chtype upper, chtype lower) {
+    mvwaddch(timeline_window, y, x, upper);
+    mvwaddch(timeline_window, y+1, x, lower);
 }
 
-void ui_draw_timeline_value_with_prev(int gpio, int place, bool value, bool prev_value) {
-    A2U.y = B1U.y = gpio * ROWS_PER_TIMELINE + TIMELINE_HEADER;
-    A2L.y = B1L.y = gpio * ROWS_PER_TIMELINE + TIMELINE_HEADER + 1;
-    A2U.x = A2L.x = place * CHARS_PER_PLACE + TIMELINE_LEFT_MARGIN - 1;
-    B1U.x = B1L.x = place * CHARS_PER_PLACE + TIMELINE_LEFT_MARGIN;
-    if (prev_value != value) {
-        if (value) {
-             // draw transition zero to one
-            A2U.ch = UP2HI_CHAR;
-            A2L.ch = LO2UP_CHAR;
-            B1U.ch = HIORLO_CHAR;
-            B1L.ch = BLANK_CHAR;
-        }
-        else {
-            // draw transiton one to zero
-            A2U.ch = HI2DOWN_CHAR;
-            A2L.ch = DOWN2LO_CHAR;
-            B1U.ch = BLANK_CHAR;
-            B1L.ch = HIORLO_CHAR;
-        }
-    }
-    else {
-        if (value) {
-            // draw high
-            A2U.ch = HIORLO_CHAR;
-            A2L.ch = BLANK_CHAR;
-            B1U.ch = HIORLO_CHAR;
-            B1L.ch = BLANK_CHAR;
+static void ui_draw_timeline_trace(int row, int trace, int num_places) {
+    int place, x;
+    place_e prev, value;
+    bool start;
+    for (place = 0; place < num_places; place++) {
+        x = TIMELINE_LEFT_MARGIN + place * CHARS_PER_PLACE;
+        value = timeline_place(place, trace);
+        prev = timeline_place(place-1, trace);
+        start = timeline_spans[place].start[trace];
+        // the boundary with the previous place
+        if (place > 0) {
+            if (value == place_none || prev == place_none) ui_draw_timeline_glyph(row, x-1, BLANK_CHAR, BLANK_CHAR);
+            else if (prev == place_busy) ui_draw_timeline_glyph(row, x-1, start ? HIORLO_CHAR : BLANK_CHAR, start ? BLANK_CHAR : HIORLO_CHAR);
+            else if ((prev == place_high) != start) {
+                if (start) ui_draw_timeline_glyph(row, x-1, UP2HI_CHAR, LO2UP_CHAR);
+                else ui_draw_timeline_glyph(row, x-1, HI2DOWN_CHAR, DOWN2LO_CHAR);
+            }
+            else ui_draw_timeline_glyph(row, x-1, start ? HIORLO_CHAR : BLANK_CHAR, start ? BLANK_CHAR : HIORLO_CHAR);
         }
-        else {
-            //draw low
-            A2U.ch = BLANK_CHAR;
-            A2L.ch = HIORLO_CHAR;
-            B1U.ch = BLANK_CHAR;
-            B1L.ch = HIORLO_CHAR;
+        // the place itself
+        switch (value) {
+            case place_none: ui_draw_timeline_glyph(row, x, BLANK_CHAR, BLANK_CHAR); break;
+            case place_low:  ui_draw_timeline_glyph(row, x, BLANK_CHAR, HIORLO_CHAR); break;
+            case place_high: ui_draw_timeline_glyph(row, x, HIORLO_CHAR, BLANK_CHAR); break;
+            case place_busy: ui_draw_timeline_glyph(row, x, BUSY_CHAR, BUSY_CHAR); break;
         }
     }
-    ui_draw_timeline_glyph(&A2U);
-    ui_draw_timeline_glyph(&A2L);
-    ui_draw_timeline_glyph(&B1U);
-    ui_draw_timeline_glyph(&B1L);
+    // the last half of the last place
+    value = timeline_place(num_places-1, trace);
+    x = TIMELINE_LEFT_MARGIN + num_places * CHARS_PER_PLACE - 1;
+    if (value == place_busy) ui_draw_timeline_glyph(row, x, BUSY_CHAR, BUSY_CHAR);
+    else if (value == place_high) ui_draw_timeline_glyph(row, x, HIORLO_CHAR, BLANK_CHAR);
+    else if (value == place_low) ui_draw_timeline_glyph(row, x, BLANK_CHAR, HIORLO_CHAR);
+}
 
+static int64_t timeline_first_cycle(timeline_view_t * view) {
+    return (int64_t) view->cursor - (int64_t) (view->num_places / 2) * view->zoom;
 }
 
-static void test_timeline(int last_place) {
-    int gpio, index, y, x, i;
-    bool value, prev_value;
-    for (gpio = 0; gpio < 5; gpio++) {
-        if (gpio % 2 == 0) value = true;
-        else value = false;
-        ui_draw_timeline_first(gpio, value);
-        prev_value = value;
-        for (index = 1; index < last_place; index++) {
-            if (gpio % 2 == 0) {
-              if (((gpio + index) % 4) == 0) value = true;  
-              else value = false;
-            }
-            else {
-              if (((gpio + index) % 4) == 0) value = false;
-              else value = true;
-            }
-            ui_draw_timeline_value_with_prev(gpio, index, value, prev_value);
-            prev_value = value;
-        }
-        ui_draw_timeline_last(gpio, last_place, value);
-    }
-    for (index = 0; index < last_place; index++) {
-        ui_draw_timeline_tick(4, index);
+static void ui_draw_timeline_ticks(timeline_view_t * view, int row) {
+    int place, x, next_free_x = 0;
+    int64_t cycle;
+    char label[16];
+    for (place = 0; place < view->num_places; place++) {
+        x = TIMELINE_LEFT_MARGIN + place * CHARS_PER_PLACE;
+        cycle = timeline_first_cycle(view) + (int64_t) place * view->zoom;
+        if (place == view->num_places / 2) mvwaddch(timeline_window, row, x, CURSOR_MARKER_CHAR);
+        else if (place % PLACES_PER_TICK == 0) mvwaddch(timeline_window, row, x, TICK_MARKER_CHAR);
+        else continue;
+        if (cycle < 0 || x < next_free_x) continue;
+        snprintf(label, sizeof(label), "%lld", (long long) cycle);
+        if (x + strlen(label) > TIMELINE_LEFT_MARGIN + view->num_places * CHARS_PER_PLACE) continue;
+        mvwaddstr(timeline_window, row+1, x, label);
+        next_free_x = x + strlen(label) + 1;
     }
 }
 
-
-static void show_timeline(ui_timeline_display_data_t * data) {
-    uint8_t gpio;
-    uint32_t place;
-    bool prev_values[TIMELINE_DIALOG_NUM_FIELDS];
-    uint32_t ticks;   
-    ui_gpio_history_t * gpio_history;
-    
-    // do the first one
-    gpio_history = data->callback();
-    if (!gpio_history) {
-        status_msg("no gpio history, no timeline to display\n");
-        return;
+static void ui_draw_timeline(timeline_view_t * view) {
+    ui_timeline_display_data_t * data = view->data;
+    int place, trace, row;
+    int64_t start;
+    werase(timeline_window);
+    mvwprintw(timeline_window, 0, 0, "TIMELINE cycles %u-%u, cursor (^) at %u, %u cycle%s per column", data->first_cycle,
+              data->last_cycle, view->cursor, view->zoom, (view->zoom == 1) ? "" : "s");
+    if (data->triggered) wprintw(timeline_window, ", trigger (t) at %u", data->trigger_cycle);
+    mvwaddstr(timeline_window, 1, 0, "q:back  left/right:pan  +/-:zoom  n/p:next/prev edge  g:go to cycle  up/down:traces  v:vcd");
+    mvwaddstr(timeline_window, 2, 0, view->msg);
+    for (place = 0; place < view->num_places; place++) {
+        start = timeline_first_cycle(view) + (int64_t) place * view->zoom;
+        timeline_spans_valid[place] = (start + view->zoom > 0) &&
+            (*data->span_callback)((start < 0) ? 0 : (uint32_t) start, (uint32_t) (start + view->zoom), &timeline_spans[place]);
     }
-    ui_draw_timeline_tick(0, gpio_history->clock_tick);
-    for (gpio = 0; gpio < TIMELINE_DIALOG_NUM_FIELDS; gpio++) {
-       if (data->to_be_displayed[gpio]) {
-           ui_draw_timeline_first(gpio, gpio_history->values[gpio]);
-           prev_values[gpio] = gpio_history->values[gpio];
-       }
+    row = TIMELINE_HEADER;
+    for (trace = view->first_trace; trace < view->num_traces && trace < view->first_trace + view->max_traces; trace++) {
+        mvwprintw(timeline_window, row, 0, "GPIO %2d", data->gpios[view->traces[trace]]);
+        ui_draw_timeline_trace(row, view->traces[trace], view->num_places);
+        row += ROWS_PER_TIMELINE;
     }
-    // do the ones with prev
-    for (place = 1; place < data->num_places; place++) {
-        gpio_history = data->callback();
-        if (!gpio_history) return;
-        ui_draw_timeline_tick(place, gpio_history->clock_tick);
-        for (gpio = 0; gpio < TIMELINE_DIALOG_NUM_FIELDS; gpio++) {
-           if (data->to_be_displayed[gpio]) {
-               ui_draw_timeline_value_with_prev(gpio, place, gpio_history->values[gpio], prev_values[gpio]);
-               prev_values[gpio] = gpio_history->values[gpio];
-           }
-        }
-    }
-    // do the last one
-    for (gpio = 0; gpio < TIMELINE_DIALOG_NUM_FIELDS; gpio++) {
-        if (data->to_be_displayed[gpio]) {
-            ui_draw_timeline_last(gpio, data->num_places, prev_values[gpio]);
+    ui_draw_timeline_ticks(view, row);
+    wrefresh(timeline_window);
+}
+
+/* reads a number on the message line, false if cancelled */
+static bool ui_timeline_read_number(timeline_view_t * view, const char * prompt, uint32_t * number) {
+    int ch;
+    uint64_t value = 0;
+    bool any = false;
+    mvwprintw(timeline_window, 2, 0, "%s", prompt);
+    wclrtoeol(timeline_window);
+    wrefresh(timeline_window);
+    for (ch = getch(); ch != '\n' && ch != KEY_ENTER; ch = getch()) {
+        if (ch == 27 || ch == 'q' || ch == 'Q') return false;
+        if ('0' <= ch && ch <= '9' && value < UINT32_MAX / 10) {
+            value = value * 10 + (ch - '0');
+            any = true;
+            waddch(timeline_window, ch);
+            wrefresh(timeline_window);
         }
     }
+    *number = (uint32_t) value;
+    return any;
+}
+
+static void ui_timeline_move(timeline_view_t * view, int64_t cycle) {
+    if (cycle < view->data->first_cycle) cycle = view->data->first_cycle;
+    if (cycle > view->data->last_cycle) cycle = view->data->last_cycle;
+    view->cursor = (uint32_t) cycle;
 }
 
 void ui_show_timeline_window(ui_timeline_display_data_t * data) {
-    int ch, i, y, x;
-    uint32_t max_places, num_places;
-    getmaxyx(stdscr, max_timeline_y, max_timeline_x);
-    int max_y = max_timeline_y;
-    int max_x = max_timeline_x;
+    static timeline_view_t view;
+    int ch, i;
+    int max_x, max_y;
+    uint32_t cycle;
+    getmaxyx(stdscr, max_y, max_x);
     timeline_window = newwin(SRC_LINES, SRC_COLS, SRC_START_Y, SRC_START_X);
-    mvwaddstr(timeline_window, 0, 0, "TIMELINE\n"); 
-    mvwaddstr(timeline_window, 2, 0, "press any key to go back to the edit window\n"); 
     noecho();
     keypad(stdscr, TRUE);
-        
-    //test_timeline(50);
-    
-    max_places = (SRC_COLS - TIMELINE_LEFT_MARGIN) / CHARS_PER_PLACE;
-    if (data->num_places > max_places) data->num_places = max_places;
-    
-    show_timeline(data);
-
-    wrefresh(timeline_window);
 
-    ch = getch();
+    view.data = data;
+    view.num_traces = 0;
+    for (i=0; i < TIMELINE_DIALOG_NUM_FIELDS; i++) if (data->to_be_displayed[i]) view.traces[view.num_traces++] = i;
+    view.first_trace = 0;
+    view.max_traces = (SRC_LINES - TIMELINE_HEADER - TIMELINE_TICK_ROWS) / ROWS_PER_TIMELINE;
+    if (view.max_traces < 1) view.max_traces = 1;
+    view.num_places = (SRC_COLS - TIMELINE_LEFT_MARGIN) / CHARS_PER_PLACE;
+    if (view.num_places > TIMELINE_MAX_PLACES) view.num_places = TIMELINE_MAX_PLACES;
+    if (view.num_places < 1) view.num_places = 1;
+    // start with the whole history on the screen
+    for (view.zoom = 1; view.zoom < TIMELINE_MAX_ZOOM && (uint64_t) view.zoom * view.num_places <= data->last_cycle - data->first_cycle; view.zoom *= 2);
+    view.cursor = data->first_cycle + (data->last_cycle - data->first_cycle) / 2;
+    view.msg[0] = 0;
+
+    for (ui_draw_timeline(&view), ch = getch(); ch != 'q' && ch != 'Q' && ch != 27; ui_draw_timeline(&view), ch = getch()) {
+        view.msg[0] = 0;
+        switch (ch) {
+            case KEY_LEFT:  ui_timeline_move(&view, (int64_t) view.cursor - (int64_t) (view.num_places / 4) * view.zoom); break;
+            case KEY_RIGHT: ui_timeline_move(&view, (int64_t) view.cursor + (int64_t) (view.num_places / 4) * view.zoom); break;
+            case KEY_HOME:  ui_timeline_move(&view, data->first_cycle); break;
+            case KEY_END:   ui_timeline_move(&view, data->last_cycle); break;
+            case '+':
+            case '=':       if (view.zoom > 1) view.zoom /= 2; break;
+            case '-':       if (view.zoom < TIMELINE_MAX_ZOOM) view.zoom *= 2; break;
+            case KEY_UP:    if (view.first_trace > 0) view.first_trace--; break;
+            case KEY_DOWN:  if (view.first_trace + view.max_traces < view.num_traces) view.first_trace++; break;
+            case 'n':
+            case 'N':
+                if ((*data->edge_callback)(view.cursor, true, &cycle)) view.cursor = cycle;
+                else snprintf(view.msg, sizeof(view.msg), "no later edge");
+                break;
+            case 'p':
+            case 'P':
+                if ((*data->edge_callback)(view.cursor, false, &cycle)) view.cursor = cycle;
+                else snprintf(view.msg, sizeof(view.msg), "no earlier edge");
+                break;
+            case 'g':
+            case 'G':
+                if (ui_timeline_read_number(&view, "go to cycle: ", &cycle)) ui_timeline_move(&view, cycle);
+                break;
+            case 't':
+            case 'T':
+                if (data->triggered) ui_timeline_move(&view, data->trigger_cycle);
+                else snprintf(view.msg, sizeof(view.msg), "not a triggered capture");
+                break;
+            case 'v':
+            case 'V':
+                (*data->export_callback)(view.msg, sizeof(view.msg));
+                break;
+        }
+    }
 
     endwin();
     return;
@@ -0,0 +1,829 @@
+/*!
+ * @file /lib_tests.c
+ * @brief Tests of the simulation core through the Simpio library
+ * @details
+ * This runs programs through the library (libsimpio.h) to check what a test program can't show by getting to its last
+ * line, e.g., inputs given from outside the simulation. Where a test needs to look inside a simulation it selects it and
+ * uses the core's own functions. Build and run it with "make test" in the build directory; it runs in the tests directory.
+ * Each test prints its result, and the exit code is 1 if any failed.
+ *
+ *  fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "libsimpio.h"
+#include "context.h"
+#include "program_cache.h"
+#include "run_thread.h"
+#include "replay.h"
+
+#define CHECK(cond) if (!(cond)) { printf("    line %d: %s\n", __LINE__, #cond); return false; }
+
+static simpio_t * load(const char * text) {
+    simpio_t * sim = simpio_create();
+    if (sim && simpio_load_buffer(sim, text, strlen(text))) {
+        simpio_destroy(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+/* a device that only counts the times it is run */
+static int device_runs;
+
+static void count_run(int instance) {
+    device_runs++;
+}
+
+/***********************************************************************************************************
+ * gpios driven from outside
+ **********************************************************************************************************/
+
+static const char * hold_program =
+    ".program hold\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    ".config open_drain 4 1\n"
+    "    SET PINDIRS 0\n"
+    "loop:\n"
+    "    JMP loop\n";
+
+static bool test_gpio_set() {
+    simpio_t * sim = load(hold_program), * prev;
+    uint32_t edge, cycle;
+    bool ok = true;
+    CHECK(sim)
+    prev = context_select(sim);
+    hardware_register_device("counter", true, count_run, 0, 1u << 3);
+    hardware_changed_gpio_history_init();
+    context_select(prev);
+    device_runs = 0;
+    simpio_step(sim, 10);
+    CHECK(device_runs == 1)                 /* once to begin with */
+    /* a plain pin is set, and the change wakes the device and is in the history */
+    cycle = simpio_cycle(sim);
+    simpio_gpio_set(sim, 3, true);
+    CHECK(simpio_gpio_get(sim, 3))
+    simpio_step(sim, 10);
+    CHECK(simpio_gpio_get(sim, 3))
+    CHECK(device_runs == 2)
+    prev = context_select(sim);
+    ok = hardware_changed_gpio_history_edge(0, 1u << 3, true, &edge);
+    context_select(prev);
+    CHECK(ok && edge == cycle)
+    /* an open-drain pin (released, so pulled up) is pulled low, and stays low as the net is resolved each step */
+    CHECK(simpio_gpio_get(sim, 4))
+    simpio_gpio_set(sim, 4, false);
+    CHECK(!simpio_gpio_get(sim, 4))
+    simpio_step(sim, 10);
+    CHECK(!simpio_gpio_get(sim, 4))
+    simpio_gpio_set(sim, 4, true);
+    simpio_step(sim, 10);
+    CHECK(simpio_gpio_get(sim, 4))
+    simpio_destroy(sim);
+    return true;
+}
+
+/***********************************************************************************************************
+ * devices woken up
+ **********************************************************************************************************/
+
+/* a device with a sensitivity mask is only run when one of its gpios changes, or when it asked to be woken up */
+static bool test_device_wake() {
+    simpio_t * sim = load(hold_program), * prev;
+    uint32_t wake;
+    int device;
+    CHECK(sim)
+    prev = context_select(sim);
+    device = hardware_register_device("counter", true, count_run, 0, 1u << 3);
+    context_select(prev);
+    CHECK(device >= 0)
+    device_runs = 0;
+    simpio_step(sim, 10);
+    CHECK(device_runs == 1)                 /* once to begin with */
+    simpio_step(sim, 10);
+    CHECK(device_runs == 1)
+    /* a gpio it isn't sensitive to */
+    simpio_gpio_set(sim, 2, true);
+    simpio_step(sim, 10);
+    CHECK(device_runs == 1)
+    /* waking up: not before it is due, once when it is, and not again */
+    wake = simpio_cycle(sim) + 20;
+    prev = context_select(sim);
+    hardware_device_wake_at(device, wake);
+    context_select(prev);
+    simpio_step(sim, 10);
+    CHECK(device_runs == 1)
+    simpio_step(sim, 20);
+    CHECK(device_runs == 2)
+    simpio_step(sim, 50);
+    CHECK(device_runs == 2)
+    /* a gpio it is sensitive to, changing and then not */
+    simpio_gpio_set(sim, 3, true);
+    simpio_step(sim, 10);
+    CHECK(device_runs == 3)
+    simpio_gpio_set(sim, 3, true);
+    simpio_step(sim, 10);
+    CHECK(device_runs == 3)
+    simpio_destroy(sim);
+    return true;
+}
+
+/* many devices that nothing wakes up are run once, and then not even looked at: no gpio changes and none is due */
+static bool test_idle_devices() {
+    simpio_t * sim = load(hold_program), * prev;
+    int i, device = -1;
+    CHECK(sim)
+    prev = context_select(sim);
+    for (i=0; i<MAX_DEVICES; i++) device = hardware_register_device("counter", true, count_run, i, 1u << (i % 4));
+    context_select(prev);
+    CHECK(device == MAX_DEVICES - 1)
+    device_runs = 0;
+    simpio_step(sim, 10);
+    CHECK(device_runs == MAX_DEVICES)
+    CHECK(sim->hardware.next_wake == DEVICE_NO_WAKE && sim->hardware.device_gpios == sim->hardware.gpio_values)
+    simpio_step(sim, 1000);
+    CHECK(device_runs == MAX_DEVICES)
+    /* one woken up is the next one due, and runs alone */
+    prev = context_select(sim);
+    hardware_device_wake_at(7, simpio_cycle(sim) + 100);
+    context_select(prev);
+    CHECK(sim->hardware.next_wake == simpio_cycle(sim) + 100)
+    simpio_step(sim, 200);
+    CHECK(device_runs == MAX_DEVICES + 1)
+    CHECK(sim->hardware.next_wake == DEVICE_NO_WAKE)
+    simpio_destroy(sim);
+    return true;
+}
+
+/***********************************************************************************************************
+ * the program cache
+ **********************************************************************************************************/
+
+static const char * blink_program =
+    ".program blink\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    ".config set_pins 5 1\n"
+    "    SET PINDIRS 1\n"
+    "loop:\n"
+    "    SET PINS 1\n"
+    "    SET PINS 0 [1]\n"
+    "    JMP loop\n";
+
+/* gpio 5 over the next 16 cycles */
+static uint32_t blink_pattern(simpio_t * sim) {
+    uint32_t pattern = 0;
+    int i;
+    for (i=0; i<16; i++) {
+        simpio_step(sim, 1);
+        if (simpio_gpio_get(sim, 5)) pattern |= (1u << i);
+    }
+    return pattern;
+}
+
+static bool cache_counts(uint32_t hits, uint32_t misses) {
+    uint32_t cache_hits, cache_misses;
+    program_cache_stats(&cache_hits, &cache_misses);
+    return cache_hits == hits && cache_misses == misses;
+}
+
+static bool test_program_cache() {
+    simpio_t * sim, * other;
+    uint32_t hits, misses, pattern;
+    char text[512];
+    int i;
+    program_cache_clear();
+    program_cache_stats(&hits, &misses);
+    sim = load(blink_program);
+    CHECK(sim)
+    CHECK(cache_counts(hits, ++misses))
+    pattern = blink_pattern(sim);
+    CHECK(pattern != 0)
+    /* resetting is a hit, and starts over */
+    CHECK(simpio_reset(sim) == 0)
+    CHECK(cache_counts(++hits, misses))
+    CHECK(simpio_cycle(sim) == 0)
+    CHECK(blink_pattern(sim) == pattern)
+    /* so is the same text loaded into another simulation */
+    other = load(blink_program);
+    CHECK(other)
+    CHECK(cache_counts(++hits, misses))
+    CHECK(blink_pattern(other) == pattern)
+    simpio_destroy(other);
+    /* as many other texts push it out of the cache... */
+    for (i=0; i<PROGRAM_CACHE_SIZE; i++) {
+        snprintf(text, sizeof(text), "%s; variant %d\n", blink_program, i);
+        other = load(text);
+        CHECK(other)
+        simpio_destroy(other);
+    }
+    CHECK(cache_counts(hits, misses += PROGRAM_CACHE_SIZE))
+    /* ...so resetting parses the simulation's own copy of its text again, and runs the same */
+    CHECK(simpio_reset(sim) == 0)
+    CHECK(cache_counts(hits, ++misses))
+    CHECK(blink_pattern(sim) == pattern)
+    CHECK(simpio_reset(sim) == 0)
+    CHECK(cache_counts(++hits, misses))
+    simpio_destroy(sim);
+    return true;
+}
+
+/***********************************************************************************************************
+ * the symbol table
+ **********************************************************************************************************/
+
+#define MANY_SYMBOLS (4 * SYMBOL_TABLE_SIZE)
+
+static bool test_symbol_table() {
+    simpio_t * sim = simpio_create(), * copy = simpio_create(), * prev;
+    char name[SYMBOL_MAX], value[SYMBOL_MAX], * found;
+    bool ok = true;
+    int i;
+    CHECK(sim && copy)
+    prev = context_select(sim);
+    symbols_init();
+    /* it grows past its starting size, and redefining or declaring again still tells which it was */
+    for (i=0; ok && i<MANY_SYMBOLS; i++) {
+        snprintf(name, SYMBOL_MAX, "name%d", i);
+        snprintf(value, SYMBOL_MAX, "%d", i);
+        ok = (symbols_new_index(name, LABEL_TYPE, i) == symbol_added) && symbols_new(name, value, DATA_TYPE);
+    }
+    ok = ok && (symbols_new_index("name7", LABEL_TYPE, 0) == symbol_exists) && symbols_new("name7", "seven", DATA_TYPE);
+    context_select(prev);
+    CHECK(ok)
+    CHECK(sim->symbols.size > SYMBOL_TABLE_SIZE && sim->symbols.count == 2 * MANY_SYMBOLS)
+    /* everything is still there, in the context and in a copy of it */
+    context_copy_program(copy, sim);
+    simpio_destroy(sim);
+    prev = context_select(copy);
+    for (i=0; ok && i<MANY_SYMBOLS; i++) {
+        snprintf(name, SYMBOL_MAX, "name%d", i);
+        snprintf(value, SYMBOL_MAX, "%d", i);
+        found = symbols_find(name, DATA_TYPE);
+        ok = (symbols_find_index(name, LABEL_TYPE) == i) && found && !strcmp(found, (i == 7) ? "seven" : value);
+    }
+    ok = ok && (symbols_find_index("name7", DEFINE_TYPE) == -1) && !symbols_find_any_type("unknown");
+    context_select(prev);
+    CHECK(ok)
+    simpio_destroy(copy);
+    return true;
+}
+
+/***********************************************************************************************************
+ * keywords of one statement
+ **********************************************************************************************************/
+
+static const char * keywords_program =
+    ".program spi\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    ".decoder spi 0 1 2 none\n"
+    ".decoder uart 3 115200\n"
+    ".device uart 4 none 115200\n"
+    "    SET X 1\n"
+    "parallel:\n"
+    "    JMP X-- parallel\n"
+    "load:\n"
+    "program:\n"
+    "none:\n"
+    "    JMP none\n";
+
+/* the words that are keywords in a statement are names everywhere else */
+static bool test_statement_keywords() {
+    simpio_t * sim = load(keywords_program), * prev;
+    int decoders;
+    CHECK(sim)
+    prev = context_select(sim);
+    decoders = decoder_count();
+    context_select(prev);
+    CHECK(decoders == 2)
+    simpio_step(sim, 10);
+    CHECK(simpio_line(sim) == 13)
+    simpio_destroy(sim);
+    return true;
+}
+
+/***********************************************************************************************************
+ * devices printing
+ **********************************************************************************************************/
+
+/* what a simulation printed, from its print events */
+static char printed[4096];
+
+static void collect_print(simpio_t * sim, const simpio_event_t * event, void * data) {
+    if (event->type == SIMPIO_EVENT_PRINT) strncat(printed, event->text, sizeof(printed) - strlen(printed) - 1);
+}
+
+/* tests/test_ws2812.simpio at twice the system clock, with the clkdiv set after the strip */
+static const char * ws2812_program =
+    ".program neopixel\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    ".config side_set_pins 0\n"
+    ".config side_set_count 1 0 0\n"
+    ".config shiftctl_out 0 0 24\n"
+    ".config user_processor 0\n"
+    ".device ws2812 0 3\n"
+    ".device ws2812_clock 16000000\n"
+    ".device ws2812_file \"-\"\n"
+    ".config clkdiv 2\n"
+    "    WRITE 0xFF000000\n"
+    "    WRITE 0x00FF0000\n"
+    "    WRITE 0x0000A500\n"
+    "    SET Y, 2            side 0\n"
+    "pixel:\n"
+    "    PULL                side 0\n"
+    "bitloop:\n"
+    "    OUT X, 1            side 0 [1]\n"
+    "    JMP !X do_zero      side 1 [1]\n"
+    "do_one:\n"
+    "    JMP bit_done        side 1 [4]\n"
+    "do_zero:\n"
+    "    NOP                 side 0 [4]\n"
+    "bit_done:\n"
+    "    JMP !OSRE bitloop   side 0\n"
+    "    JMP Y-- pixel       side 0\n"
+    "    SET X, 31           side 0\n"
+    "reset:\n"
+    "    JMP X-- reset       side 0 [15]\n"
+    "done:\n"
+    "    JMP done            side 0\n";
+
+/* the frame is printed as a message (not to stdout), and the pulses are timed with the clkdiv set after the strip */
+static bool test_ws2812_print() {
+    simpio_t * sim = load(ws2812_program);
+    CHECK(sim)
+    printed[0] = '\0';
+    simpio_set_event_callback(sim, collect_print, NULL);
+    simpio_step(sim, 2000);
+    CHECK(strstr(printed, "frame 1: FF0000 00FF00 0000A5\n"))
+    simpio_destroy(sim);
+    return true;
+}
+
+/* tests/test_uart.simpio at twice the system clock, with the clkdiv set after the uart */
+static const char * uart_program =
+    ".program uart_tx\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    ".config set_pins 0 1\n"
+    ".config out_pins 0 1\n"
+    ".config shiftctl_out 1 0 32\n"
+    ".config user_processor 0\n"
+    ".device uart 1 0 1000000\n"
+    ".device uart_clock 16000000\n"
+    ".device uart_format 8 0 1 4\n"
+    ".device uart_output \"-\"\n"
+    ".device uart_input \"-\"\n"
+    ".config clkdiv 2\n"
+    "    WRITE 0x48\n"
+    "    WRITE 0x69\n"
+    "    WRITE 0x0A\n"
+    "    SET PINS, 1\n"
+    "    SET Y, 2\n"
+    "uart_byte:\n"
+    "    PULL\n"
+    "    SET X, 7\n"
+    "    SET PINS, 0 [7]\n"
+    "uart_bit:\n"
+    "    OUT PINS, 1 [6]\n"
+    "    JMP X-- uart_bit\n"
+    "    SET PINS, 1 [7]\n"
+    "    JMP Y-- uart_byte\n"
+    "uart_done:\n"
+    "    JMP uart_done\n";
+
+/* received bytes are printed as messages (not to stdout), timed with the clkdiv set after the uart; stdin isn't read */
+static bool test_uart_print() {
+    simpio_t * sim = simpio_create();
+    CHECK(sim)
+    printed[0] = '\0';
+    simpio_set_event_callback(sim, collect_print, NULL);
+    CHECK(simpio_load_buffer(sim, uart_program, strlen(uart_program)) == 0)
+    CHECK(strstr(printed, "stdin can only be sent without the UI"))
+    printed[0] = '\0';
+    simpio_step(sim, 400);
+    CHECK(!strcmp(printed, "Hi\n"))
+    simpio_destroy(sim);
+    return true;
+}
+
+/***********************************************************************************************************
+ * spi flash images
+ **********************************************************************************************************/
+
+/* the transaction program of tests/test_spi_flash.simpio, programming a word at 0x10 and erasing the sector at 0x1000 */
+static const char * flash_program =
+    ".program spi_flash_transaction\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    ".config out_pins 19 1\n"
+    ".config shiftctl_out 0 1 32\n"
+    ".config in_pins 16\n"
+    ".config shiftctl_in 0 1 32\n"
+    ".config side_set_pins 18\n"
+    ".config side_set_count 1 1 0\n"
+    ".config set_pins 17 1\n"
+    ".device spi_flash 18 19 16 17\n"
+    ".device spi_flash_busy 10 10 40 400\n"
+    "start:\n"
+    "    SET PINS, 1 [4]\n"
+    "    PULL\n"
+    "    SET PINS, 0 [4]\n"
+    "    OUT X, 6\n"
+    "    OUT Y, 1\n"
+    "    OUT NULL, 1\n"
+    "    OUT ISR, 24\n"
+    "    PULL\n"
+    "    JMP X-- outx\n"
+    "    JMP start\n"
+    "outx:\n"
+    "    OUT PINS 1 side 1 [2]\n"
+    "    JMP X-- outx side 0 [2]\n"
+    "    JMP !Y not2read\n"
+    "    MOV Y, ISR\n"
+    "    SET X, 0\n"
+    "    MOV ISR, X\n"
+    "    JMP !Y start\n"
+    "    JMP Y-- inbits\n"
+    "not2read:\n"
+    "    MOV Y, ISR\n"
+    "    SET X, 0\n"
+    "    MOV ISR, X\n"
+    "    JMP !Y start\n"
+    "    JMP Y-- outbits\n"
+    "outbits:\n"
+    "    OUT PINS 1 side 1 [2]\n"
+    "    JMP Y-- outbits side 0 [2]\n"
+    "    JMP start\n"
+    "inbits:\n"
+    "    IN PINS 1 side 1 [2]\n"
+    "    JMP Y-- inbits side 0 [2]\n"
+    "    PUSH\n"
+    "    JMP start\n"
+    ".config user_processor 0\n"
+    ".config user_var A\n"
+    ".config user_var B\n"
+    "    WRITE 0x40000000\n"
+    "    WRITE 0x06000000\n"
+    "    WRITE 0x80000020\n"
+    "    WRITE 0x02000010\n"
+    "    WRITE 0xABCDEF12\n"
+    "    WRITE 0x40000000\n"
+    "    WRITE 0x06000000\n"
+    "    WRITE 0x80000000\n"
+    "    WRITE 0x20001000\n"
+    "    WRITE 0x82000020\n"
+    "    WRITE 0x03000010\n"
+    "    READ  A\n"
+    "    READ  B\n"
+    "    EXIT\n";
+
+/* two whole sectors and a part of one, so the image is both mapped and read */
+#define FLASH_IMAGE_SIZE (2 * SPI_SECTOR_SIZE + 100)
+
+static uint8_t flash_image_byte(uint32_t address) {
+    return (uint8_t) (address * 7 + 3);
+}
+
+/* the file is size bytes of what flash_image_byte and check_programmed say */
+static bool flash_file_is(const char * file_name, uint32_t size, bool check_programmed) {
+    static const uint8_t word[4] = { 0xAB, 0xCD, 0xEF, 0x12 };
+    FILE * file = fopen(file_name, "rb");
+    uint32_t address;
+    uint8_t expected;
+    bool ok = (file != NULL);
+    for (address = 0; ok && address < size; address++) {
+        expected = (address < FLASH_IMAGE_SIZE) ? flash_image_byte(address) : 0xFF;
+        if (check_programmed && address >= 0x10 && address < 0x14) expected &= word[address - 0x10];
+        if (check_programmed && address >= SPI_SECTOR_SIZE && address < 2 * SPI_SECTOR_SIZE) expected = 0xFF;
+        ok = (fgetc(file) == expected);
+    }
+    ok = ok && fgetc(file) == EOF;
+    if (file) fclose(file);
+    return ok;
+}
+
+/* an image is loaded, programmed and erased, saved and loaded again; the image file itself is left as it was */
+static bool test_flash_image() {
+    simpio_t * sim = load(flash_program), * other = simpio_create();
+    FILE * file = fopen("temp_flash_image", "wb");
+    uint32_t address;
+    bool ok;
+    CHECK(sim && other && file)
+    for (address = 0; address < FLASH_IMAGE_SIZE; address++) fputc(flash_image_byte(address), file);
+    CHECK(fclose(file) == 0)
+    CHECK(simpio_flash_load(sim, "temp_flash_image"))
+    CHECK(simpio_step(sim, 20000) == SIMPIO_STOP_EXITED)
+    CHECK(simpio_flash_save(sim, "temp_flash_saved"))
+    CHECK(simpio_flash_load(other, "temp_flash_saved"))
+    CHECK(simpio_flash_save(other, "temp_flash_resaved"))
+    ok = flash_file_is("temp_flash_image", FLASH_IMAGE_SIZE, false) &&
+         flash_file_is("temp_flash_saved", 3 * SPI_SECTOR_SIZE, true) &&
+         flash_file_is("temp_flash_resaved", 3 * SPI_SECTOR_SIZE, true);
+    remove("temp_flash_image");
+    remove("temp_flash_saved");
+    remove("temp_flash_resaved");
+    CHECK(ok)
+    simpio_destroy(sim);
+    simpio_destroy(other);
+    return true;
+}
+
+/***********************************************************************************************************
+ * interrupt handlers
+ **********************************************************************************************************/
+
+/* handler 0 is mapped to irq flag 0 and handler 1 to flag 2; the state machine raises flag 2 once, after a while */
+static const char * irq_program =
+    ".program raise\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    "    SET X, 31\n"
+    "pause:\n"
+    "    JMP X-- pause [3]\n"
+    "    IRQ 2\n"
+    "    IRQ CLEAR 2\n"
+    "done:\n"
+    "    JMP done\n"
+    ".config interrupt_handler 0\n"
+    ".config interrupt_source 0 0 0\n"
+    ".config user_var ZERO\n"
+    "    PRINT ZERO\n"
+    ".config interrupt_handler 1\n"
+    ".config interrupt_source 0 1 2\n"
+    ".config user_var TWO\n"
+    "    PRINT TWO\n";
+
+static void irq_flag_set(simpio_t * sim, uint8_t flag, bool set_or_clear) {
+    simpio_t * prev = context_select(sim);
+    hardware_irq_flag_set(flag, set_or_clear);
+    context_select(prev);
+}
+
+/* a handler runs when the flag mapped to it is raised, and only then */
+static bool test_irq_handlers() {
+    simpio_t * sim = load(irq_program);
+    CHECK(sim)
+    printed[0] = '\0';
+    simpio_set_event_callback(sim, collect_print, NULL);
+    simpio_step(sim, 50);
+    CHECK(printed[0] == '\0')
+    simpio_step(sim, 200);
+    CHECK(strstr(printed, "TWO") && !strstr(printed, "ZERO"))
+    /* a flag without a handler, then the flag of the other handler */
+    printed[0] = '\0';
+    irq_flag_set(sim, 3, true);
+    simpio_step(sim, 50);
+    CHECK(printed[0] == '\0')
+    irq_flag_set(sim, 0, true);
+    simpio_step(sim, 10);
+    irq_flag_set(sim, 0, false);
+    simpio_step(sim, 50);
+    CHECK(strstr(printed, "ZERO") && !strstr(printed, "TWO"))
+    simpio_destroy(sim);
+    return true;
+}
+
+/***********************************************************************************************************
+ * device plugins
+ **********************************************************************************************************/
+
+/* two instances of the example plugin (built by "make plugins"), the second counting the first one's output */
+static const char * plugin_program =
+    ".program toggle\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    ".config set_pins 5 1\n"
+    ".device load \"../build/edge_counter.so\" \"5 6 2\"\n"
+    ".device load \"../build/edge_counter.so\" \"6\"\n"
+    "    SET PINDIRS 1\n"
+    "loop:\n"
+    "    SET PINS 1\n"
+    "    SET PINS 0\n"
+    "    JMP loop\n";
+
+static unsigned int plugin_edges(simpio_t * sim, int instance) {
+    simpio_t * prev = context_select(sim);
+    char text[128];
+    unsigned int gpio, edges = 0;
+    if (device_plugin_display(instance, text, sizeof(text)) < 0 || sscanf(text, "gpio %u: %u", &gpio, &edges) != 2) edges = 0;
+    context_select(prev);
+    return edges;
+}
+
+static bool test_plugins() {
+    simpio_t * sim = load(plugin_program);
+    unsigned int first, second;
+    CHECK(sim)
+    simpio_step(sim, 300);
+    first = plugin_edges(sim, 0);
+    second = plugin_edges(sim, 1);
+    CHECK(first >= 90)
+    CHECK(second == first / 4)
+    simpio_destroy(sim);
+    return true;
+}
+
+/***********************************************************************************************************
+ * skipping periods
+ **********************************************************************************************************/
+
+/* the blink program next to a pwm at a third of the clock, which pulls the words put in its fifo and pushes two */
+static const char * pwm_program =
+    ".program blink\n"
+    ".config pio 0\n"
+    ".config sm 0\n"
+    ".config set_pins 5 1\n"
+    "    SET PINDIRS 1\n"
+    "loop:\n"
+    "    SET PINS 1\n"
+    "    SET PINS 0 [1]\n"
+    "    JMP loop\n"
+    ".program pwm\n"
+    ".config pio 0\n"
+    ".config sm 1\n"
+    ".config set_pins 6 1\n"
+    ".config clkdiv 3\n"
+    "    SET PINDIRS 1\n"
+    "    SET X 5\n"
+    "    MOV ISR, X\n"
+    "    PUSH\n"
+    "    PUSH\n"
+    "period:\n"
+    "    PULL noblock\n"
+    "    SET PINS 1\n"
+    "    SET Y 2\n"
+    "mark:\n"
+    "    JMP Y-- mark\n"
+    "    SET PINS 0\n"
+    "    SET Y 6\n"
+    "space:\n"
+    "    JMP Y-- space [1]\n"
+    "    JMP period\n";
+
+#define PWM_CYCLES 100003
+#define PWM_REG(sm, reg) (3 + (sm) * (SIMPIO_REG_WORDS_PUSHED + 1) + (reg))
+#define PWM_STATE PWM_REG(2, 0)
+
+/* the cycle, pins and every register (with the fifo word counts) of both state machines, after PWM_CYCLES */
+static bool run_pwm(simpio_period_e mode, uint32_t * state, uint64_t * skipped) {
+    simpio_t * sim = load(pwm_program);
+    int n = 0, sm, reg;
+    bool ok;
+    if (!sim) return false;
+    simpio_set_period_detection(sim, mode);
+    ok = simpio_fifo_put(sim, 0, 1, 0x11) && simpio_fifo_put(sim, 0, 1, 0x22) && simpio_fifo_put(sim, 0, 1, 0x33);
+    ok = ok && simpio_step(sim, PWM_CYCLES) == SIMPIO_STOP_CYCLES;
+    state[n++] = simpio_cycle(sim);
+    state[n++] = simpio_gpio_get(sim, 5);
+    state[n++] = simpio_gpio_get(sim, 6);
+    for (sm=0; sm<2; sm++) {
+        for (reg=SIMPIO_REG_PC; reg<=SIMPIO_REG_WORDS_PUSHED; reg++) ok = ok && simpio_peek(sim, 0, sm, reg, &state[n++]);
+    }
+    *skipped = simpio_period_skipped(sim);
+    simpio_destroy(sim);
+    return ok;
+}
+
+/* skipping whole periods ends up where running all of them does */
+static bool test_period_skip() {
+    uint32_t run[PWM_STATE], skip[PWM_STATE];
+    uint64_t run_skipped, skip_skipped;
+    CHECK(run_pwm(SIMPIO_PERIOD_OFF, run, &run_skipped))
+    CHECK(run_pwm(SIMPIO_PERIOD_SKIP, skip, &skip_skipped))
+    CHECK(run_skipped == 0 && skip_skipped > PWM_CYCLES / 2)
+    CHECK(run[0] == PWM_CYCLES)
+    CHECK(run[PWM_REG(1, SIMPIO_REG_WORDS_PULLED)] == 3 && run[PWM_REG(1, SIMPIO_REG_WORDS_PUSHED)] == 2)
+    CHECK(!memcmp(run, skip, sizeof(run)))
+    return true;
+}
+
+/***********************************************************************************************************
+ * replaying recordings
+ **********************************************************************************************************/
+
+static int replay_in_new(const char * file_name) {
+    simpio_t * sim = simpio_create(), * prev;
+    int rc;
+    if (!sim) return -1;
+    prev = context_select(sim);
+    rc = replay_run(NULL, file_name);
+    context_select(prev);
+    simpio_destroy(sim);
+    return rc;
+}
+
+/* a session built from a buffer (no file) replays from the text in the recording, which can't be changed */
+static bool test_replay_text() {
+    simpio_t * sim = load(blink_program);
+    char text[4096], * found;
+    size_t length;
+    FILE * file;
+    bool ok;
+    CHECK(sim)
+    CHECK(simpio_record(sim, "temp_replay"))
+    simpio_step(sim, 20);
+    simpio_gpio_set(sim, 3, true);
+    simpio_step(sim, 20);
+    simpio_record_stop(sim);
+    simpio_destroy(sim);
+    CHECK(replay_in_new("temp_replay") == 0)
+    /* the same recording with one character of the program changed */
+    file = fopen("temp_replay", "rb");
+    length = file ? fread(text, 1, sizeof(text) - 1, file) : 0;
+    if (file) fclose(file);
+    text[length] = '\0';
+    found = strstr(text, "SET PINS 1");
+    if (found) found[9] = '0';
+    file = fopen("temp_replay", "wb");
+    if (file) {
+        fwrite(text, 1, length, file);
+        fclose(file);
+    }
+    ok = found && replay_in_new("temp_replay") == -1;
+    remove("temp_replay");
+    CHECK(ok)
+    return true;
+}
+
+/***********************************************************************************************************
+ * running on a worker thread
+ **********************************************************************************************************/
+
+/* the newest snapshot once it is past cycle, NULL if that takes more than a few seconds */
+static simpio_t * snapshot_after(uint32_t cycle) {
+    simpio_t * snapshot;
+    int tries;
+    for (tries = 0; tries < 5000; tries++) {
+        snapshot = run_thread_snapshot();
+        if (snapshot && snapshot->exec.cycle > cycle) return snapshot;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+/* the snapshots keep up with the run, and point into themselves, not into the running context */
+static bool test_run_thread() {
+    simpio_t * sim = load(blink_program), * prev, * snapshot;
+    uint32_t cycle;
+    bool in_snapshot;
+    int line;
+    CHECK(sim)
+    prev = context_select(sim);
+    CHECK(run_thread_start())
+    snapshot = snapshot_after(0);
+    cycle = snapshot ? snapshot->exec.cycle : 0;
+    snapshot = snapshot ? snapshot_after(cycle) : NULL;
+    in_snapshot = snapshot && (char *) snapshot->hardware.sms[0].pio >= (char *) snapshot && (char *) snapshot->hardware.sms[0].pio < (char *) (snapshot + 1);
+    run_thread_break();
+    while (!run_thread_finished(&line)) usleep(1000);
+    context_select(prev);
+    CHECK(snapshot && snapshot != sim && in_snapshot)
+    CHECK(simpio_cycle(sim) >= snapshot->exec.cycle)
+    simpio_destroy(sim);
+    return true;
+}
+
+/***********************************************************************************************************
+ * running the tests
+ **********************************************************************************************************/
+
+typedef struct {
+    const char * name;
+    bool (*test)();
+} lib_test_t;
+
+static lib_test_t tests[] = {
+    { "gpio set",                   test_gpio_set },
+    { "device wake",                test_device_wake },
+    { "idle devices",               test_idle_devices },
+    { "program cache",              test_program_cache },
+    { "symbol table",               test_symbol_table },
+    { "statement keywords",         test_statement_keywords },
+    { "ws2812 print",               test_ws2812_print },
+    { "uart print",                 test_uart_print },
+    { "spi flash image",            test_flash_image },
+    { "interrupt handlers",         test_irq_handlers },
+    { "device plugins",             test_plugins },
+    { "period skip",                test_period_skip },
+    { "replay text",                test_replay_text },
+    { "run thread",                 test_run_thread },
+};
+
+int main(int argc, char ** argv) {
+    int i, failed = 0;
+    for (i=0; i<sizeof(tests)/sizeof(tests[0]); i++) {
+        printf("%s\n", tests[i].name);
+        if ((*tests[i].test)()) printf("    ok\n");
+        else {
+            printf("    FAILED\n");
+            failed++;
+        }
+    }
+    printf("%d of %d library tests failed\n", failed, (int) (sizeof(tests)/sizeof(tests[0])));
+    return failed ? 1 : 0;
+}
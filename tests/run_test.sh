@@ -5,15 +5,25 @@
 #  @details
 #  Input arguments are a space delimimited list of test files. For each file, 
 #  a breakpoint is passed which is the number of lines in the file, i.e., 
-#  the last statement in the file.
+#  the last statement in the file. A test with a golden file (the same name ending
+#  in .golden) also has its state checked against it all the way there. Exits 1 if
+#  any of the tests failed.
 #  
 #   fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
 # 
 set -x
+failed=0
 for fn in "$@"
 do
     nl=$(wc -l < ${fn})
-    rc=$(./simpio ts ${fn} ${nl})
+    if [ -f ${fn%.*}.golden ]; then opts=tsh; else opts=ts; fi
+    ./simpio ${opts} ${fn} ${nl}
+    rc=$?
+    if [ ${rc} -ne 0 ]; then
+        echo "FAILED ${fn} (rc ${rc})"
+        failed=1
+    fi
     echo "Finished ${fn}"
 done
+exit ${failed}
 
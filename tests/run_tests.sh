@@ -4,9 +4,19 @@
 #  @brief Tests all pio files in the current directory
 #  @details
 #  Gets a list of pio files in the current directory and passes it to another script
-#  to run each test through simpio.
+#  to run each test through simpio, then runs each sweep grid in the sweep directory and compares its results table
+#  with the expected one, and replays each recording in the replay directory, which has to match. Exits non-zero if
+#  any of them failed.
 #  
 #   fine-print: copyright 2023 David Hamilton. This is free software (see LICENSE.txt in root directory), provided "AS IS" without any warranty, express or implied.
 # 
 set -x
 ls -1 *.simpio | xargs ./run_test.sh 
+failed=$?
+for grid in sweep/*.grid; do
+  ./simpio w ${grid%.grid}.simpio ${grid} | diff ${grid%.grid}.expected - || { echo "FAILED ${grid}"; failed=1; }
+done
+for recording in replay/*.replay; do
+  ./simpio y ${recording%.replay}.simpio ${recording} || { echo "FAILED ${recording}"; failed=1; }
+done
+exit ${failed}